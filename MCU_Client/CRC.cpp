@@ -28,11 +28,25 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 /**< CRC configuration */
 #define CRC16_POLYNOMIAL 0x8005u
+#define CRC16_REFLECTED_POLYNOMIAL 0xA001u
 #define CRC32_POLYNOMIAL 0xEDB88320u
 
+#if CRC_FAST_TABLES == 1
+#define CRC_TABLE_BITS 8u
+#define CRC32_SLICES 4u
+#else
+#define CRC_TABLE_BITS 4u
+#define CRC32_SLICES 1u
+#endif
+
+#define CRC_TABLE_SIZE (1u << CRC_TABLE_BITS)
+#define CRC_TABLE_MASK (CRC_TABLE_SIZE - 1u)
+
 /**< SHA256 configuration */
-#define SHA256_CHUNK_SIZE 64
 #define SHA256_TOTAL_LEN_LEN 8
+#define SHA256_SCHEDULE_LEN 16u
+#define SHA256_SCHEDULE_MASK (SHA256_SCHEDULE_LEN - 1u)
+#define SHA256_ROUNDS 64u
 
 
 static const uint32_t sha256_k[] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
@@ -49,227 +63,366 @@ static const uint32_t sha256_k[] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5db
 static const uint32_t sha256_h[] =
     {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
 
-typedef struct __SHA256_State_Tag
+template <typename T, size_t SLICES>
+struct __CRC_Table_T
 {
-    const uint8_t *p;
-    size_t         len;
-    size_t         total_len;
-    bool           single_one_delivered;
-    bool           total_len_delivered;
-} __SHA256_State_T;
+    T entry[SLICES][CRC_TABLE_SIZE];
+};
 
 
+/*
+ *  Generate lookup table for CRC16 shifted MSB first
+ */
+static constexpr __CRC_Table_T<uint16_t, 1> __calcCRC16_GenTable(void);
+
+/*
+ *  Generate lookup tables for reflected CRC shifted LSB first.
+ *  Every next slice advances the CRC by another zero byte (slice-by-N).
+ */
+template <typename T, size_t SLICES>
+static constexpr __CRC_Table_T<T, SLICES> __calcCRC_GenReflectedTable(T polynomial);
+
 /*
  *  Internal CRC16 calculations
  */
-static uint16_t __calcCRC16(uint8_t data, uint16_t crc);
+static inline uint16_t __calcCRC16(uint8_t data, uint16_t crc);
 
 /*
- *  Internal SHA256 calculations
+ *  Internal CRC32 calculations
  */
-static void __calcSHA256(uint32_t hash[32], const void *input, size_t len);
+static inline uint32_t __calcCRC32(uint8_t data, uint32_t crc);
 
 /*
- *  Internal SHA256 chunk calculations
+ *  Internal SHA256 calculations, processes single chunk
  */
-static bool __calcSHA256_Chunk(uint8_t chunk[SHA256_CHUNK_SIZE], __SHA256_State_T *state);
+static void __calcSHA256(uint32_t hash[8], const uint8_t chunk[SHA256_CHUNK_SIZE]);
 
 /*
  *  Internal SHA256 right rotation
  */
 static inline uint32_t __calcSHA256_RightRotation(uint32_t value, unsigned int count);
 
+/*
+ *  Internal SHA256 message schedule, calculates word for round i >= 16 in place
+ *  of word for round i - 16
+ */
+static inline uint32_t __calcSHA256_Schedule(uint32_t w[SHA256_SCHEDULE_LEN], size_t i);
 
-uint16_t CalcCRC16(uint8_t *data, size_t len, uint16_t init_val)
+/*
+ *  Internal SHA256 round. Instead of moving all working variables, the caller
+ *  rotates their roles: new a is left in h and new e in d.
+ */
+#define __SHA256_ROUND(a, b, c, d, e, f, g, h, i, w_i)                                            \
+    do                                                                                            \
+    {                                                                                             \
+        h += __calcSHA256_RightRotation(e, 6) ^ __calcSHA256_RightRotation(e, 11) ^               \
+             __calcSHA256_RightRotation(e, 25);                                                   \
+        h += (g ^ (e & (f ^ g))) + sha256_k[i] + (w_i);                                           \
+        d += h;                                                                                   \
+        h += __calcSHA256_RightRotation(a, 2) ^ __calcSHA256_RightRotation(a, 13) ^               \
+             __calcSHA256_RightRotation(a, 22);                                                   \
+        h += (a & b) | (c & (a | b));                                                             \
+    } while (0)
+
+#define __SHA256_W(w, i) (((i) < SHA256_SCHEDULE_LEN) ? w[i] : __calcSHA256_Schedule(w, i))
+
+
+static constexpr __CRC_Table_T<uint16_t, 1> __calcCRC16_GenTable(void)
 {
-    uint16_t crc = init_val;
+    __CRC_Table_T<uint16_t, 1> table = {};
 
-    for (size_t i = 0; i < len; i++)
+    for (uint32_t i = 0; i < CRC_TABLE_SIZE; i++)
     {
-        crc = __calcCRC16(data[i], crc);
+        uint16_t crc = (uint16_t)(i << (16u - CRC_TABLE_BITS));
+        for (uint32_t j = 0; j < CRC_TABLE_BITS; j++)
+        {
+            crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ CRC16_POLYNOMIAL) : (uint16_t)(crc << 1);
+        }
+        table.entry[0][i] = crc;
     }
 
-    return crc;
+    return table;
 }
 
-uint32_t CalcCRC32(uint8_t *data, size_t len, uint32_t init_val)
+template <typename T, size_t SLICES>
+static constexpr __CRC_Table_T<T, SLICES> __calcCRC_GenReflectedTable(T polynomial)
 {
-    uint32_t crc = init_val;
-    for (uint32_t i = 0; i < len; i++)
+    __CRC_Table_T<T, SLICES> table = {};
+
+    for (uint32_t i = 0; i < CRC_TABLE_SIZE; i++)
     {
-        crc = crc ^ data[i];
-        for (uint32_t j = 8; j > 0; j--)
+        T crc = (T)i;
+        for (uint32_t j = 0; j < CRC_TABLE_BITS; j++)
         {
-            crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & ((crc & 1) ? 0xFFFFFFFF : 0));
+            crc = (crc & 1u) ? (T)((crc >> 1) ^ polynomial) : (T)(crc >> 1);
         }
+        table.entry[0][i] = crc;
     }
-    return ~crc;
+
+    for (size_t slice = 1; slice < SLICES; slice++)
+    {
+        for (uint32_t i = 0; i < CRC_TABLE_SIZE; i++)
+        {
+            T crc                 = table.entry[slice - 1][i];
+            table.entry[slice][i] = (T)((crc >> CRC_TABLE_BITS) ^ table.entry[0][crc & CRC_TABLE_MASK]);
+        }
+    }
+
+    return table;
 }
 
-void CalcSHA256(uint8_t *data, size_t len, uint8_t *sha256)
+static constexpr __CRC_Table_T<uint16_t, 1> crc16_table = __calcCRC16_GenTable();
+static constexpr __CRC_Table_T<uint32_t, CRC32_SLICES> crc32_table =
+    __calcCRC_GenReflectedTable<uint32_t, CRC32_SLICES>(CRC32_POLYNOMIAL);
+
+
+void CRC16_Init(CRC16_Context_T *p_ctx, uint16_t init_val)
 {
-    __calcSHA256((uint32_t *)sha256, data, len);
+    p_ctx->crc = init_val;
 }
 
-
-static uint16_t __calcCRC16(uint8_t data, uint16_t crc)
+void CRC16_Update(CRC16_Context_T *p_ctx, const uint8_t *data, size_t len)
 {
-    for (uint8_t i = 0; i < 8; i++)
+    uint16_t crc = p_ctx->crc;
+    for (size_t i = 0; i < len; i++)
     {
-        if (((crc & 0x8000) >> 8) ^ (data & 0x80))
-        {
-            crc = (crc << 1) ^ CRC16_POLYNOMIAL;
-        }
-        else
-        {
-            crc = (crc << 1);
-        }
-        data <<= 1;
+        crc = __calcCRC16(data[i], crc);
     }
 
-    return crc;
+    p_ctx->crc = crc;
 }
 
-static void __calcSHA256(uint32_t hash[32], const void *input, size_t len)
+void CRC16_UpdateByte(CRC16_Context_T *p_ctx, uint8_t data)
 {
-    size_t i, j;
+    p_ctx->crc = __calcCRC16(data, p_ctx->crc);
+}
 
-    memcpy(hash, sha256_h, 32);
+uint16_t CRC16_Final(CRC16_Context_T *p_ctx)
+{
+    return p_ctx->crc;
+}
 
-    uint8_t chunk[64];
+uint16_t CalcCRC16(uint8_t *data, size_t len, uint16_t init_val)
+{
+    CRC16_Context_T ctx;
 
-    __SHA256_State_T state = {
-        .p                    = (uint8_t *)input,
-        .len                  = len,
-        .total_len            = len,
-        .single_one_delivered = 0,
-        .total_len_delivered  = 0,
-    };
+    CRC16_Init(&ctx, init_val);
+    CRC16_Update(&ctx, data, len);
 
-    while (__calcSHA256_Chunk(chunk, &state))
-    {
-        uint32_t ah[8];
+    return CRC16_Final(&ctx);
+}
 
-        uint32_t       w[64];
-        const uint8_t *p = chunk;
+uint32_t CalcCRC32(uint8_t *data, size_t len, uint32_t init_val)
+{
+    uint32_t crc = init_val;
 
-        memset(w, 0x00, sizeof w);
-        for (i = 0; i < 16; i++)
-        {
-            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
-            p += 4;
-        }
+#if CRC32_SLICES == 4
+    for (; len >= CRC32_SLICES; len -= CRC32_SLICES, data += CRC32_SLICES)
+    {
+        crc ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        crc = crc32_table.entry[3][crc & 0xFFu] ^ crc32_table.entry[2][(crc >> 8) & 0xFFu] ^
+              crc32_table.entry[1][(crc >> 16) & 0xFFu] ^ crc32_table.entry[0][crc >> 24];
+    }
+#endif
 
-        for (i = 16; i < 64; i++)
-        {
-            const uint32_t s0 = __calcSHA256_RightRotation(w[i - 15], 7) ^ __calcSHA256_RightRotation(w[i - 15], 18) ^
-                                (w[i - 15] >> 3);
-            const uint32_t s1 = __calcSHA256_RightRotation(w[i - 2], 17) ^ __calcSHA256_RightRotation(w[i - 2], 19) ^
-                                (w[i - 2] >> 10);
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = __calcCRC32(data[i], crc);
+    }
+    return ~crc;
+}
 
-            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
-        }
+void SHA256_Init(SHA256_Context_T *p_ctx)
+{
+    memcpy(p_ctx->hash, sha256_h, sizeof(p_ctx->hash));
+    p_ctx->chunk_len = 0;
+    p_ctx->total_len = 0;
+}
 
-        for (i = 0; i < 8; i++)
+void SHA256_Update(SHA256_Context_T *p_ctx, const uint8_t *data, size_t len)
+{
+    p_ctx->total_len += len;
+
+    while (len > 0)
+    {
+        if ((p_ctx->chunk_len == 0) && (len >= SHA256_CHUNK_SIZE))
         {
-            ah[i] = hash[i];
+            /* Full chunks are processed in place, without copying */
+            __calcSHA256(p_ctx->hash, data);
+            data += SHA256_CHUNK_SIZE;
+            len -= SHA256_CHUNK_SIZE;
+            continue;
         }
 
-        for (i = 0; i < 64; i++)
+        size_t copy_len = SHA256_CHUNK_SIZE - p_ctx->chunk_len;
+        if (copy_len > len)
         {
-            const uint32_t s1 = __calcSHA256_RightRotation(ah[4], 6) ^ __calcSHA256_RightRotation(ah[4], 11) ^
-                                __calcSHA256_RightRotation(ah[4], 25);
-
-            const uint32_t ch    = (ah[4] & ah[5]) ^ (~ah[4] & ah[6]);
-            const uint32_t temp1 = ah[7] + s1 + ch + sha256_k[i] + w[i];
-            const uint32_t s0    = __calcSHA256_RightRotation(ah[0], 2) ^ __calcSHA256_RightRotation(ah[0], 13) ^
-                                __calcSHA256_RightRotation(ah[0], 22);
-
-            const uint32_t maj   = (ah[0] & ah[1]) ^ (ah[0] & ah[2]) ^ (ah[1] & ah[2]);
-            const uint32_t temp2 = s0 + maj;
-
-            ah[7] = ah[6];
-            ah[6] = ah[5];
-            ah[5] = ah[4];
-            ah[4] = ah[3] + temp1;
-            ah[3] = ah[2];
-            ah[2] = ah[1];
-            ah[1] = ah[0];
-            ah[0] = temp1 + temp2;
+            copy_len = len;
         }
 
-        for (i = 0; i < 8; i++)
+        memcpy(p_ctx->chunk + p_ctx->chunk_len, data, copy_len);
+        p_ctx->chunk_len += copy_len;
+        data += copy_len;
+        len -= copy_len;
+
+        if (p_ctx->chunk_len == SHA256_CHUNK_SIZE)
         {
-            hash[i] += ah[i];
+            __calcSHA256(p_ctx->hash, p_ctx->chunk);
+            p_ctx->chunk_len = 0;
         }
     }
-
-    for (i = 0, j = 0; i < 8; i++)
-    {
-        uint32_t word          = hash[i];
-        ((uint8_t *)hash)[j++] = (uint8_t)(word >> 24);
-        ((uint8_t *)hash)[j++] = (uint8_t)(word >> 16);
-        ((uint8_t *)hash)[j++] = (uint8_t)(word >> 8);
-        ((uint8_t *)hash)[j++] = (uint8_t)word;
-    }
 }
 
-static bool __calcSHA256_Chunk(uint8_t chunk[SHA256_CHUNK_SIZE], __SHA256_State_T *state)
+void SHA256_Final(SHA256_Context_T *p_ctx, uint8_t *sha256)
 {
-    size_t space_in_chunk;
+    size_t i, j;
+
+    p_ctx->chunk[p_ctx->chunk_len++] = 0x80;
 
-    if (state->total_len_delivered)
+    if (p_ctx->chunk_len > SHA256_CHUNK_SIZE - SHA256_TOTAL_LEN_LEN)
     {
-        return false;
+        memset(p_ctx->chunk + p_ctx->chunk_len, 0x00, SHA256_CHUNK_SIZE - p_ctx->chunk_len);
+        __calcSHA256(p_ctx->hash, p_ctx->chunk);
+        p_ctx->chunk_len = 0;
     }
 
-    if (state->len >= SHA256_CHUNK_SIZE)
+    memset(p_ctx->chunk + p_ctx->chunk_len, 0x00, SHA256_CHUNK_SIZE - SHA256_TOTAL_LEN_LEN - p_ctx->chunk_len);
+
+    uint64_t total_bits = (uint64_t)p_ctx->total_len << 3;
+    for (i = 0; i < SHA256_TOTAL_LEN_LEN; i++)
     {
-        memcpy(chunk, state->p, SHA256_CHUNK_SIZE);
-        state->p += SHA256_CHUNK_SIZE;
-        state->len -= SHA256_CHUNK_SIZE;
-        return true;
+        p_ctx->chunk[SHA256_CHUNK_SIZE - 1 - i] = (uint8_t)(total_bits >> (8 * i));
     }
+    __calcSHA256(p_ctx->hash, p_ctx->chunk);
 
-    memcpy(chunk, state->p, state->len);
-    chunk += state->len;
-    space_in_chunk = SHA256_CHUNK_SIZE - state->len;
-    state->p += state->len;
-    state->len = 0;
-
-    if (!state->single_one_delivered)
+    for (i = 0, j = 0; i < 8; i++)
     {
-        *chunk++ = 0x80;
-        space_in_chunk -= 1;
-        state->single_one_delivered = 1;
+        uint32_t word = p_ctx->hash[i];
+        sha256[j++]   = (uint8_t)(word >> 24);
+        sha256[j++]   = (uint8_t)(word >> 16);
+        sha256[j++]   = (uint8_t)(word >> 8);
+        sha256[j++]   = (uint8_t)word;
     }
+}
+
+void CalcSHA256(uint8_t *data, size_t len, uint8_t *sha256)
+{
+    SHA256_Context_T ctx;
+
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, data, len);
+    SHA256_Final(&ctx, sha256);
+}
+
+
+static inline uint16_t __calcCRC16(uint8_t data, uint16_t crc)
+{
+#if CRC_TABLE_BITS == 8
+    crc = (uint16_t)(crc << 8) ^ crc16_table.entry[0][((crc >> 8) ^ data) & CRC_TABLE_MASK];
+#else
+    crc = (uint16_t)(crc << 4) ^ crc16_table.entry[0][((crc >> 12) ^ (data >> 4)) & CRC_TABLE_MASK];
+    crc = (uint16_t)(crc << 4) ^ crc16_table.entry[0][((crc >> 12) ^ data) & CRC_TABLE_MASK];
+#endif
+
+    return crc;
+}
+
+static inline uint32_t __calcCRC32(uint8_t data, uint32_t crc)
+{
+#if CRC_TABLE_BITS == 8
+    crc = (crc >> 8) ^ crc32_table.entry[0][(crc ^ data) & CRC_TABLE_MASK];
+#else
+    crc = (crc >> 4) ^ crc32_table.entry[0][(crc ^ data) & CRC_TABLE_MASK];
+    crc = (crc >> 4) ^ crc32_table.entry[0][(crc ^ (data >> 4)) & CRC_TABLE_MASK];
+#endif
+
+    return crc;
+}
+
+static void __calcSHA256(uint32_t hash[8], const uint8_t chunk[SHA256_CHUNK_SIZE])
+{
+    size_t   i;
+    uint32_t w[SHA256_SCHEDULE_LEN];
 
-    if (space_in_chunk >= SHA256_TOTAL_LEN_LEN)
+    if (((uintptr_t)chunk % sizeof(uint32_t)) == 0)
     {
-        const size_t left = space_in_chunk - SHA256_TOTAL_LEN_LEN;
-        size_t       len  = state->total_len;
-        int          i;
-        memset(chunk, 0x00, left);
-        chunk += left;
-
-        chunk[7] = (uint8_t)(len << 3);
-        len >>= 5;
-        for (i = 6; i >= 0; i--)
+        const uint32_t *p_words = (const uint32_t *)chunk;
+        for (i = 0; i < SHA256_SCHEDULE_LEN; i++)
         {
-            chunk[i] = (uint8_t)len;
-            len >>= 8;
+            w[i] = __builtin_bswap32(p_words[i]);
         }
-        state->total_len_delivered = 1;
     }
     else
     {
-        memset(chunk, 0x00, space_in_chunk);
+        const uint8_t *p = chunk;
+        for (i = 0; i < SHA256_SCHEDULE_LEN; i++)
+        {
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+            p += 4;
+        }
     }
 
-    return true;
+    uint32_t a = hash[0];
+    uint32_t b = hash[1];
+    uint32_t c = hash[2];
+    uint32_t d = hash[3];
+    uint32_t e = hash[4];
+    uint32_t f = hash[5];
+    uint32_t g = hash[6];
+    uint32_t h = hash[7];
+
+#if SHA256_UNROLL == 1
+    for (i = 0; i < SHA256_ROUNDS; i += 8)
+    {
+        __SHA256_ROUND(a, b, c, d, e, f, g, h, i + 0, __SHA256_W(w, i + 0));
+        __SHA256_ROUND(h, a, b, c, d, e, f, g, i + 1, __SHA256_W(w, i + 1));
+        __SHA256_ROUND(g, h, a, b, c, d, e, f, i + 2, __SHA256_W(w, i + 2));
+        __SHA256_ROUND(f, g, h, a, b, c, d, e, i + 3, __SHA256_W(w, i + 3));
+        __SHA256_ROUND(e, f, g, h, a, b, c, d, i + 4, __SHA256_W(w, i + 4));
+        __SHA256_ROUND(d, e, f, g, h, a, b, c, i + 5, __SHA256_W(w, i + 5));
+        __SHA256_ROUND(c, d, e, f, g, h, a, b, i + 6, __SHA256_W(w, i + 6));
+        __SHA256_ROUND(b, c, d, e, f, g, h, a, i + 7, __SHA256_W(w, i + 7));
+    }
+#else
+    for (i = 0; i < SHA256_ROUNDS; i++)
+    {
+        __SHA256_ROUND(a, b, c, d, e, f, g, h, i, __SHA256_W(w, i));
+
+        uint32_t t = h;
+        h          = g;
+        g          = f;
+        f          = e;
+        e          = d;
+        d          = c;
+        c          = b;
+        b          = a;
+        a          = t;
+    }
+#endif
+
+    hash[0] += a;
+    hash[1] += b;
+    hash[2] += c;
+    hash[3] += d;
+    hash[4] += e;
+    hash[5] += f;
+    hash[6] += g;
+    hash[7] += h;
 }
 
 static inline uint32_t __calcSHA256_RightRotation(uint32_t value, unsigned int count)
 {
     return value >> count | value << (32 - count);
+}
+
+static inline uint32_t __calcSHA256_Schedule(uint32_t w[SHA256_SCHEDULE_LEN], size_t i)
+{
+    const uint32_t w15 = w[(i - 15) & SHA256_SCHEDULE_MASK];
+    const uint32_t w2  = w[(i - 2) & SHA256_SCHEDULE_MASK];
+
+    const uint32_t s0 = __calcSHA256_RightRotation(w15, 7) ^ __calcSHA256_RightRotation(w15, 18) ^ (w15 >> 3);
+    const uint32_t s1 = __calcSHA256_RightRotation(w2, 17) ^ __calcSHA256_RightRotation(w2, 19) ^ (w2 >> 10);
+
+    w[i & SHA256_SCHEDULE_MASK] += s0 + w[(i - 7) & SHA256_SCHEDULE_MASK] + s1;
+    return w[i & SHA256_SCHEDULE_MASK];
 }
\ No newline at end of file
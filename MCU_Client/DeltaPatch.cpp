@@ -0,0 +1,128 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "DeltaPatch.h"
+
+
+#define DELTAPATCH_INSERT_HEADER_LEN 3u
+#define DELTAPATCH_COPY_HEADER_LEN 7u
+
+
+/*
+ *  Get header length of operation
+ *
+ *  @param op           Operation code
+ *  @return             Header length, 0 if operation is invalid
+ */
+static uint8_t DeltaPatch_HeaderLen(uint8_t op);
+
+/*
+ *  Start operation, which header is fully received
+ *
+ *  @param p_decoder    Pointer to decoder
+ */
+static void DeltaPatch_StartOperation(DeltaPatch_Decoder_T *p_decoder);
+
+
+void DeltaPatch_Init(DeltaPatch_Decoder_T *p_decoder)
+{
+    p_decoder->header_len  = 0;
+    p_decoder->insert_left = 0;
+    p_decoder->copy_offset = 0;
+    p_decoder->copy_left   = 0;
+}
+
+bool DeltaPatch_Decode(DeltaPatch_Decoder_T *p_decoder, const uint8_t *p_data, size_t len, size_t *p_consumed, DeltaPatch_PutCallback put)
+{
+    size_t index = 0;
+    bool   ret   = true;
+
+    while ((index < len) && (p_decoder->copy_left == 0) && ret)
+    {
+        if (p_decoder->insert_left != 0)
+        {
+            ret = put(p_data[index++]);
+            p_decoder->insert_left--;
+            continue;
+        }
+
+        p_decoder->header[p_decoder->header_len++] = p_data[index++];
+
+        uint8_t header_len = DeltaPatch_HeaderLen(p_decoder->header[0]);
+        if (header_len == 0)
+        {
+            ret = false;
+        }
+        else if (p_decoder->header_len == header_len)
+        {
+            DeltaPatch_StartOperation(p_decoder);
+        }
+    }
+
+    *p_consumed = index;
+    return ret;
+}
+
+static uint8_t DeltaPatch_HeaderLen(uint8_t op)
+{
+    switch (op)
+    {
+        case DELTAPATCH_OP_INSERT:
+        {
+            return DELTAPATCH_INSERT_HEADER_LEN;
+        }
+        case DELTAPATCH_OP_COPY:
+        {
+            return DELTAPATCH_COPY_HEADER_LEN;
+        }
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+static void DeltaPatch_StartOperation(DeltaPatch_Decoder_T *p_decoder)
+{
+    size_t   index = 1;
+    uint16_t len;
+    len = ((uint16_t)p_decoder->header[index++]);
+    len |= ((uint16_t)p_decoder->header[index++] << 8);
+
+    if (p_decoder->header[0] == DELTAPATCH_OP_INSERT)
+    {
+        p_decoder->insert_left = len;
+    }
+    else
+    {
+        uint32_t offset;
+        offset = ((uint32_t)p_decoder->header[index++]);
+        offset |= ((uint32_t)p_decoder->header[index++] << 8);
+        offset |= ((uint32_t)p_decoder->header[index++] << 16);
+        offset |= ((uint32_t)p_decoder->header[index++] << 24);
+
+        p_decoder->copy_offset = offset;
+        p_decoder->copy_left   = len;
+    }
+
+    p_decoder->header_len = 0;
+}
@@ -0,0 +1,85 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef DELTAPATCH_H_
+#define DELTAPATCH_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Delta patch format, as produced by Tools/dfu_pack.py --base:
+ *
+ *  Patch is a sequence of operations rebuilding new image from the running one:
+ *
+ *      DELTAPATCH_OP_INSERT    len u16 LE, len bytes of new image data
+ *      DELTAPATCH_OP_COPY      len u16 LE, offset u32 LE of data in running image
+ *
+ *  Decoder passes inserted data to the callback. Copy operations are not
+ *  executed by decoder, decoding stops at each of them and the caller copies
+ *  copy_left bytes from copy_offset, in as many steps as it needs.
+ */
+#define DELTAPATCH_OP_INSERT 0x00
+#define DELTAPATCH_OP_COPY 0x01
+
+#define DELTAPATCH_HEADER_MAX_LEN 7u /**< Length of the longest operation header */
+
+typedef struct DeltaPatch_Decoder_Tag
+{
+    uint8_t  header[DELTAPATCH_HEADER_MAX_LEN]; /**< Header of operation being received */
+    uint8_t  header_len;                        /**< Bytes of header received */
+    uint16_t insert_left;                       /**< Bytes of insert operation not received yet */
+    uint32_t copy_offset;                       /**< Offset of data to copy from running image */
+    uint32_t copy_left;                         /**< Bytes to copy, caller updates both fields while copying */
+} DeltaPatch_Decoder_T;
+
+/*
+ *  Callback storing single byte of new image
+ *
+ *  @param data         Data byte
+ *  @return             True on success
+ */
+typedef bool (*DeltaPatch_PutCallback)(uint8_t data);
+
+/*
+ *  Initialize delta patch decoder
+ *
+ *  @param p_decoder    Pointer to decoder
+ */
+void DeltaPatch_Init(DeltaPatch_Decoder_T *p_decoder);
+
+/*
+ *  Decode part of delta patch. Patch may be split at any byte. Decoding
+ *  stops when input is consumed or copy operation is pending.
+ *
+ *  @param p_decoder    Pointer to decoder
+ *  @param p_data       Pointer to patch data
+ *  @param len          Patch data len
+ *  @param p_consumed   Pointer to number of patch bytes consumed
+ *  @param put          Callback storing inserted bytes
+ *  @return             True on success, false on invalid operation or callback failure
+ */
+bool DeltaPatch_Decode(DeltaPatch_Decoder_T *p_decoder, const uint8_t *p_data, size_t len, size_t *p_consumed, DeltaPatch_PutCallback put);
+
+#endif /* DELTAPATCH_H_ */
@@ -25,10 +25,14 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <kinetis.h>
 #include <stdint.h>
 
+#include "Config.h"
 
+
+#define FLASH_START_ADDR 0x0u                     /**< Pointer to beginning of flash. */
 #define FLASH_END_ADDR 0x10000u                   /**< Pointer to end of flash. */
-#define FLASH_SECTOR_SIZE 0x400u                  /**< Flash sector size */
+#define FLASH_SECTOR_SIZE FLASHER_SECTOR_SIZE      /**< Flash sector size */
 #define FLASH_EEPROM_SIZE (2 * FLASH_SECTOR_SIZE) /**< Size of space reserved for dummy eeprom */
+#define FLASH_METADATA_SIZE (FLASHER_METADATA_SECTORS * FLASH_SECTOR_SIZE) /**< Space reserved for DFU metadata */
 #define FLASH_CONFIG_FIELD_ADDR 0x40u             /**< Config field address */
 #define FLASH_CONFIG_FIELD_VAL 0xFFFFFFFEu        /**< Config field desirable value */
 #define FLASH_ERASED_WORD_VAL 0xFFFFFFFFu         /**< Erased word value */
@@ -36,6 +40,19 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define FLASH_ERASE_SECTOR_CMD 0x09               /**< Flash sector erase command code */
 #define CPU_RESTART_ADDR ((uint32_t *)0xE000ED0C) /**< CPU restart register address */
 #define CPU_RESTART_VAL 0x5FA0004                 /**< CPU restart register value  */
+#define FLASH_CRC32_POLYNOMIAL 0xEDB88320u        /**< Reflected CRC32 polynomial used for sector verification */
+#define FLASH_UPDATE_ATTEMPTS 5                   /**< Attempts to program sector during firmware update */
+#define FLASH_HALT_BLINK_MS 250                   /**< LED on and off time of each error code blink */
+#define FLASH_HALT_PAUSE_MS 2000                  /**< LED off time between error code repetitions */
+
+/* Registers of PIN_LED_STATUS, driven directly as core functions in flash may be already overwritten */
+#define FLASH_PIN_REG(_pin, _reg) FLASH_PIN_REG_EXPAND(_pin, _reg)
+#define FLASH_PIN_REG_EXPAND(_pin, _reg) CORE_PIN##_pin##_##_reg
+#define FLASH_LED_CONFIG FLASH_PIN_REG(PIN_LED_STATUS, CONFIG)
+#define FLASH_LED_DDR FLASH_PIN_REG(PIN_LED_STATUS, DDRREG)
+#define FLASH_LED_SET FLASH_PIN_REG(PIN_LED_STATUS, PORTSET)
+#define FLASH_LED_CLEAR FLASH_PIN_REG(PIN_LED_STATUS, PORTCLEAR)
+#define FLASH_LED_BITMASK FLASH_PIN_REG(PIN_LED_STATUS, BITMASK)
 
 /**< Data memory barrier instruction definition. */
 #define _DMB()                 \
@@ -69,29 +86,106 @@ RAMFUNC static int Flasher_FlashWordNotEeprom(uint32_t address, uint32_t word_va
  */
 RAMFUNC static int Flasher_SectorErase(uint32_t address, bool unsafe, bool reenable_irq);
 
+/*
+ *  Compare staged data with flash, skipping flash config field.
+ *
+ *  @param destination   Pointer to flash
+ *  @param source        Pointer to staged data
+ *  @param num_of_words  Number of words to compare
+ *  @return              True if all words are equal
+ */
+RAMFUNC static bool Flasher_IsEqual(uint32_t destination, uint32_t source, uint32_t num_of_words);
+
+/*
+ *  Calculate CRC32 of data to be placed at destination, skipping flash config field.
+ *  Bitwise, as CRC tables in flash are overwritten by firmware update.
+ *
+ *  @param address       Pointer to data
+ *  @param destination   Pointer to flash, where data is placed
+ *  @param num_of_words  Number of words
+ *  @return              CRC32 value
+ */
+RAMFUNC static uint32_t Flasher_CalcCRC32(uint32_t address, uint32_t destination, uint32_t num_of_words);
+
+/*
+ *  Erase sector and program it with staged data. Leaves IRQ disabled.
+ *
+ *  @param destination   Pointer to first byte in sector
+ *  @param source        Pointer to staged data
+ *  @param num_of_words  Number of words to program, up to sector size
+ *  @return              Flasher return code of the first failed operation
+ */
+RAMFUNC static int Flasher_ProgramSector(uint32_t destination, uint32_t source, uint32_t num_of_words);
+
+/*
+ *  Stop with IRQ disabled, blinking PIN_LED_STATUS as many times as error code, then pausing. Never returns.
+ *
+ *  @param error         Flasher return code
+ */
+RAMFUNC static void Flasher_Halt(int error);
+
+/*
+ *  Busy wait on SysTick, which keeps counting with IRQ disabled and wraps every millisecond.
+ *
+ *  @param ms            Time to wait in milliseconds
+ */
+RAMFUNC static void Flasher_WaitMs(uint32_t ms);
+
 
 RAMFUNC int Flasher_UpdateFirmware(uint32_t num_of_words)
 {
     uint32_t src = Flasher_GetSpaceAddr();
-    uint32_t dst = 0;
+    uint32_t dst = FLASH_START_ADDR;
 
     __disable_irq();
 
-    for (uint32_t i = 0; i <= num_of_words; i++)
+    for (uint32_t i = 0; i < num_of_words; i += FLASH_SECTOR_SIZE / 4)
     {
-        uint32_t source      = src + i * 4;
-        uint32_t destination = dst + i * 4;
+        uint32_t source       = src + i * 4;
+        uint32_t destination  = dst + i * 4;
+        uint32_t sector_words = num_of_words - i;
+        if (sector_words > FLASH_SECTOR_SIZE / 4)
+        {
+            sector_words = FLASH_SECTOR_SIZE / 4;
+        }
+
+        /* Sectors not changed by update are neither erased nor programmed */
+        if (Flasher_IsEqual(destination, source, sector_words))
+        {
+            continue;
+        }
 
-        if (destination % FLASH_SECTOR_SIZE == 0)
+        /*
+         *  Sector is programmed again until it verifies. Once the first sector
+         *  is changed neither image is complete, so there is nothing to fall
+         *  back to and restarting would run corrupted firmware. A sector that
+         *  cannot be programmed halts the device with its error code blinked
+         *  on PIN_LED_STATUS, it needs to be reprogrammed with external
+         *  programmer then. Protection violation and access error come from
+         *  the command itself, so they are not retried.
+         */
+        uint32_t crc     = Flasher_CalcCRC32(source, destination, sector_words);
+        int      ret_val = FLASHER_ERROR_VERIFY;
+
+        for (uint32_t attempt = 0; attempt < FLASH_UPDATE_ATTEMPTS; attempt++)
         {
-            Flasher_SectorErase(destination, true, false);
-            if (destination + FLASH_SECTOR_SIZE > FLASH_CONFIG_FIELD_ADDR && destination <= FLASH_CONFIG_FIELD_ADDR)
+            ret_val = Flasher_ProgramSector(destination, source, sector_words);
+            if ((ret_val == FLASHER_SUCCESS) && (Flasher_CalcCRC32(destination, destination, sector_words) != crc))
             {
-                Flasher_FlashWordNotEeprom(FLASH_CONFIG_FIELD_ADDR, FLASH_CONFIG_FIELD_VAL, false);
+                ret_val = FLASHER_ERROR_VERIFY;
+            }
+
+            if ((ret_val == FLASHER_SUCCESS) || (ret_val == FLASHER_ERROR_PROTECTION) ||
+                (ret_val == FLASHER_ERROR_ACCESS))
+            {
+                break;
             }
         }
 
-        Flasher_FlashWordNotEeprom(destination, *(volatile uint32_t *)source, false);
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            Flasher_Halt(ret_val);
+        }
     }
 
     *CPU_RESTART_ADDR = CPU_RESTART_VAL;
@@ -163,6 +257,11 @@ RAMFUNC int Flasher_FlashWord(uint32_t address, uint32_t word_value, bool reenab
     return FLASHER_SUCCESS;
 }
 
+uint32_t Flasher_GetFirmwareAddr(void)
+{
+    return FLASH_START_ADDR;
+}
+
 uint32_t Flasher_GetSpaceAddr(void)
 {
     uint32_t first_free_addr = (uint32_t)&_etext + (uint32_t)&_edata - (uint32_t)&_sdata;
@@ -171,7 +270,12 @@ uint32_t Flasher_GetSpaceAddr(void)
 
 size_t Flasher_GetSpaceSize(void)
 {
-    return FLASH_END_ADDR - Flasher_GetSpaceAddr() - FLASH_EEPROM_SIZE;
+    return FLASH_END_ADDR - Flasher_GetSpaceAddr() - FLASH_EEPROM_SIZE - FLASH_METADATA_SIZE;
+}
+
+uint32_t Flasher_GetMetadataAddr(void)
+{
+    return FLASH_END_ADDR - FLASH_EEPROM_SIZE - FLASH_METADATA_SIZE;
 }
 
 int Flasher_EraseSpace(void)
@@ -189,6 +293,16 @@ int Flasher_EraseSpace(void)
     return FLASHER_SUCCESS;
 }
 
+int Flasher_EraseSpaceSector(uint32_t address)
+{
+    if (address < Flasher_GetSpaceAddr())
+    {
+        return FLASHER_ERROR_RANGE;
+    }
+
+    return Flasher_SectorErase(address, false, true);
+}
+
 int Flasher_SaveMemoryToFlash(uint32_t address, const uint32_t *src, uint32_t num_of_words)
 {
     if (address % sizeof(uint32_t) != 0)
@@ -232,6 +346,102 @@ RAMFUNC int Flasher_FlashWordNotEeprom(uint32_t address, uint32_t word_value, bo
     }
 }
 
+RAMFUNC bool Flasher_IsEqual(uint32_t destination, uint32_t source, uint32_t num_of_words)
+{
+    for (uint32_t i = 0; i < num_of_words; i++)
+    {
+        if ((destination + i * 4 != FLASH_CONFIG_FIELD_ADDR) &&
+            (*(volatile uint32_t *)(destination + i * 4) != *(volatile uint32_t *)(source + i * 4)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+RAMFUNC uint32_t Flasher_CalcCRC32(uint32_t address, uint32_t destination, uint32_t num_of_words)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (uint32_t i = 0; i < num_of_words; i++)
+    {
+        if (destination + i * 4 == FLASH_CONFIG_FIELD_ADDR)
+        {
+            continue;
+        }
+
+        crc ^= *(volatile uint32_t *)(address + i * 4);
+        for (uint32_t bit = 0; bit < 32; bit++)
+        {
+            crc = (crc >> 1) ^ (FLASH_CRC32_POLYNOMIAL & (0u - (crc & 1u)));
+        }
+    }
+
+    return ~crc;
+}
+
+RAMFUNC int Flasher_ProgramSector(uint32_t destination, uint32_t source, uint32_t num_of_words)
+{
+    int ret_val = Flasher_SectorErase(destination, true, false);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    if (destination + FLASH_SECTOR_SIZE > FLASH_CONFIG_FIELD_ADDR && destination <= FLASH_CONFIG_FIELD_ADDR)
+    {
+        ret_val = Flasher_FlashWordNotEeprom(FLASH_CONFIG_FIELD_ADDR, FLASH_CONFIG_FIELD_VAL, false);
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            return ret_val;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_of_words; i++)
+    {
+        ret_val = Flasher_FlashWordNotEeprom(destination + i * 4, *(volatile uint32_t *)(source + i * 4), false);
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            return ret_val;
+        }
+    }
+
+    return FLASHER_SUCCESS;
+}
+
+RAMFUNC void Flasher_Halt(int error)
+{
+    FLASH_LED_CONFIG = PORT_PCR_SRE | PORT_PCR_DSE | PORT_PCR_MUX(1);
+    FLASH_LED_DDR |= FLASH_LED_BITMASK;
+
+    for (;;)
+    {
+        for (int i = 0; i < error; i++)
+        {
+            FLASH_LED_SET = FLASH_LED_BITMASK;
+            Flasher_WaitMs(FLASH_HALT_BLINK_MS);
+            FLASH_LED_CLEAR = FLASH_LED_BITMASK;
+            Flasher_WaitMs(FLASH_HALT_BLINK_MS);
+        }
+
+        Flasher_WaitMs(FLASH_HALT_PAUSE_MS);
+    }
+}
+
+RAMFUNC void Flasher_WaitMs(uint32_t ms)
+{
+    /* COUNTFLAG is cleared by reading, the first wrap may come early */
+    (void)SYST_CSR;
+
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        while ((SYST_CSR & SYST_CSR_COUNTFLAG) == 0)
+        {
+        }
+    }
+}
+
 RAMFUNC int Flasher_SectorErase(uint32_t address, bool unsafe, bool reenable_irq)
 {
     if (address >= FLASH_END_ADDR - FLASH_EEPROM_SIZE)
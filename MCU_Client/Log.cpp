@@ -21,6 +21,260 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "Log.h"
 
+#if LOG_DEFERRED_ENABLE == 1
+
+#include <string.h>
+
+#include "SPSCRingBuffer.h"
+
+#define LOG_BUFFER_SIZE 512 /**< Log buffer size, has to be a power of two */
+#define LOG_RECORD_PREFIX_LEN 2 /**< Sync and length bytes */
+#define LOG_RECORD_HEADER_LEN (LOG_RECORD_PREFIX_LEN + sizeof(uint32_t))
+#define LOG_BUFFER_ARG_HEADER_LEN 2 /**< Buffer tag and length bytes */
+
+static uint8_t                          LogBuffer[LOG_BUFFER_SIZE];
+static SPSCRingBuffer_T<LOG_BUFFER_SIZE> LogRingBuffer = {LogBuffer, 0, 0};
+static uint32_t                         DroppedRecords;
+
+/*
+ *  Get length of encoded argument
+ *
+ *  @param p_arg    Pointer to argument
+ *  @return         Number of bytes argument takes in record, including tag
+ */
+static uint16_t LogInternal_GetArgLen(const Log_Arg_T *p_arg);
+
+/*
+ *  Write argument to reserved record
+ *
+ *  @param p_span   Pointer to reserved record span
+ *  @param offset   Argument offset in record
+ *  @param p_arg    Pointer to argument
+ *  @return         Offset after written argument
+ */
+static uint16_t LogInternal_WriteArg(RingBuffer_Span_T *p_span, uint16_t offset, const Log_Arg_T *p_arg);
+
+/*
+ *  Queue record with number of dropped records, if there were any and it fits
+ */
+static void LogInternal_QueueDroppedRecord(void);
+
+/*
+ *  Reserve space for record and write its header
+ *
+ *  @param p_span       Pointer to span to be reserved
+ *  @param format       Format string
+ *  @param args_len     Length of encoded arguments
+ *  @return             True if record was reserved
+ */
+static bool LogInternal_BeginRecord(RingBuffer_Span_T *p_span, const char *format, uint16_t args_len);
+
+void Log_Queue(const char *format, const Log_Arg_T *p_args, size_t args_count)
+{
+    LogInternal_QueueDroppedRecord();
+
+    uint16_t args_len = 0;
+    for (size_t i = 0; i < args_count; i++)
+    {
+        args_len += LogInternal_GetArgLen(p_args + i);
+    }
+
+    RingBuffer_Span_T span;
+    if (!LogInternal_BeginRecord(&span, format, args_len))
+    {
+        DroppedRecords++;
+        return;
+    }
+
+    uint16_t offset = LOG_RECORD_HEADER_LEN;
+    for (size_t i = 0; i < args_count; i++)
+    {
+        offset = LogInternal_WriteArg(&span, offset, p_args + i);
+    }
+
+    SPSCRingBuffer_Commit(&LogRingBuffer, offset);
+}
+
+void _LOG_HEXBUF(const char *text, const void *buf, size_t len)
+{
+    LogInternal_QueueDroppedRecord();
+
+    const size_t max_len = LOG_RECORD_MAX_LEN - sizeof(uint32_t) - LOG_BUFFER_ARG_HEADER_LEN;
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+
+    RingBuffer_Span_T span;
+    if (!LogInternal_BeginRecord(&span, text, LOG_BUFFER_ARG_HEADER_LEN + len))
+    {
+        DroppedRecords++;
+        return;
+    }
+
+    uint8_t buffer_header[LOG_BUFFER_ARG_HEADER_LEN] = {LOG_ARG_TAG_BUFFER, (uint8_t)len};
+    RingBuffer_SpanWrite(&span, LOG_RECORD_HEADER_LEN, buffer_header, sizeof(buffer_header));
+    RingBuffer_SpanWrite(&span, LOG_RECORD_HEADER_LEN + sizeof(buffer_header), (const uint8_t *)buf, len);
+
+    SPSCRingBuffer_Commit(&LogRingBuffer, LOG_RECORD_HEADER_LEN + sizeof(buffer_header) + len);
+}
+
+void Log_Loop(void)
+{
+    int space = DEBUG_INTERFACE.availableForWrite();
+    while (space > 0)
+    {
+        uint16_t len;
+        uint8_t *p_data = SPSCRingBuffer_Peek(&LogRingBuffer, &len);
+        if (len == 0)
+        {
+            break;
+        }
+
+        if (len > space)
+        {
+            len = space;
+        }
+
+        DEBUG_INTERFACE.write(p_data, len);
+        SPSCRingBuffer_Skip(&LogRingBuffer, len);
+        space -= len;
+    }
+}
+
+void Log_Flush(void)
+{
+    LogInternal_QueueDroppedRecord();
+
+    while (!SPSCRingBuffer_IsEmpty(&LogRingBuffer))
+    {
+        uint16_t len;
+        uint8_t *p_data = SPSCRingBuffer_Peek(&LogRingBuffer, &len);
+        DEBUG_INTERFACE.write(p_data, len);
+        SPSCRingBuffer_Skip(&LogRingBuffer, len);
+    }
+
+    DEBUG_INTERFACE.flush();
+}
+
+static uint16_t LogInternal_GetArgLen(const Log_Arg_T *p_arg)
+{
+    switch (p_arg->tag)
+    {
+        case LOG_ARG_TAG_INT:
+        {
+            return sizeof(uint8_t) + sizeof(uint32_t);
+        }
+
+        case LOG_ARG_TAG_INT64:
+        {
+            return sizeof(uint8_t) + sizeof(uint64_t);
+        }
+
+        case LOG_ARG_TAG_DOUBLE:
+        {
+            return sizeof(uint8_t) + sizeof(double);
+        }
+
+        case LOG_ARG_TAG_STRING:
+        {
+            return sizeof(uint8_t) + strlen(p_arg->str) + 1;
+        }
+
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+static uint16_t LogInternal_WriteArg(RingBuffer_Span_T *p_span, uint16_t offset, const Log_Arg_T *p_arg)
+{
+    RingBuffer_SpanWrite(p_span, offset, &p_arg->tag, sizeof(p_arg->tag));
+    offset += sizeof(p_arg->tag);
+
+    switch (p_arg->tag)
+    {
+        case LOG_ARG_TAG_INT:
+        {
+            RingBuffer_SpanWrite(p_span, offset, (const uint8_t *)&p_arg->u32, sizeof(uint32_t));
+            return offset + sizeof(uint32_t);
+        }
+
+        case LOG_ARG_TAG_INT64:
+        {
+            RingBuffer_SpanWrite(p_span, offset, (const uint8_t *)&p_arg->u64, sizeof(uint64_t));
+            return offset + sizeof(uint64_t);
+        }
+
+        case LOG_ARG_TAG_DOUBLE:
+        {
+            RingBuffer_SpanWrite(p_span, offset, (const uint8_t *)&p_arg->f64, sizeof(double));
+            return offset + sizeof(double);
+        }
+
+        case LOG_ARG_TAG_STRING:
+        {
+            uint16_t len = strlen(p_arg->str) + 1;
+            RingBuffer_SpanWrite(p_span, offset, (const uint8_t *)p_arg->str, len);
+            return offset + len;
+        }
+
+        default:
+        {
+            return offset;
+        }
+    }
+}
+
+static void LogInternal_QueueDroppedRecord(void)
+{
+    if (DroppedRecords == 0)
+    {
+        return;
+    }
+
+    RingBuffer_Span_T span;
+    if (!LogInternal_BeginRecord(&span, NULL, sizeof(uint8_t) + sizeof(uint32_t)))
+    {
+        return;
+    }
+
+    Log_Arg_T arg(DroppedRecords);
+    uint16_t  len = LogInternal_WriteArg(&span, LOG_RECORD_HEADER_LEN, &arg);
+    SPSCRingBuffer_Commit(&LogRingBuffer, len);
+    DroppedRecords = 0;
+}
+
+static bool LogInternal_BeginRecord(RingBuffer_Span_T *p_span, const char *format, uint16_t args_len)
+{
+    uint16_t len = LOG_RECORD_HEADER_LEN + args_len;
+    if (len - LOG_RECORD_PREFIX_LEN > LOG_RECORD_MAX_LEN)
+    {
+        return false;
+    }
+
+    if (!SPSCRingBuffer_Reserve(&LogRingBuffer, len, p_span))
+    {
+        return false;
+    }
+
+    uint32_t format_addr = (uintptr_t)format;
+    uint8_t  header[]    = {
+        LOG_RECORD_SYNC,
+        (uint8_t)(len - LOG_RECORD_PREFIX_LEN),
+        (uint8_t)(format_addr),
+        (uint8_t)(format_addr >> 8),
+        (uint8_t)(format_addr >> 16),
+        (uint8_t)(format_addr >> 24),
+    };
+    RingBuffer_SpanWrite(p_span, 0, header, sizeof(header));
+
+    return true;
+}
+
+#else
+
 void _LOG_HEXBUF(const char *text, const void *buf, size_t len)
 {
     _PRINTF(text);
@@ -34,3 +288,5 @@ void _LOG_HEXBUF(const char *text, const void *buf, size_t len)
 
     _PRINTF("\n");
 }
+
+#endif
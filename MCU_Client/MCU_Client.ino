@@ -456,4 +456,7 @@ void loop()
             LoopMeshTimeSync();
             break;
     }
+
+    LoopDFU();
+    Log_Loop();
 }
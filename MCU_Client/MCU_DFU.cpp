@@ -25,14 +25,60 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string.h>
 
 #include "CRC.h"
+#include "DeltaPatch.h"
 #include "Flasher.h"
+#include "LZSS.h"
 #include "Log.h"
 #include "UARTProtocol.h"
 #include "Utils.h"
 
 
-#define SHA256_SIZE 32u
-#define MAX_PAGE_SIZE 1024UL
+#define MAX_PAGE_SIZE 512UL
+
+/*
+ *  Number of page buffers, MAX_PAGE_SIZE of RAM each. Stored page is programmed
+ *  from LoopDFU while the modem requests DFU Status and creates the next page,
+ *  additional buffers let the next page be received before that completes.
+ *  Two 512 byte buffers take as much RAM as one 1 KB page on Teensy LC. The
+ *  number of buffers is reported in DFU Status response.
+ */
+#ifndef DFU_PAGE_BUFFERS
+#define DFU_PAGE_BUFFERS 2
+#endif
+
+#define DFU_PROGRAM_SLICE_SIZE 128UL /**< Bytes programmed to flash in single loop iteration, multiple of word size */
+
+/*
+ *  Compressed image container, as produced by Tools/dfu_pack.py:
+ *
+ *      magic u32 LE, format u8, 3 reserved bytes, image size u32 LE, compressed image
+ *
+ *  Image size is size of decompressed image and SHA256 from DFU Init is
+ *  calculated over decompressed image. Images not starting with the magic
+ *  are stored as they are. Magic is not a valid initial stack pointer, so
+ *  it never collides with plain firmware image.
+ *
+ *  Delta format carries a patch rebuilding new image from the running one.
+ */
+#define DFU_IMAGE_MAGIC 0x5A554644UL /**< "DFUZ" */
+#define DFU_IMAGE_FORMAT_PLAIN 0x00  /**< Image without container */
+#define DFU_IMAGE_FORMAT_LZSS 0x01
+#define DFU_IMAGE_FORMAT_DELTA 0x02
+#define DFU_IMAGE_HEADER_SIZE 12UL
+
+#define DFU_OUTPUT_BUFFER_SIZE 256UL /**< Decompressed data buffer, multiple of word size */
+
+/*
+ *  DFU progress is kept in metadata sectors, so transfer can be resumed after
+ *  reset. Header is written at DFU Init, then commit record is appended each
+ *  time a page is fully programmed. The last record with valid CRC is the
+ *  resume point. When sector is full, records continue in the other sector,
+ *  under header with incremented sequence number. The full sector is erased
+ *  only after the first record is written to the other one, so there is
+ *  always a valid resume point. Sector with the newer header wins.
+ */
+#define DFU_METADATA_MAGIC 0x4D554644UL /**< "DFUM" */
+#define DFU_METADATA_ERASED_WORD 0xFFFFFFFFUL
 
 #define DFU_INVALID_CODE 0x00
 #define DFU_SUCCESS 0x01
@@ -49,21 +95,64 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define DFU_STATUS_IN_PROGRESS 0x00
 #define DFU_STATUS_NOT_IN_PROGRESS 0x01
 
-/**< CRC configuration */
-#define CRC_POLYNOMIAL 0x8005u
-#define CRC_INIT_VAL 0xFFFFu
+typedef struct MCU_DFU_MetadataHeader_Tag
+{
+    uint32_t magic;
+    uint32_t sequence;      /**< Incremented each time records move to the other sector */
+    uint32_t space_addr;    /**< Storage space address, differs between firmware builds */
+    uint32_t firmware_size; /**< Size of received image from DFU Init */
+    uint8_t  sha256[SHA256_SIZE];
+    uint32_t crc; /**< CRC32 of preceding fields */
+} MCU_DFU_MetadataHeader_T;
+
+typedef struct MCU_DFU_MetadataCommit_Tag
+{
+    uint32_t             offset;       /**< Received bytes committed, transfer is resumed from there */
+    uint32_t             firmware_crc; /**< CRC32 of committed received bytes */
+    uint32_t             image_size;
+    uint32_t             stored_size;
+    uint8_t              image_format;
+    uint8_t              output_len; /**< Decompressed bytes not programmed yet, less than word size */
+    uint8_t              output[sizeof(uint32_t) - 1];
+    LZSS_Decoder_T       lzss;
+    DeltaPatch_Decoder_T patch;
+    uint32_t             crc; /**< CRC32 of preceding fields */
+} MCU_DFU_MetadataCommit_T;
 
 /**< Defines string that forces update */
 #define DFU_VALIDATION_IGNORE_STRING "ignore"
 
 
-static uint8_t DfuInProgress             = 0;
-static size_t  FirmwareSize              = 0;
-static size_t  FirmwareOffset            = 0;
-static uint8_t Sha256[SHA256_SIZE]       = {0};
-static uint8_t PageBuffer[MAX_PAGE_SIZE] = {0};
-static size_t  PageOffset                = 0;
-static size_t  PageSize                  = 0;
+static uint8_t          DfuInProgress             = 0;
+static size_t           FirmwareSize              = 0;
+static size_t           FirmwareOffset            = 0;
+static uint32_t         FirmwareCrc               = ~CRC32_INIT_VAL;
+static uint8_t          Sha256[SHA256_SIZE]       = {0};
+static SHA256_Context_T Sha256Ctx;
+static size_t           PageOffset                = 0;
+static size_t           PageSize                  = 0;
+static size_t           ErasedSize                = 0;
+
+static uint8_t  PageBuffers[DFU_PAGE_BUFFERS][MAX_PAGE_SIZE] __attribute__((aligned(4))) = {{0}};
+static size_t   PendingPageSizes[DFU_PAGE_BUFFERS]                                       = {0};
+static uint32_t PendingPageCrcs[DFU_PAGE_BUFFERS] = {0}; /**< CRC of received bytes up to the end of pending page */
+static size_t   PendingPages          = 0; /**< Number of stored pages not programmed to flash yet */
+static size_t   PendingIndex          = 0; /**< Buffer index of the oldest pending page */
+static size_t   PendingPageProgrammed = 0; /**< Bytes of the oldest pending page already programmed */
+static size_t   ProgrammedSize        = 0; /**< Bytes of received image already processed */
+
+static uint8_t              ImageFormat = DFU_IMAGE_FORMAT_PLAIN;
+static size_t               ImageSize   = 0; /**< Size of firmware image stored in flash */
+static size_t               StoredSize  = 0; /**< Bytes of firmware image programmed to flash */
+static LZSS_Decoder_T       Decoder;
+static DeltaPatch_Decoder_T Patch;
+static uint8_t              OutputBuffer[DFU_OUTPUT_BUFFER_SIZE] __attribute__((aligned(4))) = {0};
+static size_t               OutputLen    = 0; /**< Decompressed bytes waiting in OutputBuffer */
+static int                  OutputStatus = FLASHER_SUCCESS;
+
+static uint32_t MetadataSector    = 0; /**< Address of metadata sector records are appended to */
+static uint32_t MetadataSequence  = 0; /**< Sequence number of header in MetadataSector */
+static uint32_t MetadataWriteAddr = 0; /**< Address of the next commit record */
 
 
 /*
@@ -72,24 +161,209 @@ static size_t  PageSize                  = 0;
 static uint8_t MCU_DFU_AppData_Validate(uint8_t *p_app_data, uint8_t app_data_len);
 
 /*
- *  Clear DFU states
+ *  Clear DFU states, including metadata stored in flash
  */
 static void MCU_DFU_ClearStates(void);
 
 /*
- *  Calculate CRC of data saved in flash and ram
+ *  Program remaining data, verify received image and update firmware with it
+ */
+static void MCU_DFU_Finish(void);
+
+/*
+ *  Restore DFU states from metadata stored in flash
+ *
+ *  @return     True if DFU in progress was restored
+ */
+static bool MCU_DFU_Resume(void);
+
+/*
+ *  Erase metadata sectors and write metadata header for current DFU
+ *
+ *  @return     Flasher return code
+ */
+static int MCU_DFU_Metadata_Start(void);
+
+/*
+ *  Erase metadata sector and write metadata header for current DFU to it
+ *
+ *  @param sector_addr  Metadata sector address
+ *  @param sequence     Header sequence number
+ *  @return             Flasher return code
+ */
+static int MCU_DFU_Metadata_WriteHeader(uint32_t sector_addr, uint32_t sequence);
+
+/*
+ *  Find the last valid commit record in metadata sector, skipping the one torn by reset
+ *
+ *  @param sector_addr      Metadata sector address
+ *  @param p_write_addr     Pointer to write address following the records
+ *  @return                 Pointer to commit record or NULL if sector holds no valid one
+ */
+static const MCU_DFU_MetadataCommit_T *MCU_DFU_Metadata_FindCommit(uint32_t sector_addr, uint32_t *p_write_addr);
+
+/*
+ *  Append commit record for data programmed so far to metadata sector
+ *
+ *  @param firmware_crc     CRC32 of received bytes up to ProgrammedSize
+ *  @return                 Flasher return code
+ */
+static int MCU_DFU_Metadata_Commit(uint32_t firmware_crc);
+
+/*
+ *  Erase all metadata sectors, if they are not erased yet
+ *
+ *  @return     Flasher return code
+ */
+static int MCU_DFU_Metadata_Erase(void);
+
+/*
+ *  Erase single metadata sector, if it is not erased yet
+ *
+ *  @param sector_addr  Metadata sector address
+ *  @return             Flasher return code
+ */
+static int MCU_DFU_Metadata_EraseSector(uint32_t sector_addr);
+
+/*
+ *  Get buffer for page being received
+ *
+ *  @return     Pointer to page buffer
+ */
+static uint8_t *MCU_DFU_GetPageBuffer(void);
+
+/*
+ *  Program part of the oldest pending page to flash
+ *
+ *  @param max_len  Maximum number of bytes to program, multiple of word size
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_ProgramPendingPage(size_t max_len);
+
+/*
+ *  Check if the first page starts with compressed image header and set up image storage
+ *
+ *  @param p_page   Pointer to the first page
+ *  @param len      Page len
+ *  @return         DFU status code
+ */
+static uint8_t MCU_DFU_ParseImageHeader(const uint8_t *p_page, size_t len);
+
+/*
+ *  Append data to firmware image in flash
+ *
+ *  @param p_data   Pointer to data, word aligned
+ *  @param len      Data len
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_StoreData(const uint8_t *p_data, size_t len);
+
+/*
+ *  Decompress part of compressed image to flash
+ *
+ *  @param p_data   Pointer to compressed data
+ *  @param len      Data len
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_DecompressData(const uint8_t *p_data, size_t len);
+
+/*
+ *  Apply part of delta patch to flash, stop before pending copy operation
+ *
+ *  @param p_data       Pointer to patch data
+ *  @param len          Data len
+ *  @param p_consumed   Pointer to number of patch bytes consumed
+ *  @return             Flasher return code
+ */
+static int MCU_DFU_PatchData(const uint8_t *p_data, size_t len, size_t *p_consumed);
+
+/*
+ *  Copy part of pending delta patch copy operation from running firmware to flash
+ *
+ *  @param max_len  Maximum number of bytes to copy
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_CopyFirmware(size_t max_len);
+
+/*
+ *  Check if any received data is waiting to be programmed to flash
+ *
+ *  @return     True if MCU_DFU_ProgramPendingPage has work to do
+ */
+static bool MCU_DFU_IsProgramPending(void);
+
+/*
+ *  Program decompressed data waiting in output buffer to flash, except
+ *  trailing bytes not filling whole word
+ *
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_FlushOutput(void);
+
+/*
+ *  LZSS and delta patch decoder callbacks, decompressed data already
+ *  programmed to flash is used as LZSS decoder window
+ */
+static bool MCU_DFU_PutOutputByte(uint8_t data);
+static bool MCU_DFU_GetOutputByte(size_t distance, uint8_t *p_data);
+
+/*
+ *  Erase next sector of storage space, not erased in current DFU yet
+ *
+ *  @return     Flasher return code
+ */
+static int MCU_DFU_EraseNextSector(void);
+
+/*
+ *  Erase storage space up to given size, if not erased yet
+ *
+ *  @param size     Size of storage space that has to be erased
+ *  @return         Flasher return code
+ */
+static int MCU_DFU_EraseUpTo(size_t size);
+
+/*
+ *  Calculate CRC of data saved in flash and ram, from CRC of stored pages and current page buffer
  */
 static uint32_t MCU_DFU_CalcCRC(void);
 
 
 void SetupDFU(void)
 {
-    MCU_DFU_ClearStates();
+    if (!MCU_DFU_Resume())
+    {
+        MCU_DFU_ClearStates();
+    }
 
     LOG_INFO("DFU space start addr: %016X", Flasher_GetSpaceAddr());
     LOG_INFO("DFU available bytes:  %d", Flasher_GetSpaceSize());
 }
 
+void LoopDFU(void)
+{
+    if (!DfuInProgress)
+    {
+        return;
+    }
+
+    int ret_val = FLASHER_SUCCESS;
+    if (MCU_DFU_IsProgramPending())
+    {
+        ret_val = MCU_DFU_ProgramPendingPage(DFU_PROGRAM_SLICE_SIZE);
+    }
+    else if (ErasedSize < ImageSize)
+    {
+        ret_val = MCU_DFU_EraseNextSector();
+    }
+
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        UART_SendDfuCancelRequest(NULL, 0);
+        MCU_DFU_ClearStates();
+        LOG_INFO("DFU Flash operation failed, canceling");
+    }
+}
+
 bool MCU_DFU_IsInProgress(void)
 {
     return (bool)DfuInProgress;
@@ -97,20 +371,38 @@ bool MCU_DFU_IsInProgress(void)
 
 void ProcessDfuInitRequest(uint8_t *p_payload, uint8_t len)
 {
-    MCU_DFU_ClearStates();
-
     size_t index = 0;
 
-    FirmwareSize = ((uint32_t)p_payload[index++]);
-    FirmwareSize |= ((uint32_t)p_payload[index++] << 8);
-    FirmwareSize |= ((uint32_t)p_payload[index++] << 16);
-    FirmwareSize |= ((uint32_t)p_payload[index++] << 24);
+    size_t firmware_size;
+    firmware_size = ((uint32_t)p_payload[index++]);
+    firmware_size |= ((uint32_t)p_payload[index++] << 8);
+    firmware_size |= ((uint32_t)p_payload[index++] << 16);
+    firmware_size |= ((uint32_t)p_payload[index++] << 24);
 
+    uint8_t sha256[SHA256_SIZE];
     for (size_t i = 0; i < SHA256_SIZE; i++)
     {
-        Sha256[SHA256_SIZE - i - 1] = p_payload[index++];
+        sha256[SHA256_SIZE - i - 1] = p_payload[index++];
+    }
+
+    if (DfuInProgress && (firmware_size == FirmwareSize) && (memcmp(sha256, Sha256, SHA256_SIZE) == 0))
+    {
+        /* The same image as in progress, continue from the last received page */
+        PageOffset = 0;
+        PageSize   = 0;
+
+        uint8_t init_status[] = {DFU_SUCCESS};
+        UART_SendDfuInitResponse(init_status, sizeof(init_status));
+
+        LOG_INFO("DFU Init, resuming at %d", FirmwareOffset);
+        return;
     }
 
+    MCU_DFU_ClearStates();
+
+    FirmwareSize = firmware_size;
+    memcpy(Sha256, sha256, SHA256_SIZE);
+
     uint8_t  app_data_len = p_payload[index++];
     uint8_t *p_app_data   = p_payload + index;
 
@@ -127,9 +419,10 @@ void ProcessDfuInitRequest(uint8_t *p_payload, uint8_t len)
     }
 
     size_t available = Flasher_GetSpaceSize();
-    if (available > FirmwareSize)
+    if ((available > FirmwareSize) && (MCU_DFU_Metadata_Start() == FLASHER_SUCCESS))
     {
-        Flasher_EraseSpace();
+        SHA256_Init(&Sha256Ctx);
+        ImageSize = FirmwareSize;
 
         uint8_t init_status[] = {DFU_SUCCESS};
         UART_SendDfuInitResponse(init_status, sizeof(init_status));
@@ -172,12 +465,15 @@ void ProcessDfuStatusRequest(uint8_t *p_payload, uint8_t len)
         (uint8_t)(crc >> 8),
         (uint8_t)(crc >> 16),
         (uint8_t)(crc >> 24),
+
+        (uint8_t)DFU_PAGE_BUFFERS,
     };
 
     UART_SendDfuStatusResponse(response, sizeof(response));
 
     LOG_INFO("DFU Status:");
     LOG_INFO("Max page: %08X", MAX_PAGE_SIZE);
+    LOG_INFO("Page buffers: %d", DFU_PAGE_BUFFERS);
     LOG_INFO("offset: %08X", offset);
     LOG_INFO("crc: %08X", crc);
 }
@@ -200,6 +496,20 @@ void ProcessDfuPageCreateRequest(uint8_t *p_payload, uint8_t len)
     req_page_size |= ((uint32_t)p_payload[index++] << 16);
     req_page_size |= ((uint32_t)p_payload[index++] << 24);
 
+    int ret_val = FLASHER_SUCCESS;
+    while ((req_page_size <= MAX_PAGE_SIZE) && (PendingPages == DFU_PAGE_BUFFERS) && (ret_val == FLASHER_SUCCESS))
+    {
+        ret_val = MCU_DFU_ProgramPendingPage(MAX_PAGE_SIZE);
+    }
+
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        uint8_t response[] = {DFU_OPERATION_FAILED};
+        UART_SendDfuPageCreateResponse(response, sizeof(response));
+        LOG_INFO("DFU Page not created, flasher fail");
+        return;
+    }
+
     if (req_page_size <= MAX_PAGE_SIZE)
     {
         PageOffset = 0;
@@ -234,7 +544,7 @@ void ProcessDfuWriteDataEvent(uint8_t *p_payload, uint8_t len)
 
     if (PageOffset + image_len <= PageSize)
     {
-        memcpy(PageBuffer + PageOffset, p_image, image_len);
+        memcpy(MCU_DFU_GetPageBuffer() + PageOffset, p_image, image_len);
         PageOffset += image_len;
     }
 }
@@ -252,6 +562,13 @@ void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
 
     if (PageOffset == 0)
     {
+        if (FirmwareOffset == FirmwareSize)
+        {
+            /* Whole image was committed before reset, only verification is left */
+            MCU_DFU_Finish();
+            return;
+        }
+
         uint8_t response[] = {DFU_SUCCESS};
         UART_SendDfuPageStoreResponse(response, sizeof(response));
         LOG_INFO("DFU Page not stored");
@@ -267,17 +584,29 @@ void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
         return;
     }
 
-    uint32_t page_store_address = Flasher_GetSpaceAddr() + FirmwareOffset;
-    uint8_t  ret_val            = Flasher_SaveMemoryToFlash(page_store_address, (uint32_t *)PageBuffer, PageSize / 4);
-    if (ret_val != FLASHER_SUCCESS)
+    /*
+     *  Page is acknowledged before it is programmed, so the next one can be
+     *  received while this one is programmed to flash from LoopDFU.
+     */
+    if (FirmwareOffset == 0)
     {
-        uint8_t response[] = {DFU_OPERATION_FAILED};
-        UART_SendDfuPageStoreResponse(response, sizeof(response));
-
-        LOG_INFO("DFU Page not stored, flasher fail");
-        return;
+        uint8_t status = MCU_DFU_ParseImageHeader(MCU_DFU_GetPageBuffer(), PageOffset);
+        if (status != DFU_SUCCESS)
+        {
+            uint8_t response[] = {status};
+            UART_SendDfuPageStoreResponse(response, sizeof(response));
+
+            LOG_INFO("DFU Invalid image header");
+            MCU_DFU_ClearStates();
+            return;
+        }
     }
 
+    FirmwareCrc = CalcCRC32(MCU_DFU_GetPageBuffer(), PageOffset, ~FirmwareCrc);
+    PendingPageSizes[(PendingIndex + PendingPages) % DFU_PAGE_BUFFERS] = PageOffset;
+    PendingPageCrcs[(PendingIndex + PendingPages) % DFU_PAGE_BUFFERS]  = FirmwareCrc;
+    PendingPages++;
+
     FirmwareOffset += PageOffset;
     PageOffset = 0;
     PageSize   = 0;
@@ -287,14 +616,56 @@ void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
         uint8_t response[] = {DFU_SUCCESS};
         UART_SendDfuPageStoreResponse(response, sizeof(response));
 
-        uint32_t crc = CalcCRC32((uint8_t *)((uintptr_t)Flasher_GetSpaceAddr()), FirmwareOffset, CRC_INIT_VAL);
-        LOG_INFO("DFU Page store success, CRC %08X", crc);
+        LOG_INFO("DFU Page store success, CRC %08X", FirmwareCrc);
+        return;
+    }
+
+    MCU_DFU_Finish();
+}
+
+void ProcessDfuStateCheckResponse(uint8_t *p_payload, uint8_t len)
+{
+    size_t  index  = 0;
+    uint8_t status = p_payload[index++];
+
+    if ((status == DFU_STATUS_IN_PROGRESS) != (DfuInProgress))
+    {
+        UART_SendDfuCancelRequest(NULL, 0);
+        LOG_INFO("DFU Canceling");
+    }
+}
+
+void ProcessDfuCancelResponse(uint8_t *p_payload, uint8_t len)
+{
+    MCU_DFU_ClearStates();
+    LOG_INFO("DFU Cancelled");
+}
+
+static void MCU_DFU_Finish(void)
+{
+    int ret_val = FLASHER_SUCCESS;
+    while (MCU_DFU_IsProgramPending() && (ret_val == FLASHER_SUCCESS))
+    {
+        ret_val = MCU_DFU_ProgramPendingPage(MAX_PAGE_SIZE);
+    }
+    if (ret_val == FLASHER_SUCCESS)
+    {
+        ret_val = MCU_DFU_FlushOutput();
+    }
+
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        uint8_t response[] = {DFU_OPERATION_FAILED};
+        UART_SendDfuPageStoreResponse(response, sizeof(response));
+
+        LOG_INFO("DFU Page not stored, flasher fail");
+        MCU_DFU_ClearStates();
         return;
     }
 
     uint8_t calculated_sha256[SHA256_SIZE];
-    CalcSHA256((uint8_t *)((uintptr_t)Flasher_GetSpaceAddr()), FirmwareOffset, calculated_sha256);
-    bool is_object_valid = (0 == memcmp(calculated_sha256, Sha256, SHA256_SIZE));
+    SHA256_Final(&Sha256Ctx, calculated_sha256);
+    bool is_object_valid = (StoredSize == ImageSize) && (0 == memcmp(calculated_sha256, Sha256, SHA256_SIZE));
 
     if (!is_object_valid)
     {
@@ -310,9 +681,9 @@ void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
     UART_SendDfuPageStoreResponse(response, sizeof(response));
 
     LOG_INFO("DFU Firmware updated");
-    DEBUG_INTERFACE.flush();
+    Log_Flush();
 
-    size_t FwSizeWords = FirmwareSize / sizeof(uint32_t);
+    size_t FwSizeWords = ImageSize / sizeof(uint32_t);
 
     MCU_DFU_ClearStates();
     Flasher_UpdateFirmware(FwSizeWords);
@@ -327,24 +698,6 @@ void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
     }
 }
 
-void ProcessDfuStateCheckResponse(uint8_t *p_payload, uint8_t len)
-{
-    size_t  index  = 0;
-    uint8_t status = p_payload[index++];
-
-    if ((status == DFU_STATUS_IN_PROGRESS) != (DfuInProgress))
-    {
-        UART_SendDfuCancelRequest(NULL, 0);
-        LOG_INFO("DFU Canceling");
-    }
-}
-
-void ProcessDfuCancelResponse(uint8_t *p_payload, uint8_t len)
-{
-    MCU_DFU_ClearStates();
-    LOG_INFO("DFU Cancelled");
-}
-
 static uint8_t MCU_DFU_AppData_Validate(uint8_t *p_app_data, uint8_t app_data_len)
 {
     LOG_INFO("Application Data length: %d", app_data_len);
@@ -390,23 +743,553 @@ static void MCU_DFU_ClearStates(void)
     DfuInProgress  = 0;
     FirmwareSize   = 0;
     FirmwareOffset = 0;
+    FirmwareCrc    = ~CRC32_INIT_VAL;
     PageOffset     = 0;
     PageSize       = 0;
+    ErasedSize     = 0;
+
+    PendingPages          = 0;
+    PendingIndex          = 0;
+    PendingPageProgrammed = 0;
+    ProgrammedSize        = 0;
+    MetadataSector        = 0;
+    MetadataSequence      = 0;
+    MetadataWriteAddr     = 0;
+
+    ImageFormat  = DFU_IMAGE_FORMAT_PLAIN;
+    ImageSize    = 0;
+    StoredSize   = 0;
+    OutputLen    = 0;
+    OutputStatus = FLASHER_SUCCESS;
+    DeltaPatch_Init(&Patch);
 
     memset(Sha256, 0, SHA256_SIZE);
-    memset(PageBuffer, 0, MAX_PAGE_SIZE);
+    memset(PageBuffers, 0, sizeof(PageBuffers));
+
+    MCU_DFU_Metadata_Erase();
 }
 
-static uint32_t MCU_DFU_CalcCRC(void)
+static bool MCU_DFU_Resume(void)
+{
+    /* Sector with the newer valid header is used, unless reset came before its first record */
+    const MCU_DFU_MetadataHeader_T *p_header = NULL;
+    const MCU_DFU_MetadataCommit_T *p_commit = NULL;
+    uint32_t                        address  = 0;
+    for (size_t i = 0; i < FLASHER_METADATA_SECTORS; i++)
+    {
+        uint32_t                        sector_addr = Flasher_GetMetadataAddr() + i * FLASHER_SECTOR_SIZE;
+        const MCU_DFU_MetadataHeader_T *p_sector    = (const MCU_DFU_MetadataHeader_T *)((uintptr_t)sector_addr);
+        if ((p_sector->magic != DFU_METADATA_MAGIC) || (p_sector->space_addr != Flasher_GetSpaceAddr()) ||
+            (p_sector->crc != CalcCRC32((uint8_t *)p_sector, offsetof(MCU_DFU_MetadataHeader_T, crc), CRC32_INIT_VAL)))
+        {
+            continue;
+        }
+        if ((p_header != NULL) && ((int32_t)(p_sector->sequence - p_header->sequence) < 0))
+        {
+            continue;
+        }
+
+        uint32_t                        write_addr;
+        const MCU_DFU_MetadataCommit_T *p_record = MCU_DFU_Metadata_FindCommit(sector_addr, &write_addr);
+        if (p_record != NULL)
+        {
+            p_header = p_sector;
+            p_commit = p_record;
+            address  = write_addr;
+        }
+    }
+
+    if ((p_commit == NULL) || (p_commit->offset > p_header->firmware_size) ||
+        (p_commit->stored_size > p_commit->image_size) || (p_commit->image_size >= Flasher_GetSpaceSize()) ||
+        (p_commit->output_len >= sizeof(uint32_t)))
+    {
+        return false;
+    }
+
+    FirmwareSize   = p_header->firmware_size;
+    FirmwareOffset = p_commit->offset;
+    FirmwareCrc    = p_commit->firmware_crc;
+    ProgrammedSize = p_commit->offset;
+    memcpy(Sha256, p_header->sha256, SHA256_SIZE);
+
+    ImageFormat = p_commit->image_format;
+    ImageSize   = p_commit->image_size;
+    StoredSize  = p_commit->stored_size;
+    OutputLen   = p_commit->output_len;
+    Decoder     = p_commit->lzss;
+    Patch       = p_commit->patch;
+    memcpy(OutputBuffer, p_commit->output, OutputLen);
+
+    MetadataSector    = (uint32_t)((uintptr_t)p_header);
+    MetadataSequence  = p_header->sequence;
+    MetadataWriteAddr = address;
+
+    /*
+     *  Sector holding the end of committed data may contain data programmed
+     *  after the commit, rewrite its committed part.
+     */
+    size_t sector_offset = StoredSize % FLASHER_SECTOR_SIZE;
+    ErasedSize           = StoredSize - sector_offset;
+    if (sector_offset != 0)
+    {
+        uint32_t sector_address = Flasher_GetSpaceAddr() + ErasedSize;
+        memcpy(PageBuffers[0], (const uint8_t *)((uintptr_t)sector_address), sector_offset);
+
+        if (MCU_DFU_EraseNextSector() != FLASHER_SUCCESS)
+        {
+            return false;
+        }
+        if (Flasher_SaveMemoryToFlash(sector_address, (uint32_t *)PageBuffers[0], sector_offset / 4) != FLASHER_SUCCESS)
+        {
+            return false;
+        }
+    }
+
+    SHA256_Init(&Sha256Ctx);
+    SHA256_Update(&Sha256Ctx, (uint8_t *)((uintptr_t)Flasher_GetSpaceAddr()), StoredSize);
+
+    DfuInProgress = 1;
+
+    LOG_INFO("DFU Resumed at %d, stored %d", FirmwareOffset, StoredSize);
+    return true;
+}
+
+static int MCU_DFU_Metadata_Start(void)
+{
+    int ret_val = MCU_DFU_Metadata_Erase();
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    return MCU_DFU_Metadata_WriteHeader(Flasher_GetMetadataAddr(), 0);
+}
+
+static int MCU_DFU_Metadata_WriteHeader(uint32_t sector_addr, uint32_t sequence)
+{
+    int ret_val = MCU_DFU_Metadata_EraseSector(sector_addr);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    MCU_DFU_MetadataHeader_T header;
+    memset(&header, 0, sizeof(header));
+    header.magic         = DFU_METADATA_MAGIC;
+    header.sequence      = sequence;
+    header.space_addr    = Flasher_GetSpaceAddr();
+    header.firmware_size = FirmwareSize;
+    memcpy(header.sha256, Sha256, SHA256_SIZE);
+    header.crc = CalcCRC32((uint8_t *)&header, offsetof(MCU_DFU_MetadataHeader_T, crc), CRC32_INIT_VAL);
+
+    ret_val = Flasher_SaveMemoryToFlash(sector_addr, (uint32_t *)&header, sizeof(header) / 4);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    MetadataSector    = sector_addr;
+    MetadataSequence  = sequence;
+    MetadataWriteAddr = sector_addr + sizeof(header);
+    return FLASHER_SUCCESS;
+}
+
+static const MCU_DFU_MetadataCommit_T *MCU_DFU_Metadata_FindCommit(uint32_t sector_addr, uint32_t *p_write_addr)
+{
+    uint32_t                        sector_end = sector_addr + FLASHER_SECTOR_SIZE;
+    uint32_t                        address    = sector_addr + sizeof(MCU_DFU_MetadataHeader_T);
+    const MCU_DFU_MetadataCommit_T *p_commit   = NULL;
+    while (address + sizeof(MCU_DFU_MetadataCommit_T) <= sector_end)
+    {
+        const MCU_DFU_MetadataCommit_T *p_record = (const MCU_DFU_MetadataCommit_T *)((uintptr_t)address);
+        if (p_record->offset == DFU_METADATA_ERASED_WORD)
+        {
+            break;
+        }
+        if (p_record->crc == CalcCRC32((uint8_t *)p_record, offsetof(MCU_DFU_MetadataCommit_T, crc), CRC32_INIT_VAL))
+        {
+            p_commit = p_record;
+        }
+        address += sizeof(MCU_DFU_MetadataCommit_T);
+    }
+
+    *p_write_addr = address;
+    return p_commit;
+}
+
+static int MCU_DFU_Metadata_Commit(uint32_t firmware_crc)
+{
+    int ret_val = MCU_DFU_FlushOutput();
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    uint32_t full_sector = 0;
+    if (MetadataWriteAddr + sizeof(MCU_DFU_MetadataCommit_T) > MetadataSector + FLASHER_SECTOR_SIZE)
+    {
+        full_sector = MetadataSector;
+
+        uint32_t next_sector = MetadataSector + FLASHER_SECTOR_SIZE;
+        if (next_sector == Flasher_GetMetadataAddr() + FLASHER_METADATA_SECTORS * FLASHER_SECTOR_SIZE)
+        {
+            next_sector = Flasher_GetMetadataAddr();
+        }
+
+        ret_val = MCU_DFU_Metadata_WriteHeader(next_sector, MetadataSequence + 1);
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            return ret_val;
+        }
+    }
+
+    MCU_DFU_MetadataCommit_T commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.offset       = ProgrammedSize;
+    commit.firmware_crc = firmware_crc;
+    commit.image_size   = ImageSize;
+    commit.stored_size  = StoredSize;
+    commit.image_format = ImageFormat;
+    commit.output_len   = OutputLen;
+    commit.lzss         = Decoder;
+    commit.patch        = Patch;
+    memcpy(commit.output, OutputBuffer, OutputLen);
+    commit.crc = CalcCRC32((uint8_t *)&commit, offsetof(MCU_DFU_MetadataCommit_T, crc), CRC32_INIT_VAL);
+
+    ret_val = Flasher_SaveMemoryToFlash(MetadataWriteAddr, (uint32_t *)&commit, sizeof(commit) / 4);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    MetadataWriteAddr += sizeof(commit);
+
+    /* Full sector is no longer needed, the other one holds newer header and record */
+    if (full_sector != 0)
+    {
+        return MCU_DFU_Metadata_EraseSector(full_sector);
+    }
+    return FLASHER_SUCCESS;
+}
+
+static int MCU_DFU_Metadata_Erase(void)
+{
+    for (size_t i = 0; i < FLASHER_METADATA_SECTORS; i++)
+    {
+        int ret_val = MCU_DFU_Metadata_EraseSector(Flasher_GetMetadataAddr() + i * FLASHER_SECTOR_SIZE);
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            return ret_val;
+        }
+    }
+
+    return FLASHER_SUCCESS;
+}
+
+static int MCU_DFU_Metadata_EraseSector(uint32_t sector_addr)
+{
+    /* Whole sector is checked, erase interrupted by reset may leave the first word erased only */
+    const uint32_t *p_metadata = (const uint32_t *)((uintptr_t)sector_addr);
+    for (size_t i = 0; i < FLASHER_SECTOR_SIZE / sizeof(uint32_t); i++)
+    {
+        if (p_metadata[i] != DFU_METADATA_ERASED_WORD)
+        {
+            return Flasher_EraseSpaceSector(sector_addr);
+        }
+    }
+
+    return FLASHER_SUCCESS;
+}
+
+static uint8_t *MCU_DFU_GetPageBuffer(void)
+{
+    return PageBuffers[(PendingIndex + PendingPages) % DFU_PAGE_BUFFERS];
+}
+
+static int MCU_DFU_ProgramPendingPage(size_t max_len)
+{
+    if (Patch.copy_left != 0)
+    {
+        return MCU_DFU_CopyFirmware(max_len);
+    }
+
+    if (PendingPages == 0)
+    {
+        return FLASHER_SUCCESS;
+    }
+
+    size_t len = PendingPageSizes[PendingIndex] - PendingPageProgrammed;
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+
+    const uint8_t *p_data  = PageBuffers[PendingIndex] + PendingPageProgrammed;
+    int            ret_val = FLASHER_SUCCESS;
+    switch (ImageFormat)
+    {
+        case DFU_IMAGE_FORMAT_LZSS:
+        {
+            ret_val = MCU_DFU_DecompressData(p_data, len);
+            break;
+        }
+        case DFU_IMAGE_FORMAT_DELTA:
+        {
+            ret_val = MCU_DFU_PatchData(p_data, len, &len);
+            break;
+        }
+        default:
+        {
+            ret_val = MCU_DFU_StoreData(p_data, len);
+            break;
+        }
+    }
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    ProgrammedSize += len;
+    PendingPageProgrammed += len;
+
+    if (PendingPageProgrammed == PendingPageSizes[PendingIndex])
+    {
+        uint32_t firmware_crc = PendingPageCrcs[PendingIndex];
+
+        PendingPages--;
+        PendingIndex          = (PendingIndex + 1) % DFU_PAGE_BUFFERS;
+        PendingPageProgrammed = 0;
+
+        return MCU_DFU_Metadata_Commit(firmware_crc);
+    }
+
+    return FLASHER_SUCCESS;
+}
+
+static uint8_t MCU_DFU_ParseImageHeader(const uint8_t *p_page, size_t len)
+{
+    if (len < DFU_IMAGE_HEADER_SIZE)
+    {
+        return DFU_SUCCESS;
+    }
+
+    size_t   index = 0;
+    uint32_t magic;
+    magic = ((uint32_t)p_page[index++]);
+    magic |= ((uint32_t)p_page[index++] << 8);
+    magic |= ((uint32_t)p_page[index++] << 16);
+    magic |= ((uint32_t)p_page[index++] << 24);
+
+    if (magic != DFU_IMAGE_MAGIC)
+    {
+        return DFU_SUCCESS;
+    }
+
+    uint8_t format = p_page[index];
+    index += 4;
+
+    uint32_t image_size;
+    image_size = ((uint32_t)p_page[index++]);
+    image_size |= ((uint32_t)p_page[index++] << 8);
+    image_size |= ((uint32_t)p_page[index++] << 16);
+    image_size |= ((uint32_t)p_page[index++] << 24);
+
+    LOG_INFO("DFU Image container, format %d, size %d", format, image_size);
+
+    if ((format != DFU_IMAGE_FORMAT_LZSS) && (format != DFU_IMAGE_FORMAT_DELTA))
+    {
+        return DFU_UNSUPPORTED_TYPE;
+    }
+
+    if ((image_size % sizeof(uint32_t) != 0) || (image_size >= Flasher_GetSpaceSize()))
+    {
+        return DFU_INSUFFICIENT_RESOURCES;
+    }
+
+    LZSS_Init(&Decoder);
+    DeltaPatch_Init(&Patch);
+    ImageFormat = format;
+    ImageSize   = image_size;
+
+    /* Header is not stored, first page is queued with header already processed */
+    PendingPageProgrammed = DFU_IMAGE_HEADER_SIZE;
+    ProgrammedSize        = DFU_IMAGE_HEADER_SIZE;
+
+    return DFU_SUCCESS;
+}
+
+static int MCU_DFU_StoreData(const uint8_t *p_data, size_t len)
+{
+    int ret_val = MCU_DFU_EraseUpTo(StoredSize + len);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    uint32_t address = Flasher_GetSpaceAddr() + StoredSize;
+    ret_val = Flasher_SaveMemoryToFlash(address, (const uint32_t *)p_data, len / 4);
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        return ret_val;
+    }
+
+    SHA256_Update(&Sha256Ctx, (uint8_t *)((uintptr_t)address), len);
+    StoredSize += len;
+
+    return FLASHER_SUCCESS;
+}
+
+static int MCU_DFU_DecompressData(const uint8_t *p_data, size_t len)
+{
+    OutputStatus = FLASHER_SUCCESS;
+    if (LZSS_Decode(&Decoder, p_data, len, MCU_DFU_PutOutputByte, MCU_DFU_GetOutputByte))
+    {
+        return FLASHER_SUCCESS;
+    }
+
+    LOG_INFO("DFU Decompression failed at %d", StoredSize + OutputLen);
+    return (OutputStatus != FLASHER_SUCCESS) ? OutputStatus : FLASHER_ERROR_RANGE;
+}
+
+static int MCU_DFU_PatchData(const uint8_t *p_data, size_t len, size_t *p_consumed)
+{
+    OutputStatus = FLASHER_SUCCESS;
+    if (DeltaPatch_Decode(&Patch, p_data, len, p_consumed, MCU_DFU_PutOutputByte))
+    {
+        return FLASHER_SUCCESS;
+    }
+
+    LOG_INFO("DFU Patch failed at %d", StoredSize + OutputLen);
+    return (OutputStatus != FLASHER_SUCCESS) ? OutputStatus : FLASHER_ERROR_RANGE;
+}
+
+static int MCU_DFU_CopyFirmware(size_t max_len)
+{
+    size_t firmware_size = Flasher_GetSpaceAddr() - Flasher_GetFirmwareAddr();
+    if ((Patch.copy_offset > firmware_size) || (Patch.copy_left > firmware_size - Patch.copy_offset))
+    {
+        LOG_INFO("DFU Patch copy out of firmware, offset %d", Patch.copy_offset);
+        return FLASHER_ERROR_RANGE;
+    }
+
+    size_t len = Patch.copy_left;
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+
+    const uint8_t *p_src = (const uint8_t *)((uintptr_t)(Flasher_GetFirmwareAddr() + Patch.copy_offset));
+
+    OutputStatus = FLASHER_SUCCESS;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!MCU_DFU_PutOutputByte(p_src[i]))
+        {
+            return (OutputStatus != FLASHER_SUCCESS) ? OutputStatus : FLASHER_ERROR_RANGE;
+        }
+    }
+
+    Patch.copy_offset += len;
+    Patch.copy_left -= len;
+
+    return FLASHER_SUCCESS;
+}
+
+static bool MCU_DFU_IsProgramPending(void)
+{
+    return (PendingPages != 0) || (Patch.copy_left != 0);
+}
+
+static int MCU_DFU_FlushOutput(void)
+{
+    if (OutputLen < sizeof(uint32_t))
+    {
+        return FLASHER_SUCCESS;
+    }
+
+    size_t len     = OutputLen - OutputLen % sizeof(uint32_t);
+    int    ret_val = MCU_DFU_StoreData(OutputBuffer, len);
+    if (ret_val == FLASHER_SUCCESS)
+    {
+        memmove(OutputBuffer, OutputBuffer + len, OutputLen - len);
+        OutputLen -= len;
+    }
+    return ret_val;
+}
+
+static bool MCU_DFU_PutOutputByte(uint8_t data)
+{
+    if (StoredSize + OutputLen >= ImageSize)
+    {
+        return false;
+    }
+
+    OutputBuffer[OutputLen++] = data;
+    if (OutputLen == DFU_OUTPUT_BUFFER_SIZE)
+    {
+        OutputStatus = MCU_DFU_FlushOutput();
+        return OutputStatus == FLASHER_SUCCESS;
+    }
+    return true;
+}
+
+static bool MCU_DFU_GetOutputByte(size_t distance, uint8_t *p_data)
+{
+    if (distance <= OutputLen)
+    {
+        *p_data = OutputBuffer[OutputLen - distance];
+        return true;
+    }
+
+    distance -= OutputLen;
+    if (distance > StoredSize)
+    {
+        return false;
+    }
+
+    *p_data = *(const uint8_t *)((uintptr_t)(Flasher_GetSpaceAddr() + StoredSize - distance));
+    return true;
+}
+
+static int MCU_DFU_EraseNextSector(void)
+{
+    uint32_t sector_address = Flasher_GetSpaceAddr() + ErasedSize;
+    uint32_t start_time     = micros();
+    int      ret_val        = Flasher_EraseSpaceSector(sector_address);
+    uint32_t erase_time     = micros() - start_time;
+
+    if (ret_val != FLASHER_SUCCESS)
+    {
+        LOG_INFO("DFU Sector %08X erase error %d", sector_address, ret_val);
+        return ret_val;
+    }
+
+    ErasedSize += FLASHER_SECTOR_SIZE;
+
+    LOG_INFO("DFU Sector %08X erased in %d us", sector_address, erase_time);
+    return FLASHER_SUCCESS;
+}
+
+static int MCU_DFU_EraseUpTo(size_t size)
 {
-    uint32_t crc = ~CRC32_INIT_VAL;
-    if (FirmwareOffset != 0)
+    while (ErasedSize < size)
     {
-        crc = CalcCRC32((uint8_t *)((uintptr_t)Flasher_GetSpaceAddr()), FirmwareOffset, ~crc);
+        int ret_val = MCU_DFU_EraseNextSector();
+        if (ret_val != FLASHER_SUCCESS)
+        {
+            return ret_val;
+        }
     }
+
+    return FLASHER_SUCCESS;
+}
+
+static uint32_t MCU_DFU_CalcCRC(void)
+{
+    uint32_t crc = FirmwareCrc;
     if (PageOffset != 0)
     {
-        crc = CalcCRC32(PageBuffer, PageOffset, ~crc);
+        crc = CalcCRC32(MCU_DFU_GetPageBuffer(), PageOffset, ~crc);
     }
     return crc;
 }
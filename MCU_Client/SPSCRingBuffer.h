@@ -0,0 +1,262 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "RingBuffer.h"
+
+/*
+ *  Single-producer/single-consumer ring buffer with compile time capacity.
+ *
+ *  Capacity has to be a power of two. Write and read counters are free-running
+ *  and wrap only at uint32_t overflow, so whole capacity is usable and buffer
+ *  position is obtained with a mask. Only producer modifies wr and only
+ *  consumer modifies rd, with memory barriers ordering data accesses against
+ *  counter updates, so producer and consumer may run in different contexts
+ *  (main loop and interrupt) without locking.
+ */
+
+#ifdef CMAKE_UNIT_TEST
+#define SPSC_MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define SPSC_MEMORY_BARRIER() __asm volatile("dmb" ::: "memory")
+#endif
+
+template <uint32_t CAPACITY>
+struct SPSCRingBuffer_T
+{
+    static_assert((CAPACITY != 0) && ((CAPACITY & (CAPACITY - 1)) == 0), "Capacity has to be a power of two");
+
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    uint8_t *         p_buf;
+    volatile uint32_t wr;
+    volatile uint32_t rd;
+};
+
+/*
+ *  Initialize ring buffer.
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param p_buf          Pointer to buffer of CAPACITY bytes
+ */
+template <uint32_t CAPACITY>
+inline void SPSCRingBuffer_Init(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint8_t *p_buf)
+{
+    p_ring_buffer->p_buf = p_buf;
+    p_ring_buffer->wr    = 0;
+    p_ring_buffer->rd    = 0;
+}
+
+/*
+ *  Get length of queued data.
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @return               Length of data
+ */
+template <uint32_t CAPACITY>
+inline uint32_t SPSCRingBuffer_DataLen(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer)
+{
+    return p_ring_buffer->wr - p_ring_buffer->rd;
+}
+
+/*
+ *  Get length of free space.
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @return               Length of free space
+ */
+template <uint32_t CAPACITY>
+inline uint32_t SPSCRingBuffer_FreeLen(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer)
+{
+    return CAPACITY - SPSCRingBuffer_DataLen(p_ring_buffer);
+}
+
+/*
+ *  Get information if any bytes are present in the ring buffer.
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @return               True if it's empty, false otherwise
+ */
+template <uint32_t CAPACITY>
+inline bool SPSCRingBuffer_IsEmpty(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer)
+{
+    return p_ring_buffer->wr == p_ring_buffer->rd;
+}
+
+/*
+ *  Reserve space for len bytes without queuing them (producer side). Reserved
+ *  space is returned as two continuous segments, second one is empty if there
+ *  is no wraparound. Data is queued by SPSCRingBuffer_Commit.
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param len            Number of bytes to reserve
+ *  @param p_span         output, reserved segments
+ *  @return               True if success, false if there is not enough free space
+ */
+template <uint32_t CAPACITY>
+inline bool SPSCRingBuffer_Reserve(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint16_t len, RingBuffer_Span_T *p_span)
+{
+    if (len > SPSCRingBuffer_FreeLen(p_ring_buffer))
+    {
+        return false;
+    }
+
+    uint32_t wr_pos = p_ring_buffer->wr & SPSCRingBuffer_T<CAPACITY>::MASK;
+    uint32_t to_end = CAPACITY - wr_pos;
+
+    p_span->p_first    = &p_ring_buffer->p_buf[wr_pos];
+    p_span->first_len  = (len < to_end) ? len : to_end;
+    p_span->p_second   = p_ring_buffer->p_buf;
+    p_span->second_len = len - p_span->first_len;
+
+    return true;
+}
+
+/*
+ *  Queue len bytes written into reserved space, or written into buffer by DMA
+ *  (producer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param len            Number of bytes to queue
+ */
+template <uint32_t CAPACITY>
+inline void SPSCRingBuffer_Commit(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint32_t len)
+{
+    SPSC_MEMORY_BARRIER();
+    p_ring_buffer->wr = p_ring_buffer->wr + len;
+}
+
+/*
+ *  Write bytes from table to ring buffer (producer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param table          Pointer to table with bytes to be queued
+ *  @param table_len      Length of table
+ *  @return               True if success, false if table does not fit (nothing is queued)
+ */
+template <uint32_t CAPACITY>
+inline bool SPSCRingBuffer_QueueBytes(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, const uint8_t *table, uint16_t table_len)
+{
+    RingBuffer_Span_T span;
+
+    if (!SPSCRingBuffer_Reserve(p_ring_buffer, table_len, &span))
+    {
+        return false;
+    }
+
+    memcpy(span.p_first, table, span.first_len);
+    memcpy(span.p_second, table + span.first_len, span.second_len);
+    SPSCRingBuffer_Commit(p_ring_buffer, table_len);
+
+    return true;
+}
+
+/*
+ *  Get pointer to first queued byte and length of continuous data following
+ *  it, without dequeuing (consumer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param len            output, length of continuous data
+ *  @return               Pointer to first queued byte
+ */
+template <uint32_t CAPACITY>
+inline uint8_t *SPSCRingBuffer_Peek(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint16_t *len)
+{
+    uint32_t data_len = SPSCRingBuffer_DataLen(p_ring_buffer);
+    uint32_t rd_pos   = p_ring_buffer->rd & SPSCRingBuffer_T<CAPACITY>::MASK;
+    uint32_t to_end   = CAPACITY - rd_pos;
+
+    SPSC_MEMORY_BARRIER();
+    *len = (data_len < to_end) ? data_len : to_end;
+
+    return &p_ring_buffer->p_buf[rd_pos];
+}
+
+/*
+ *  Dequeue len bytes without copying them (consumer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param len            Number of bytes to dequeue, not greater than queued
+ */
+template <uint32_t CAPACITY>
+inline void SPSCRingBuffer_Skip(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint32_t len)
+{
+    SPSC_MEMORY_BARRIER();
+    p_ring_buffer->rd = p_ring_buffer->rd + len;
+}
+
+/*
+ *  Dequeue up to len bytes into table (consumer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param table          Pointer to table for dequeued bytes
+ *  @param len            Size of table
+ *  @return               Number of dequeued bytes
+ */
+template <uint32_t CAPACITY>
+inline uint16_t SPSCRingBuffer_DequeueBytes(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint8_t *table, uint16_t len)
+{
+    uint16_t dequeued = 0;
+
+    while (dequeued < len)
+    {
+        uint16_t cont_len;
+        uint8_t *p_data = SPSCRingBuffer_Peek(p_ring_buffer, &cont_len);
+
+        if (cont_len == 0)
+        {
+            break;
+        }
+
+        if (cont_len > len - dequeued)
+        {
+            cont_len = len - dequeued;
+        }
+
+        memcpy(table + dequeued, p_data, cont_len);
+        SPSCRingBuffer_Skip(p_ring_buffer, cont_len);
+        dequeued += cont_len;
+    }
+
+    return dequeued;
+}
+
+/*
+ *  Dequeue single byte (consumer side).
+ *
+ *  @param p_ring_buffer  Pointer to ring buffer instance
+ *  @param read_byte      output, dequeued byte
+ *  @return               True if success, false if empty
+ */
+template <uint32_t CAPACITY>
+inline bool SPSCRingBuffer_DequeueByte(SPSCRingBuffer_T<CAPACITY> *p_ring_buffer, uint8_t *read_byte)
+{
+    return SPSCRingBuffer_DequeueBytes(p_ring_buffer, read_byte, 1) == 1;
+}
+
+#endif    //SPSCRINGBUFFER_H
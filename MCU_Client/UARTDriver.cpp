@@ -19,12 +19,14 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTI
 WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#ifndef CMAKE_UNIT_TEST
+
 #include "UARTDriver.h"
 
 #include <DMAChannel.h>
 
 #include "Config.h"
-#include "RingBuffer.h"
+#include "SPSCRingBuffer.h"
 #include "kinetis.h"
 
 #define RX_BUFFER_LEN 512
@@ -41,8 +43,8 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 static DMAChannel rx_dma;
 static DMAChannel tx_dma;
 
-static RingBuffer_T rx_dma_buffer;
-static RingBuffer_T tx_dma_buffer;
+static SPSCRingBuffer_T<RX_BUFFER_LEN> rx_dma_buffer;
+static SPSCRingBuffer_T<TX_BUFFER_LEN> tx_dma_buffer;
 
 /*
  *  According to http://cache.freescale.com/files/microcontrollers/doc/ref_manual/KL26P121M48SF4RM.pdf
@@ -53,10 +55,15 @@ static __attribute__((section(".dmabuffers"), aligned(RX_BUFFER_LEN))) uint8_t r
 
 static uint16_t cur_tx_message_len = 0;
 
+static volatile uint32_t rx_dma_laps = 0;
+
+static UARTDriver_Stats_T stats;
+
 static void DMA_TransmitRequest();
 static void DMA_OnTXCompletion();
 static void DMA_OnRXCompletion();
 static bool IsTXActive();
+static void UpdateTxPeakLen();
 
 void UARTDriver_Init()
 {
@@ -73,7 +80,7 @@ void UARTDriver_Init()
     CORE_PIN10_CONFIG = PORT_PCR_DSE | PORT_PCR_SRE | PORT_PCR_MUX(3);
 
     // TX DMA configuration
-    RingBuffer_Init(&tx_dma_buffer, tx_buf, TX_BUFFER_LEN);
+    SPSCRingBuffer_Init(&tx_dma_buffer, tx_buf);
     tx_dma.destination(UART1_D);
     tx_dma.interruptAtCompletion();
     tx_dma.disableOnCompletion();
@@ -81,7 +88,7 @@ void UARTDriver_Init()
     tx_dma.triggerAtHardwareEvent(DMAMUX_SOURCE_UART1_TX);
 
     // RX DMA configuration
-    RingBuffer_Init(&rx_dma_buffer, rx_buf, RX_BUFFER_LEN);
+    SPSCRingBuffer_Init(&rx_dma_buffer, rx_buf);
     rx_dma.source(UART1_D);
     rx_dma.destinationCircular(rx_buf, RX_BUFFER_LEN);
     rx_dma.disableOnCompletion();
@@ -100,15 +107,28 @@ void UARTDriver_Init()
 
 bool UARTDriver_WriteBytes(uint8_t *table, uint16_t table_len)
 {
-    if (!RingBuffer_QueueBytes(&tx_dma_buffer, table, table_len))
+    if (!SPSCRingBuffer_QueueBytes(&tx_dma_buffer, table, table_len))
     {
         return false;
     }
 
+    UpdateTxPeakLen();
     DMA_TransmitRequest();
     return true;
 }
 
+bool UARTDriver_ReserveTx(uint16_t len, RingBuffer_Span_T *p_span)
+{
+    return SPSCRingBuffer_Reserve(&tx_dma_buffer, len, p_span);
+}
+
+void UARTDriver_CommitTx(uint16_t len)
+{
+    SPSCRingBuffer_Commit(&tx_dma_buffer, len);
+    UpdateTxPeakLen();
+    DMA_TransmitRequest();
+}
+
 void DMA_TransmitRequest()
 {
     __disable_irq();
@@ -118,7 +138,7 @@ void DMA_TransmitRequest()
         return;
     }
 
-    uint8_t *tx_begin_pointer = RingBuffer_GetMaxContinuousBuffer(&tx_dma_buffer, &cur_tx_message_len);
+    uint8_t *tx_begin_pointer = SPSCRingBuffer_Peek(&tx_dma_buffer, &cur_tx_message_len);
     if (cur_tx_message_len == 0)
     {
         __enable_irq();
@@ -133,14 +153,52 @@ void DMA_TransmitRequest()
 
 bool UARTDriver_ReadByte(uint8_t *read_byte)
 {
-    return RingBuffer_DequeueByte(&rx_dma_buffer, read_byte);
+    return SPSCRingBuffer_DequeueByte(&rx_dma_buffer, read_byte);
 }
 
-void UARTDriver_RxDMAPoll()
+uint8_t *UARTDriver_GetRxBuffer(uint16_t *len)
 {
+    return SPSCRingBuffer_Peek(&rx_dma_buffer, len);
+}
+
+void UARTDriver_ReleaseRxBytes(uint16_t len)
+{
+    SPSCRingBuffer_Skip(&rx_dma_buffer, len);
+}
+
+bool UARTDriver_RxDMAPoll()
+{
+    /*
+     *  Total number of received bytes is the number of completed DMA laps plus
+     *  position in the current one. Both are read with interrupts disabled, so
+     *  completion ISR cannot increment laps in between. Until ISR reloads the
+     *  counter, position of the finished lap reads as full RX_BUFFER_LEN.
+     */
     __disable_irq();
-    RingBuffer_SetWrIndex(&rx_dma_buffer, COUNTER_SIZE - DMA_DSR_BCR_BCR(DMA_DSR_BCR0));
+    uint32_t rx_total = rx_dma_laps * RX_BUFFER_LEN + (COUNTER_SIZE - DMA_DSR_BCR_BCR(DMA_DSR_BCR0));
     __enable_irq();
+
+    SPSCRingBuffer_Commit(&rx_dma_buffer, rx_total - rx_dma_buffer.wr);
+
+    uint32_t rx_len = SPSCRingBuffer_DataLen(&rx_dma_buffer);
+    if (rx_len > RX_BUFFER_LEN)
+    {
+        stats.rx_overruns++;
+        SPSCRingBuffer_Skip(&rx_dma_buffer, rx_len);
+        return false;
+    }
+
+    if (rx_len > stats.rx_peak_len)
+    {
+        stats.rx_peak_len = rx_len;
+    }
+
+    return true;
+}
+
+const UARTDriver_Stats_T *UARTDriver_GetStats(void)
+{
+    return &stats;
 }
 
 static bool IsTXActive()
@@ -148,13 +206,23 @@ static bool IsTXActive()
     return (UART1_C2 & C2_TX_ACTIVE);
 }
 
+static void UpdateTxPeakLen()
+{
+    uint32_t tx_len = SPSCRingBuffer_DataLen(&tx_dma_buffer);
+
+    if (tx_len > stats.tx_peak_len)
+    {
+        stats.tx_peak_len = tx_len;
+    }
+}
+
 static void DMA_OnTXCompletion()
 {
     tx_dma.clearInterrupt();
     UART1_C2 &= C2_TX_INACTIVE;
-    RingBuffer_IncrementRdIndex(&tx_dma_buffer, cur_tx_message_len);
+    SPSCRingBuffer_Skip(&tx_dma_buffer, cur_tx_message_len);
 
-    if (!RingBuffer_isEmpty(&tx_dma_buffer))
+    if (!SPSCRingBuffer_IsEmpty(&tx_dma_buffer))
     {
         DMA_TransmitRequest();
     }
@@ -164,6 +232,7 @@ static void DMA_OnRXCompletion()
 {
     rx_dma.clearInterrupt();
     rx_dma.transferCount(COUNTER_SIZE);
+    rx_dma_laps++;
 
     if ((UART1_S1 & UART_S1_OR) != 0)
     {
@@ -172,3 +241,5 @@ static void DMA_OnRXCompletion()
 
     rx_dma.enable();
 }
+
+#endif    // CMAKE_UNIT_TEST
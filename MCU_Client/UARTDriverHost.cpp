@@ -0,0 +1,303 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifdef CMAKE_UNIT_TEST
+
+#include "UARTDriverHost.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Config.h"
+#include "SPSCRingBuffer.h"
+#include "UARTDriver.h"
+
+#define RX_BUFFER_LEN 512
+#define TX_BUFFER_LEN 512
+
+#define BITS_PER_BYTE 10
+#define US_PER_SECOND 1000000ull
+
+static SPSCRingBuffer_T<RX_BUFFER_LEN> rx_buffer;
+static SPSCRingBuffer_T<TX_BUFFER_LEN> tx_buffer;
+
+static uint8_t rx_buf[RX_BUFFER_LEN];
+static uint8_t tx_buf[TX_BUFFER_LEN];
+
+static int      uart_fd       = -1;
+static uint32_t baud_rate     = UART_INTERFACE_BAUDRATE;
+static uint32_t max_jitter_us = 0;
+
+static uint64_t rx_next_us = 0;    /**< Time when next byte may be received */
+static uint64_t tx_next_us = 0;    /**< Time when next byte may be sent */
+static uint32_t rx_total   = 0;    /**< Total bytes written to rx_buf, like DMA does */
+static bool     rx_busy    = false; /**< More received bytes were pending at last poll */
+static bool     tx_busy    = false; /**< More bytes to send were pending at last poll */
+
+static UARTDriver_Stats_T stats;
+
+static uint64_t GetTimeUs(void);
+static uint32_t GetAllowedBytes(uint64_t *p_next_us, uint64_t now_us, uint32_t max_len, bool line_busy);
+static void     ConsumeTime(uint64_t *p_next_us, uint64_t now_us, uint32_t len);
+static void     PollRx(uint64_t now_us);
+static void     PollTx(uint64_t now_us);
+
+void UARTDriver_Init(void)
+{
+    SPSCRingBuffer_Init(&rx_buffer, rx_buf);
+    SPSCRingBuffer_Init(&tx_buffer, tx_buf);
+
+    rx_next_us = 0;
+    tx_next_us = 0;
+    rx_total   = 0;
+    rx_busy    = false;
+    tx_busy    = false;
+}
+
+bool UARTDriverHost_OpenPty(char *p_name, size_t name_len)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct termios tio;
+    if ((grantpt(fd) != 0) || (unlockpt(fd) != 0) || (ptsname_r(fd, p_name, name_len) != 0) ||
+        (tcgetattr(fd, &tio) != 0))
+    {
+        close(fd);
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+
+    UARTDriverHost_SetFd(fd);
+    return true;
+}
+
+void UARTDriverHost_SetFd(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    uart_fd = fd;
+}
+
+void UARTDriverHost_SetBaudRate(uint32_t baud)
+{
+    baud_rate = baud;
+}
+
+void UARTDriverHost_SetJitter(uint32_t jitter_us)
+{
+    max_jitter_us = jitter_us;
+}
+
+void UARTDriverHost_Poll(void)
+{
+    uint64_t now_us = GetTimeUs();
+
+    PollRx(now_us);
+    PollTx(now_us);
+}
+
+bool UARTDriver_WriteBytes(uint8_t *table, uint16_t len)
+{
+    if (!SPSCRingBuffer_QueueBytes(&tx_buffer, table, len))
+    {
+        return false;
+    }
+
+    if (SPSCRingBuffer_DataLen(&tx_buffer) > stats.tx_peak_len)
+    {
+        stats.tx_peak_len = SPSCRingBuffer_DataLen(&tx_buffer);
+    }
+
+    UARTDriverHost_Poll();
+    return true;
+}
+
+bool UARTDriver_ReserveTx(uint16_t len, RingBuffer_Span_T *p_span)
+{
+    return SPSCRingBuffer_Reserve(&tx_buffer, len, p_span);
+}
+
+void UARTDriver_CommitTx(uint16_t len)
+{
+    SPSCRingBuffer_Commit(&tx_buffer, len);
+
+    if (SPSCRingBuffer_DataLen(&tx_buffer) > stats.tx_peak_len)
+    {
+        stats.tx_peak_len = SPSCRingBuffer_DataLen(&tx_buffer);
+    }
+
+    UARTDriverHost_Poll();
+}
+
+bool UARTDriver_ReadByte(uint8_t *read_byte)
+{
+    return SPSCRingBuffer_DequeueByte(&rx_buffer, read_byte);
+}
+
+uint8_t *UARTDriver_GetRxBuffer(uint16_t *len)
+{
+    return SPSCRingBuffer_Peek(&rx_buffer, len);
+}
+
+void UARTDriver_ReleaseRxBytes(uint16_t len)
+{
+    SPSCRingBuffer_Skip(&rx_buffer, len);
+}
+
+bool UARTDriver_RxDMAPoll(void)
+{
+    UARTDriverHost_Poll();
+
+    SPSCRingBuffer_Commit(&rx_buffer, rx_total - rx_buffer.wr);
+
+    uint32_t rx_len = SPSCRingBuffer_DataLen(&rx_buffer);
+    if (rx_len > RX_BUFFER_LEN)
+    {
+        stats.rx_overruns++;
+        SPSCRingBuffer_Skip(&rx_buffer, rx_len);
+        return false;
+    }
+
+    if (rx_len > stats.rx_peak_len)
+    {
+        stats.rx_peak_len = rx_len;
+    }
+
+    return true;
+}
+
+const UARTDriver_Stats_T *UARTDriver_GetStats(void)
+{
+    return &stats;
+}
+
+static uint64_t GetTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * US_PER_SECOND + ts.tv_nsec / 1000;
+}
+
+static uint32_t GetAllowedBytes(uint64_t *p_next_us, uint64_t now_us, uint32_t max_len, bool line_busy)
+{
+    if (baud_rate == 0)
+    {
+        return max_len;
+    }
+
+    if (now_us < *p_next_us)
+    {
+        return 0;
+    }
+
+    /*
+     *  If nothing was pending at last poll, line has been idle since *p_next_us.
+     *  Credit at most one byte time of idle period then, so bytes are not
+     *  bursted after a long stall. If data was pending, the hardware would have
+     *  kept transferring during the stall, so the whole period is credited.
+     */
+    uint64_t byte_time_us = BITS_PER_BYTE * US_PER_SECOND / baud_rate;
+    if (!line_busy && (*p_next_us + byte_time_us < now_us))
+    {
+        *p_next_us = now_us - byte_time_us;
+    }
+
+    uint64_t allowed = (now_us - *p_next_us) * baud_rate / (BITS_PER_BYTE * US_PER_SECOND) + 1;
+
+    return (allowed < max_len) ? allowed : max_len;
+}
+
+static void ConsumeTime(uint64_t *p_next_us, uint64_t now_us, uint32_t len)
+{
+    if (baud_rate != 0)
+    {
+        *p_next_us += len * BITS_PER_BYTE * US_PER_SECOND / baud_rate;
+    }
+
+    if (max_jitter_us != 0)
+    {
+        *p_next_us = ((*p_next_us < now_us) ? now_us : *p_next_us) + rand() % max_jitter_us;
+    }
+}
+
+static void PollRx(uint64_t now_us)
+{
+    if (uart_fd < 0)
+    {
+        return;
+    }
+
+    uint32_t rx_pos  = rx_total & (RX_BUFFER_LEN - 1);
+    uint32_t allowed = GetAllowedBytes(&rx_next_us, now_us, RX_BUFFER_LEN - rx_pos, rx_busy);
+    if (allowed == 0)
+    {
+        return;
+    }
+
+    /*
+     *  Like RX DMA, write circularly regardless of reader position,
+     *  so overruns are detected the same way as on target.
+     */
+    ssize_t len = read(uart_fd, &rx_buf[rx_pos], allowed);
+    if (len > 0)
+    {
+        rx_total += len;
+        ConsumeTime(&rx_next_us, now_us, len);
+    }
+    rx_busy = (len == (ssize_t)allowed);
+}
+
+static void PollTx(uint64_t now_us)
+{
+    uint16_t tx_len;
+    uint8_t *p_tx = SPSCRingBuffer_Peek(&tx_buffer, &tx_len);
+
+    if ((uart_fd < 0) || (tx_len == 0))
+    {
+        tx_busy = false;
+        return;
+    }
+
+    uint32_t allowed = GetAllowedBytes(&tx_next_us, now_us, tx_len, tx_busy);
+    if (allowed == 0)
+    {
+        return;
+    }
+
+    ssize_t len = write(uart_fd, p_tx, allowed);
+    if (len > 0)
+    {
+        SPSCRingBuffer_Skip(&tx_buffer, len);
+        ConsumeTime(&tx_next_us, now_us, len);
+    }
+    tx_busy = !SPSCRingBuffer_IsEmpty(&tx_buffer);
+}
+
+#endif    // CMAKE_UNIT_TEST
@@ -0,0 +1,74 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef UARTDRIVERHOST_H
+#define UARTDRIVERHOST_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Host implementation of UARTDriver.h, built instead of the DMA driver when
+ *  CMAKE_UNIT_TEST is defined. Bytes are exchanged over a file descriptor
+ *  (pseudo terminal or socketpair end) at simulated baud rate, through the
+ *  same RX and TX buffer sizes as used on target.
+ */
+
+/*
+ *  Open pseudo terminal and use its master side as UART transport.
+ *
+ *  @param p_name       [out] buffer for path of pty slave device, to be opened by peer
+ *  @param name_len     size of p_name buffer
+ *
+ *  @return             True if success, false otherwise
+ */
+bool UARTDriverHost_OpenPty(char *p_name, size_t name_len);
+
+/*
+ *  Use given file descriptor (e.g. socketpair end) as UART transport.
+ *
+ *  @param fd           File descriptor, switched to non-blocking mode
+ */
+void UARTDriverHost_SetFd(int fd);
+
+/*
+ *  Set simulated baud rate. Bytes are delivered in both directions no faster
+ *  than 10 bits per byte at this rate.
+ *
+ *  @param baud_rate    Baud rate, 0 disables throttling
+ */
+void UARTDriverHost_SetBaudRate(uint32_t baud_rate);
+
+/*
+ *  Set simulated jitter. Each transfer is delayed by random time up to max_jitter_us.
+ *
+ *  @param max_jitter_us    Maximum jitter in microseconds, 0 disables jitter
+ */
+void UARTDriverHost_SetJitter(uint32_t max_jitter_us);
+
+/*
+ *  Move bytes between transport and driver buffers. Called by every driver
+ *  function, may be called additionally while application is busy.
+ */
+void UARTDriverHost_Poll(void);
+
+#endif    //UARTDRIVERHOST_H
@@ -233,7 +233,7 @@ void UART_SendTimeGetRequest(uint8_t instance_idx);
 void UART_SendBatteryStatusSetRequest(uint8_t *p_payload, uint8_t len);
 
 /*
- *  Receive and process incoming UART command
+ *  Receive and process all complete UART commands waiting in receive buffer
  */
 void UART_ProcessIncomingCommand(void);
 
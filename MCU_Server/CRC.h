@@ -30,7 +30,97 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define CRC16_INIT_VAL 0xFFFFu     /**< CRC16 init value */
 #define CRC32_INIT_VAL 0xFFFFFFFFu /**< CRC32 init value */
+#define SHA256_SIZE 32u            /**< SHA256 digest size */
+#define SHA256_CHUNK_SIZE 64u      /**< SHA256 chunk size */
 
+#ifndef CRC_FAST_TABLES
+#define CRC_FAST_TABLES 0 /**< 1 selects 256-entry (slice-by-4 for CRC32) tables, 0 selects 16-entry nibble tables */
+#endif
+
+#ifndef SHA256_UNROLL
+#define SHA256_UNROLL 0 /**< 1 unrolls SHA256 rounds 8 times (faster, bigger), 0 runs single round per iteration */
+#endif
+
+
+typedef struct CRC16_Context_Tag
+{
+    uint16_t crc;
+} CRC16_Context_T;
+
+typedef struct SHA256_Context_Tag
+{
+    uint32_t hash[SHA256_SIZE / sizeof(uint32_t)];
+    uint8_t  chunk[SHA256_CHUNK_SIZE];
+    size_t   chunk_len;
+    size_t   total_len;
+} SHA256_Context_T;
+
+
+/*
+ *  Initialize incremental CRC16 calculation
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param init_val     CRC init val
+ */
+void CRC16_Init(CRC16_Context_T *p_ctx, uint16_t init_val);
+
+/*
+ *  Update incremental CRC16 calculation with data
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ */
+void CRC16_Update(CRC16_Context_T *p_ctx, const uint8_t *data, size_t len);
+
+/*
+ *  Update incremental CRC16 calculation with single byte
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param data         Data byte
+ */
+void CRC16_UpdateByte(CRC16_Context_T *p_ctx, uint8_t data);
+
+/*
+ *  Finish incremental CRC16 calculation
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @return             Calculated CRC, same as returned by CalcCRC16
+ */
+uint16_t CRC16_Final(CRC16_Context_T *p_ctx);
+
+/*
+ *  Initialize incremental CRC16 MODBUS calculation
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param init_val     CRC init val
+ */
+void CRC16_Modbus_Init(CRC16_Context_T *p_ctx, uint16_t init_val);
+
+/*
+ *  Update incremental CRC16 MODBUS calculation with data
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ */
+void CRC16_Modbus_Update(CRC16_Context_T *p_ctx, const uint8_t *data, size_t len);
+
+/*
+ *  Update incremental CRC16 MODBUS calculation with single byte
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @param data         Data byte
+ */
+void CRC16_Modbus_UpdateByte(CRC16_Context_T *p_ctx, uint8_t data);
+
+/*
+ *  Finish incremental CRC16 MODBUS calculation
+ *
+ *  @param * p_ctx      Pointer to CRC16 context
+ *  @return             Calculated CRC, same as returned by CalcCRC16_Modbus
+ */
+uint16_t CRC16_Modbus_Final(CRC16_Context_T *p_ctx);
 
 /*
  *  Calculate CRC16
@@ -63,7 +153,31 @@ uint16_t CalcCRC16_Modbus(uint8_t *data, size_t len, uint16_t init_val);
 uint32_t CalcCRC32(uint8_t *data, size_t len, uint32_t init_val);
 
 /*
- *  Calculate CRC32
+ *  Initialize incremental SHA256 calculation
+ *
+ *  @param * p_ctx      Pointer to SHA256 context
+ */
+void SHA256_Init(SHA256_Context_T *p_ctx);
+
+/*
+ *  Update incremental SHA256 calculation with data
+ *
+ *  @param * p_ctx      Pointer to SHA256 context
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ */
+void SHA256_Update(SHA256_Context_T *p_ctx, const uint8_t *data, size_t len);
+
+/*
+ *  Finish incremental SHA256 calculation
+ *
+ *  @param * p_ctx      Pointer to SHA256 context
+ *  @param * sha256     [out] calculated SHA256, same as returned by CalcSHA256
+ */
+void SHA256_Final(SHA256_Context_T *p_ctx, uint8_t *sha256);
+
+/*
+ *  Calculate SHA256
  *
  *  @param * data       Pointer to data
  *  @param len          Data len
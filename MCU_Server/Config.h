@@ -30,6 +30,10 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define ENABLE_CTL 0    /**< Enable CTL support */
 #define ENABLE_PIRALS 1 /**< Enable PIR and ALS support */
 #define ENABLE_ENERGY 1 /**< Enable energy monitoring support */
+#ifndef SDM_METERS_COUNT
+#define SDM_METERS_COUNT \
+    1 /**< Number of SDM120 meters on MODBUS, addressed from 1. CreateInstances payload fits 2 without PIR and ALS */
+#endif
 #define ENABLE_1_10_V 0 /**< Define for calculate lightness for 0-10 V (value 0) or 1-10 V (value 1) */
 
 #define BUILD_NUMBER "0.0.0"           /**< Defines firmware build number. */
@@ -40,19 +44,23 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #ifdef CMAKE_UNIT_TEST
 
-#define DEBUG_INTERFACE (Serial)        /**< Defines serial port to print debug messages. */
-#define DEBUG_INTERFACE_BAUDRATE 115200 /**< Defines baudrate of debug interface. */
-#define UART_INTERFACE_BAUDRATE 57600   /**< Defines baudrate of modem interface. */
-#define MODBUS_INTERFACE (Serial)       /**< Defines serial port to communicate with modem */
-#define MODBUS_INTERFACE_BAUDRATE 2400  /**< Defines baudrate of modem interface */
+#include "MODBUSSerialHost.h"
+
+#define DEBUG_INTERFACE (Serial)            /**< Defines serial port to print debug messages. */
+#define DEBUG_INTERFACE_BAUDRATE 115200     /**< Defines baudrate of debug interface. */
+#define UART_INTERFACE_BAUDRATE 57600       /**< Defines baudrate of modem interface. */
+#define MODBUS_INTERFACE (MODBUSSerialHost) /**< Defines serial port to communicate with modem */
+#define MODBUS_INTERFACE_BAUDRATE 2400      /**< Defines baudrate of modem interface */
+#define MODBUS_INTERFACE_BAUDRATE_MAX 9600  /**< Defines baudrate negotiated with meters, 2400 disables negotiation */
 
 #else
 
-#define DEBUG_INTERFACE (Serial1)       /**< Defines serial port to print debug messages. */
-#define DEBUG_INTERFACE_BAUDRATE 115200 /**< Defines baudrate of debug interface. */
-#define UART_INTERFACE_BAUDRATE 57600   /**< Defines baudrate of modem interface. */
-#define MODBUS_INTERFACE (Serial3)      /**< Defines serial port to communicate with modem */
-#define MODBUS_INTERFACE_BAUDRATE 2400  /**< Defines baudrate of modem interface */
+#define DEBUG_INTERFACE (Serial1)          /**< Defines serial port to print debug messages. */
+#define DEBUG_INTERFACE_BAUDRATE 115200    /**< Defines baudrate of debug interface. */
+#define UART_INTERFACE_BAUDRATE 57600      /**< Defines baudrate of modem interface. */
+#define MODBUS_INTERFACE (Serial3)         /**< Defines serial port to communicate with modem */
+#define MODBUS_INTERFACE_BAUDRATE 2400     /**< Defines baudrate of modem interface */
+#define MODBUS_INTERFACE_BAUDRATE_MAX 9600 /**< Defines baudrate negotiated with meters, 2400 disables negotiation */
 
 #endif
 
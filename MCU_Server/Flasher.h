@@ -36,6 +36,12 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 /**< RAMFUNC attribute definition. Used to place function in RAM */
 #define RAMFUNC __attribute__((section(".fastrun"), noinline, noclone, optimize("Os")))
 
+/**< Flash sector size, smallest erasable unit */
+#define FLASHER_SECTOR_SIZE 0x400u
+
+/**< Number of DFU metadata sectors, used in turns so one of them always holds valid data */
+#define FLASHER_METADATA_SECTORS 2
+
 /**< Flasher return codes*/
 #define FLASHER_SUCCESS 0
 #define FLASHER_ERROR_ALIGNMENT 1
@@ -51,7 +57,9 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 /*
  *  Copy stored firmware to the beggining of flash and reboots.
- *  If success will never return.
+ *  Never returns. Sector failing verification is programmed again, up to FLASH_UPDATE_ATTEMPTS times.
+ *  When it still fails, or programming reports protection or access error, device halts with IRQ disabled,
+ *  blinking PIN_LED_STATUS as many times as flasher return code.
  *
  *  @param num_of_words    Size of firmware image.
  *  @return                Flasher return code.
@@ -68,6 +76,13 @@ RAMFUNC int Flasher_UpdateFirmware(uint32_t num_of_words);
  */
 RAMFUNC int Flasher_FlashWord(uint32_t address, uint32_t word_value, bool reenable_irq);
 
+/*
+ *  Get pointer to beggining of running firmware image.
+ *
+ *  @return        firmware address.
+ */
+uint32_t Flasher_GetFirmwareAddr(void);
+
 /*
  *  Get pointer to beggining of storage space.
  *
@@ -82,6 +97,13 @@ uint32_t Flasher_GetSpaceAddr(void);
  */
 size_t Flasher_GetSpaceSize(void);
 
+/*
+ *  Get pointer to the first of FLASHER_METADATA_SECTORS DFU metadata sectors, placed right after storage space.
+ *
+ *  @return        metadata sectors address.
+ */
+uint32_t Flasher_GetMetadataAddr(void);
+
 /*
  *  Erase whole storage space.
  *
@@ -89,9 +111,17 @@ size_t Flasher_GetSpaceSize(void);
  */
 int Flasher_EraseSpace(void);
 
+/*
+ *  Erase single sector of storage space.
+ *
+ *  @param address  Pointer to first byte in sector to be erased, has to be within storage space
+ *  @return         Flasher return code
+ */
+int Flasher_EraseSpaceSector(uint32_t address);
+
 /*
  *  Saves words to flash.
- *  Destination should be already erased with Flasher_EraseSpace.
+ *  Destination should be already erased with Flasher_EraseSpace or Flasher_EraseSpaceSector.
  *
  *  @param address         Destination pointer
  *  @param src             Source pointer
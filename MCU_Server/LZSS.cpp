@@ -0,0 +1,112 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "LZSS.h"
+
+
+/*
+ *  Copy back reference to the output
+ *
+ *  @param ref_low      First byte of back reference
+ *  @param ref_high     Second byte of back reference
+ *  @param put          Callback storing decoded bytes
+ *  @param get          Callback reading decoded bytes
+ *  @return             True on success
+ */
+static bool LZSS_CopyReference(uint8_t ref_low, uint8_t ref_high, LZSS_PutCallback put, LZSS_GetCallback get);
+
+
+void LZSS_Init(LZSS_Decoder_T *p_decoder)
+{
+    p_decoder->flags      = 0;
+    p_decoder->flags_left = 0;
+    p_decoder->ref_low    = 0;
+    p_decoder->ref_split  = false;
+}
+
+bool LZSS_Decode(LZSS_Decoder_T *p_decoder, const uint8_t *p_data, size_t len, LZSS_PutCallback put, LZSS_GetCallback get)
+{
+    size_t index = 0;
+
+    if (p_decoder->ref_split && (index < len))
+    {
+        p_decoder->ref_split = false;
+        if (!LZSS_CopyReference(p_decoder->ref_low, p_data[index++], put, get))
+        {
+            return false;
+        }
+    }
+
+    while (index < len)
+    {
+        if (p_decoder->flags_left == 0)
+        {
+            p_decoder->flags      = p_data[index++];
+            p_decoder->flags_left = 8;
+            continue;
+        }
+
+        bool is_literal = (p_decoder->flags & 0x01) != 0;
+        p_decoder->flags >>= 1;
+        p_decoder->flags_left--;
+
+        if (is_literal)
+        {
+            if (!put(p_data[index++]))
+            {
+                return false;
+            }
+        }
+        else if (index + 1 < len)
+        {
+            if (!LZSS_CopyReference(p_data[index], p_data[index + 1], put, get))
+            {
+                return false;
+            }
+            index += 2;
+        }
+        else
+        {
+            p_decoder->ref_low   = p_data[index++];
+            p_decoder->ref_split = true;
+        }
+    }
+
+    return true;
+}
+
+static bool LZSS_CopyReference(uint8_t ref_low, uint8_t ref_high, LZSS_PutCallback put, LZSS_GetCallback get)
+{
+    size_t distance = ((size_t)ref_low | ((size_t)(ref_high & 0x0F) << 8)) + 1;
+    size_t length   = (size_t)(ref_high >> 4) + LZSS_MIN_MATCH;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t data;
+        if (!get(distance, &data) || !put(data))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef LZSS_H_
+#define LZSS_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  LZSS stream format, as produced by Tools/dfu_pack.py:
+ *
+ *  Stream is a sequence of groups. Each group starts with a flag byte,
+ *  followed by up to 8 items, one per flag bit starting from the LSB:
+ *
+ *      bit set     literal byte
+ *      bit clear   back reference, 2 bytes: b0 = distance - 1 bits 0-7,
+ *                  b1 bits 0-3 = distance - 1 bits 8-11, b1 bits 4-7 = length - LZSS_MIN_MATCH
+ *
+ *  Stream has no end marker, decoder is fed until expected output size is produced.
+ */
+#define LZSS_WINDOW_SIZE 4096u /**< Maximum back reference distance */
+#define LZSS_MIN_MATCH 3u      /**< Shortest back reference length */
+#define LZSS_MAX_MATCH 18u     /**< Longest back reference length */
+
+typedef struct LZSS_Decoder_Tag
+{
+    uint8_t flags;      /**< Flag byte of current group */
+    uint8_t flags_left; /**< Items left in current group */
+    uint8_t ref_low;    /**< First byte of back reference */
+    bool    ref_split;  /**< Back reference split between input buffers, ref_low is valid */
+} LZSS_Decoder_T;
+
+/*
+ *  Callback storing single decoded byte
+ *
+ *  @param data         Decoded byte
+ *  @return             True on success
+ */
+typedef bool (*LZSS_PutCallback)(uint8_t data);
+
+/*
+ *  Callback reading already decoded byte
+ *
+ *  @param distance     Distance from the end of decoded data, 1 is the last decoded byte
+ *  @param p_data       Pointer to read byte
+ *  @return             True on success, false if distance exceeds decoded data
+ */
+typedef bool (*LZSS_GetCallback)(size_t distance, uint8_t *p_data);
+
+/*
+ *  Initialize LZSS decoder
+ *
+ *  @param p_decoder    Pointer to decoder
+ */
+void LZSS_Init(LZSS_Decoder_T *p_decoder);
+
+/*
+ *  Decode part of LZSS stream. Stream may be split at any byte.
+ *
+ *  @param p_decoder    Pointer to decoder
+ *  @param p_data       Pointer to encoded data
+ *  @param len          Encoded data len
+ *  @param put          Callback storing decoded bytes
+ *  @param get          Callback reading decoded bytes referenced by stream
+ *  @return             True on success, false if any callback failed
+ */
+bool LZSS_Decode(LZSS_Decoder_T *p_decoder, const uint8_t *p_data, size_t len, LZSS_PutCallback put, LZSS_GetCallback get);
+
+#endif /* LZSS_H_ */
@@ -34,7 +34,13 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define LOG_INFO_ENABLE 0 /**< Enables INFO level logs */
 #define LOG_DEBUG_ENABLE \
-    0 /**< Enables DEBUG level logs Enabling this make DFU impossible, due to implementation of UART in Arduino */
+    0 /**< Enables DEBUG level logs. Without deferred logging it makes DFU impossible, as printing blocks main loop */
+
+#ifndef CMAKE_UNIT_TEST
+#define LOG_DEFERRED_ENABLE 1 /**< Enables deferred binary logging, decoded on host with Tools/log_decoder.py */
+#else
+#define LOG_DEFERRED_ENABLE 0
+#endif
 
 #ifdef CMAKE_UNIT_TEST
 #define _PRINTF(format, ...) printf(format, ##__VA_ARGS__)
@@ -42,6 +48,90 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define _PRINTF(format, ...) DEBUG_INTERFACE.printf(format, ##__VA_ARGS__)
 #endif
 
+#if LOG_DEFERRED_ENABLE == 1
+
+/*
+ *  Deferred log record, as sent over DEBUG_INTERFACE:
+ *
+ *      LOG_RECORD_SYNC <len> <format address u32 LE> <arguments...>
+ *
+ *  where len is number of bytes following it. Format string is not sent, host
+ *  decoder looks it up in the firmware ELF file by its address. Each argument
+ *  starts with a type tag:
+ *
+ *      LOG_ARG_TAG_INT     u32 LE, any integer or pointer up to 32 bits
+ *      LOG_ARG_TAG_INT64   u64 LE
+ *      LOG_ARG_TAG_DOUBLE  IEEE 754 double LE
+ *      LOG_ARG_TAG_STRING  NUL-terminated string
+ *      LOG_ARG_TAG_BUFFER  u8 length and raw bytes, printed in hex after the message
+ *
+ *  Record with format address 0 carries number of records dropped because
+ *  the log buffer was full.
+ */
+#define LOG_RECORD_SYNC 0xA5
+#define LOG_RECORD_MAX_LEN UINT8_MAX /**< Maximum value of record length field */
+
+#define LOG_ARG_TAG_INT 'i'
+#define LOG_ARG_TAG_INT64 'q'
+#define LOG_ARG_TAG_DOUBLE 'f'
+#define LOG_ARG_TAG_STRING 's'
+#define LOG_ARG_TAG_BUFFER 'b'
+
+typedef struct Log_Arg_Tag
+{
+    uint8_t tag;
+    union
+    {
+        uint32_t    u32;
+        uint64_t    u64;
+        double      f64;
+        const char *str;
+    };
+
+    Log_Arg_Tag() : tag(0), u64(0) {}
+    Log_Arg_Tag(int v) : tag(LOG_ARG_TAG_INT), u32(v) {}
+    Log_Arg_Tag(unsigned int v) : tag(LOG_ARG_TAG_INT), u32(v) {}
+    Log_Arg_Tag(long v) : tag(LOG_ARG_TAG_INT), u32(v) {}
+    Log_Arg_Tag(unsigned long v) : tag(LOG_ARG_TAG_INT), u32(v) {}
+    Log_Arg_Tag(long long v) : tag(LOG_ARG_TAG_INT64), u64(v) {}
+    Log_Arg_Tag(unsigned long long v) : tag(LOG_ARG_TAG_INT64), u64(v) {}
+    Log_Arg_Tag(double v) : tag(LOG_ARG_TAG_DOUBLE), f64(v) {}
+    Log_Arg_Tag(const char *v) : tag(LOG_ARG_TAG_STRING), str(v) {}
+    Log_Arg_Tag(const void *v) : tag(LOG_ARG_TAG_INT), u32((uintptr_t)v) {}
+} Log_Arg_T;
+
+/*
+ *  Queue log record in the log buffer. Record is dropped if there is no space.
+ *
+ *  @param format       Format string, has to be a string literal
+ *  @param p_args       Pointer to argument list
+ *  @param args_count   Number of arguments
+ */
+void Log_Queue(const char *format, const Log_Arg_T *p_args, size_t args_count);
+
+/*
+ *  Send queued log records to DEBUG_INTERFACE, as long as it can take them
+ *  without blocking. Should be called from main loop.
+ */
+void Log_Loop(void);
+
+/*
+ *  Send all queued log records to DEBUG_INTERFACE and wait for transmission.
+ *  Blocking, to be called before reset.
+ */
+void Log_Flush(void);
+
+template <typename... Args>
+static inline void _LOG_DEFERRED(const char *format, Args... args)
+{
+    const Log_Arg_T arg_list[] = {Log_Arg_T(args)..., Log_Arg_T()};
+    Log_Queue(format, arg_list, sizeof...(args));
+}
+
+#define _LOG(format, ...) _LOG_DEFERRED(format, ##__VA_ARGS__)
+
+#else
+
 #define _LOG(format, ...)               \
     do                                  \
     {                                   \
@@ -49,6 +139,19 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
         _PRINTF("\n");                  \
     } while (0)
 
+static inline void Log_Loop(void)
+{
+}
+
+static inline void Log_Flush(void)
+{
+#ifndef CMAKE_UNIT_TEST
+    DEBUG_INTERFACE.flush();
+#endif
+}
+
+#endif
+
 static inline void _LOG_NULL(const char *format, ...)
 {
     UNUSED(format);
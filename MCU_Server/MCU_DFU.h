@@ -33,6 +33,11 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 void SetupDFU(void);
 
+/*
+ * DFU loop, erases storage space ahead of incoming pages
+ */
+void LoopDFU(void);
+
 /*
  * Get DFU state
  */
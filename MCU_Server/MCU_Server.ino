@@ -185,6 +185,15 @@ static const uint8_t health_registration[] = {
     highByte(SILVAIR_ID),
 };
 
+static_assert(sizeof(ctl_registration) + sizeof(time_with_battery_registration) + sizeof(light_el_server_registration) +
+                      (ENABLE_PIRALS != 0 ? sizeof(pir_registration) + sizeof(als_registration) : 0) +
+                      (ENABLE_ENERGY != 0 ? SDM_METERS_COUNT * (sizeof(current_precise_energy_registration) +
+                                                                sizeof(voltage_power_registration))
+                                          : 0) +
+                      sizeof(health_registration) <=
+                  MAX_PAYLOAD_SIZE,
+              "Too many SDM meters to register in single CreateInstances request");
+
 static ModemState_t ModemState = MODEM_STATE_UNKNOWN;
 
 #if ENABLE_CTL == 1 && ENABLE_LC == 1
@@ -423,7 +432,8 @@ void ProcessEnterInitDevice(uint8_t *p_payload, uint8_t len)
 
     if (ENERGYEnabled)
     {
-        payload_len += sizeof(current_precise_energy_registration) + sizeof(voltage_power_registration);
+        payload_len +=
+            SDM_METERS_COUNT * (sizeof(current_precise_energy_registration) + sizeof(voltage_power_registration));
     }
 
     payload_len += sizeof(health_registration);
@@ -474,10 +484,13 @@ void ProcessEnterInitDevice(uint8_t *p_payload, uint8_t len)
 
     if (ENERGYEnabled)
     {
-        memcpy(model_ids + index, current_precise_energy_registration, sizeof(current_precise_energy_registration));
-        index += sizeof(current_precise_energy_registration);
-        memcpy(model_ids + index, voltage_power_registration, sizeof(voltage_power_registration));
-        index += sizeof(voltage_power_registration);
+        for (size_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+        {
+            memcpy(model_ids + index, current_precise_energy_registration, sizeof(current_precise_energy_registration));
+            index += sizeof(current_precise_energy_registration);
+            memcpy(model_ids + index, voltage_power_registration, sizeof(voltage_power_registration));
+            index += sizeof(voltage_power_registration);
+        }
     }
 
     memcpy(model_ids + index, health_registration, sizeof(health_registration));
@@ -504,8 +517,11 @@ void ProcessEnterInitNode(uint8_t *p_payload, uint8_t len)
     SensorInput_SetPirIdx(INSTANCE_INDEX_UNKNOWN);
     SensorInput_SetAlsIdx(INSTANCE_INDEX_UNKNOWN);
     SetTimeServerInstanceIdx(INSTANCE_INDEX_UNKNOWN);
-    SensorInput_SetCurrPreciseEnergyIdx(INSTANCE_INDEX_UNKNOWN);
-    SensorInput_SetVoltPowIdx(INSTANCE_INDEX_UNKNOWN);
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        SensorInput_SetCurrPreciseEnergyIdx(meter, INSTANCE_INDEX_UNKNOWN);
+        SensorInput_SetVoltPowIdx(meter, INSTANCE_INDEX_UNKNOWN);
+    }
 
     uint8_t sensor_server_model_id_occurency = 0;
 
@@ -540,13 +556,19 @@ void ProcessEnterInitNode(uint8_t *p_payload, uint8_t len)
             {
                 SensorInput_SetAlsIdx(current_model_id_instance_index);
             }
-            else if (sensor_server_model_id_occurency == CURR_ENERGY_REGISTRATION_ORDER && ENERGYEnabled)
+            else if (ENERGYEnabled)
             {
-                SensorInput_SetCurrPreciseEnergyIdx(current_model_id_instance_index);
-            }
-            else if (sensor_server_model_id_occurency == VOLT_POWER_REGISTRATION_ORDER && ENERGYEnabled)
-            {
-                SensorInput_SetVoltPowIdx(current_model_id_instance_index);
+                for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+                {
+                    if (sensor_server_model_id_occurency == CURR_ENERGY_REGISTRATION_ORDER(meter))
+                    {
+                        SensorInput_SetCurrPreciseEnergyIdx(meter, current_model_id_instance_index);
+                    }
+                    else if (sensor_server_model_id_occurency == VOLT_POWER_REGISTRATION_ORDER(meter))
+                    {
+                        SensorInput_SetVoltPowIdx(meter, current_model_id_instance_index);
+                    }
+                }
             }
         }
 
@@ -578,18 +600,21 @@ void ProcessEnterInitNode(uint8_t *p_payload, uint8_t len)
         return;
     }
 
-    if (SensorInput_GetCurrPreciseEnergyIdx() == INSTANCE_INDEX_UNKNOWN && ENERGYEnabled)
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
     {
-        ModemState = MODEM_STATE_UNKNOWN;
-        LOG_INFO("Sensor server (Voltage Current) model id not found in init node message");
-        return;
-    }
+        if (SensorInput_GetCurrPreciseEnergyIdx(meter) == INSTANCE_INDEX_UNKNOWN && ENERGYEnabled)
+        {
+            ModemState = MODEM_STATE_UNKNOWN;
+            LOG_INFO("Sensor server (Voltage Current) model id of meter %d not found in init node message", meter);
+            return;
+        }
 
-    if (SensorInput_GetVoltPowIdx() == INSTANCE_INDEX_UNKNOWN && ENERGYEnabled)
-    {
-        ModemState = MODEM_STATE_UNKNOWN;
-        LOG_INFO("Sensor server (Power Energy) model id not found in init node message");
-        return;
+        if (SensorInput_GetVoltPowIdx(meter) == INSTANCE_INDEX_UNKNOWN && ENERGYEnabled)
+        {
+            ModemState = MODEM_STATE_UNKNOWN;
+            LOG_INFO("Sensor server (Power Energy) model id of meter %d not found in init node message", meter);
+            return;
+        }
     }
 
     if (GetHealthSrvIdx() == INSTANCE_INDEX_UNKNOWN)
@@ -719,4 +744,6 @@ void loop(void)
         LoopLightElTest();
     }
     LoopMeshTimeSync();
+    LoopDFU();
+    Log_Loop();
 }
@@ -28,12 +28,20 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define MIN_RX_MODBUS_MESSAGE_LEN 4u
 #define MAX_RX_MODBUS_MESSAGE_LEN 255u
+
+/**
+ * RTU frames are separated by at least 3.5 character times of silence. Above 19200 baud
+ * fixed 1750 us is used, as recommended by MODBUS over serial line specification.
+ */
+#define MODBUS_CHARACTER_BITS 11u
+#define MODBUS_FRAME_SILENCE_US(_baudrate) \
+    (((_baudrate) > 19200u) ? 1750u : (7u * MODBUS_CHARACTER_BITS * 1000000u / (2u * (_baudrate))))
 #define MODBUS_TX_MESSAGE_LEN(_payload_len) (4 + _payload_len)
 #define MODBUS_BASIC_COMMAND_PAYLOAD_LEN 4u
 #define MODBUS_READ_HOLDING_REGISTERS_PAYLOAD_LEN 4u
 #define MODBUS_READ_INPUT_REGISTERS_PAYLOAD_LEN 4u
 #define MODBUS_PRESET_SINGLE_REGISTER_PAYLOAD_LEN 4u
-#define MODBUS_PRESET_MULTIPLE_REGISTERS_PAYLOAD_LEN(_num_of_registers) (3 + (_num_of_registers * 2))
+#define MODBUS_PRESET_MULTIPLE_REGISTERS_PAYLOAD_LEN(_num_of_registers) (5 + (_num_of_registers * 2))
 
 #define MODBUS_READ_MULTIPLE_REGISTERS_PAYLOAD_SIZE(_byte_count) (1u + _byte_count)
 #define MODBUS_READ_SINGLE_REGISTER_PAYLOAD_SIZE 4u
@@ -69,9 +77,12 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 typedef struct MODBUS_State_Tag
 {
-    uint8_t payload[MAX_RX_MODBUS_MESSAGE_LEN];
-    uint8_t already_received;
-    size_t  expected_len;
+    uint8_t         payload[MAX_RX_MODBUS_MESSAGE_LEN];
+    uint8_t         already_received;
+    bool            discard;             /**< Drop bytes until inter-frame silence */
+    bool            dropped;             /**< Some bytes of current frame were dropped */
+    uint32_t        last_byte_timestamp; /**< Time in microseconds when last byte was read from interface */
+    CRC16_Context_T crc_ctx;
 } MODBUS_State_T;
 
 typedef struct MODBUS_Frame_Tag
@@ -82,7 +93,9 @@ typedef struct MODBUS_Frame_Tag
     uint8_t *p_payload;
 } MODBUS_Frame_T;
 
-static MODBUS_State_T state = {0};
+static MODBUS_State_T state         = {0};
+static MODBUS_Stats_T stats         = {0};
+static uint32_t       frame_silence = MODBUS_FRAME_SILENCE_US(MODBUS_INTERFACE_BAUDRATE);
 
 
 /**
@@ -105,19 +118,30 @@ static size_t MODBUS_ExpectedMessageLen(uint8_t function_code, uint8_t first_pay
 /**
  * Process incoming MODBUS frame.
  *
- * @param payload   Complete received payload
- * @param len       Payload size
+ * @param payload       Complete received frame, with valid CRC
+ * @param len           Frame size
  */
 static void MODBUS_ProcessFrame(uint8_t *payload, size_t len);
 
 /**
- * Determine if message's CRC matches expected
+ * Determine if received frame has length expected for its function code
+ *
+ * @return              true if frame is complete or its function code is not supported
+ */
+static bool MODBUS_IsCompleteMessage(void);
+
+/**
+ * Determine if received frame CRC is correct
  *
- * @param buffer    Buffer with raw message
- * @param len       Data len
- * @return          true is CRC OK, false otherwise
+ * @return              true is CRC OK, false otherwise
+ */
+static bool MODBUS_IsValidMessage(void);
+
+/**
+ * Close received frame on inter-frame silence. Frame is processed if valid, otherwise
+ * it is dropped and receiver starts over with next frame.
  */
-static bool MODBUS_IsValidMessage(uint8_t *buffer, size_t len);
+static void MODBUS_ProcessSilence(void);
 
 /**
  * Process MODBUS repsponse based on parsed frame.
@@ -148,61 +172,69 @@ void MODBUS_ProcessIncoming(void)
 {
     while (MODBUS_INTERFACE.available())
     {
-        if (state.already_received == MAX_RX_MODBUS_MESSAGE_LEN)
-            state.already_received = 0;
-
-        state.payload[state.already_received] = MODBUS_INTERFACE.read();
+        uint8_t data              = MODBUS_INTERFACE.read();
+        state.last_byte_timestamp = micros();
 
-        switch (state.already_received)
+        if (state.discard || (state.already_received == MAX_RX_MODBUS_MESSAGE_LEN))
         {
-            case MODBUS_SLAVE_ADDR_OFFSET:
-            {
-                LOG_DEBUG("Received slave address");
-                state.already_received++;
-                break;
-            }
-            case MODBUS_FUNCTION_CODE_OFFSET:
-            {
-                LOG_DEBUG("Received function code");
-                if (MODBUS_IsFunctionCodeSupported(state.payload[MODBUS_FUNCTION_CODE_OFFSET]))
-                    state.already_received++;
-                else
-                    state.already_received = 0;
+            state.discard          = true;
+            state.dropped          = true;
+            state.already_received = 0;
+            continue;
+        }
 
-                break;
-            }
-            case MODBUS_PAYLOAD_START_OFFSET:
-            {
-                state.already_received++;
-                state.expected_len = MODBUS_ExpectedMessageLen(state.payload[MODBUS_FUNCTION_CODE_OFFSET],
-                                                               state.payload[MODBUS_PAYLOAD_START_OFFSET]);
-                LOG_DEBUG("Received first payload byte, expected len: %d", state.expected_len);
-                break;
-            }
-            default:
-            {
-                if (state.expected_len > state.already_received)
-                {
-                    LOG_DEBUG("Received next payload byte");
-                    state.already_received++;
-                }
+        if (state.already_received == 0)
+        {
+            CRC16_Modbus_Init(&state.crc_ctx, CRC16_INIT_VAL);
+        }
 
-                if (state.expected_len == state.already_received)
-                {
-                    MODBUS_ProcessFrame(state.payload, state.already_received);
+        state.payload[state.already_received++] = data;
+        CRC16_Modbus_UpdateByte(&state.crc_ctx, data);
 
-                    state.already_received = 0;
-                }
+        // Complete response does not have to wait for silence, if it has expected length and valid CRC
+        if ((state.already_received > MODBUS_PAYLOAD_START_OFFSET) &&
+            MODBUS_IsFunctionCodeSupported(state.payload[MODBUS_FUNCTION_CODE_OFFSET]) &&
+            MODBUS_IsCompleteMessage() && MODBUS_IsValidMessage())
+        {
+            MODBUS_ProcessFrame(state.payload, state.already_received);
 
-                break;
-            }
+            state.already_received = 0;
+            state.discard          = true;
         }
     }
+
+    // Serial buffer keeps no arrival times, bytes are timestamped when read. Silence is therefore seen only
+    // between separate calls, bytes read in one call count as one burst however long they waited in the buffer.
+    if ((state.already_received > 0 || state.discard) && (micros() - state.last_byte_timestamp >= frame_silence))
+    {
+        MODBUS_ProcessSilence();
+    }
+}
+
+void MODBUS_SetBaudrate(uint32_t baudrate)
+{
+    MODBUS_INTERFACE.flush();
+    MODBUS_INTERFACE.begin(baudrate);
+
+    frame_silence = MODBUS_FRAME_SILENCE_US(baudrate);
+    MODBUS_ClearBuffer();
 }
 
 void MODBUS_ClearBuffer(void)
 {
+    while (MODBUS_INTERFACE.available())
+    {
+        MODBUS_INTERFACE.read();
+    }
+
     state.already_received = 0;
+    state.discard          = false;
+    state.dropped          = false;
+}
+
+const MODBUS_Stats_T *MODBUS_GetStats(void)
+{
+    return &stats;
 }
 
 void MODBUS_SendReadHoldingRegisters(uint8_t slave_address, uint16_t starting_address, uint16_t num_of_points)
@@ -231,7 +263,9 @@ void MODBUS_SendPresetMultipleRegisters(uint8_t   slave_address,
 
     buffer[index++] = highByte(starting_address);
     buffer[index++] = lowByte(starting_address);
+    buffer[index++] = 0;
     buffer[index++] = register_count;
+    buffer[index++] = register_count * sizeof(uint16_t);
 
     for (size_t i = 0; i < register_count; i++)
     {
@@ -358,15 +392,46 @@ static void MODBUS_SendFrame(MODBUS_Frame_T *p_frame)
     MODBUS_INTERFACE.write(buffer, sizeof(buffer));
 }
 
-static bool MODBUS_IsValidMessage(uint8_t *buffer, size_t len)
+static bool MODBUS_IsCompleteMessage(void)
 {
-    uint16_t expected_crc = CalcCRC16_Modbus(buffer, len - sizeof(uint16_t), CRC16_INIT_VAL);
-    uint16_t actual_crc   = buffer[len - 1];
-    actual_crc |= (uint16_t)buffer[len - 2] << 8;
+    if ((state.already_received <= MODBUS_PAYLOAD_START_OFFSET) ||
+        !MODBUS_IsFunctionCodeSupported(state.payload[MODBUS_FUNCTION_CODE_OFFSET]))
+    {
+        return true;
+    }
 
-    LOG_DEBUG("Expected CRC: %04X, actual CRC: %04X", expected_crc, actual_crc);
+    return state.already_received == MODBUS_ExpectedMessageLen(state.payload[MODBUS_FUNCTION_CODE_OFFSET],
+                                                                state.payload[MODBUS_PAYLOAD_START_OFFSET]);
+}
 
-    return expected_crc == actual_crc;
+static bool MODBUS_IsValidMessage(void)
+{
+    // CRC calculated over whole frame including its CRC field is zero
+    return (state.already_received >= MIN_RX_MODBUS_MESSAGE_LEN) && (CRC16_Modbus_Final(&state.crc_ctx) == 0);
+}
+
+static void MODBUS_ProcessSilence(void)
+{
+    if (!state.dropped && MODBUS_IsValidMessage() && MODBUS_IsCompleteMessage())
+    {
+        MODBUS_ProcessFrame(state.payload, state.already_received);
+    }
+    else if (state.dropped || (state.already_received > 0))
+    {
+        LOG_DEBUG("Dropped MODBUS frame, len %d", state.already_received);
+
+        if (!state.dropped && (state.already_received >= MIN_RX_MODBUS_MESSAGE_LEN))
+        {
+            stats.crc_errors++;
+        }
+        stats.resyncs++;
+
+        MODBUS_ProcessFrameError();
+    }
+
+    state.already_received = 0;
+    state.discard          = false;
+    state.dropped          = false;
 }
 
 static void MODBUS_SendBasicCommand(uint8_t slave_address, uint16_t data1, uint16_t data2, uint8_t funtion_code)
@@ -437,22 +502,16 @@ static bool MODBUS_IsFunctionCodeSupported(uint8_t function_code)
 
 static void MODBUS_ProcessFrame(uint8_t *payload, size_t len)
 {
-    if (MODBUS_IsValidMessage(payload, len))
-    {
-        MODBUS_Frame_T frame;
-        size_t         index = 0;
+    MODBUS_Frame_T frame;
+    size_t         index = 0;
 
-        frame.slave_address = payload[index++];
-        frame.function_code = payload[index++];
-        frame.len           = len - index;
-        frame.p_payload     = payload + index;
+    frame.slave_address = payload[index++];
+    frame.function_code = payload[index++];
+    frame.len           = len - index - MODBUS_CRC_SIZE;
+    frame.p_payload     = payload + index;
 
-        LOG_DEBUG("Received MODBUS frame");
+    LOG_DEBUG("Received MODBUS frame");
+    stats.frames++;
 
-        MODBUS_ProcessResponse(&frame);
-    }
-    else
-    {
-        LOG_DEBUG("Message not valid");
-    }
+    MODBUS_ProcessResponse(&frame);
 }
@@ -40,13 +40,36 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define MODBUS_ERROR_MEMORY_PARITY_ERROR 0x08u
 
 
+typedef struct MODBUS_Stats_Tag
+{
+    uint32_t frames;     /**< Valid frames received */
+    uint32_t crc_errors; /**< Frames dropped because of CRC mismatch */
+    uint32_t resyncs;    /**< Times receiver dropped bytes and waited for inter-frame silence */
+} MODBUS_Stats_T;
+
+
 /**
  * Process incoming MODBUS data
  */
 void MODBUS_ProcessIncoming(void);
 
 /**
- * Clear MODBUS receiving buffer
+ * Get MODBUS receiver statistics
+ *
+ * @return  Pointer to statistics
+ */
+const MODBUS_Stats_T *MODBUS_GetStats(void);
+
+/**
+ * Change baudrate of MODBUS interface, together with inter-frame silence detection. Pending request is sent
+ * out at previous baudrate and receiving buffer is cleared.
+ *
+ * @param baudrate  New baudrate
+ */
+void MODBUS_SetBaudrate(uint32_t baudrate);
+
+/**
+ * Clear MODBUS receiving buffer and drop bytes pending in interface, e.g. late response to timed out request
  */
 void MODBUS_ClearBuffer(void);
 
@@ -139,4 +162,10 @@ extern void MODBUS_ProcessReadPresetMultipleRegisters(uint8_t  slave_address,
  */
 extern void MODBUS_ProcessException(uint8_t slave_address, uint8_t original_function_code, uint8_t error_code);
 
+/**
+ * Incoming frame dropped handler. Called when frame delimited by inter-frame silence
+ * has invalid CRC or length, or is longer than receive buffer.
+ */
+extern void MODBUS_ProcessFrameError(void);
+
 #endif    // MODBUS_H_
@@ -0,0 +1,267 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifdef CMAKE_UNIT_TEST
+
+#include "MODBUSSerialHost.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SPSCRingBuffer.h"
+
+#define RX_BUFFER_LEN 64 /**< Serial3 RX buffer of Teensy LC */
+#define TX_BUFFER_LEN 64 /**< Serial3 TX buffer of Teensy LC rounded up to power of two */
+
+#define BITS_PER_BYTE 10
+#define US_PER_SECOND 1000000ul
+
+MODBUSSerialHost_T MODBUSSerialHost;
+
+static uint8_t rx_buf[RX_BUFFER_LEN];
+static uint8_t tx_buf[TX_BUFFER_LEN];
+
+static SPSCRingBuffer_T<RX_BUFFER_LEN> rx_buffer = {rx_buf, 0, 0};
+static SPSCRingBuffer_T<TX_BUFFER_LEN> tx_buffer = {tx_buf, 0, 0};
+
+static int      modbus_fd    = -1;
+static uint32_t baud_rate    = 0;
+static bool     is_throttled = true;
+
+static uint32_t rx_next_us = 0;     /**< Time when next byte may be received */
+static uint32_t tx_next_us = 0;     /**< Time when next byte may be sent */
+static bool     rx_busy    = false; /**< More received bytes were pending at last poll */
+static bool     tx_busy    = false; /**< More bytes to send were pending at last poll */
+
+static uint32_t GetAllowedBytes(uint32_t *p_next_us, uint32_t now_us, uint32_t max_len, bool line_busy);
+static void     ConsumeTime(uint32_t *p_next_us, uint32_t len);
+static void     Poll(void);
+static speed_t  GetSpeed(uint32_t baud);
+
+void MODBUSSerialHost_T::begin(uint32_t baud)
+{
+    SPSCRingBuffer_Init(&rx_buffer, rx_buf);
+    SPSCRingBuffer_Init(&tx_buffer, tx_buf);
+
+    baud_rate  = baud;
+    rx_next_us = micros();
+    tx_next_us = rx_next_us;
+    rx_busy    = false;
+    tx_busy    = false;
+
+    struct termios tio;
+    if ((modbus_fd >= 0) && isatty(modbus_fd) && (tcgetattr(modbus_fd, &tio) == 0))
+    {
+        cfsetispeed(&tio, GetSpeed(baud));
+        cfsetospeed(&tio, GetSpeed(baud));
+        tcsetattr(modbus_fd, TCSANOW, &tio);
+    }
+}
+
+void MODBUSSerialHost_T::end(void)
+{
+    flush();
+}
+
+void MODBUSSerialHost_T::flush(void)
+{
+    Poll();
+    while (!SPSCRingBuffer_IsEmpty(&tx_buffer))
+    {
+        Poll();
+    }
+}
+
+int MODBUSSerialHost_T::available(void)
+{
+    Poll();
+    return SPSCRingBuffer_DataLen(&rx_buffer);
+}
+
+int MODBUSSerialHost_T::read(void)
+{
+    uint8_t data;
+    if (!SPSCRingBuffer_DequeueByte(&rx_buffer, &data))
+    {
+        return -1;
+    }
+
+    return data;
+}
+
+size_t MODBUSSerialHost_T::write(const uint8_t *p_buffer, size_t len)
+{
+    /* Like Serial3, write blocks until the whole buffer is queued */
+    for (size_t i = 0; i < len; i++)
+    {
+        while (!SPSCRingBuffer_QueueBytes(&tx_buffer, p_buffer + i, 1))
+        {
+            Poll();
+        }
+    }
+
+    Poll();
+    return len;
+}
+
+void MODBUSSerialHost_T::transmitterEnable(uint8_t pin)
+{
+}
+
+bool MODBUSSerialHost_OpenPty(char *p_name, size_t name_len)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct termios tio;
+    if ((grantpt(fd) != 0) || (unlockpt(fd) != 0) || (ptsname_r(fd, p_name, name_len) != 0) ||
+        (tcgetattr(fd, &tio) != 0))
+    {
+        close(fd);
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+
+    MODBUSSerialHost_SetFd(fd);
+    return true;
+}
+
+void MODBUSSerialHost_SetFd(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    modbus_fd = fd;
+}
+
+void MODBUSSerialHost_SetThrottling(bool throttled)
+{
+    is_throttled = throttled;
+}
+
+uint32_t MODBUSSerialHost_GetBaudRate(void)
+{
+    return baud_rate;
+}
+
+static uint32_t GetAllowedBytes(uint32_t *p_next_us, uint32_t now_us, uint32_t max_len, bool line_busy)
+{
+    if (!is_throttled || (baud_rate == 0))
+    {
+        return max_len;
+    }
+
+    /* micros() wraps around, times are compared by their difference */
+    if ((int32_t)(now_us - *p_next_us) < 0)
+    {
+        return 0;
+    }
+
+    /* Idle line is credited with at most one byte time, as in UARTDriverHost */
+    uint32_t byte_time_us = BITS_PER_BYTE * US_PER_SECOND / baud_rate;
+    if (!line_busy && (now_us - *p_next_us > byte_time_us))
+    {
+        *p_next_us = now_us - byte_time_us;
+    }
+
+    uint32_t allowed = (now_us - *p_next_us) / byte_time_us + 1;
+
+    return (allowed < max_len) ? allowed : max_len;
+}
+
+static void ConsumeTime(uint32_t *p_next_us, uint32_t len)
+{
+    if (is_throttled && (baud_rate != 0))
+    {
+        *p_next_us += len * (BITS_PER_BYTE * US_PER_SECOND / baud_rate);
+    }
+}
+
+static void Poll(void)
+{
+    if (modbus_fd < 0)
+    {
+        return;
+    }
+
+    uint32_t now_us = micros();
+
+    /* Bytes not fitting in RX buffer are left in transport instead of being overrun */
+    uint8_t  data[RX_BUFFER_LEN];
+    uint32_t allowed = GetAllowedBytes(&rx_next_us, now_us, SPSCRingBuffer_FreeLen(&rx_buffer), rx_busy);
+    if (allowed > 0)
+    {
+        ssize_t len = ::read(modbus_fd, data, allowed);
+        if (len > 0)
+        {
+            SPSCRingBuffer_QueueBytes(&rx_buffer, data, len);
+            ConsumeTime(&rx_next_us, len);
+        }
+        rx_busy = (len == (ssize_t)allowed);
+    }
+
+    uint16_t tx_len;
+    uint8_t *p_tx = SPSCRingBuffer_Peek(&tx_buffer, &tx_len);
+    if (tx_len == 0)
+    {
+        tx_busy = false;
+        return;
+    }
+
+    allowed = GetAllowedBytes(&tx_next_us, now_us, tx_len, tx_busy);
+    if (allowed > 0)
+    {
+        ssize_t len = ::write(modbus_fd, p_tx, allowed);
+        if (len > 0)
+        {
+            SPSCRingBuffer_Skip(&tx_buffer, len);
+            ConsumeTime(&tx_next_us, len);
+        }
+        tx_busy = !SPSCRingBuffer_IsEmpty(&tx_buffer);
+    }
+}
+
+static speed_t GetSpeed(uint32_t baud)
+{
+    switch (baud)
+    {
+        case 1200:
+            return B1200;
+        case 2400:
+            return B2400;
+        case 4800:
+            return B4800;
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        default:
+            return B38400;
+    }
+}
+
+#endif    // CMAKE_UNIT_TEST
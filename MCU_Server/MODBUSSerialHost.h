@@ -0,0 +1,90 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MODBUSSERIALHOST_H
+#define MODBUSSERIALHOST_H
+
+#ifdef CMAKE_UNIT_TEST
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Host implementation of the serial port used as MODBUS_INTERFACE, built when
+ *  CMAKE_UNIT_TEST is defined. Bytes are exchanged over a file descriptor
+ *  (pseudo terminal or socketpair end) at the baud rate set with begin(),
+ *  through the same RX and TX buffer sizes as Serial3 of Teensy LC. Time is
+ *  taken from micros(), so tests may run it on virtual time.
+ *
+ *  On pseudo terminal, begin() also sets line speed, which is shared by both
+ *  sides, so the peer can tell the baud rate frames are sent at.
+ */
+class MODBUSSerialHost_T
+{
+  public:
+    void   begin(uint32_t baud);
+    void   end(void);
+    void   flush(void);
+    int    available(void);
+    int    read(void);
+    size_t write(const uint8_t *p_buffer, size_t len);
+    void   transmitterEnable(uint8_t pin);
+};
+
+extern MODBUSSerialHost_T MODBUSSerialHost;
+
+/*
+ *  Open pseudo terminal and use its master side as MODBUS transport.
+ *
+ *  @param p_name       [out] buffer for path of pty slave device, to be opened by peer
+ *  @param name_len     size of p_name buffer
+ *
+ *  @return             True if success, false otherwise
+ */
+bool MODBUSSerialHost_OpenPty(char *p_name, size_t name_len);
+
+/*
+ *  Use given file descriptor (e.g. socketpair end) as MODBUS transport.
+ *
+ *  @param fd           File descriptor, switched to non-blocking mode
+ */
+void MODBUSSerialHost_SetFd(int fd);
+
+/*
+ *  Enable or disable throttling. If enabled, bytes are delivered in both
+ *  directions no faster than 10 bits per byte at current baud rate, otherwise
+ *  they are passed on as soon as available.
+ *
+ *  @param is_throttled     True to enable throttling, enabled by default
+ */
+void MODBUSSerialHost_SetThrottling(bool is_throttled);
+
+/*
+ *  Get baud rate set with last begin()
+ *
+ *  @return             Baud rate, 0 if begin() was not called
+ */
+uint32_t MODBUSSerialHost_GetBaudRate(void);
+
+#endif    // CMAKE_UNIT_TEST
+
+#endif    // MODBUSSERIALHOST_H
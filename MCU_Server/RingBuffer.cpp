@@ -84,6 +84,29 @@ bool RingBuffer_QueueBytes(RingBuffer_T *p_ring_buffer, uint8_t *table, uint16_t
     return true;
 }
 
+void RingBuffer_SpanWrite(RingBuffer_Span_T *p_span, uint16_t offset, const uint8_t *table, uint16_t table_len)
+{
+    if (offset < p_span->first_len)
+    {
+        uint16_t cpy_len = p_span->first_len - offset;
+        if (cpy_len > table_len)
+        {
+            cpy_len = table_len;
+        }
+
+        memcpy(p_span->p_first + offset, table, cpy_len);
+        table += cpy_len;
+        table_len -= cpy_len;
+        offset = 0;
+    }
+    else
+    {
+        offset -= p_span->first_len;
+    }
+
+    memcpy(p_span->p_second + offset, table, table_len);
+}
+
 uint8_t *RingBuffer_GetMaxContinuousBuffer(RingBuffer_T *p_ring_buffer, uint16_t *buf_len)
 {
     if (p_ring_buffer->rd + RingBuffer_DataLen(p_ring_buffer) > p_ring_buffer->buf_len)
@@ -105,7 +128,11 @@ uint16_t RingBuffer_DataLen(RingBuffer_T *p_ring_buffer)
 
 static bool IsOverflow(RingBuffer_T *p_ring_buffer, uint16_t len)
 {
-    return (len + RingBuffer_DataLen(p_ring_buffer)) > p_ring_buffer->buf_len;
+    /*
+     *  One byte is always kept free, completely filled buffer would have
+     *  wr == rd and could not be distinguished from empty one.
+     */
+    return (len + RingBuffer_DataLen(p_ring_buffer)) >= p_ring_buffer->buf_len;
 }
 
 static uint16_t MaxQueueBufferLen(RingBuffer_T *p_ring_buffer, uint16_t table_len)
@@ -36,6 +36,14 @@ typedef struct RingBuffer_Tag
     size_t   rd;
 } RingBuffer_T;
 
+typedef struct RingBuffer_Span_Tag
+{
+    uint8_t *p_first;
+    uint16_t first_len;
+    uint8_t *p_second;
+    uint16_t second_len;
+} RingBuffer_Span_T;
+
 /*
  *  Initialize ring buffer.
  *
@@ -111,4 +119,14 @@ uint16_t RingBuffer_DataLen(RingBuffer_T *p_ring_buffer);
  */
 uint8_t *RingBuffer_GetMaxContinuousBuffer(RingBuffer_T *p_ring_buffer, uint16_t *buf_len);
 
+/*
+ *  Write bytes into reserved span at given offset, handling wraparound.
+ *
+ *  @param p_span         Pointer to span obtained with SPSCRingBuffer_Reserve
+ *  @param offset         Offset from the beginning of the span
+ *  @param table          pointer to table with bytes to be written
+ *  @param table_len      length of table
+ */
+void RingBuffer_SpanWrite(RingBuffer_Span_T *p_span, uint16_t offset, const uint8_t *table, uint16_t table_len);
+
 #endif    //RINGBUFFER_H
@@ -36,6 +36,65 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define SDM_DEFAULT_ADDRESS 1
 #define SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED 10
 
+/**
+ * Response timeout of each meter is derived from its measured round trip times, as TCP
+ * retransmission timeout is (RFC 6298): smoothed RTT plus four mean deviations. SDM_QUERY_TIMEOUT
+ * is used until the first response. Timeout is doubled after every timeout in row and a meter
+ * timing out repeatedly is polled with exponentially growing delay, so an absent meter does not
+ * take the bus from the others.
+ */
+#define SDM_QUERY_TIMEOUT_MIN_MARGIN 40 /**< Minimal margin over smoothed RTT, covers loop latency and frame silence */
+#define SDM_QUERY_TIMEOUT_MAX 400       /**< Upper limit of doubled timeout, absent meter is probed this long */
+#define SDM_BACKOFF_INITIAL 250         /**< Polling delay after second timeout in row, in milliseconds */
+#define SDM_BACKOFF_MAX_STEPS 6         /**< Number of times polling delay is doubled, up to 16 seconds */
+#define SDM_SRTT_SHIFT 3                /**< Smoothed RTT is kept multiplied by 8, gain 1/8 */
+#define SDM_RTTVAR_SHIFT 2              /**< RTT deviation is kept multiplied by 4, gain 1/4 */
+
+/**
+ * Baud rate negotiation. All meters share the bus, so they are switched together. Meters are looked
+ * for at current baud rate and then at other supported ones. Meters found are switched to
+ * MODBUS_INTERFACE_BAUDRATE_MAX and their baud rate register is read back at the new rate. If any of
+ * them does not confirm it, all are switched back to MODBUS_INTERFACE_BAUDRATE, which is written once
+ * more at that rate for meters applying new baud rate only after restart. Negotiation starts over
+ * when all meters are lost, as they may have been reset or replaced.
+ */
+#define SDM_LINK_ATTEMPTS 3         /**< Requests sent to meter in each negotiation step before giving up */
+#define SDM_LINK_RETRY_PERIOD 60000 /**< Minimal time between negotiations, in milliseconds */
+
+/**
+ * SDM query planner configuration. Polled input registers lying no more than
+ * SDM_QUERY_MAX_GAP unused registers apart are read with single Read Input Registers
+ * request, as long as it does not exceed SDM_QUERY_MAX_REGISTERS. At 2400 baud every
+ * gap register costs about 8 ms, while every extra request costs 13 bytes and meter
+ * turnaround.
+ */
+#ifndef SDM_QUERY_MAX_GAP
+#define SDM_QUERY_MAX_GAP 16
+#endif
+
+#ifndef SDM_QUERY_MAX_REGISTERS
+#define SDM_QUERY_MAX_REGISTERS 40
+#endif
+
+/**
+ * SDM polling schedule. Every query is released one period after it was sent and has to be
+ * sent within next period, queries are selected earliest deadline first. Values reported by
+ * SensorInput every second are polled twice per report.
+ */
+#define SDM_POLL_PERIOD_REPORTED 500
+#define SDM_POLL_PERIOD_ENERGY 5000
+#define SDM_POLL_PERIOD_HOLDING 60000
+
+#define SDM_PRIORITY_HIGH 0
+#define SDM_PRIORITY_LOW 1
+
+#define SDM_STATS_WINDOW 10000 /**< Bus utilisation averaging window in milliseconds */
+
+#define SDM_FLOAT_REGISTERS (sizeof(float) / sizeof(uint16_t))
+#define SDM_BITS_PER_BYTE 10
+#define SDM_REGISTERS_TRANSFER_TIME(_num_of_registers, _baudrate) \
+    (((_num_of_registers)*sizeof(uint16_t) * SDM_BITS_PER_BYTE * 1000 + (_baudrate)-1) / (_baudrate))
+
 /**
  * SDM register addresses
  */
@@ -74,57 +133,287 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * SDM no query value
  */
 #define SDM_NO_QUERY 0xFFFF
+#define SDM_NO_QUERY_INDEX 0xFF
+
+
+#define SDM_INPUT_REGISTER(_address, _field, _period, _priority)    \
+    {                                                               \
+        _address, offsetof(SDM_State_T, _field), _period, _priority \
+    }
+
 
+typedef struct SDM_InputRegister_Tag
+{
+    uint16_t address;      /**< Address of first register of float value */
+    size_t   state_offset; /**< Offset of float value in SDM_State_T */
+    uint16_t period;       /**< Refresh period in milliseconds */
+    uint8_t  priority;     /**< Decides between queries with equal deadlines, lower value wins */
+} SDM_InputRegister_T;
+
+typedef struct SDM_InputQuery_Tag
+{
+    uint16_t start_address;    /**< First register read */
+    uint16_t num_of_registers; /**< Number of registers read */
+    uint8_t  first_entry;      /**< Index of first value in input_query_table */
+    uint8_t  num_of_entries;   /**< Number of values in input_query_table */
+} SDM_InputQuery_T;
+
+typedef struct SDM_Schedule_Tag
+{
+    uint32_t release;  /**< Timestamp since which query may be sent */
+    uint16_t period;   /**< Shortest period of values read by query */
+    uint8_t  priority; /**< Highest priority of values read by query */
+} SDM_Schedule_T;
+
+typedef struct SDM_BaudRate_Tag
+{
+    uint32_t baudrate; /**< Interface baudrate */
+    uint8_t  code;     /**< Value of SDM_HOLDING_REG_BAUD_RATE */
+} SDM_BaudRate_T;
 
-static const uint16_t input_query_table[] = {
-    SDM_INPUT_REG_VOLTAGE,
-    SDM_INPUT_REG_CURRENT,
-    SDM_INPUT_REG_ACTIVE_POWER,
-    SDM_INPUT_REG_TOTAL_ACTIVE_ENERGY,
+typedef enum
+{
+    SDM_LINK_PROBE,   /**< Reading baud rate register of all meters */
+    SDM_LINK_UPGRADE, /**< Writing MODBUS_INTERFACE_BAUDRATE_MAX to meters found */
+    SDM_LINK_VERIFY,  /**< Reading baud rate register back at MODBUS_INTERFACE_BAUDRATE_MAX */
+    SDM_LINK_REVERT,  /**< Writing MODBUS_INTERFACE_BAUDRATE to meters found, still at new baud rate */
+    SDM_LINK_RESTORE, /**< Writing MODBUS_INTERFACE_BAUDRATE again at that baud rate */
+    SDM_LINK_READY,   /**< Meters are polled */
+} SDM_LinkState_T;
+
+
+/* Has to be sorted by address */
+static const SDM_InputRegister_T input_query_table[] = {
+    SDM_INPUT_REGISTER(SDM_INPUT_REG_VOLTAGE, voltage, SDM_POLL_PERIOD_REPORTED, SDM_PRIORITY_HIGH),
+    SDM_INPUT_REGISTER(SDM_INPUT_REG_CURRENT, current, SDM_POLL_PERIOD_REPORTED, SDM_PRIORITY_HIGH),
+    SDM_INPUT_REGISTER(SDM_INPUT_REG_ACTIVE_POWER, active_power, SDM_POLL_PERIOD_REPORTED, SDM_PRIORITY_HIGH),
+    SDM_INPUT_REGISTER(SDM_INPUT_REG_TOTAL_ACTIVE_ENERGY,
+                       total_active_energy,
+                       SDM_POLL_PERIOD_ENERGY,
+                       SDM_PRIORITY_LOW),
 };
 static const size_t input_query_entries = sizeof(input_query_table) / sizeof(*input_query_table);
 
 static const uint16_t holding_query_table[] = {};
 static const size_t   holding_query_entries = sizeof(holding_query_table) / sizeof(*holding_query_table);
 
-static bool        is_enabled           = false;
-static uint8_t     slave_address        = SDM_DEFAULT_ADDRESS;
-static SDM_State_T state                = {0};
-static uint16_t    waiting_for_query    = SDM_NO_QUERY;
-static uint8_t     query_index          = 0;
-static uint32_t    last_query_timestamp = 0;
-static uint32_t    timeouts_in_row      = SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED + 1;
+/* Baud rates meters are looked for at, SDM_BAUD_1200 is left out as slower than the default one */
+static const SDM_BaudRate_T baud_rate_table[] = {
+    {2400, SDM_BAUD_2400},
+    {4800, SDM_BAUD_4800},
+    {9600, SDM_BAUD_9600},
+};
+static const size_t baud_rate_entries = sizeof(baud_rate_table) / sizeof(*baud_rate_table);
+
+typedef struct SDM_Meter_Tag
+{
+    uint8_t          address;           /**< MODBUS slave address */
+    uint32_t         timeouts_in_row;   /**< Queries in row that got no valid response */
+    uint16_t         srtt;              /**< Smoothed round trip time scaled by SDM_SRTT_SHIFT, 0 if unknown */
+    uint16_t         rttvar;            /**< Round trip time mean deviation scaled by SDM_RTTVAR_SHIFT */
+    uint8_t          backoff;           /**< Timeouts in row, up to SDM_BACKOFF_MAX_STEPS + 1 */
+    uint32_t         backoff_timestamp; /**< Meter is not polled before this time if backoff is above 1 */
+    bool             linked;            /**< Meter answered at current baud rate during negotiation */
+    SDM_State_T      state;
+    SDM_Schedule_T   schedule[input_query_entries + holding_query_entries];
+    uint32_t         value_timestamps[input_query_entries];
+    SDM_ValueStats_T value_stats[input_query_entries];
+} SDM_Meter_T;
+
+static bool             is_enabled                         = false;
+static SDM_Meter_T      meters[SDM_METERS_COUNT]           = {0};
+static SDM_InputQuery_T input_queries[input_query_entries] = {0};
+static size_t           input_queries_count                = 0;
+static size_t           schedule_count                     = 0;
+static uint16_t         waiting_for_query                  = SDM_NO_QUERY;
+static uint8_t          query_meter                        = 0;
+static uint8_t          query_index                        = SDM_NO_QUERY_INDEX;
+static uint32_t         query_timeout                      = SDM_QUERY_TIMEOUT;
+static uint32_t         query_transfer_time                = 0;
+static uint32_t         last_query_timestamp               = 0;
+static SDM_Stats_T      stats                              = {0};
+static uint32_t         stats_window_timestamp             = 0;
+static uint32_t         bus_busy_time                      = 0;
+static SDM_LinkState_T  link_state                         = SDM_LINK_READY;
+static size_t           link_baud_index                    = 0;
+static size_t           link_probes                        = 0;
+static uint8_t          link_meter                         = 0;
+static uint8_t          link_attempts                      = 0;
+static bool             link_pending                       = false;
+static bool             link_failed                        = false;
+static uint32_t         link_timestamp                     = 0;
 
 
 /**
- * Request input register value
+ * Merge polled input registers into as few Read Input Registers requests as possible
+ * and schedule all queries to be sent as soon as possible
  *
- * @param address   Register address
+ * @param max_gap   Maximum number of unused registers between two values read with single request
+ */
+static void SDM_PlanInputQueries(uint16_t max_gap);
+
+/**
+ * Select released query with earliest deadline among all meters. Equal deadlines are decided
+ * by priority, then by meter rotation starting after the meter queried last and then by order
+ * in meter schedule. Meters polled for the same values at the same period end up with equal
+ * deadlines, rotation takes them in turns instead of favouring the lowest meter index.
+ *
+ * @param now       Current timestamp
+ * @param p_meter   Pointer to write index of selected meter
+ * @return          Index of selected query in meter schedule or SDM_NO_QUERY_INDEX if there is none
+ */
+static uint8_t SDM_SelectQuery(uint32_t now, uint8_t *p_meter);
+
+/**
+ * Send scheduled query and release it again one period later
+ *
+ * @param meter     Meter index
+ * @param index     Index of query in meter schedule
+ * @param now       Current timestamp
+ */
+static void SDM_SendQuery(uint8_t meter, uint8_t index, uint32_t now);
+
+/**
+ * Mark query as outstanding
+ *
+ * @param meter             Meter index
+ * @param index             Index of query in meter schedule, SDM_NO_QUERY_INDEX if it is not scheduled
+ * @param address           Address of first register accessed
+ * @param transfer_time     Transfer time of registers read beside the first float, in milliseconds
+ * @param now               Current timestamp
+ */
+static void SDM_StartQuery(uint8_t meter, uint8_t index, uint16_t address, uint32_t transfer_time, uint32_t now);
+
+/**
+ * Find baud rate in baud_rate_table
+ *
+ * @param baudrate  Interface baudrate
+ * @return          Index of baud rate or baud_rate_entries if it is not supported
+ */
+static size_t SDM_FindBaudRate(uint32_t baudrate);
+
+/**
+ * Switch bus to baud rate and forget round trip times measured at previous one
+ *
+ * @param index     Index of baud rate in baud_rate_table
+ */
+static void SDM_SetBusBaudRate(size_t index);
+
+/**
+ * Start baud rate negotiation, polling is stopped until it is finished
  */
-static void SDM_SendRequestInput(uint16_t address);
+static void SDM_StartLink(void);
+
+/**
+ * Check result of last negotiation request and send next one, or move to next negotiation step
+ *
+ * @param now       Current timestamp
+ */
+static void SDM_ProcessLink(uint32_t now);
+
+/**
+ * Move to next negotiation step after all meters taking part in current one are done
+ *
+ * @param now       Current timestamp
+ */
+static void SDM_FinishLinkStep(uint32_t now);
+
+/**
+ * Send negotiation request of current step to link_meter
+ *
+ * @param now       Current timestamp
+ */
+static void SDM_SendLinkQuery(uint32_t now);
+
+/**
+ * Check if no meter responds anymore
+ *
+ * @return          true if all meters exceeded SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED
+ */
+static bool SDM_AreAllMetersLost(void);
+
+/**
+ * Get meter the response came from, if it is awaited
+ *
+ * @param slave_address     Address of responding meter
+ * @return                  Pointer to meter or NULL if no response from this address is awaited
+ */
+static SDM_Meter_T *SDM_GetRespondingMeter(uint8_t slave_address);
+
+/**
+ * Mark outstanding query as finished and account bus time it took
+ */
+static void SDM_FinishQuery(void);
+
+/**
+ * Get response timeout of meter, without transfer time of registers read
+ *
+ * @param p_meter   Pointer to meter
+ * @return          Timeout in milliseconds
+ */
+static uint32_t SDM_GetTimeout(const SDM_Meter_T *p_meter);
+
+/**
+ * Update smoothed round trip time of meter with response to outstanding query
+ *
+ * @param p_meter   Pointer to meter
+ */
+static void SDM_UpdateRoundTripTime(SDM_Meter_T *p_meter);
+
+/**
+ * Double response timeout of meter and delay its polling after repeated timeouts
+ *
+ * @param p_meter   Pointer to meter
+ * @param now       Current timestamp
+ */
+static void SDM_BackOff(SDM_Meter_T *p_meter, uint32_t now);
+
+/**
+ * Request input registers of planned query
+ *
+ * @param p_meter   Pointer to meter
+ * @param p_query   Pointer to query
+ */
+static void SDM_SendRequestInputQuery(const SDM_Meter_T *p_meter, const SDM_InputQuery_T *p_query);
+
+/**
+ * Write values read by planned query to meter state
+ *
+ * @param p_meter   Pointer to meter
+ * @param p_query   Pointer to query
+ * @param data_len  Incoming data len
+ * @param p_data    Pointer to incoming registers
+ */
+static void SDM_ProcessInputQueryData(SDM_Meter_T            *p_meter,
+                                      const SDM_InputQuery_T *p_query,
+                                      size_t                  data_len,
+                                      uint16_t               *p_data);
 
 /**
  * Request holding register value
  *
+ * @param p_meter   Pointer to meter
  * @param address   Register address
  */
-static void SDM_SendRequestHolding(uint16_t address);
+static void SDM_SendRequestHolding(const SDM_Meter_T *p_meter, uint16_t address);
 
 /**
  * Request float value write
  *
+ * @param meter     Meter index
  * @param value     Value to be written
  * @param address   Address to write
  */
-static void SDM_SendSetFloat(float value, uint16_t address);
+static void SDM_SendSetFloat(uint8_t meter, float value, uint16_t address);
 
 /**
  * Request word value write
  *
+ * @param meter     Meter index
  * @param value     Value to be written
  * @param address   Address to write
  */
-static void SDM_SendSetHEX(uint16_t value, uint16_t address);
+static void SDM_SendSetHEX(uint8_t meter, uint16_t value, uint16_t address);
 
 /**
  * Process incoming float data and write it to address
@@ -159,13 +448,17 @@ void LoopSDM(void)
     if (!is_enabled)
         return;
 
+    uint32_t now = Timestamp_GetCurrent();
+
     if (waiting_for_query != SDM_NO_QUERY)
     {
-        if (Timestamp_GetTimeElapsed(last_query_timestamp, Timestamp_GetCurrent()) >= SDM_QUERY_TIMEOUT)
+        if (Timestamp_GetTimeElapsed(last_query_timestamp, now) >= query_timeout)
         {
-            timeouts_in_row++;
+            meters[query_meter].timeouts_in_row++;
+            stats.timeouts++;
+            SDM_BackOff(&meters[query_meter], now);
 
-            waiting_for_query = SDM_NO_QUERY;
+            SDM_FinishQuery();
             MODBUS_ClearBuffer();
         }
         else
@@ -174,290 +467,810 @@ void LoopSDM(void)
         }
     }
 
-    if (waiting_for_query == SDM_NO_QUERY)
+    uint32_t window = Timestamp_GetTimeElapsed(stats_window_timestamp, now);
+    if (window >= SDM_STATS_WINDOW)
     {
-        switch (query_index)
-        {
-            case 0 ... input_query_entries - 1:
-            {
-                uint16_t query_address = input_query_table[query_index];
-
-                SDM_SendRequestInput(query_address);
-                waiting_for_query    = query_address;
-                last_query_timestamp = Timestamp_GetCurrent();
+        stats.bus_utilisation  = (uint16_t)((uint64_t)bus_busy_time * 1000 / window);
+        bus_busy_time          = 0;
+        stats_window_timestamp = now;
+    }
 
-                query_index++;
-                break;
-            }
-#if holding_query_entries == 0
-            case input_query_entries:
-#else
-            case input_query_entries ... input_query_entries + (holding_query_entries - 1):
-#endif
-            {
-                uint16_t query_address = holding_query_table[query_index - input_query_entries];
+    if ((link_state == SDM_LINK_READY) && SDM_AreAllMetersLost() &&
+        (Timestamp_GetTimeElapsed(link_timestamp, now) >= SDM_LINK_RETRY_PERIOD))
+    {
+        LOG_INFO("All meters lost, negotiating baud rate again");
+        SDM_StartLink();
+    }
 
-                SDM_SendRequestHolding(query_address);
-                waiting_for_query    = query_address;
-                last_query_timestamp = Timestamp_GetCurrent();
+    if (waiting_for_query == SDM_NO_QUERY)
+    {
+        if (link_state != SDM_LINK_READY)
+        {
+            SDM_ProcessLink(now);
+            return;
+        }
 
-                query_index++;
-                break;
-            }
-            default:
-            {
-                query_index       = 0;
-                waiting_for_query = SDM_NO_QUERY;
+        uint8_t meter;
+        uint8_t index = SDM_SelectQuery(now, &meter);
 
-                break;
-            }
+        if (index != SDM_NO_QUERY_INDEX)
+        {
+            SDM_SendQuery(meter, index, now);
         }
     }
 }
 
 void SetupSDM(void)
 {
-    MODBUS_INTERFACE.begin(MODBUS_INTERFACE_BAUDRATE);
+    SDM_SetBusBaudRate(SDM_FindBaudRate(MODBUS_INTERFACE_BAUDRATE));
     MODBUS_INTERFACE.transmitterEnable(PIN_MODBUS_RTS);
+
+    for (size_t i = 0; i < SDM_METERS_COUNT; i++)
+    {
+        meters[i].address         = SDM_DEFAULT_ADDRESS + i;
+        meters[i].timeouts_in_row = SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED + 1;
+    }
+
     // Waits for debug interface initialization.
     delay(1000);
+    SDM_PlanInputQueries(SDM_QUERY_MAX_GAP);
+    SDM_StartLink();
     is_enabled = true;
 }
 
-const SDM_State_T *SDM_GetState(void)
+const SDM_State_T *SDM_GetState(uint8_t meter)
 {
-    if (timeouts_in_row >= SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED)
+    if ((meter >= SDM_METERS_COUNT) || (meters[meter].timeouts_in_row >= SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED))
         return NULL;
 
-    return &state;
+    return &meters[meter].state;
+}
+
+const SDM_Stats_T *SDM_GetStats(void)
+{
+    return &stats;
+}
+
+bool SDM_GetMeterStats(uint8_t meter, SDM_MeterStats_T *p_stats)
+{
+    if (meter >= SDM_METERS_COUNT)
+        return false;
+
+    const SDM_Meter_T *p_meter = &meters[meter];
+
+    p_stats->address                  = p_meter->address;
+    p_stats->round_trip_time          = p_meter->srtt >> SDM_SRTT_SHIFT;
+    p_stats->round_trip_time_deviation = p_meter->rttvar >> SDM_RTTVAR_SHIFT;
+    p_stats->timeout                  = SDM_GetTimeout(p_meter);
+    p_stats->backoff                  = p_meter->backoff;
+
+    return true;
+}
+
+bool SDM_GetValueStats(uint8_t meter, size_t index, SDM_ValueStats_T *p_stats)
+{
+    if ((meter >= SDM_METERS_COUNT) || (index >= input_query_entries))
+        return false;
+
+    *p_stats         = meters[meter].value_stats[index];
+    p_stats->address = input_query_table[index].address;
+    p_stats->period  = input_query_table[index].period;
+    p_stats->age     = UINT32_MAX;
+
+    if (p_stats->refreshes > 0)
+    {
+        p_stats->age = Timestamp_GetTimeElapsed(meters[meter].value_timestamps[index], Timestamp_GetCurrent());
+    }
+
+    return true;
 }
 
-void SDM_SetRelayPulseWidth(uint8_t relay_pulse_width)
+void SDM_SetRelayPulseWidth(uint8_t meter, uint8_t relay_pulse_width)
 {
-    SDM_SendSetFloat((float)relay_pulse_width, SDM_HOLDING_REG_RELAY_PULSE_WIDTH);
+    SDM_SendSetFloat(meter, (float)relay_pulse_width, SDM_HOLDING_REG_RELAY_PULSE_WIDTH);
 }
 
-void SDM_SetNetworkParityStop(uint8_t network_parity_stop)
+void SDM_SetNetworkParityStop(uint8_t meter, uint8_t network_parity_stop)
 {
-    SDM_SendSetFloat((float)network_parity_stop, SDM_HOLDING_REG_NETWORK_PARITY_STOP);
+    SDM_SendSetFloat(meter, (float)network_parity_stop, SDM_HOLDING_REG_NETWORK_PARITY_STOP);
 }
 
-void SDM_SetMeterID(uint8_t meter_id)
+void SDM_SetMeterID(uint8_t meter, uint8_t meter_id)
 {
-    SDM_SendSetFloat((float)meter_id, SDM_HOLDING_REG_METER_ID);
+    SDM_SendSetFloat(meter, (float)meter_id, SDM_HOLDING_REG_METER_ID);
 }
 
-void SDM_SetBaudRate(uint8_t baud_rate)
+void SDM_SetBaudRate(uint8_t meter, uint8_t baud_rate)
 {
-    SDM_SendSetFloat((float)baud_rate, SDM_HOLDING_REG_BAUD_RATE);
+    SDM_SendSetFloat(meter, (float)baud_rate, SDM_HOLDING_REG_BAUD_RATE);
 }
 
-void SDM_SetCTPrimaryCurrent(uint16_t ct_primary_current)
+void SDM_SetCTPrimaryCurrent(uint8_t meter, uint16_t ct_primary_current)
 {
-    SDM_SendSetFloat((float)ct_primary_current, SDM_HOLDING_REG_CT_PRIMARY_CURRENT);
+    SDM_SendSetFloat(meter, (float)ct_primary_current, SDM_HOLDING_REG_CT_PRIMARY_CURRENT);
 }
 
-void SDM_SetPulse1OutputMode(uint8_t pulse1_output_mode)
+void SDM_SetPulse1OutputMode(uint8_t meter, uint8_t pulse1_output_mode)
 {
-    SDM_SendSetHEX(pulse1_output_mode, SDM_HOLDING_REG_PULSE_1_OUTPUT_MODE);
+    SDM_SendSetHEX(meter, pulse1_output_mode, SDM_HOLDING_REG_PULSE_1_OUTPUT_MODE);
 }
 
-void SDM_SetTimeOfScrollDisplay(uint16_t time_of_scroll_display)
+void SDM_SetTimeOfScrollDisplay(uint8_t meter, uint16_t time_of_scroll_display)
 {
-    SDM_SendSetHEX(time_of_scroll_display, SDM_HOLDING_REG_TIME_OF_SCROLL_DISPLAY);
+    SDM_SendSetHEX(meter, time_of_scroll_display, SDM_HOLDING_REG_TIME_OF_SCROLL_DISPLAY);
 }
 
-void SDM_SetPulse1Output(uint16_t pulse1_output)
+void SDM_SetPulse1Output(uint8_t meter, uint16_t pulse1_output)
 {
-    SDM_SendSetHEX(pulse1_output, SDM_HOLDING_REG_PULSE_1_OUTPUT);
+    SDM_SendSetHEX(meter, pulse1_output, SDM_HOLDING_REG_PULSE_1_OUTPUT);
 }
 
-void SDM_SetMeasurementMode(uint16_t measurement_mode)
+void SDM_SetMeasurementMode(uint8_t meter, uint16_t measurement_mode)
 {
-    SDM_SendSetHEX(measurement_mode, SDM_HOLDING_REG_MEASUREMENT_MODE);
+    SDM_SendSetHEX(meter, measurement_mode, SDM_HOLDING_REG_MEASUREMENT_MODE);
 }
 
 void MODBUS_ProcessReadInputRegisters(uint8_t slave_address, size_t data_len, uint16_t *p_data)
 {
     LOG_DEBUG("Processing query: %04X, len %d", waiting_for_query, data_len);
 
+    SDM_Meter_T *p_meter = SDM_GetRespondingMeter(slave_address);
+
+    if (p_meter == NULL)
+        return;
+
+    if ((query_index < input_queries_count) && (input_queries[query_index].start_address == waiting_for_query) &&
+        (input_queries[query_index].num_of_registers == data_len))
+    {
+        SDM_ProcessInputQueryData(p_meter, &input_queries[query_index], data_len, p_data);
+    }
+
+    SDM_UpdateRoundTripTime(p_meter);
+    SDM_FinishQuery();
+    p_meter->timeouts_in_row = 0;
+}
+
+void MODBUS_ProcessReadHoldingRegisters(uint8_t slave_address, size_t data_len, uint16_t *p_data)
+{
+    LOG_DEBUG("Processing query: %04X, len %d", waiting_for_query, data_len);
+
+    SDM_Meter_T *p_meter = SDM_GetRespondingMeter(slave_address);
+
+    if (p_meter == NULL)
+        return;
+
+    SDM_State_T *p_state = &p_meter->state;
+
     switch (waiting_for_query)
     {
-        case SDM_INPUT_REG_VOLTAGE:
-            SDM_ProcessFloatData(data_len, p_data, &state.voltage);
+        case SDM_HOLDING_REG_RELAY_PULSE_WIDTH:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->relay_pulse_width);
             break;
 
-        case SDM_INPUT_REG_CURRENT:
-            SDM_ProcessFloatData(data_len, p_data, &state.current);
+        case SDM_HOLDING_REG_NETWORK_PARITY_STOP:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->network_parity_stop);
             break;
 
-        case SDM_INPUT_REG_ACTIVE_POWER:
-            SDM_ProcessFloatData(data_len, p_data, &state.active_power);
+        case SDM_HOLDING_REG_METER_ID:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->meter_id);
             break;
 
-        case SDM_INPUT_REG_APPARENT_POWER:
-            SDM_ProcessFloatData(data_len, p_data, &state.apparent_power);
+        case SDM_HOLDING_REG_BAUD_RATE:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->baud_rate);
             break;
 
-        case SDM_INPUT_REG_REACTIVE_POWER:
-            SDM_ProcessFloatData(data_len, p_data, &state.reactive_power);
+        case SDM_HOLDING_REG_CT_PRIMARY_CURRENT:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->ct_primary_current);
             break;
 
-        case SDM_INPUT_REG_POWER_FACTOR:
-            SDM_ProcessFloatData(data_len, p_data, &state.power_factor);
+        case SDM_HOLDING_REG_PULSE_1_OUTPUT_MODE:
+            SDM_ProcessUint8InsideFloatData(data_len, p_data, &p_state->pulse1_output_mode);
             break;
 
-        case SDM_INPUT_REG_FREQUENCY:
-            SDM_ProcessFloatData(data_len, p_data, &state.frequency);
+        case SDM_HOLDING_REG_TIME_OF_SCROLL_DISPLAY:
+            SDM_ProcessUint16Data(data_len, p_data, &p_state->time_of_scroll_display);
             break;
 
-        case SDM_INPUT_REG_IMPORT_ACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.import_active_energy);
+        case SDM_HOLDING_REG_PULSE_1_OUTPUT:
+            SDM_ProcessUint16Data(data_len, p_data, &p_state->pulse1_output);
             break;
 
-        case SDM_INPUT_REG_EXPORT_ACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.export_active_energy);
+        case SDM_HOLDING_REG_MEASUREMENT_MODE:
+            SDM_ProcessUint16Data(data_len, p_data, &p_state->measurement_mode);
             break;
 
-        case SDM_INPUT_REG_IMPORT_REACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.import_reactive_energy);
+        default:
             break;
+    }
 
-        case SDM_INPUT_REG_EXPORT_REACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.export_reactive_energy);
-            break;
+    SDM_UpdateRoundTripTime(p_meter);
+    SDM_FinishQuery();
+    p_meter->timeouts_in_row = 0;
+}
 
-        case SDM_INPUT_REG_TOTAL_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.total_system_power_demand);
-            break;
 
-        case SDM_INPUT_REG_MAX_TOTAL_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.max_total_system_power_demand);
-            break;
+void MODBUS_ProcessReadPresetSingleRegister(uint8_t slave_address, uint16_t register_address, uint16_t preset_data)
+{
+    /// Not implemented
+}
 
-        case SDM_INPUT_REG_IMPORT_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.import_system_power_demand);
-            break;
+void MODBUS_ProcessReadPresetMultipleRegisters(uint8_t  slave_address,
+                                               uint16_t starting_address,
+                                               uint16_t num_of_registers)
+{
+    SDM_Meter_T *p_meter = SDM_GetRespondingMeter(slave_address);
 
-        case SDM_INPUT_REG_MAX_IMPORT_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.max_import_system_power_demand);
-            break;
+    // Only writes made by baud rate negotiation are awaited
+    if ((p_meter == NULL) || (starting_address != waiting_for_query))
+        return;
 
-        case SDM_INPUT_REG_EXPORT_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.export_system_power_demand);
-            break;
+    // Write request is longer than read one, it is not used as round trip time sample
+    p_meter->backoff = 0;
 
-        case SDM_INPUT_REG_MAX_EXPORT_SYSTEM_POWER_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.max_export_system_power_demand);
-            break;
+    SDM_FinishQuery();
+    p_meter->timeouts_in_row = 0;
+}
 
-        case SDM_INPUT_REG_CURRENT_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.current_demand);
-            break;
+void MODBUS_ProcessException(uint8_t slave_address, uint8_t original_function_code, uint8_t error_code)
+{
+    LOG_DEBUG("Received MODBUS exception");
 
-        case SDM_INPUT_REG_MAX_CURRENT_DEMAND:
-            SDM_ProcessFloatData(data_len, p_data, &state.max_current_demand);
-            break;
+    SDM_Meter_T *p_meter = SDM_GetRespondingMeter(slave_address);
 
-        case SDM_INPUT_REG_TOTAL_ACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.total_active_energy);
-            break;
+    if (p_meter == NULL)
+        return;
 
-        case SDM_INPUT_REG_TOTAL_REACTIVE_ENERGY:
-            SDM_ProcessFloatData(data_len, p_data, &state.total_reactive_energy);
-            break;
+    // Exception response is shorter than regular one, it is not used as round trip time sample
+    p_meter->backoff = 0;
 
-        default:
-            break;
+    if ((error_code == MODBUS_ERROR_ILLEGAL_DATA_ADDRESS) && (query_index < input_queries_count))
+    {
+        const SDM_InputQuery_T *p_query = &input_queries[query_index];
+
+        if ((p_query->start_address == waiting_for_query) &&
+            (p_query->num_of_registers > p_query->num_of_entries * SDM_FLOAT_REGISTERS))
+        {
+            LOG_INFO("Meter rejected read of unused registers, polling without gaps");
+            SDM_PlanInputQueries(0);
+        }
     }
 
-    waiting_for_query = SDM_NO_QUERY;
-    timeouts_in_row   = 0;
+    SDM_FinishQuery();
 }
 
-void MODBUS_ProcessReadHoldingRegisters(uint8_t slave_address, size_t data_len, uint16_t *p_data)
+void MODBUS_ProcessFrameError(void)
 {
-    LOG_DEBUG("Processing query: %04X, len %d", waiting_for_query, data_len);
+    LOG_DEBUG("Received corrupted MODBUS frame");
 
-    switch (waiting_for_query)
+    if (waiting_for_query != SDM_NO_QUERY)
     {
-        case SDM_HOLDING_REG_RELAY_PULSE_WIDTH:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.relay_pulse_width);
-            break;
+        // Response will not come anymore, ask again at once instead of waiting for timeout
+        if (query_index < schedule_count)
+        {
+            meters[query_meter].schedule[query_index].release = Timestamp_GetCurrent();
+        }
 
-        case SDM_HOLDING_REG_NETWORK_PARITY_STOP:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.network_parity_stop);
-            break;
+        meters[query_meter].timeouts_in_row++;
+        meters[query_meter].backoff = 0;
+        SDM_FinishQuery();
+    }
+}
 
-        case SDM_HOLDING_REG_METER_ID:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.meter_id);
-            break;
+static void SDM_PlanInputQueries(uint16_t max_gap)
+{
+    input_queries_count = 0;
 
-        case SDM_HOLDING_REG_BAUD_RATE:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.baud_rate);
+    for (size_t i = 0; i < input_query_entries; i++)
+    {
+        uint16_t address = input_query_table[i].address;
+
+        if (input_queries_count > 0)
+        {
+            SDM_InputQuery_T *p_query = &input_queries[input_queries_count - 1];
+            uint16_t          end     = p_query->start_address + p_query->num_of_registers;
+
+            if ((address - end <= max_gap) &&
+                (address + SDM_FLOAT_REGISTERS - p_query->start_address <= SDM_QUERY_MAX_REGISTERS))
+            {
+                p_query->num_of_registers = address + SDM_FLOAT_REGISTERS - p_query->start_address;
+                p_query->num_of_entries++;
+                continue;
+            }
+        }
+
+        SDM_InputQuery_T *p_query = &input_queries[input_queries_count++];
+        p_query->start_address    = address;
+        p_query->num_of_registers = SDM_FLOAT_REGISTERS;
+        p_query->first_entry      = i;
+        p_query->num_of_entries   = 1;
+    }
+
+    uint32_t now   = Timestamp_GetCurrent();
+    schedule_count = 0;
+
+    for (size_t i = 0; i < input_queries_count; i++)
+    {
+        const SDM_InputQuery_T *p_query    = &input_queries[i];
+        SDM_Schedule_T         *p_schedule = &meters[0].schedule[schedule_count++];
+
+        p_schedule->release  = now;
+        p_schedule->period   = UINT16_MAX;
+        p_schedule->priority = UINT8_MAX;
+
+        for (size_t j = p_query->first_entry; j < p_query->first_entry + p_query->num_of_entries; j++)
+        {
+            if (input_query_table[j].period < p_schedule->period)
+            {
+                p_schedule->period = input_query_table[j].period;
+            }
+            if (input_query_table[j].priority < p_schedule->priority)
+            {
+                p_schedule->priority = input_query_table[j].priority;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < holding_query_entries; i++)
+    {
+        SDM_Schedule_T *p_schedule = &meters[0].schedule[schedule_count++];
+        p_schedule->release        = now;
+        p_schedule->period         = SDM_POLL_PERIOD_HOLDING;
+        p_schedule->priority       = SDM_PRIORITY_LOW;
+    }
+
+    // All meters are polled for the same values
+    for (size_t i = 1; i < SDM_METERS_COUNT; i++)
+    {
+        memcpy(meters[i].schedule, meters[0].schedule, sizeof(meters[0].schedule));
+    }
+
+    query_index = SDM_NO_QUERY_INDEX;
+
+    LOG_INFO("Polling %d input values with %d requests", input_query_entries, input_queries_count);
+}
+
+static uint8_t SDM_SelectQuery(uint32_t now, uint8_t *p_meter)
+{
+    uint8_t  selected          = SDM_NO_QUERY_INDEX;
+    uint8_t  selected_priority = 0;
+    uint32_t selected_deadline = 0;
+
+    for (size_t n = 1; n <= SDM_METERS_COUNT; n++)
+    {
+        uint8_t meter = (query_meter + n) % SDM_METERS_COUNT;
+
+        if ((meters[meter].backoff > 1) && (now != meters[meter].backoff_timestamp) &&
+            Timestamp_Compare(now, meters[meter].backoff_timestamp))
+            continue;
+
+        for (size_t i = 0; i < schedule_count; i++)
+        {
+            const SDM_Schedule_T *p_schedule = &meters[meter].schedule[i];
+            uint32_t              deadline   = Timestamp_GetDelayed(p_schedule->release, p_schedule->period);
+
+            // Query is released at its release time, Timestamp_Compare is true on equal timestamps
+            if ((now != p_schedule->release) && Timestamp_Compare(now, p_schedule->release))
+                continue;
+
+            if (selected != SDM_NO_QUERY_INDEX)
+            {
+                if ((deadline != selected_deadline) && Timestamp_Compare(selected_deadline, deadline))
+                    continue;
+
+                // Equal priority keeps the query found first in meter rotation
+                if ((selected_deadline == deadline) && (selected_priority <= p_schedule->priority))
+                    continue;
+            }
+
+            selected          = i;
+            selected_priority = p_schedule->priority;
+            selected_deadline = deadline;
+            *p_meter          = meter;
+        }
+    }
+
+    return selected;
+}
+
+static void SDM_SendQuery(uint8_t meter, uint8_t index, uint32_t now)
+{
+    SDM_Meter_T    *p_meter    = &meters[meter];
+    SDM_Schedule_T *p_schedule = &p_meter->schedule[index];
+
+    // Deadlines of meter in backoff are missed on purpose, query sent right at its deadline is in time
+    uint32_t deadline = Timestamp_GetDelayed(p_schedule->release, p_schedule->period);
+    if ((p_meter->backoff == 0) && (deadline != now) && Timestamp_Compare(deadline, now))
+    {
+        stats.missed_deadlines++;
+    }
+    p_schedule->release = Timestamp_GetDelayed(now, p_schedule->period);
+
+    MODBUS_ClearBuffer();
+
+    if (index < input_queries_count)
+    {
+        const SDM_InputQuery_T *p_query = &input_queries[index];
+
+        SDM_SendRequestInputQuery(p_meter, p_query);
+        SDM_StartQuery(meter,
+                       index,
+                       p_query->start_address,
+                       SDM_REGISTERS_TRANSFER_TIME(p_query->num_of_registers - SDM_FLOAT_REGISTERS,
+                                                   baud_rate_table[link_baud_index].baudrate),
+                       now);
+    }
+    else
+    {
+        uint16_t query_address = holding_query_table[index - input_queries_count];
+
+        SDM_SendRequestHolding(p_meter, query_address);
+        SDM_StartQuery(meter, index, query_address, 0, now);
+    }
+}
+
+static void SDM_StartQuery(uint8_t meter, uint8_t index, uint16_t address, uint32_t transfer_time, uint32_t now)
+{
+    waiting_for_query    = address;
+    query_transfer_time  = transfer_time;
+    query_timeout        = SDM_GetTimeout(&meters[meter]) + transfer_time;
+    query_meter          = meter;
+    query_index          = index;
+    last_query_timestamp = now;
+    stats.requests++;
+}
+
+static size_t SDM_FindBaudRate(uint32_t baudrate)
+{
+    size_t index = 0;
+
+    while ((index < baud_rate_entries) && (baud_rate_table[index].baudrate != baudrate))
+    {
+        index++;
+    }
+
+    return index;
+}
+
+static void SDM_SetBusBaudRate(size_t index)
+{
+    if (index >= baud_rate_entries)
+    {
+        index = 0;
+    }
+
+    link_baud_index = index;
+    stats.baudrate  = baud_rate_table[index].baudrate;
+    MODBUS_SetBaudrate(baud_rate_table[index].baudrate);
+
+    for (size_t i = 0; i < SDM_METERS_COUNT; i++)
+    {
+        meters[i].srtt    = 0;
+        meters[i].rttvar  = 0;
+        meters[i].backoff = 0;
+    }
+}
+
+static void SDM_StartLink(void)
+{
+    for (size_t i = 0; i < SDM_METERS_COUNT; i++)
+    {
+        meters[i].linked = false;
+    }
+
+    link_state    = SDM_LINK_PROBE;
+    link_probes   = 0;
+    link_meter    = 0;
+    link_attempts = 0;
+    link_pending  = false;
+}
+
+static void SDM_ProcessLink(uint32_t now)
+{
+    if (link_pending)
+    {
+        SDM_Meter_T *p_meter  = &meters[link_meter];
+        bool         answered = (p_meter->timeouts_in_row == 0);
+
+        link_pending = false;
+
+        if (answered && (link_state == SDM_LINK_PROBE))
+        {
+            p_meter->linked = true;
+        }
+
+        if (answered && (link_state == SDM_LINK_VERIFY) &&
+            (p_meter->state.baud_rate != baud_rate_table[link_baud_index].code))
+        {
+            LOG_INFO("Meter %d reports baud rate %d", p_meter->address, p_meter->state.baud_rate);
+            answered = false;
+        }
+
+        if (!answered && (++link_attempts < SDM_LINK_ATTEMPTS))
+        {
+            SDM_SendLinkQuery(now);
+            return;
+        }
+
+        if (!answered && (link_state == SDM_LINK_VERIFY))
+        {
+            link_failed = true;
+        }
+
+        link_attempts = 0;
+        link_meter++;
+    }
+
+    // Meters not found are left out of all steps after probing
+    while ((link_meter < SDM_METERS_COUNT) && (link_state != SDM_LINK_PROBE) && !meters[link_meter].linked)
+    {
+        link_meter++;
+    }
+
+    if (link_meter < SDM_METERS_COUNT)
+    {
+        SDM_SendLinkQuery(now);
+    }
+    else
+    {
+        SDM_FinishLinkStep(now);
+    }
+}
+
+static void SDM_FinishLinkStep(uint32_t now)
+{
+    size_t target_index  = SDM_FindBaudRate(MODBUS_INTERFACE_BAUDRATE_MAX);
+    size_t default_index = SDM_FindBaudRate(MODBUS_INTERFACE_BAUDRATE);
+
+    link_meter = 0;
+
+    switch (link_state)
+    {
+        case SDM_LINK_PROBE:
+        {
+            bool found = false;
+
+            for (size_t i = 0; i < SDM_METERS_COUNT; i++)
+            {
+                found = found || meters[i].linked;
+            }
+
+            if (found)
+            {
+                bool upgrade = !link_failed && (target_index < baud_rate_entries) && (target_index != link_baud_index);
+
+                link_state = upgrade ? SDM_LINK_UPGRADE : SDM_LINK_READY;
+            }
+            else if (++link_probes < baud_rate_entries)
+            {
+                SDM_SetBusBaudRate((link_baud_index + 1) % baud_rate_entries);
+            }
+            else
+            {
+                SDM_SetBusBaudRate(default_index);
+                link_state = SDM_LINK_READY;
+            }
+            break;
+        }
+        case SDM_LINK_UPGRADE:
+            SDM_SetBusBaudRate(target_index);
+            link_state = SDM_LINK_VERIFY;
             break;
 
-        case SDM_HOLDING_REG_CT_PRIMARY_CURRENT:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.ct_primary_current);
+        case SDM_LINK_VERIFY:
+            link_state = link_failed ? SDM_LINK_REVERT : SDM_LINK_READY;
             break;
 
-        case SDM_HOLDING_REG_PULSE_1_OUTPUT_MODE:
-            SDM_ProcessUint8InsideFloatData(data_len, p_data, &state.pulse1_output_mode);
+        case SDM_LINK_REVERT:
+            SDM_SetBusBaudRate(default_index);
+            link_state = SDM_LINK_RESTORE;
             break;
 
-        case SDM_HOLDING_REG_TIME_OF_SCROLL_DISPLAY:
-            SDM_ProcessUint16Data(data_len, p_data, &state.time_of_scroll_display);
+        case SDM_LINK_RESTORE:
+        default:
+            link_state = SDM_LINK_READY;
             break;
+    }
 
-        case SDM_HOLDING_REG_PULSE_1_OUTPUT:
-            SDM_ProcessUint16Data(data_len, p_data, &state.pulse1_output);
+    if (link_state == SDM_LINK_READY)
+    {
+        LOG_INFO("Polling meters at %d baud", baud_rate_table[link_baud_index].baudrate);
+        link_timestamp = now;
+    }
+}
+
+static void SDM_SendLinkQuery(uint32_t now)
+{
+    uint8_t code = baud_rate_table[SDM_FindBaudRate(MODBUS_INTERFACE_BAUDRATE)].code;
+
+    MODBUS_ClearBuffer();
+
+    switch (link_state)
+    {
+        case SDM_LINK_PROBE:
+        case SDM_LINK_VERIFY:
+            SDM_SendRequestHolding(&meters[link_meter], SDM_HOLDING_REG_BAUD_RATE);
             break;
 
-        case SDM_HOLDING_REG_MEASUREMENT_MODE:
-            SDM_ProcessUint16Data(data_len, p_data, &state.measurement_mode);
+        case SDM_LINK_UPGRADE:
+            code = baud_rate_table[SDM_FindBaudRate(MODBUS_INTERFACE_BAUDRATE_MAX)].code;
+            SDM_SendSetFloat(link_meter, (float)code, SDM_HOLDING_REG_BAUD_RATE);
             break;
 
         default:
+            SDM_SendSetFloat(link_meter, (float)code, SDM_HOLDING_REG_BAUD_RATE);
             break;
     }
 
-    waiting_for_query = SDM_NO_QUERY;
-    timeouts_in_row   = 0;
+    SDM_StartQuery(link_meter, SDM_NO_QUERY_INDEX, SDM_HOLDING_REG_BAUD_RATE, 0, now);
+    link_pending = true;
+
+    // Round trip time is not known at this baud rate yet, late response must not be taken for the next one
+    query_timeout = SDM_QUERY_TIMEOUT_MAX;
 }
 
+static bool SDM_AreAllMetersLost(void)
+{
+    for (size_t i = 0; i < SDM_METERS_COUNT; i++)
+    {
+        if (meters[i].timeouts_in_row < SDM_MAX_TIMEOUTS_IN_ROW_ALLOWED)
+            return false;
+    }
+
+    return true;
+}
 
-void MODBUS_ProcessReadPresetSingleRegister(uint8_t slave_address, uint16_t register_address, uint16_t preset_data)
+static SDM_Meter_T *SDM_GetRespondingMeter(uint8_t slave_address)
 {
-    /// Not implemented
+    if ((waiting_for_query == SDM_NO_QUERY) || (meters[query_meter].address != slave_address))
+    {
+        LOG_DEBUG("Unexpected response from %d", slave_address);
+        return NULL;
+    }
+
+    return &meters[query_meter];
 }
 
-void MODBUS_ProcessReadPresetMultipleRegisters(uint8_t  slave_address,
-                                               uint16_t starting_address,
-                                               uint16_t num_of_registers)
+static void SDM_FinishQuery(void)
 {
-    /// Not implemented
+    bus_busy_time += Timestamp_GetTimeElapsed(last_query_timestamp, Timestamp_GetCurrent());
+    waiting_for_query = SDM_NO_QUERY;
 }
 
-void MODBUS_ProcessException(uint8_t slave_address, uint8_t original_function_code, uint8_t error_code)
+static uint32_t SDM_GetTimeout(const SDM_Meter_T *p_meter)
 {
-    /// Not implemented
-    LOG_DEBUG("Received MODBUS exception");
+    uint32_t timeout = SDM_QUERY_TIMEOUT;
 
-    waiting_for_query = SDM_NO_QUERY;
+    if (p_meter->srtt != 0)
+    {
+        // Scaled deviation is already four mean deviations
+        uint32_t margin = p_meter->rttvar;
+
+        if (margin < SDM_QUERY_TIMEOUT_MIN_MARGIN)
+        {
+            margin = SDM_QUERY_TIMEOUT_MIN_MARGIN;
+        }
+
+        timeout = (p_meter->srtt >> SDM_SRTT_SHIFT) + margin;
+    }
+
+    for (uint8_t i = 0; (i < p_meter->backoff) && (timeout < SDM_QUERY_TIMEOUT_MAX); i++)
+    {
+        timeout *= 2;
+    }
+
+    if (timeout > SDM_QUERY_TIMEOUT_MAX)
+    {
+        timeout = SDM_QUERY_TIMEOUT_MAX;
+    }
+
+    return timeout;
+}
+
+static void SDM_UpdateRoundTripTime(SDM_Meter_T *p_meter)
+{
+    // Queries are never repeated and late responses are dropped, so every sample is unambiguous
+    uint32_t elapsed = Timestamp_GetTimeElapsed(last_query_timestamp, Timestamp_GetCurrent());
+    int32_t  rtt     = (elapsed > query_transfer_time) ? (int32_t)(elapsed - query_transfer_time) : 1;
+
+    if (rtt > SDM_QUERY_TIMEOUT_MAX)
+    {
+        rtt = SDM_QUERY_TIMEOUT_MAX;
+    }
+
+    if (p_meter->srtt == 0)
+    {
+        p_meter->srtt   = rtt << SDM_SRTT_SHIFT;
+        p_meter->rttvar = (rtt / 2) << SDM_RTTVAR_SHIFT;
+    }
+    else
+    {
+        int32_t delta = rtt - (p_meter->srtt >> SDM_SRTT_SHIFT);
+
+        p_meter->srtt += delta;
+
+        if (delta < 0)
+        {
+            delta = -delta;
+        }
+
+        p_meter->rttvar += delta - (p_meter->rttvar >> SDM_RTTVAR_SHIFT);
+    }
+
+    p_meter->backoff = 0;
+}
+
+static void SDM_BackOff(SDM_Meter_T *p_meter, uint32_t now)
+{
+    if (p_meter->backoff > 0)
+    {
+        uint8_t steps = p_meter->backoff - 1;
+
+        if (steps > SDM_BACKOFF_MAX_STEPS)
+        {
+            steps = SDM_BACKOFF_MAX_STEPS;
+        }
+
+        p_meter->backoff_timestamp = Timestamp_GetDelayed(now, (uint32_t)SDM_BACKOFF_INITIAL << steps);
+    }
+
+    if (p_meter->backoff <= SDM_BACKOFF_MAX_STEPS)
+    {
+        p_meter->backoff++;
+    }
+}
+
+static void SDM_SendRequestInputQuery(const SDM_Meter_T *p_meter, const SDM_InputQuery_T *p_query)
+{
+    MODBUS_SendReadInputRegisters(p_meter->address, p_query->start_address, p_query->num_of_registers);
 }
 
-static void SDM_SendRequestInput(uint16_t address)
+static void SDM_ProcessInputQueryData(SDM_Meter_T            *p_meter,
+                                      const SDM_InputQuery_T *p_query,
+                                      size_t                  data_len,
+                                      uint16_t               *p_data)
 {
-    MODBUS_SendReadInputRegisters(slave_address, address, sizeof(float) / sizeof(uint16_t));
+    uint32_t now = Timestamp_GetCurrent();
+
+    for (size_t i = p_query->first_entry; i < p_query->first_entry + p_query->num_of_entries; i++)
+    {
+        size_t            offset  = input_query_table[i].address - p_query->start_address;
+        float            *p_dest  = (float *)((uint8_t *)&p_meter->state + input_query_table[i].state_offset);
+        SDM_ValueStats_T *p_stats = &p_meter->value_stats[i];
+
+        if (offset + SDM_FLOAT_REGISTERS > data_len)
+        {
+            LOG_DEBUG("Response too short for %04X, data_len: %d", input_query_table[i].address, data_len);
+            MODBUS_ClearBuffer();
+            return;
+        }
+
+        SDM_ProcessFloatData(data_len - offset, p_data + offset, p_dest);
+
+        if (p_stats->refreshes > 0)
+        {
+            uint32_t age = Timestamp_GetTimeElapsed(p_meter->value_timestamps[i], now);
+
+            if (age > p_stats->max_age)
+            {
+                p_stats->max_age = age;
+            }
+            if (age > 2 * (uint32_t)input_query_table[i].period)
+            {
+                p_stats->late_refreshes++;
+            }
+        }
+        p_stats->refreshes++;
+        p_meter->value_timestamps[i] = now;
+    }
 }
 
-static void SDM_SendRequestHolding(uint16_t address)
+static void SDM_SendRequestHolding(const SDM_Meter_T *p_meter, uint16_t address)
 {
-    MODBUS_SendReadHoldingRegisters(slave_address, address, sizeof(float) / sizeof(uint16_t));
+    MODBUS_SendReadHoldingRegisters(p_meter->address, address, sizeof(float) / sizeof(uint16_t));
 }
 
 
-static void SDM_SendSetFloat(float value, uint16_t address)
+static void SDM_SendSetFloat(uint8_t meter, float value, uint16_t address)
 {
     uint16_t  to_send[sizeof(float) / sizeof(uint16_t)];
     uint16_t *p_value = (uint16_t *)&value;
@@ -465,12 +1278,18 @@ static void SDM_SendSetFloat(float value, uint16_t address)
     to_send[0] = p_value[1];
     to_send[1] = p_value[0];
 
-    MODBUS_SendPresetMultipleRegisters(slave_address, address, 2, to_send);
+    if (meter < SDM_METERS_COUNT)
+    {
+        MODBUS_SendPresetMultipleRegisters(meters[meter].address, address, 2, to_send);
+    }
 }
 
-static void SDM_SendSetHEX(uint16_t value, uint16_t address)
+static void SDM_SendSetHEX(uint8_t meter, uint16_t value, uint16_t address)
 {
-    MODBUS_SendPresetSingleRegister(slave_address, address, value);
+    if (meter < SDM_METERS_COUNT)
+    {
+        MODBUS_SendPresetSingleRegister(meters[meter].address, address, value);
+    }
 }
 
 static void SDM_ProcessFloatData(size_t data_len, uint16_t *p_data, float *p_dest)
@@ -96,6 +96,34 @@ typedef struct SDM_State_Tag
     uint16_t measurement_mode;
 } SDM_State_T;
 
+typedef struct SDM_ValueStats_Tag
+{
+    uint16_t address;        /**< Input register address */
+    uint16_t period;         /**< Requested refresh period in milliseconds */
+    uint32_t age;            /**< Time since last refresh in milliseconds, UINT32_MAX if never refreshed */
+    uint32_t max_age;        /**< Longest time between two refreshes in milliseconds */
+    uint32_t refreshes;      /**< Number of refreshes */
+    uint16_t late_refreshes; /**< Refreshes more than two periods after previous one */
+} SDM_ValueStats_T;
+
+typedef struct SDM_MeterStats_Tag
+{
+    uint8_t  address;                   /**< MODBUS slave address */
+    uint16_t round_trip_time;           /**< Smoothed round trip time in milliseconds, 0 if not measured yet */
+    uint16_t round_trip_time_deviation; /**< Mean deviation of round trip time in milliseconds */
+    uint16_t timeout;                   /**< Current response timeout in milliseconds */
+    uint8_t  backoff;                   /**< Timeouts in row, polling is delayed above 1 */
+} SDM_MeterStats_T;
+
+typedef struct SDM_Stats_Tag
+{
+    uint32_t requests;         /**< Queries sent */
+    uint32_t timeouts;         /**< Queries not answered in time */
+    uint32_t missed_deadlines; /**< Queries sent after their deadline */
+    uint16_t bus_utilisation;  /**< Share of time spent waiting for responses, in permille */
+    uint32_t baudrate;         /**< Current baudrate of MODBUS interface */
+} SDM_Stats_T;
+
 
 /**
  * SDM Loop, call this inside Arduino main loop()
@@ -110,71 +138,107 @@ void SetupSDM(void);
 /**
  * Get SDM state.
  *
- * @return  Pointer to SDM state. Returns NULL if SDM120 is not connected.
+ * @param meter     Meter index, from 0 to SDM_METERS_COUNT - 1
+ * @return          Pointer to SDM state. Returns NULL if SDM120 is not connected.
+ */
+const SDM_State_T *SDM_GetState(uint8_t meter);
+
+/**
+ * Get SDM polling statistics
+ *
+ * @return  Pointer to statistics
+ */
+const SDM_Stats_T *SDM_GetStats(void);
+
+/**
+ * Get round trip time statistics of meter
+ *
+ * @param meter     Meter index
+ * @param p_stats   Pointer to write statistics
+ * @return          False if there is no such meter
+ */
+bool SDM_GetMeterStats(uint8_t meter, SDM_MeterStats_T *p_stats);
+
+/**
+ * Get polling statistics of single polled value
+ *
+ * @param meter     Meter index
+ * @param index     Index of polled value
+ * @param p_stats   Pointer to write statistics
+ * @return          False if there is no such meter or polled value
  */
-const SDM_State_T *SDM_GetState(void);
+bool SDM_GetValueStats(uint8_t meter, size_t index, SDM_ValueStats_T *p_stats);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param relay_pulse_width
  */
-void SDM_SetRelayPulseWidth(uint8_t relay_pulse_width);
+void SDM_SetRelayPulseWidth(uint8_t meter, uint8_t relay_pulse_width);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param network_parity_stop
  */
-void SDM_SetNetworkParityStop(uint8_t network_parity_stop);
+void SDM_SetNetworkParityStop(uint8_t meter, uint8_t network_parity_stop);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param meter_id
  */
-void SDM_SetMeterID(uint8_t meter_id);
+void SDM_SetMeterID(uint8_t meter, uint8_t meter_id);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param baud_rate
  */
-void SDM_SetBaudRate(uint8_t baud_rate);
+void SDM_SetBaudRate(uint8_t meter, uint8_t baud_rate);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param ct_primary_current
  */
-void SDM_SetCTPrimaryCurrent(uint16_t ct_primary_current);
+void SDM_SetCTPrimaryCurrent(uint8_t meter, uint16_t ct_primary_current);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param pulse1_output_mode
  */
-void SDM_SetPulse1OutputMode(uint8_t pulse1_output_mode);
+void SDM_SetPulse1OutputMode(uint8_t meter, uint8_t pulse1_output_mode);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param time_of_scroll_display
  */
-void SDM_SetTimeOfScrollDisplay(uint16_t time_of_scroll_display);
+void SDM_SetTimeOfScrollDisplay(uint8_t meter, uint16_t time_of_scroll_display);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param pulse1_output
  */
-void SDM_SetPulse1Output(uint16_t pulse1_output);
+void SDM_SetPulse1Output(uint8_t meter, uint16_t pulse1_output);
 
 /**
  * Set SDM property
  *
+ * @param meter
  * @param measurement_mode
  */
-void SDM_SetMeasurementMode(uint16_t measurement_mode);
+void SDM_SetMeasurementMode(uint8_t meter, uint16_t measurement_mode);
 
 #endif    // SDM_H_
@@ -46,12 +46,12 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define ANALOG_MAX 1023                     /**< uppper range of analog measurements. */
 
 
-static bool              IsEnabled                       = false;
-static volatile uint32_t PirTimestamp                    = 0;
-static uint8_t           SensorInputPirIdx               = INSTANCE_INDEX_UNKNOWN;
-static uint8_t           SensorInputAlsIdx               = INSTANCE_INDEX_UNKNOWN;
-static uint8_t           SensorInputCurrPreciseEnergyIdx = INSTANCE_INDEX_UNKNOWN;
-static uint8_t           SensorInputVoltPowIdx           = INSTANCE_INDEX_UNKNOWN;
+static bool              IsEnabled                                         = false;
+static volatile uint32_t PirTimestamp                                      = 0;
+static uint8_t           SensorInputPirIdx                                 = INSTANCE_INDEX_UNKNOWN;
+static uint8_t           SensorInputAlsIdx                                 = INSTANCE_INDEX_UNKNOWN;
+static uint8_t           SensorInputCurrPreciseEnergyIdx[SDM_METERS_COUNT] = {INSTANCE_INDEX_UNKNOWN};
+static uint8_t           SensorInputVoltPowIdx[SDM_METERS_COUNT]           = {INSTANCE_INDEX_UNKNOWN};
 
 
 /**
@@ -98,13 +98,17 @@ static void ProcessALS(void);
 
 /**
  * Process voltage, current update
+ *
+ * @param meter     SDM meter index
  */
-static void ProcessCurrPreciseEnergy(void);
+static void ProcessCurrPreciseEnergy(uint8_t meter);
 
 /**
  * Process power and energy update
+ *
+ * @param meter     SDM meter index
  */
-static void ProcessVoltPow(void);
+static void ProcessVoltPow(uint8_t meter);
 
 
 void SensorInput_SetAlsIdx(uint8_t idx)
@@ -127,24 +131,36 @@ uint8_t SensorInput_GetPirIdx(void)
     return SensorInputPirIdx;
 }
 
-void SensorInput_SetCurrPreciseEnergyIdx(uint8_t idx)
+void SensorInput_SetCurrPreciseEnergyIdx(uint8_t meter, uint8_t idx)
 {
-    SensorInputCurrPreciseEnergyIdx = idx;
+    if (meter < SDM_METERS_COUNT)
+    {
+        SensorInputCurrPreciseEnergyIdx[meter] = idx;
+    }
 }
 
-uint8_t SensorInput_GetCurrPreciseEnergyIdx(void)
+uint8_t SensorInput_GetCurrPreciseEnergyIdx(uint8_t meter)
 {
-    return SensorInputCurrPreciseEnergyIdx;
+    if (meter >= SDM_METERS_COUNT)
+        return INSTANCE_INDEX_UNKNOWN;
+
+    return SensorInputCurrPreciseEnergyIdx[meter];
 }
 
-void SensorInput_SetVoltPowIdx(uint8_t idx)
+void SensorInput_SetVoltPowIdx(uint8_t meter, uint8_t idx)
 {
-    SensorInputVoltPowIdx = idx;
+    if (meter < SDM_METERS_COUNT)
+    {
+        SensorInputVoltPowIdx[meter] = idx;
+    }
 }
 
-uint8_t SensorInput_GetVoltPowIdx(void)
+uint8_t SensorInput_GetVoltPowIdx(uint8_t meter)
 {
-    return SensorInputVoltPowIdx;
+    if (meter >= SDM_METERS_COUNT)
+        return INSTANCE_INDEX_UNKNOWN;
+
+    return SensorInputVoltPowIdx[meter];
 }
 
 void InterruptPIR(void)
@@ -154,6 +170,12 @@ void InterruptPIR(void)
 
 void SensorInput_Setup(void)
 {
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        SensorInputCurrPreciseEnergyIdx[meter] = INSTANCE_INDEX_UNKNOWN;
+        SensorInputVoltPowIdx[meter]           = INSTANCE_INDEX_UNKNOWN;
+    }
+
     pinMode(PIN_PIR, INPUT);
 
     attachInterrupt(digitalPinToInterrupt(PIN_PIR), InterruptPIR, RISING);
@@ -183,12 +205,18 @@ void SensorInput_Loop(void)
     if (Timestamp_GetTimeElapsed(timestamp_curr_energy, Timestamp_GetCurrent()) >= SENSOR_UPDATE_INTV_CURR_ENERGY)
     {
         timestamp_curr_energy = Timestamp_GetCurrent();
-        ProcessCurrPreciseEnergy();
+        for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+        {
+            ProcessCurrPreciseEnergy(meter);
+        }
     }
     if (Timestamp_GetTimeElapsed(timestamp_volt_power, Timestamp_GetCurrent()) >= SENSOR_UPDATE_INTV_VOLT_POWER)
     {
         timestamp_volt_power = Timestamp_GetCurrent();
-        ProcessVoltPow();
+        for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+        {
+            ProcessVoltPow(meter);
+        }
     }
 }
 
@@ -245,12 +273,12 @@ static void ProcessALS(void)
     }
 }
 
-static void ProcessCurrPreciseEnergy(void)
+static void ProcessCurrPreciseEnergy(uint8_t meter)
 {
     uint16_t current;
     uint32_t energy;
 
-    const SDM_State_T *p_sdm_state = SDM_GetState();
+    const SDM_State_T *p_sdm_state = SDM_GetState(meter);
 
     if (p_sdm_state != NULL)
     {
@@ -263,9 +291,9 @@ static void ProcessCurrPreciseEnergy(void)
         energy  = MESH_PROP_PRECISE_TOTAL_DEVICE_ENERGY_USE_UNKNOWN_VAL;
     }
 
-    if (SensorInput_GetCurrPreciseEnergyIdx() != INSTANCE_INDEX_UNKNOWN)
+    if (SensorInput_GetCurrPreciseEnergyIdx(meter) != INSTANCE_INDEX_UNKNOWN)
     {
-        uint8_t currpreciseenergy_buf[] = {SensorInputCurrPreciseEnergyIdx,
+        uint8_t currpreciseenergy_buf[] = {SensorInputCurrPreciseEnergyIdx[meter],
                                            lowByte(MESH_PROP_ID_PRESENT_INPUT_CURRENT),
                                            highByte(MESH_PROP_ID_PRESENT_INPUT_CURRENT),
                                            (uint8_t)current,
@@ -280,12 +308,12 @@ static void ProcessCurrPreciseEnergy(void)
     }
 }
 
-static void ProcessVoltPow(void)
+static void ProcessVoltPow(uint8_t meter)
 {
     uint16_t voltage;
     uint32_t power;
 
-    const SDM_State_T *p_sdm_state = SDM_GetState();
+    const SDM_State_T *p_sdm_state = SDM_GetState(meter);
 
     if (p_sdm_state != NULL)
     {
@@ -298,10 +326,10 @@ static void ProcessVoltPow(void)
         power   = MESH_PROP_PRESENT_DEVICE_INPUT_POWER_UNKNOWN_VAL;
     }
 
-    if (SensorInput_GetVoltPowIdx() != INSTANCE_INDEX_UNKNOWN)
+    if (SensorInput_GetVoltPowIdx(meter) != INSTANCE_INDEX_UNKNOWN)
     {
         uint8_t voltpow_buf[] = {
-            SensorInputVoltPowIdx,
+            SensorInputVoltPowIdx[meter],
             lowByte(MESH_PROP_ID_PRESENT_INPUT_VOLTAGE),
             highByte(MESH_PROP_ID_PRESENT_INPUT_VOLTAGE),
             (uint8_t)voltage,
@@ -285,9 +285,10 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define ALS_REGISTRATION_ORDER 0 /**< Defines sensor servers registration order */
 #endif
 
-#define CURR_ENERGY_REGISTRATION_ORDER (ALS_REGISTRATION_ORDER + 1) /**< Defines sensor servers registration order */
-#define VOLT_POWER_REGISTRATION_ORDER \
-    (CURR_ENERGY_REGISTRATION_ORDER + 1) /**< Defines sensor servers registration order */
+#define CURR_ENERGY_REGISTRATION_ORDER(meter) \
+    (ALS_REGISTRATION_ORDER + 1 + 2 * (meter)) /**< Defines sensor servers registration order */
+#define VOLT_POWER_REGISTRATION_ORDER(meter) \
+    (CURR_ENERGY_REGISTRATION_ORDER(meter) + 1) /**< Defines sensor servers registration order */
 
 
 typedef union
@@ -339,27 +340,35 @@ uint8_t SensorInput_GetPirIdx(void);
 
 /*
  *  Sensor Input Voltage Current instance index setter
+ *
+ *  @param meter    SDM meter index
+ *  @param idx      Instance index
  */
-void SensorInput_SetCurrPreciseEnergyIdx(uint8_t idx);
+void SensorInput_SetCurrPreciseEnergyIdx(uint8_t meter, uint8_t idx);
 
 /*
  *  Sensor Input Voltage Current instance index getter
  *
- *  @return  Instance index
+ *  @param meter    SDM meter index
+ *  @return         Instance index
  */
-uint8_t SensorInput_GetCurrPreciseEnergyIdx(void);
+uint8_t SensorInput_GetCurrPreciseEnergyIdx(uint8_t meter);
 
 /*
  *  Sensor Input Power Energy instance index setter
+ *
+ *  @param meter    SDM meter index
+ *  @param idx      Instance index
  */
-void SensorInput_SetVoltPowIdx(uint8_t idx);
+void SensorInput_SetVoltPowIdx(uint8_t meter, uint8_t idx);
 
 /*
  *  Sensor Input Power Energy instance index getter
  *
- *  @return  Instance index
+ *  @param meter    SDM meter index
+ *  @return         Instance index
  */
-uint8_t SensorInput_GetVoltPowIdx(void);
+uint8_t SensorInput_GetVoltPowIdx(uint8_t meter);
 
 /*
  *  Setup Sensor Input hardware
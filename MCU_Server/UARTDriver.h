@@ -26,6 +26,15 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stddef.h>
 #include <stdint.h>
 
+#include "RingBuffer.h"
+
+typedef struct UARTDriver_Stats_Tag
+{
+    uint32_t rx_overruns; /**< Number of times RX DMA overwrote data not yet consumed */
+    uint16_t rx_peak_len; /**< Peak number of bytes waiting in RX buffer */
+    uint16_t tx_peak_len; /**< Peak number of bytes waiting in TX buffer */
+} UARTDriver_Stats_T;
+
 /*
  *  Initialize UART Driver.
  */
@@ -42,6 +51,24 @@ void UARTDriver_Init(void);
  */
 bool UARTDriver_WriteBytes(uint8_t *table, uint16_t len);
 
+/*
+ *  Reserve space in transmit buffer, so data could be serialized directly
+ *  into it. Reserved data is sent after UARTDriver_CommitTx call.
+ *
+ *  @param len          number of bytes to reserve
+ *  @param p_span       [out] reserved transmit buffer segments
+ *
+ *  @return             False if overflow in TX buffer would occur, true otherwise
+ */
+bool UARTDriver_ReserveTx(uint16_t len, RingBuffer_Span_T *p_span);
+
+/*
+ *  Send data written into space obtained with UARTDriver_ReserveTx.
+ *
+ *  @param len          number of bytes to send
+ */
+void UARTDriver_CommitTx(uint16_t len);
+
 /*
  *  Read Byte from Receive Buffer.
  *
@@ -52,8 +79,36 @@ bool UARTDriver_WriteBytes(uint8_t *table, uint16_t len);
 bool UARTDriver_ReadByte(uint8_t *read_byte);
 
 /*
- *  Function for polling received bytes from UART DMA buffer
+ *  Get continuous block of bytes from Receive Buffer without dequeuing them.
+ *  Bytes have to be released with UARTDriver_ReleaseRxBytes after processing.
+ *
+ *  @param len              [out] number of bytes available in returned block
+ *
+ *  @return                 Pointer to first received byte
+ */
+uint8_t *UARTDriver_GetRxBuffer(uint16_t *len);
+
+/*
+ *  Release bytes obtained with UARTDriver_GetRxBuffer.
+ *
+ *  @param len              Number of bytes to be released
+ */
+void UARTDriver_ReleaseRxBytes(uint16_t len);
+
+/*
+ *  Function for polling received bytes from UART DMA buffer. If DMA overwrote
+ *  bytes not yet consumed, whole RX buffer content is dropped.
+ *
+ *  @return                 False if RX overrun occurred and received data was dropped,
+ *                          true otherwise
+ */
+bool UARTDriver_RxDMAPoll(void);
+
+/*
+ *  Get UART driver statistics
+ *
+ *  @return                 Pointer to statistics
  */
-void UARTDriver_RxDMAPoll(void);
+const UARTDriver_Stats_T *UARTDriver_GetStats(void);
 
 #endif    //UARTDRIVER_H
@@ -25,6 +25,7 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Log.h"
 #include "MeshTime.h"
 #include "UARTDriver.h"
+#include "UARTScheduler.h"
 #include "Utils.h"
 
 /**< UART Command Codes definitions */
@@ -105,6 +106,9 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CRC_BYTE_1_OFFSET(len) (PAYLOAD_OFFSET + (len))
 #define CRC_BYTE_2_OFFSET(len) (PAYLOAD_OFFSET + (len) + 1)
 
+/**< Sensor Update Request payload bytes identifying queued update: instance index and property ID */
+#define SENSOR_UPDATE_KEY_LEN 3u
+
 
 typedef struct RxFrame_tag
 {
@@ -116,15 +120,24 @@ typedef struct RxFrame_tag
 static bool UART_PingsEnabled = true; /**< If true, device will send and respond to pings. Default it should work */
 
 /*
- *  Received data from UART
+ *  Received data from UART. Consumes received bytes until a complete frame
+ *  is found or the receive buffer is drained.
  *
  *  @param rx_frame    Pointer to frame to be filled with received data
- *  @return            True if frame's CRC is valid, false otherwise
+ *  @param resync      If true, partially received frame is discarded first
+ *  @return            True if frame with valid CRC was extracted, false otherwise
+ */
+static bool ExtractFrameFromBuffer(RxFrame_t *rx_frame, bool resync);
+
+/*
+ *  Dispatch received frame to its command handler
+ *
+ *  @param rx_frame    Pointer to received frame
  */
-static bool ExtractFrameFromBuffer(RxFrame_t *rx_frame);
+static void ProcessFrame(RxFrame_t *rx_frame);
 
 /*
- *  Send message over UART
+ *  Send message over UART, via transmit scheduler
  *
  *  @param len        Message length
  *  @param cmd        Message command
@@ -132,6 +145,24 @@ static bool ExtractFrameFromBuffer(RxFrame_t *rx_frame);
  */
 static void UARTInternal_Send(uint8_t len, uint8_t cmd, uint8_t *p_payload);
 
+/*
+ *  Serialize message into UART driver transmit buffer
+ *
+ *  @param len        Message length
+ *  @param cmd        Message command
+ *  @param p_payload  Message payload
+ *  @return           True if success, false if there is no space in transmit buffer
+ */
+static bool UARTInternal_Transmit(uint8_t len, uint8_t cmd, uint8_t *p_payload);
+
+/*
+ *  Get transmit priority class of command
+ *
+ *  @param cmd        Message command
+ *  @return           Transmit priority class
+ */
+static UARTScheduler_Class_t UARTInternal_GetTxClass(uint8_t cmd);
+
 /*
  *  Print debug message
  *
@@ -155,6 +186,7 @@ static uint16_t UARTInternal_CalcCRC16(uint8_t len, uint8_t cmd, uint8_t *data);
 void UART_Init(void)
 {
     UARTDriver_Init();
+    UARTScheduler_Init(UARTInternal_Transmit);
 }
 
 void UART_EnablePings(void)
@@ -279,103 +311,113 @@ void UART_ProcessIncomingCommand(void)
 {
     static RxFrame_t rx_frame;
 
-    UARTDriver_RxDMAPoll();
+    UARTScheduler_Flush();
+
+    bool resync = !UARTDriver_RxDMAPoll();
+    if (resync)
+    {
+        LOG_INFO("UART RX overrun, received data dropped");
+    }
 
-    if (!ExtractFrameFromBuffer(&rx_frame))
+    while (ExtractFrameFromBuffer(&rx_frame, resync))
     {
-        return;
+        resync = false;
+        ProcessFrame(&rx_frame);
     }
+}
 
-    switch (rx_frame.cmd)
+static void ProcessFrame(RxFrame_t *rx_frame)
+{
+    switch (rx_frame->cmd)
     {
         case UART_CMD_PING_REQUEST:
         {
-            UART_SendPongResponse(rx_frame.p_payload, rx_frame.len);
+            UART_SendPongResponse(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_INIT_DEVICE_EVENT:
         {
-            ProcessEnterInitDevice(rx_frame.p_payload, rx_frame.len);
+            ProcessEnterInitDevice(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_CREATE_INSTANCES_RESPONSE:
         {
-            ProcessEnterDevice(rx_frame.p_payload, rx_frame.len);
+            ProcessEnterDevice(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_INIT_NODE_EVENT:
         {
-            ProcessEnterInitNode(rx_frame.p_payload, rx_frame.len);
+            ProcessEnterInitNode(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_START_NODE_RESPONSE:
         {
-            ProcessEnterNode(rx_frame.p_payload, rx_frame.len);
+            ProcessEnterNode(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_MESH_MESSAGE_REQUEST:
         {
-            ProcessMeshCommand(rx_frame.p_payload, rx_frame.len);
+            ProcessMeshCommand(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_MESH_MESSAGE_REQUEST_1:
         {
-            ProcessMeshMessageRequest1(rx_frame.p_payload, rx_frame.len);
+            ProcessMeshMessageRequest1(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_ATTENTION_EVENT:
         {
-            ProcessAttention(rx_frame.p_payload, rx_frame.len);
+            ProcessAttention(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_ERROR:
         {
-            ProcessError(rx_frame.p_payload, rx_frame.len);
+            ProcessError(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_MODEM_FIRMWARE_VERSION_RESPONSE:
         {
-            ProcessModemFirmwareVersion(rx_frame.p_payload, rx_frame.len);
+            ProcessModemFirmwareVersion(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_START_TEST_REQ:
         {
-            ProcessStartTest(rx_frame.p_payload, rx_frame.len);
+            ProcessStartTest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_INIT_REQ:
         {
-            ProcessDfuInitRequest(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuInitRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_STATUS_REQ:
         {
-            ProcessDfuStatusRequest(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuStatusRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_PAGE_CREATE_REQ:
         {
-            ProcessDfuPageCreateRequest(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuPageCreateRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_WRITE_DATA_EVENT:
         {
-            ProcessDfuWriteDataEvent(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuWriteDataEvent(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_PAGE_STORE_REQ:
         {
-            ProcessDfuPageStoreRequest(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuPageStoreRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_STATE_CHECK_RESP:
         {
-            ProcessDfuStateCheckResponse(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuStateCheckResponse(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_DFU_CANCEL_RESP:
         {
-            ProcessDfuCancelResponse(rx_frame.p_payload, rx_frame.len);
+            ProcessDfuCancelResponse(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_FIRMWARE_VERSION_SET_RESP:
@@ -390,88 +432,127 @@ void UART_ProcessIncomingCommand(void)
         }
         case UART_CMD_TIME_SOURCE_SET_REQ:
         {
-            MeshTime_ProcessTimeSourceSetRequest(rx_frame.p_payload, rx_frame.len);
+            MeshTime_ProcessTimeSourceSetRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_TIME_SOURCE_GET_REQ:
         {
-            MeshTime_ProcessTimeSourceGetRequest(rx_frame.p_payload, rx_frame.len);
+            MeshTime_ProcessTimeSourceGetRequest(rx_frame->p_payload, rx_frame->len);
             break;
         }
         case UART_CMD_TIME_GET_RESP:
         {
-            MeshTime_ProcessTimeGetResponse(rx_frame.p_payload, rx_frame.len);
+            MeshTime_ProcessTimeGetResponse(rx_frame->p_payload, rx_frame->len);
             break;
         }
     }
 }
 
-static bool ExtractFrameFromBuffer(RxFrame_t *rx_frame)
+static bool ExtractFrameFromBuffer(RxFrame_t *rx_frame, bool resync)
 {
-    bool            isCRCValid = false;
-    static uint16_t crc        = 0;
-    static size_t   count      = 0;
-    uint8_t         received_byte;
+    bool                   isCRCValid = false;
+    static uint16_t        crc        = 0;
+    static size_t          count      = 0;
+    static CRC16_Context_T crc_ctx;
+    uint16_t               rx_len;
+    uint8_t *              p_rx_buf;
 
-    if (!UARTDriver_ReadByte(&received_byte))
+    if (resync)
     {
-        return isCRCValid;
+        count = 0;
     }
 
-    if (count == PREAMBLE_BYTE_1_OFFSET)
-    {
-        if (received_byte == PREAMBLE_BYTE_1)
-        {
-            count++;
-        }
-        else
-        {
-            count = 0;
-        }
-    }
-    else if (count == PREAMBLE_BYTE_2_OFFSET)
-    {
-        if (received_byte == PREAMBLE_BYTE_2)
-        {
-            count++;
-        }
-        else
-        {
-            count = 0;
-        }
-    }
-    else if (count == LEN_OFFSET)
+    while (!isCRCValid)
     {
-        if (received_byte <= MAX_PAYLOAD_SIZE)
+        p_rx_buf = UARTDriver_GetRxBuffer(&rx_len);
+        if (rx_len == 0)
         {
-            rx_frame->len = received_byte;
-            count++;
+            break;
         }
-        else
+
+        uint16_t index = 0;
+
+        while ((index < rx_len) && !isCRCValid)
         {
-            count = 0;
+            if (count == PREAMBLE_BYTE_1_OFFSET)
+            {
+                uint8_t *p_preamble = (uint8_t *)memchr(p_rx_buf + index, PREAMBLE_BYTE_1, rx_len - index);
+                if (p_preamble == NULL)
+                {
+                    index = rx_len;
+                }
+                else
+                {
+                    index = p_preamble - p_rx_buf + 1;
+                    count++;
+                }
+                continue;
+            }
+
+            if ((CMD_OFFSET < count) && (count < CRC_BYTE_1_OFFSET(rx_frame->len)))
+            {
+                size_t payload_offset = count - PAYLOAD_OFFSET;
+                size_t cpy_len        = rx_frame->len - payload_offset;
+
+                if (cpy_len > (size_t)(rx_len - index))
+                {
+                    cpy_len = rx_len - index;
+                }
+
+                memcpy(rx_frame->p_payload + payload_offset, p_rx_buf + index, cpy_len);
+                CRC16_Update(&crc_ctx, p_rx_buf + index, cpy_len);
+                index += cpy_len;
+                count += cpy_len;
+                continue;
+            }
+
+            uint8_t received_byte = p_rx_buf[index++];
+
+            if (count == PREAMBLE_BYTE_2_OFFSET)
+            {
+                if (received_byte == PREAMBLE_BYTE_2)
+                {
+                    count++;
+                }
+                else if (received_byte != PREAMBLE_BYTE_1)
+                {
+                    count = 0;
+                }
+            }
+            else if (count == LEN_OFFSET)
+            {
+                if (received_byte <= MAX_PAYLOAD_SIZE)
+                {
+                    rx_frame->len = received_byte;
+                    CRC16_Init(&crc_ctx, CRC16_INIT_VAL);
+                    CRC16_UpdateByte(&crc_ctx, received_byte);
+                    count++;
+                }
+                else
+                {
+                    count = 0;
+                }
+            }
+            else if (count == CMD_OFFSET)
+            {
+                rx_frame->cmd = received_byte;
+                CRC16_UpdateByte(&crc_ctx, received_byte);
+                count++;
+            }
+            else if (count == CRC_BYTE_1_OFFSET(rx_frame->len))
+            {
+                crc = received_byte;
+                count++;
+            }
+            else if (count == CRC_BYTE_2_OFFSET(rx_frame->len))
+            {
+                crc += ((uint16_t)received_byte) << 8;
+                isCRCValid = (crc == CRC16_Final(&crc_ctx));
+                count      = 0;
+            }
         }
-    }
-    else if (count == CMD_OFFSET)
-    {
-        rx_frame->cmd = received_byte;
-        count++;
-    }
-    else if ((CMD_OFFSET < count) && (count < CRC_BYTE_1_OFFSET(rx_frame->len)))
-    {
-        rx_frame->p_payload[count - PAYLOAD_OFFSET] = received_byte;
-        count++;
-    }
-    else if (count == CRC_BYTE_1_OFFSET(rx_frame->len))
-    {
-        crc = received_byte;
-        count++;
-    }
-    else if (count == CRC_BYTE_2_OFFSET(rx_frame->len))
-    {
-        crc += ((uint16_t)received_byte) << 8;
-        isCRCValid = (crc == UARTInternal_CalcCRC16(rx_frame->len, rx_frame->cmd, rx_frame->p_payload));
-        count      = 0;
+
+        UARTDriver_ReleaseRxBytes(index);
     }
 
     if (isCRCValid)
@@ -518,23 +599,59 @@ void UART_SendBatteryStatusSetRequest(uint8_t *p_payload, uint8_t len)
 
 static void UARTInternal_Send(uint8_t len, uint8_t cmd, uint8_t *p_payload)
 {
-    uint16_t crc;
-    uint8_t  msg[PACKET_LEN(len)];
+    uint8_t key_len = (cmd == UART_CMD_SENSOR_UPDATE_REQUEST) ? SENSOR_UPDATE_KEY_LEN : 0;
 
-    msg[PREAMBLE_BYTE_1_OFFSET] = PREAMBLE_BYTE_1;
-    msg[PREAMBLE_BYTE_2_OFFSET] = PREAMBLE_BYTE_2;
-    msg[LEN_OFFSET]             = len;
-    msg[CMD_OFFSET]             = cmd;
+    UARTScheduler_Send(UARTInternal_GetTxClass(cmd), len, cmd, p_payload, key_len);
+}
+
+static bool UARTInternal_Transmit(uint8_t len, uint8_t cmd, uint8_t *p_payload)
+{
+    RingBuffer_Span_T span;
+    uint16_t          crc;
+
+    if (!UARTDriver_ReserveTx(PACKET_LEN(len), &span))
+    {
+        return false;
+    }
 
-    memcpy(&msg[PAYLOAD_OFFSET], p_payload, len);
+    uint8_t header[HEADER_LEN] = {PREAMBLE_BYTE_1, PREAMBLE_BYTE_2, len, cmd};
+    RingBuffer_SpanWrite(&span, PREAMBLE_BYTE_1_OFFSET, header, sizeof(header));
+    RingBuffer_SpanWrite(&span, PAYLOAD_OFFSET, p_payload, len);
 
-    crc                         = UARTInternal_CalcCRC16(len, cmd, p_payload);
-    msg[CRC_BYTE_1_OFFSET(len)] = lowByte(crc);
-    msg[CRC_BYTE_2_OFFSET(len)] = highByte(crc);
+    crc                      = UARTInternal_CalcCRC16(len, cmd, p_payload);
+    uint8_t crc_buf[CRC_LEN] = {lowByte(crc), highByte(crc)};
+    RingBuffer_SpanWrite(&span, CRC_BYTE_1_OFFSET(len), crc_buf, sizeof(crc_buf));
 
-    UARTDriver_WriteBytes(msg, PACKET_LEN(len));
+    UARTDriver_CommitTx(PACKET_LEN(len));
 
     PrintDebug("Sent", len, cmd, p_payload, crc);
+
+    return true;
+}
+
+static UARTScheduler_Class_t UARTInternal_GetTxClass(uint8_t cmd)
+{
+    switch (cmd)
+    {
+        case UART_CMD_MESH_MESSAGE_REQUEST:
+        case UART_CMD_MESH_MESSAGE_REQUEST_1:
+        {
+            return UART_TX_CLASS_MESH;
+        }
+        case UART_CMD_SENSOR_UPDATE_REQUEST:
+        {
+            return UART_TX_CLASS_SENSOR;
+        }
+        case UART_CMD_PING_REQUEST:
+        case UART_CMD_PONG_RESPONSE:
+        {
+            return UART_TX_CLASS_PING;
+        }
+        default:
+        {
+            return UART_TX_CLASS_CONTROL;
+        }
+    }
 }
 
 static void PrintDebug(const char *dir, uint8_t len, uint8_t cmd, uint8_t *buf, uint16_t crc)
@@ -625,11 +742,14 @@ static void PrintDebug(const char *dir, uint8_t len, uint8_t cmd, uint8_t *buf,
         }
     }
 
-    LOG_DEBUG("%s %s command", dir, command_name);
-    LOG_DEBUG("\t Len: 0x%02X", len);
-    LOG_DEBUG("\t Cmd: 0x%02X", cmd);
+    LOG_DEBUG("%s %s command\n\t Len: 0x%02X\n\t Cmd: 0x%02X\n\t CRC: 0x%02X%02X",
+              dir,
+              command_name,
+              len,
+              cmd,
+              lowByte(crc),
+              highByte(crc));
     LOG_DEBUG_HEXBUF("\t Data:", buf, len);
-    LOG_DEBUG("\t CRC: 0x%02X%02X", lowByte(crc), highByte(crc));
 #endif
 }
 
@@ -0,0 +1,208 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "UARTScheduler.h"
+
+#include <string.h>
+
+#include "Log.h"
+
+#define CONTROL_QUEUE_LEN 160
+#define MESH_QUEUE_LEN 160
+#define SENSOR_QUEUE_LEN 96
+#define PING_QUEUE_LEN 16
+
+/**< Queued frame record: [cmd][len][payload] */
+#define RECORD_CMD_OFFSET 0u
+#define RECORD_LEN_OFFSET 1u
+#define RECORD_PAYLOAD_OFFSET 2u
+#define RECORD_LEN(len) (RECORD_PAYLOAD_OFFSET + (len))
+
+
+typedef struct UARTScheduler_Queue_Tag
+{
+    uint8_t *p_buf;
+    size_t   buf_len;
+    size_t   used;
+} UARTScheduler_Queue_T;
+
+static uint8_t control_buf[CONTROL_QUEUE_LEN];
+static uint8_t mesh_buf[MESH_QUEUE_LEN];
+static uint8_t sensor_buf[SENSOR_QUEUE_LEN];
+static uint8_t ping_buf[PING_QUEUE_LEN];
+
+static UARTScheduler_Queue_T queues[UART_TX_CLASS_COUNT] = {
+    {control_buf, sizeof(control_buf), 0},
+    {mesh_buf, sizeof(mesh_buf), 0},
+    {sensor_buf, sizeof(sensor_buf), 0},
+    {ping_buf, sizeof(ping_buf), 0},
+};
+
+static UARTScheduler_TransmitCallback TransmitCallback = NULL;
+static UARTScheduler_Stats_T          Stats;
+
+/*
+ *  Check if any frame of given or higher priority class is queued
+ *
+ *  @param tx_class     Transmit priority class
+ *  @return             True if any frame is pending
+ */
+static bool IsPending(UARTScheduler_Class_t tx_class);
+
+/*
+ *  Replace queued frame with the same command, length and key
+ *
+ *  @param p_queue      Pointer to queue
+ *  @param len          Payload len
+ *  @param cmd          Command code
+ *  @param p_payload    Pointer to payload
+ *  @param key_len      Number of leading payload bytes identifying frame
+ *  @return             True if queued frame was replaced
+ */
+static bool Coalesce(UARTScheduler_Queue_T *p_queue, uint8_t len, uint8_t cmd, uint8_t *p_payload, uint8_t key_len);
+
+/*
+ *  Append frame at the end of queue
+ *
+ *  @param p_queue      Pointer to queue
+ *  @param len          Payload len
+ *  @param cmd          Command code
+ *  @param p_payload    Pointer to payload
+ *  @return             True if success, false if there is no space in queue
+ */
+static bool Enqueue(UARTScheduler_Queue_T *p_queue, uint8_t len, uint8_t cmd, uint8_t *p_payload);
+
+
+void UARTScheduler_Init(UARTScheduler_TransmitCallback transmit)
+{
+    TransmitCallback = transmit;
+
+    for (size_t i = 0; i < UART_TX_CLASS_COUNT; i++)
+    {
+        queues[i].used = 0;
+    }
+
+    memset(&Stats, 0, sizeof(Stats));
+}
+
+void UARTScheduler_Send(UARTScheduler_Class_t tx_class, uint8_t len, uint8_t cmd, uint8_t *p_payload, uint8_t key_len)
+{
+    UARTScheduler_Queue_T *p_queue = &queues[tx_class];
+
+    if (!IsPending(tx_class) && TransmitCallback(len, cmd, p_payload))
+    {
+        return;
+    }
+
+    if ((key_len != 0) && Coalesce(p_queue, len, cmd, p_payload, key_len))
+    {
+        Stats.coalesced++;
+        return;
+    }
+
+    if (!Enqueue(p_queue, len, cmd, p_payload))
+    {
+        LOG_INFO("UART TX queue %d full, frame 0x%02X dropped", tx_class, cmd);
+        Stats.dropped[tx_class]++;
+    }
+}
+
+void UARTScheduler_Flush(void)
+{
+    for (size_t i = 0; i < UART_TX_CLASS_COUNT; i++)
+    {
+        UARTScheduler_Queue_T *p_queue = &queues[i];
+
+        while (p_queue->used != 0)
+        {
+            uint8_t len = p_queue->p_buf[RECORD_LEN_OFFSET];
+
+            if (!TransmitCallback(len, p_queue->p_buf[RECORD_CMD_OFFSET], p_queue->p_buf + RECORD_PAYLOAD_OFFSET))
+            {
+                return;
+            }
+
+            p_queue->used -= RECORD_LEN(len);
+            memmove(p_queue->p_buf, p_queue->p_buf + RECORD_LEN(len), p_queue->used);
+        }
+    }
+}
+
+const UARTScheduler_Stats_T *UARTScheduler_GetStats(void)
+{
+    return &Stats;
+}
+
+static bool IsPending(UARTScheduler_Class_t tx_class)
+{
+    for (size_t i = 0; i <= (size_t)tx_class; i++)
+    {
+        if (queues[i].used != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool Coalesce(UARTScheduler_Queue_T *p_queue, uint8_t len, uint8_t cmd, uint8_t *p_payload, uint8_t key_len)
+{
+    size_t index = 0;
+
+    if (key_len > len)
+    {
+        return false;
+    }
+
+    while (index < p_queue->used)
+    {
+        uint8_t *p_record = p_queue->p_buf + index;
+
+        if ((p_record[RECORD_CMD_OFFSET] == cmd) && (p_record[RECORD_LEN_OFFSET] == len) &&
+            (memcmp(p_record + RECORD_PAYLOAD_OFFSET, p_payload, key_len) == 0))
+        {
+            memcpy(p_record + RECORD_PAYLOAD_OFFSET, p_payload, len);
+            return true;
+        }
+
+        index += RECORD_LEN(p_record[RECORD_LEN_OFFSET]);
+    }
+
+    return false;
+}
+
+static bool Enqueue(UARTScheduler_Queue_T *p_queue, uint8_t len, uint8_t cmd, uint8_t *p_payload)
+{
+    if (p_queue->used + RECORD_LEN(len) > p_queue->buf_len)
+    {
+        return false;
+    }
+
+    uint8_t *p_record = p_queue->p_buf + p_queue->used;
+
+    p_record[RECORD_CMD_OFFSET] = cmd;
+    p_record[RECORD_LEN_OFFSET] = len;
+    memcpy(p_record + RECORD_PAYLOAD_OFFSET, p_payload, len);
+    p_queue->used += RECORD_LEN(len);
+
+    return true;
+}
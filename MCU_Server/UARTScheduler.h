@@ -0,0 +1,90 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef UARTSCHEDULER_H
+#define UARTSCHEDULER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Transmit priority classes, ordered from highest to lowest priority
+ */
+typedef enum
+{
+    UART_TX_CLASS_CONTROL,
+    UART_TX_CLASS_MESH,
+    UART_TX_CLASS_SENSOR,
+    UART_TX_CLASS_PING,
+    UART_TX_CLASS_COUNT,
+} UARTScheduler_Class_t;
+
+typedef struct UARTScheduler_Stats_Tag
+{
+    uint16_t dropped[UART_TX_CLASS_COUNT]; /**< Frames dropped because class queue was full */
+    uint16_t coalesced;                    /**< Queued frames replaced by newer ones */
+} UARTScheduler_Stats_T;
+
+/*
+ *  Callback transmitting single frame
+ *
+ *  @param len          Payload len
+ *  @param cmd          Command code
+ *  @param p_payload    Pointer to payload
+ *  @return             True if frame was accepted by driver, false if there is no space in TX buffer
+ */
+typedef bool (*UARTScheduler_TransmitCallback)(uint8_t len, uint8_t cmd, uint8_t *p_payload);
+
+/*
+ *  Initialize UART transmit scheduler
+ *
+ *  @param transmit     Callback used to pass frames to the driver
+ */
+void UARTScheduler_Init(UARTScheduler_TransmitCallback transmit);
+
+/*
+ *  Send frame or queue it if it cannot be transmitted now. Frame is sent
+ *  immediately only if there is nothing pending in its class or any class
+ *  with higher priority. If key_len is not zero, queued frame with the same
+ *  command, length and first key_len payload bytes is replaced by this one.
+ *
+ *  @param tx_class     Transmit priority class
+ *  @param len          Payload len
+ *  @param cmd          Command code
+ *  @param p_payload    Pointer to payload
+ *  @param key_len      Number of leading payload bytes identifying frame for coalescing
+ */
+void UARTScheduler_Send(UARTScheduler_Class_t tx_class, uint8_t len, uint8_t cmd, uint8_t *p_payload, uint8_t key_len);
+
+/*
+ *  Pass queued frames to the driver in priority order, as long as it accepts them
+ */
+void UARTScheduler_Flush(void);
+
+/*
+ *  Get scheduler statistics
+ *
+ *  @return             Pointer to statistics
+ */
+const UARTScheduler_Stats_T *UARTScheduler_GetStats(void);
+
+#endif    //UARTSCHEDULER_H
@@ -0,0 +1,398 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test of table driven CRC16, CRC16 MODBUS and CRC32. Results are
+ *  checked against standard check values and against bit by bit reference
+ *  implementations for random data, offsets, lengths and init values.
+ *  Incremental CRC16 and CRC16 MODBUS contexts fed in random spans and single
+ *  bytes must give the same results as batch functions. Then throughput of
+ *  table driven and bit by bit CRCs is reported. Built once per
+ *  CRC_FAST_TABLES setting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "CRC.h"
+
+
+#define TEST_DATA_LEN 0x10000u          /**< Size of random test data */
+#define TEST_RANDOM_CASES 3000u         /**< Random offset, length and init value cases per CRC */
+#define TEST_BENCHMARK_ROUNDS 50u       /**< Passes over test data per measured CRC */
+#define TEST_CHECK_DATA "123456789"     /**< Standard CRC check input */
+#define TEST_CHECK_CRC16 0xAEE7u        /**< CRC16 (polynomial 0x8005, init 0xFFFF) of check input */
+#define TEST_CHECK_CRC16_MODBUS 0x374Bu /**< CRC16 MODBUS 0x4B37, bytes swapped as sent high byte first */
+#define TEST_CHECK_CRC32 0xCBF43926u
+
+#define TEST_CRC16_POLYNOMIAL 0x8005u
+#define TEST_CRC32_POLYNOMIAL 0xEDB88320u
+
+
+static uint8_t Data[TEST_DATA_LEN];
+
+
+/*
+ *  Bit by bit CRC16, reference for CalcCRC16
+ *
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ *  @param init_val     CRC init val
+ *  @return             Calculated CRC
+ */
+static uint16_t Test_RefCRC16(uint8_t *data, size_t len, uint16_t init_val);
+
+/*
+ *  Bit by bit CRC16 MODBUS over reflected bytes, reference for CalcCRC16_Modbus
+ *
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ *  @param init_val     CRC init val
+ *  @return             Calculated CRC
+ */
+static uint16_t Test_RefCRC16_Modbus(uint8_t *data, size_t len, uint16_t init_val);
+
+/*
+ *  Bit by bit CRC32, reference for CalcCRC32
+ *
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ *  @param init_val     CRC init val
+ *  @return             Calculated CRC
+ */
+static uint32_t Test_RefCRC32(uint8_t *data, size_t len, uint32_t init_val);
+
+/*
+ *  Reflect bit order of byte
+ *
+ *  @param value    Byte to reflect
+ *  @return         Reflected byte
+ */
+static uint8_t Test_ReflectByte(uint8_t value);
+
+/*
+ *  Check CRCs against check values and reference implementations
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_Compare(void);
+
+/*
+ *  Check incremental CRC16 and CRC16 MODBUS against batch functions
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_Streaming(void);
+
+/*
+ *  Feed data to incremental CRC in random spans and single bytes
+ *
+ *  @param * p_ctx          Pointer to CRC16 context
+ *  @param * data           Pointer to data
+ *  @param len              Data len
+ *  @param update           CRC16_Update or CRC16_Modbus_Update
+ *  @param update_byte      CRC16_UpdateByte or CRC16_Modbus_UpdateByte
+ */
+static void Test_Feed(CRC16_Context_T *p_ctx,
+                      const uint8_t *  data,
+                      size_t           len,
+                      void (*update)(CRC16_Context_T *, const uint8_t *, size_t),
+                      void (*update_byte)(CRC16_Context_T *, uint8_t));
+
+/*
+ *  Report throughput of CRCs and reference implementations
+ */
+static void Test_Benchmark(void);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in seconds
+ */
+static double Test_GetTime(void);
+
+
+int main(void)
+{
+    srand(1);
+    for (size_t i = 0; i < TEST_DATA_LEN; i++)
+    {
+        Data[i] = (uint8_t)rand();
+    }
+
+    unsigned fails = Test_Compare();
+    fails += Test_Streaming();
+    Test_Benchmark();
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint16_t Test_RefCRC16(uint8_t *data, size_t len, uint16_t init_val)
+{
+    uint16_t crc = init_val;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t byte = data[i];
+        for (uint8_t j = 0; j < 8; j++)
+        {
+            if (((crc & 0x8000) >> 8) ^ (byte & 0x80))
+            {
+                crc = (crc << 1) ^ TEST_CRC16_POLYNOMIAL;
+            }
+            else
+            {
+                crc = (crc << 1);
+            }
+            byte <<= 1;
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t Test_RefCRC16_Modbus(uint8_t *data, size_t len, uint16_t init_val)
+{
+    uint16_t crc = init_val;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t byte = Test_ReflectByte(data[i]);
+        crc          = Test_RefCRC16(&byte, 1, crc);
+    }
+
+    return (uint16_t)Test_ReflectByte((uint8_t)crc) | ((uint16_t)Test_ReflectByte((uint8_t)(crc >> 8)) << 8);
+}
+
+static uint32_t Test_RefCRC32(uint8_t *data, size_t len, uint32_t init_val)
+{
+    uint32_t crc = init_val;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = crc ^ data[i];
+        for (uint32_t j = 8; j > 0; j--)
+        {
+            crc = (crc >> 1) ^ (TEST_CRC32_POLYNOMIAL & ((crc & 1) ? 0xFFFFFFFF : 0));
+        }
+    }
+    return ~crc;
+}
+
+static uint8_t Test_ReflectByte(uint8_t value)
+{
+    uint8_t result = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (value & (1u << i))
+        {
+            result |= (uint8_t)(0x80u >> i);
+        }
+    }
+
+    return result;
+}
+
+static unsigned Test_Compare(void)
+{
+    uint8_t  check_data[] = TEST_CHECK_DATA;
+    size_t   check_len    = sizeof(check_data) - 1;
+    unsigned fails        = 0;
+
+    if (CalcCRC16(check_data, check_len, CRC16_INIT_VAL) != TEST_CHECK_CRC16)
+    {
+        fprintf(stderr, "CRC16 check value mismatch\n");
+        fails++;
+    }
+    if (CalcCRC16_Modbus(check_data, check_len, CRC16_INIT_VAL) != TEST_CHECK_CRC16_MODBUS)
+    {
+        fprintf(stderr, "CRC16 MODBUS check value mismatch\n");
+        fails++;
+    }
+    if (CalcCRC32(check_data, check_len, CRC32_INIT_VAL) != TEST_CHECK_CRC32)
+    {
+        fprintf(stderr, "CRC32 check value mismatch\n");
+        fails++;
+    }
+
+    for (uint32_t i = 0; i < TEST_RANDOM_CASES; i++)
+    {
+        /* Offsets cover every alignment, lengths cover slice-by-4 head and tail */
+        size_t   offset     = rand() % 1024;
+        size_t   len        = rand() % 2048;
+        uint16_t init_val   = (uint16_t)rand();
+        uint32_t init_val32 = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        uint8_t *p_data     = Data + offset;
+
+        if (CalcCRC16(p_data, len, init_val) != Test_RefCRC16(p_data, len, init_val))
+        {
+            fprintf(stderr, "CRC16 mismatch, offset %zu, len %zu, init %04X\n", offset, len, init_val);
+            fails++;
+        }
+        if (CalcCRC16_Modbus(p_data, len, init_val) != Test_RefCRC16_Modbus(p_data, len, init_val))
+        {
+            fprintf(stderr, "CRC16 MODBUS mismatch, offset %zu, len %zu, init %04X\n", offset, len, init_val);
+            fails++;
+        }
+        if (CalcCRC32(p_data, len, init_val32) != Test_RefCRC32(p_data, len, init_val32))
+        {
+            fprintf(stderr, "CRC32 mismatch, offset %zu, len %zu, init %08X\n", offset, len, init_val32);
+            fails++;
+        }
+    }
+
+    printf("CRC_FAST_TABLES=%d: %u random cases, %u failed\n", CRC_FAST_TABLES, TEST_RANDOM_CASES, fails);
+    return fails;
+}
+
+static unsigned Test_Streaming(void)
+{
+    unsigned fails = 0;
+
+    for (uint32_t i = 0; i < TEST_RANDOM_CASES; i++)
+    {
+        size_t   offset   = rand() % 1024;
+        size_t   len      = rand() % 300;
+        uint16_t init_val = (i == 0) ? CRC16_INIT_VAL : (uint16_t)rand();
+        uint8_t *p_data   = Data + offset;
+
+        CRC16_Context_T ctx;
+        CRC16_Init(&ctx, init_val);
+        Test_Feed(&ctx, p_data, len, CRC16_Update, CRC16_UpdateByte);
+        if (CRC16_Final(&ctx) != CalcCRC16(p_data, len, init_val))
+        {
+            fprintf(stderr, "Incremental CRC16 mismatch, len %zu, init %04X\n", len, init_val);
+            fails++;
+        }
+
+        uint16_t crc = CalcCRC16_Modbus(p_data, len, init_val);
+        CRC16_Modbus_Init(&ctx, init_val);
+        Test_Feed(&ctx, p_data, len, CRC16_Modbus_Update, CRC16_Modbus_UpdateByte);
+        if (CRC16_Modbus_Final(&ctx) != crc)
+        {
+            fprintf(stderr, "Incremental CRC16 MODBUS mismatch, len %zu, init %04X\n", len, init_val);
+            fails++;
+        }
+
+        /* Received MODBUS frame is checked by feeding its CRC field too, high byte first */
+        uint8_t crc_field[] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+        Test_Feed(&ctx, crc_field, sizeof(crc_field), CRC16_Modbus_Update, CRC16_Modbus_UpdateByte);
+        if (CRC16_Modbus_Final(&ctx) != 0)
+        {
+            fprintf(stderr, "MODBUS frame residue not zero, len %zu, init %04X\n", len, init_val);
+            fails++;
+        }
+    }
+
+    printf("Incremental CRC16: %u random cases, %u failed\n", TEST_RANDOM_CASES, fails);
+    return fails;
+}
+
+static void Test_Feed(CRC16_Context_T *p_ctx,
+                      const uint8_t *  data,
+                      size_t           len,
+                      void (*update)(CRC16_Context_T *, const uint8_t *, size_t),
+                      void (*update_byte)(CRC16_Context_T *, uint8_t))
+{
+    size_t offset = 0;
+    while (offset < len)
+    {
+        if (rand() % 2)
+        {
+            update_byte(p_ctx, data[offset++]);
+            continue;
+        }
+
+        /* Empty spans are fed too */
+        size_t span_len = rand() % (len - offset + 1);
+        update(p_ctx, data + offset, span_len);
+        offset += span_len;
+    }
+}
+
+static void Test_Benchmark(void)
+{
+    double   bytes = (double)TEST_BENCHMARK_ROUNDS * TEST_DATA_LEN;
+    uint32_t sink  = 0;
+    double   times[6];
+    double   start;
+
+    /* Init value changes every round, so calls are not hoisted out of loops */
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += Test_RefCRC16(Data, TEST_DATA_LEN, CRC16_INIT_VAL ^ i);
+    }
+    times[0] = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += CalcCRC16(Data, TEST_DATA_LEN, CRC16_INIT_VAL ^ i);
+    }
+    times[1] = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += Test_RefCRC16_Modbus(Data, TEST_DATA_LEN, CRC16_INIT_VAL ^ i);
+    }
+    times[2] = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += CalcCRC16_Modbus(Data, TEST_DATA_LEN, CRC16_INIT_VAL ^ i);
+    }
+    times[3] = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += Test_RefCRC32(Data, TEST_DATA_LEN, CRC32_INIT_VAL ^ i);
+    }
+    times[4] = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        sink += CalcCRC32(Data, TEST_DATA_LEN, CRC32_INIT_VAL ^ i);
+    }
+    times[5] = Test_GetTime() - start;
+
+    printf("CRC16        bitwise %7.1f MB/s, table %7.1f MB/s\n", bytes / times[0] / 1e6, bytes / times[1] / 1e6);
+    printf("CRC16 MODBUS bitwise %7.1f MB/s, table %7.1f MB/s\n", bytes / times[2] / 1e6, bytes / times[3] / 1e6);
+    printf("CRC32        bitwise %7.1f MB/s, table %7.1f MB/s (%08X)\n",
+           bytes / times[4] / 1e6,
+           bytes / times[5] / 1e6,
+           sink);
+}
+
+static double Test_GetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
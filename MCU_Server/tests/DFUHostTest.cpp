@@ -0,0 +1,585 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  End-to-end DFU test on host. MCU_DFU runs in a child process against
+ *  Tools/modem_simulator.py connected over pseudo terminal (UARTDriverHost),
+ *  with flash emulated in shared memory, erased and programmed at typical
+ *  MKL26Z64 timings. Transfer throughput at UART_INTERFACE_BAUDRATE is reported.
+ *
+ *  With --power-cut, device is reset in the middle of each flash operation
+ *  of the transfer in turn, and the transfer must complete after restart,
+ *  resumed from committed progress if any.
+ *
+ *  Usage: DFUHostTest <path to modem_simulator.py> [--power-cut]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Flasher.h"
+#include "MCU_DFU.h"
+#include "MeshTime.h"
+#include "UARTDriverHost.h"
+#include "UARTProtocol.h"
+#include "UARTScheduler.h"
+
+
+#define TEST_FLASH_ADDR 0x20000000UL   /**< Emulated flash is mapped below 4 GB, Flasher API takes 32-bit addresses */
+#define TEST_FIRMWARE_SIZE 0x8000UL    /**< Size of running firmware area */
+#define TEST_SPACE_SIZE 0x8000UL       /**< Size of DFU storage space */
+#define TEST_METADATA_SIZE (FLASHER_METADATA_SECTORS * FLASHER_SECTOR_SIZE)
+#define TEST_FLASH_SIZE (TEST_FIRMWARE_SIZE + TEST_SPACE_SIZE + TEST_METADATA_SIZE)
+#define TEST_ERASE_TIME_US 14000       /**< Typical sector erase time */
+#define TEST_PROGRAM_TIME_US 65        /**< Typical longword program time */
+#define TEST_IMAGE_SIZE (16 * 1024UL)  /**< Size of transferred image */
+#define TEST_CUT_IMAGE_SIZE 4096UL     /**< Size of image transferred with power cuts, spans metadata rollovers */
+#define TEST_ERASED_WORD 0xFFFFFFFFUL
+
+#define TEST_EXIT_UPDATED 0      /**< Device child exit code, image transferred and verified */
+#define TEST_EXIT_FAILED 1       /**< Device child exit code, transfer or verification failed */
+#define TEST_EXIT_NO_SIMULATOR 2 /**< Device child exit code, modem simulator could not be started */
+#define TEST_EXIT_RESET 3        /**< Device child exit code, power cut in the middle of flash operation */
+
+typedef struct Test_PowerCut_Tag
+{
+    uint32_t cut_op;    /**< Flash operation number reset happens in, 0 if none */
+    uint32_t ops;       /**< Flash operations started during transfer */
+    bool     committed; /**< Commit record completely written before reset */
+    bool     resumed;   /**< DFU resumed after restart */
+} Test_PowerCut_T;
+
+
+static uint8_t *Flash = NULL;
+static uint8_t  Image[TEST_IMAGE_SIZE];
+static size_t   ImageSize = TEST_IMAGE_SIZE;
+
+static pid_t            SimulatorPid = -1;
+static bool             IsTimed      = true;
+static Test_PowerCut_T *PowerCut     = NULL;
+
+
+/*
+ *  Busy wait, flash operations stall the CPU on target
+ *
+ *  @param us   Time to wait in microseconds
+ */
+static void Test_Spin(uint32_t us);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in microseconds
+ */
+static uint64_t Test_GetTimeUs(void);
+
+/*
+ *  Erase emulated flash and fill running firmware area with random data
+ */
+static void Test_ResetFlash(void);
+
+/*
+ *  Write image to temporary file, passed to modem simulator
+ *
+ *  @param p_path   Buffer for file path, at least 32 bytes long
+ *  @return         True if success, false otherwise
+ */
+static bool Test_WriteImage(char *p_path);
+
+/*
+ *  Run device in child process until modem simulator finishes the transfer
+ *
+ *  @param p_simulator  Path to modem_simulator.py
+ *  @param p_image      Path to image file
+ *  @param baud_rate    Simulated UART baud rate, 0 disables throttling
+ *  @param quiet        If true, simulator output is discarded
+ *  @param pp_args      Additional simulator arguments, NULL terminated
+ *  @return             Device child exit code
+ */
+static int Test_RunDevice(const char *p_simulator,
+                          const char *p_image,
+                          uint32_t    baud_rate,
+                          bool        quiet,
+                          const char *pp_args[]);
+
+/*
+ *  Reset device in the middle of each flash operation of the transfer in turn
+ *
+ *  @param p_simulator  Path to modem_simulator.py
+ *  @param p_image      Path to image file
+ *  @return             True if every transfer completed after restart, false otherwise
+ */
+static bool Test_PowerCuts(const char *p_simulator, const char *p_image);
+
+/*
+ *  Count flash operation and cut power in the middle of it, if it is the selected one
+ *
+ *  @param address  Flash address
+ *  @param len      Operation length in bytes
+ *  @param p_src    Data programmed, NULL for erase
+ */
+static void Test_FlashOperation(uint32_t address, size_t len, const uint32_t *p_src);
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <modem_simulator.py> [--power-cut]\n", argv[0]);
+        return 1;
+    }
+
+    int flags = MAP_SHARED | MAP_ANONYMOUS;
+#ifdef MAP_32BIT
+    flags |= MAP_32BIT;
+#endif
+    void *p_flash = mmap((void *)TEST_FLASH_ADDR, TEST_FLASH_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if ((p_flash == MAP_FAILED) || ((uintptr_t)p_flash + TEST_FLASH_SIZE > UINT32_MAX))
+    {
+        fprintf(stderr, "Flash emulation below 4 GB not available\n");
+        return 1;
+    }
+    Flash = (uint8_t *)p_flash;
+
+    bool is_power_cut = (argc > 2) && (strcmp(argv[2], "--power-cut") == 0);
+    if (is_power_cut)
+    {
+        void *p_shared = mmap(NULL, sizeof(Test_PowerCut_T), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p_shared == MAP_FAILED)
+        {
+            return 1;
+        }
+        PowerCut  = (Test_PowerCut_T *)p_shared;
+        ImageSize = TEST_CUT_IMAGE_SIZE;
+        IsTimed   = false;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < ImageSize; i++)
+    {
+        Image[i] = (uint8_t)rand();
+    }
+    /* Initial stack pointer, image must not start with compressed container magic */
+    Image[0] = 0x00;
+    Image[1] = 0x18;
+    Image[2] = 0x00;
+    Image[3] = 0x20;
+
+    char image_path[32];
+    if (!Test_WriteImage(image_path))
+    {
+        fprintf(stderr, "Image file not written\n");
+        return 1;
+    }
+
+    if (is_power_cut)
+    {
+        bool is_passed = Test_PowerCuts(argv[1], image_path);
+        unlink(image_path);
+        return is_passed ? 0 : 1;
+    }
+
+    const char *p_args[] = {NULL};
+
+    Test_ResetFlash();
+    uint64_t start  = Test_GetTimeUs();
+    int      result = Test_RunDevice(argv[1], image_path, UART_INTERFACE_BAUDRATE, false, p_args);
+    uint64_t time   = Test_GetTimeUs() - start;
+
+    unlink(image_path);
+
+    if (result != TEST_EXIT_UPDATED)
+    {
+        fprintf(stderr, "DFU failed, device exit code %d\n", result);
+        return 1;
+    }
+
+    printf("DFU of %lu bytes at %d baud: %.2f s, %.0f B/s\n",
+           TEST_IMAGE_SIZE,
+           UART_INTERFACE_BAUDRATE,
+           time / 1e6,
+           TEST_IMAGE_SIZE * 1e6 / time);
+    return 0;
+}
+
+static void Test_Spin(uint32_t us)
+{
+    if (!IsTimed)
+    {
+        return;
+    }
+
+    uint64_t end = Test_GetTimeUs() + us;
+    while (Test_GetTimeUs() < end)
+    {
+    }
+}
+
+static uint64_t Test_GetTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void Test_ResetFlash(void)
+{
+    for (size_t i = 0; i < TEST_FIRMWARE_SIZE; i++)
+    {
+        Flash[i] = (uint8_t)rand();
+    }
+    memset(Flash + TEST_FIRMWARE_SIZE, 0xFF, TEST_FLASH_SIZE - TEST_FIRMWARE_SIZE);
+}
+
+static bool Test_WriteImage(char *p_path)
+{
+    strcpy(p_path, "/tmp/DFUHostTestXXXXXX");
+    int fd = mkstemp(p_path);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool is_written = (write(fd, Image, ImageSize) == (ssize_t)ImageSize);
+    close(fd);
+    return is_written;
+}
+
+static int Test_RunDevice(const char *p_simulator,
+                          const char *p_image,
+                          uint32_t    baud_rate,
+                          bool        quiet,
+                          const char *pp_args[])
+{
+    fflush(stdout);
+    pid_t device = fork();
+    if (device < 0)
+    {
+        return TEST_EXIT_FAILED;
+    }
+    if (device != 0)
+    {
+        int status;
+        waitpid(device, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : TEST_EXIT_FAILED;
+    }
+
+    char pty_name[64];
+    if (!UARTDriverHost_OpenPty(pty_name, sizeof(pty_name)))
+    {
+        _exit(TEST_EXIT_NO_SIMULATOR);
+    }
+    UART_Init();
+    UARTDriverHost_SetBaudRate(baud_rate);
+    SetupDFU();
+    if (PowerCut != NULL)
+    {
+        PowerCut->resumed = MCU_DFU_IsInProgress();
+    }
+
+    SimulatorPid = fork();
+    if (SimulatorPid == 0)
+    {
+        if (quiet)
+        {
+            freopen("/dev/null", "w", stdout);
+        }
+
+        const char *p_argv[16] = {p_simulator, pty_name, "--no-handshake", "--dfu", p_image};
+        size_t      argc       = 5;
+        while ((*pp_args != NULL) && (argc < sizeof(p_argv) / sizeof(p_argv[0]) - 1))
+        {
+            p_argv[argc++] = *pp_args++;
+        }
+        execv(p_simulator, (char *const *)p_argv);
+        _exit(TEST_EXIT_NO_SIMULATOR);
+    }
+
+    for (;;)
+    {
+        UART_ProcessIncomingCommand();
+        LoopDFU();
+
+        /* Simulator finishing before firmware update means failed transfer */
+        int status;
+        if (waitpid(SimulatorPid, &status, WNOHANG) == SimulatorPid)
+        {
+            _exit(TEST_EXIT_FAILED);
+        }
+    }
+}
+
+static bool Test_PowerCuts(const char *p_simulator, const char *p_image)
+{
+    const char *p_args[] = {"--page-size", "128", "--timeout", "0.1", NULL};
+
+    for (uint32_t cut_op = 1;; cut_op++)
+    {
+        Test_ResetFlash();
+        PowerCut->cut_op    = cut_op;
+        PowerCut->ops       = 0;
+        PowerCut->committed = false;
+
+        int result = Test_RunDevice(p_simulator, p_image, 0, true, p_args);
+        if (result == TEST_EXIT_UPDATED)
+        {
+            printf("Transfer of %u flash operations completed after reset in each of them\n", cut_op - 1);
+            return true;
+        }
+        if (result != TEST_EXIT_RESET)
+        {
+            fprintf(stderr, "DFU failed before reset in flash operation %u, device exit code %d\n", cut_op, result);
+            return false;
+        }
+
+        bool is_committed = PowerCut->committed;
+        PowerCut->cut_op  = 0;
+
+        result = Test_RunDevice(p_simulator, p_image, 0, true, p_args);
+        if ((result != TEST_EXIT_UPDATED) || (PowerCut->resumed != is_committed))
+        {
+            fprintf(stderr,
+                    "DFU failed after reset in flash operation %u, device exit code %d, %s\n",
+                    cut_op,
+                    result,
+                    PowerCut->resumed ? "resumed" : "restarted");
+            return false;
+        }
+    }
+}
+
+static void Test_FlashOperation(uint32_t address, size_t len, const uint32_t *p_src)
+{
+    if ((PowerCut == NULL) || (PowerCut->cut_op == 0) || !MCU_DFU_IsInProgress())
+    {
+        return;
+    }
+
+    PowerCut->ops++;
+    if (PowerCut->ops != PowerCut->cut_op)
+    {
+        return;
+    }
+
+    /* Only half of the operation is done before reset */
+    uint8_t *p_dst = (uint8_t *)(uintptr_t)address;
+    if (p_src == NULL)
+    {
+        memset(p_dst, 0xFF, len / 2);
+    }
+    else
+    {
+        memcpy(p_dst, p_src, len / 2);
+    }
+
+    if (SimulatorPid > 0)
+    {
+        kill(SimulatorPid, SIGKILL);
+        waitpid(SimulatorPid, NULL, 0);
+    }
+    _exit(TEST_EXIT_RESET);
+}
+
+
+/*
+ *  Emulated flash, see Flasher.h
+ */
+
+uint32_t Flasher_GetFirmwareAddr(void)
+{
+    return (uint32_t)(uintptr_t)Flash;
+}
+
+uint32_t Flasher_GetSpaceAddr(void)
+{
+    return (uint32_t)(uintptr_t)(Flash + TEST_FIRMWARE_SIZE);
+}
+
+size_t Flasher_GetSpaceSize(void)
+{
+    return TEST_SPACE_SIZE;
+}
+
+uint32_t Flasher_GetMetadataAddr(void)
+{
+    return Flasher_GetSpaceAddr() + TEST_SPACE_SIZE;
+}
+
+int Flasher_EraseSpace(void)
+{
+    memset(Flash + TEST_FIRMWARE_SIZE, 0xFF, TEST_FLASH_SIZE - TEST_FIRMWARE_SIZE);
+    return FLASHER_SUCCESS;
+}
+
+int Flasher_EraseSpaceSector(uint32_t address)
+{
+    if ((address < Flasher_GetSpaceAddr()) || (address >= Flasher_GetFirmwareAddr() + TEST_FLASH_SIZE))
+    {
+        return FLASHER_ERROR_RANGE;
+    }
+    if (address % FLASHER_SECTOR_SIZE != 0)
+    {
+        return FLASHER_ERROR_ALIGNMENT;
+    }
+
+    Test_FlashOperation(address, FLASHER_SECTOR_SIZE, NULL);
+    Test_Spin(TEST_ERASE_TIME_US);
+    memset((uint8_t *)(uintptr_t)address, 0xFF, FLASHER_SECTOR_SIZE);
+    return FLASHER_SUCCESS;
+}
+
+int Flasher_SaveMemoryToFlash(uint32_t address, const uint32_t *src, uint32_t num_of_words)
+{
+    if ((address < Flasher_GetSpaceAddr()) ||
+        (address + num_of_words * sizeof(uint32_t) > Flasher_GetFirmwareAddr() + TEST_FLASH_SIZE))
+    {
+        return FLASHER_ERROR_RANGE;
+    }
+
+    Test_FlashOperation(address, num_of_words * sizeof(uint32_t), src);
+
+    uint32_t *p_dst = (uint32_t *)(uintptr_t)address;
+    for (uint32_t i = 0; i < num_of_words; i++)
+    {
+        if (p_dst[i] != TEST_ERASED_WORD)
+        {
+            return FLASHER_ERROR_NOT_ERASED;
+        }
+        Test_Spin(TEST_PROGRAM_TIME_US);
+        p_dst[i] = src[i];
+    }
+
+    /* Records follow the header in metadata sectors */
+    if ((PowerCut != NULL) && (address >= Flasher_GetMetadataAddr()) && (address % FLASHER_SECTOR_SIZE != 0))
+    {
+        PowerCut->committed = true;
+    }
+    return FLASHER_SUCCESS;
+}
+
+int Flasher_UpdateFirmware(uint32_t num_of_words)
+{
+    /* Let the last response out and the simulator finish, then check stored image */
+    int status;
+    while (waitpid(SimulatorPid, &status, WNOHANG) != SimulatorPid)
+    {
+        UARTScheduler_Flush();
+        UARTDriverHost_Poll();
+        usleep(100);
+    }
+
+    bool is_stored = (num_of_words * sizeof(uint32_t) == ImageSize) &&
+                     (memcmp((const uint8_t *)(uintptr_t)Flasher_GetSpaceAddr(), Image, ImageSize) == 0);
+    bool is_done = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+
+    _exit((is_stored && is_done) ? TEST_EXIT_UPDATED : TEST_EXIT_FAILED);
+}
+
+
+/*
+ *  Arduino and application functions used by linked modules
+ */
+
+uint32_t millis(void)
+{
+    return (uint32_t)(Test_GetTimeUs() / 1000);
+}
+
+uint32_t micros(void)
+{
+    return (uint32_t)Test_GetTimeUs();
+}
+
+void delay(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void digitalWrite(int pin, int value)
+{
+}
+
+void ProcessEnterInitDevice(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterDevice(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterInitNode(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterNode(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessMeshCommand(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessMeshMessageRequest1(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessAttention(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessError(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessModemFirmwareVersion(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessStartTest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessFirmwareVersionSetResponse(void)
+{
+}
+
+void ProcessFactoryResetEvent(void)
+{
+}
+
+void MeshTime_ProcessTimeSourceSetRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void MeshTime_ProcessTimeSourceGetRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void MeshTime_ProcessTimeGetResponse(uint8_t *p_payload, uint8_t len)
+{
+}
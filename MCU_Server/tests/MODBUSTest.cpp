@@ -0,0 +1,318 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test of MODBUS RTU receiver. Responses are written to a socketpair
+ *  read by MODBUSSerialHost, while micros() is virtual time advanced by the
+ *  test, so inter-frame silence is exact. Valid responses, responses with
+ *  dropped, inserted and flipped bytes, responses split by silence or
+ *  followed by garbage and oversize frames are fed in turn. MODBUS_GetStats()
+ *  counters, handler calls and MODBUS_ProcessFrameError() calls are checked
+ *  for each of them, and a valid response has to be received after each.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "CRC.h"
+#include "MODBUS.h"
+#include "MODBUSSerialHost.h"
+
+
+#define TEST_BAUDRATE 9600            /**< Frame silence is 4010 us */
+#define TEST_SILENCE_US 4010          /**< 3.5 character times of 11 bits */
+#define TEST_STEP_US 100              /**< Virtual time between MODBUS_ProcessIncoming calls */
+#define TEST_SETTLE_US 10000          /**< Time fed after each case, closes any pending frame */
+#define TEST_FRAME_MAX_LEN 300        /**< Longer than MODBUS receive buffer */
+#define TEST_SLAVE_ADDRESS 1
+#define TEST_READ_INPUT_REGISTERS 0x04
+#define TEST_EXCEPTION 0x84
+#define TEST_ILLEGAL_DATA_ADDRESS 0x02
+
+typedef struct Test_Counters_Tag
+{
+    uint32_t frames;       /**< MODBUS_GetStats()->frames */
+    uint32_t crc_errors;   /**< MODBUS_GetStats()->crc_errors */
+    uint32_t resyncs;      /**< MODBUS_GetStats()->resyncs */
+    uint32_t responses;    /**< Read Input Registers responses handled */
+    uint32_t exceptions;   /**< Exception responses handled */
+    uint32_t frame_errors; /**< MODBUS_ProcessFrameError calls */
+} Test_Counters_T;
+
+
+static uint32_t        TimeUs = 0;
+static int             PeerFd = -1;
+static Test_Counters_T Handled;
+static uint16_t        LastRegisters[2];
+static size_t          LastRegistersLen;
+
+
+/*
+ *  Build response frame with CRC, sent high byte first as by MODBUS_SendFrame
+ *
+ *  @param p_frame      Buffer for frame
+ *  @param function     Function code
+ *  @param p_payload    Payload following function code
+ *  @param len          Payload len
+ *  @return             Frame len
+ */
+static size_t Test_BuildFrame(uint8_t *p_frame, uint8_t function, const uint8_t *p_payload, size_t len);
+
+/*
+ *  Write bytes to the receiver and let virtual time pass
+ *
+ *  @param p_data       Bytes to write
+ *  @param len          Number of bytes
+ *  @param time_us      Time to pass after writing, in microseconds
+ */
+static void Test_Feed(const uint8_t *p_data, size_t len, uint32_t time_us);
+
+/*
+ *  Take current counters
+ *
+ *  @param p_counters   Pointer to write counters
+ */
+static void Test_GetCounters(Test_Counters_T *p_counters);
+
+/*
+ *  Feed frame, optionally split by pause, and compare counter changes with expected ones
+ *
+ *  @param p_name       Case name
+ *  @param p_data       Bytes to feed
+ *  @param len          Number of bytes
+ *  @param split        Number of bytes fed before pause, len for none
+ *  @param pause_us     Pause after first split bytes, in microseconds
+ *  @param p_expected   Expected counter changes
+ *  @return             Number of failed checks
+ */
+static unsigned Test_Case(const char            *p_name,
+                          const uint8_t         *p_data,
+                          size_t                 len,
+                          size_t                 split,
+                          uint32_t               pause_us,
+                          const Test_Counters_T *p_expected);
+
+
+int main(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        fprintf(stderr, "socketpair failed\n");
+        return 1;
+    }
+    MODBUSSerialHost_SetFd(fds[0]);
+    MODBUSSerialHost_SetThrottling(false);
+    PeerFd = fds[1];
+
+    MODBUS_SetBaudrate(TEST_BAUDRATE);
+
+    const uint8_t read_payload[]      = {4, 0x43, 0x66, 0x80, 0x00};
+    const uint8_t exception_payload[] = {TEST_ILLEGAL_DATA_ADDRESS};
+
+    uint8_t valid[TEST_FRAME_MAX_LEN];
+    size_t  valid_len = Test_BuildFrame(valid, TEST_READ_INPUT_REGISTERS, read_payload, sizeof(read_payload));
+
+    uint8_t exception[TEST_FRAME_MAX_LEN];
+    size_t  exception_len = Test_BuildFrame(exception, TEST_EXCEPTION, exception_payload, sizeof(exception_payload));
+
+    uint8_t dropped[TEST_FRAME_MAX_LEN];
+    memcpy(dropped, valid, 4);
+    memcpy(dropped + 4, valid + 5, valid_len - 5);
+
+    uint8_t inserted[TEST_FRAME_MAX_LEN];
+    memcpy(inserted, valid, 4);
+    inserted[4] = 0x55;
+    memcpy(inserted + 5, valid + 4, valid_len - 4);
+
+    uint8_t flipped[TEST_FRAME_MAX_LEN];
+    memcpy(flipped, valid, valid_len);
+    flipped[5] ^= 0x10;
+
+    uint8_t trailing[TEST_FRAME_MAX_LEN];
+    memcpy(trailing, valid, valid_len);
+    memset(trailing + valid_len, 0xAA, 3);
+
+    /* Unsupported function code never completes, receiver buffer overflows */
+    uint8_t oversize[TEST_FRAME_MAX_LEN];
+    memset(oversize, 0x00, sizeof(oversize));
+
+    /* frames, crc_errors, resyncs, responses, exceptions, frame_errors */
+    const Test_Counters_T none      = {0, 0, 0, 0, 0, 0};
+    const Test_Counters_T response  = {1, 0, 0, 1, 0, 0};
+    const Test_Counters_T error     = {1, 0, 0, 0, 1, 0};
+    const Test_Counters_T corrupted = {0, 1, 1, 0, 0, 1};
+    const Test_Counters_T resync    = {0, 0, 1, 0, 0, 1};
+    const Test_Counters_T split     = {0, 2, 2, 0, 0, 2};
+    const Test_Counters_T garbage   = {1, 0, 1, 1, 0, 1};
+
+    unsigned fails = 0;
+
+    fails += Test_Case("valid", valid, valid_len, valid_len, 0, &response);
+    if ((LastRegistersLen != 2) || (LastRegisters[0] != 0x4366) || (LastRegisters[1] != 0x8000))
+    {
+        fprintf(stderr, "valid: registers %zu %04X %04X\n", LastRegistersLen, LastRegisters[0], LastRegisters[1]);
+        fails++;
+    }
+    fails += Test_Case("exception", exception, exception_len, exception_len, 0, &error);
+    fails += Test_Case("dropped byte", dropped, valid_len - 1, valid_len - 1, 0, &corrupted);
+    fails += Test_Case("valid after dropped byte", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("inserted byte", inserted, valid_len + 1, valid_len + 1, 0, &corrupted);
+    fails += Test_Case("valid after inserted byte", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("flipped byte", flipped, valid_len, valid_len, 0, &corrupted);
+    fails += Test_Case("valid after flipped byte", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("pause below silence", valid, valid_len, 4, TEST_SILENCE_US - 2 * TEST_STEP_US, &response);
+    fails += Test_Case("pause of silence", valid, valid_len, 4, TEST_SILENCE_US + TEST_STEP_US, &split);
+    fails += Test_Case("valid after pause", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("trailing garbage", trailing, valid_len + 3, valid_len + 3, 0, &garbage);
+    fails += Test_Case("valid after trailing garbage", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("oversize", oversize, sizeof(oversize), sizeof(oversize), 0, &resync);
+    fails += Test_Case("valid after oversize", valid, valid_len, valid_len, 0, &response);
+    fails += Test_Case("silence only", valid, 0, 0, 0, &none);
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static size_t Test_BuildFrame(uint8_t *p_frame, uint8_t function, const uint8_t *p_payload, size_t len)
+{
+    size_t index = 0;
+
+    p_frame[index++] = TEST_SLAVE_ADDRESS;
+    p_frame[index++] = function;
+    memcpy(p_frame + index, p_payload, len);
+    index += len;
+
+    uint16_t crc     = CalcCRC16_Modbus(p_frame, index, CRC16_INIT_VAL);
+    p_frame[index++] = highByte(crc);
+    p_frame[index++] = lowByte(crc);
+
+    return index;
+}
+
+static void Test_Feed(const uint8_t *p_data, size_t len, uint32_t time_us)
+{
+    if ((len > 0) && (write(PeerFd, p_data, len) != (ssize_t)len))
+    {
+        fprintf(stderr, "write failed\n");
+    }
+
+    MODBUS_ProcessIncoming();
+    for (uint32_t elapsed = 0; elapsed < time_us; elapsed += TEST_STEP_US)
+    {
+        TimeUs += TEST_STEP_US;
+        MODBUS_ProcessIncoming();
+    }
+}
+
+static void Test_GetCounters(Test_Counters_T *p_counters)
+{
+    *p_counters            = Handled;
+    p_counters->frames     = MODBUS_GetStats()->frames;
+    p_counters->crc_errors = MODBUS_GetStats()->crc_errors;
+    p_counters->resyncs    = MODBUS_GetStats()->resyncs;
+}
+
+static unsigned Test_Case(const char            *p_name,
+                          const uint8_t         *p_data,
+                          size_t                 len,
+                          size_t                 split,
+                          uint32_t               pause_us,
+                          const Test_Counters_T *p_expected)
+{
+    Test_Counters_T before;
+    Test_Counters_T after;
+
+    Test_GetCounters(&before);
+    Test_Feed(p_data, split, pause_us);
+    Test_Feed(p_data + split, len - split, TEST_SETTLE_US);
+    Test_GetCounters(&after);
+
+    const char    *p_names[]  = {"frames", "crc_errors", "resyncs", "responses", "exceptions", "frame_errors"};
+    const uint32_t *p_before  = (const uint32_t *)&before;
+    const uint32_t *p_after   = (const uint32_t *)&after;
+    const uint32_t *p_changes = (const uint32_t *)p_expected;
+    unsigned        fails     = 0;
+
+    for (size_t i = 0; i < sizeof(Test_Counters_T) / sizeof(uint32_t); i++)
+    {
+        if (p_after[i] - p_before[i] != p_changes[i])
+        {
+            fprintf(stderr, "%s: %s changed by %u, expected %u\n", p_name, p_names[i], p_after[i] - p_before[i],
+                    p_changes[i]);
+            fails++;
+        }
+    }
+
+    return fails;
+}
+
+
+/*
+ *  Arduino and application functions used by linked modules
+ */
+
+uint32_t micros(void)
+{
+    return TimeUs;
+}
+
+void MODBUS_ProcessReadHoldingRegisters(uint8_t slave_address, size_t data_len, uint16_t *p_data)
+{
+}
+
+void MODBUS_ProcessReadInputRegisters(uint8_t slave_address, size_t data_len, uint16_t *p_data)
+{
+    Handled.responses++;
+    LastRegistersLen = data_len;
+    memcpy(LastRegisters, p_data, (data_len < 2 ? data_len : 2) * sizeof(uint16_t));
+}
+
+void MODBUS_ProcessReadPresetSingleRegister(uint8_t slave_address, uint16_t register_address, uint16_t preset_data)
+{
+}
+
+void MODBUS_ProcessReadPresetMultipleRegisters(uint8_t  slave_address,
+                                               uint16_t starting_address,
+                                               uint16_t num_of_registers)
+{
+}
+
+void MODBUS_ProcessException(uint8_t slave_address, uint8_t original_function_code, uint8_t error_code)
+{
+    if ((original_function_code == TEST_READ_INPUT_REGISTERS) && (error_code == TEST_ILLEGAL_DATA_ADDRESS))
+    {
+        Handled.exceptions++;
+    }
+}
+
+void MODBUS_ProcessFrameError(void)
+{
+    Handled.frame_errors++;
+}
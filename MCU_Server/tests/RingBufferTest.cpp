@@ -0,0 +1,413 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test of ring buffer wraparound. Every start position and length is
+ *  queued and read back through RingBuffer_T, and reserved, written in
+ *  frame-like pieces with RingBuffer_SpanWrite and committed through
+ *  SPSCRingBuffer_T. Then UART frame serialization through a stack buffer
+ *  and RingBuffer_QueueBytes is compared with serialization straight into
+ *  reserved space, in bytes copied and frames per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CRC.h"
+#include "RingBuffer.h"
+#include "SPSCRingBuffer.h"
+
+
+#define TEST_BUFFER_LEN 64u            /**< Size of buffers in wraparound tests, power of two */
+#define TEST_TX_BUFFER_LEN 1024u       /**< Size of TX buffers in frame benchmark, power of two */
+#define TEST_BENCHMARK_FRAMES 1000000u /**< Frames serialized per payload length in benchmark */
+
+#define TEST_HEADER_LEN 4u /**< Frame preamble, length and command */
+#define TEST_CRC_LEN 2u
+#define TEST_PACKET_LEN(len) (TEST_HEADER_LEN + (len) + TEST_CRC_LEN)
+
+
+static uint64_t BytesCopied = 0;
+
+
+/*
+ *  Queue and read back every length at every start position of RingBuffer_T
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_RingBufferWraparound(void);
+
+/*
+ *  Reserve, write and commit every length at every start position of SPSCRingBuffer_T
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_SpanWraparound(void);
+
+/*
+ *  Compare frame serialization through stack buffer with serialization into reserved space
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_FrameBenchmark(void);
+
+/*
+ *  Serialize frame the way UART protocol did before reserve/commit, in stack buffer queued afterwards
+ *
+ *  @param p_ring_buffer    Pointer to TX ring buffer
+ *  @param len              Payload length
+ *  @param cmd              Command
+ *  @param p_payload        Pointer to payload
+ *  @return                 True if success, false if frame does not fit
+ */
+static bool Test_SendQueued(RingBuffer_T *p_ring_buffer, uint8_t len, uint8_t cmd, uint8_t *p_payload);
+
+/*
+ *  Serialize frame the way UART protocol does, straight into reserved space
+ *
+ *  @param p_ring_buffer    Pointer to TX ring buffer
+ *  @param len              Payload length
+ *  @param cmd              Command
+ *  @param p_payload        Pointer to payload
+ *  @return                 True if success, false if frame does not fit
+ */
+static bool Test_SendReserved(SPSCRingBuffer_T<TEST_TX_BUFFER_LEN> *p_ring_buffer,
+                              uint8_t                               len,
+                              uint8_t                               cmd,
+                              uint8_t *                             p_payload);
+
+/*
+ *  Calculate frame CRC over length, command and payload
+ *
+ *  @param len          Payload length
+ *  @param cmd          Command
+ *  @param p_payload    Pointer to payload
+ *  @return             CRC16
+ */
+static uint16_t Test_CalcFrameCRC(uint8_t len, uint8_t cmd, uint8_t *p_payload);
+
+/*
+ *  Copy bytes and count them
+ *
+ *  @param p_dst    Destination
+ *  @param p_src    Source
+ *  @param len      Number of bytes
+ */
+static void Test_Copy(uint8_t *p_dst, const uint8_t *p_src, size_t len);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in seconds
+ */
+static double Test_GetTime(void);
+
+
+int main(void)
+{
+    unsigned fails = 0;
+
+    fails += Test_RingBufferWraparound();
+    fails += Test_SpanWraparound();
+    fails += Test_FrameBenchmark();
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static unsigned Test_RingBufferWraparound(void)
+{
+    static uint8_t buf[TEST_BUFFER_LEN];
+    unsigned       fails = 0;
+
+    for (uint16_t start = 0; start < TEST_BUFFER_LEN; start++)
+    {
+        /* One byte is kept free, full buffer would look empty */
+        for (uint16_t len = 0; len < TEST_BUFFER_LEN; len++)
+        {
+            RingBuffer_T ring_buffer;
+            uint8_t      data[TEST_BUFFER_LEN];
+            uint8_t      read[TEST_BUFFER_LEN];
+
+            RingBuffer_Init(&ring_buffer, buf, sizeof(buf));
+            memset(buf, 0, sizeof(buf));
+            RingBuffer_SetWrIndex(&ring_buffer, start);
+            RingBuffer_IncrementRdIndex(&ring_buffer, start);
+
+            for (uint16_t i = 0; i < len; i++)
+            {
+                data[i] = (uint8_t)(start + i + 1);
+            }
+
+            if (!RingBuffer_QueueBytes(&ring_buffer, data, len) || (RingBuffer_DataLen(&ring_buffer) != len) ||
+                RingBuffer_QueueBytes(&ring_buffer, data, TEST_BUFFER_LEN - len))
+            {
+                fprintf(stderr, "RingBuffer_T queue failed, start %u, len %u\n", start, len);
+                fails++;
+                continue;
+            }
+
+            uint16_t read_len = 0;
+            uint16_t cont_len;
+            uint8_t *p_data;
+            while ((p_data = RingBuffer_GetMaxContinuousBuffer(&ring_buffer, &cont_len)), cont_len != 0)
+            {
+                if (read_len + cont_len > len)
+                {
+                    break;
+                }
+                memcpy(read + read_len, p_data, cont_len);
+                RingBuffer_IncrementRdIndex(&ring_buffer, cont_len);
+                read_len += cont_len;
+            }
+
+            if ((read_len != len) || (memcmp(read, data, len) != 0) || !RingBuffer_isEmpty(&ring_buffer))
+            {
+                fprintf(stderr, "RingBuffer_T read back failed, start %u, len %u\n", start, len);
+                fails++;
+            }
+        }
+    }
+
+    printf("RingBuffer_T wraparound: %u failed\n", fails);
+    return fails;
+}
+
+static unsigned Test_SpanWraparound(void)
+{
+    static uint8_t                           buf[TEST_BUFFER_LEN];
+    static SPSCRingBuffer_T<TEST_BUFFER_LEN> ring_buffer;
+    unsigned                                 fails = 0;
+
+    for (uint16_t start = 0; start < TEST_BUFFER_LEN; start++)
+    {
+        for (uint16_t len = 0; len <= TEST_BUFFER_LEN; len++)
+        {
+            RingBuffer_Span_T span;
+            uint8_t           data[TEST_BUFFER_LEN];
+            uint8_t           read[TEST_BUFFER_LEN];
+
+            SPSCRingBuffer_Init(&ring_buffer, buf);
+            memset(buf, 0, sizeof(buf));
+            SPSCRingBuffer_Commit(&ring_buffer, start);
+            SPSCRingBuffer_Skip(&ring_buffer, start);
+
+            for (uint16_t i = 0; i < len; i++)
+            {
+                data[i] = (uint8_t)(start + i + 1);
+            }
+
+            if (!SPSCRingBuffer_Reserve(&ring_buffer, len, &span) || (span.first_len + span.second_len != len))
+            {
+                fprintf(stderr, "Reserve failed, start %u, len %u\n", start, len);
+                fails++;
+                continue;
+            }
+
+            /* Written out of order in header, CRC and payload pieces, as a frame is */
+            uint16_t header_len = (len < TEST_HEADER_LEN) ? len : TEST_HEADER_LEN;
+            uint16_t body_len   = len - header_len;
+            uint16_t crc_len    = (body_len < TEST_CRC_LEN) ? body_len : TEST_CRC_LEN;
+            uint16_t crc_offset = len - crc_len;
+            RingBuffer_SpanWrite(&span, 0, data, header_len);
+            RingBuffer_SpanWrite(&span, crc_offset, data + crc_offset, crc_len);
+            RingBuffer_SpanWrite(&span, header_len, data + header_len, crc_offset - header_len);
+            SPSCRingBuffer_Commit(&ring_buffer, len);
+
+            if ((SPSCRingBuffer_DataLen(&ring_buffer) != len) ||
+                SPSCRingBuffer_Reserve(&ring_buffer, TEST_BUFFER_LEN - len + 1, &span))
+            {
+                fprintf(stderr, "Commit failed, start %u, len %u\n", start, len);
+                fails++;
+                continue;
+            }
+
+            if ((SPSCRingBuffer_DequeueBytes(&ring_buffer, read, sizeof(read)) != len) ||
+                (memcmp(read, data, len) != 0) || !SPSCRingBuffer_IsEmpty(&ring_buffer))
+            {
+                fprintf(stderr, "Span read back failed, start %u, len %u\n", start, len);
+                fails++;
+            }
+        }
+    }
+
+    printf("SPSCRingBuffer_T reserve/commit wraparound: %u failed\n", fails);
+    return fails;
+}
+
+static unsigned Test_FrameBenchmark(void)
+{
+    static uint8_t                              queued_buf[TEST_TX_BUFFER_LEN];
+    static uint8_t                              reserved_buf[TEST_TX_BUFFER_LEN];
+    static SPSCRingBuffer_T<TEST_TX_BUFFER_LEN> reserved;
+    const uint8_t                               payload_lens[] = {4, 16, 64, 127};
+    unsigned                                    fails          = 0;
+
+    printf("Payload  Copied per frame (queued/reserved)  Frames/s (queued/reserved)\n");
+
+    for (size_t i = 0; i < sizeof(payload_lens); i++)
+    {
+        uint8_t len = payload_lens[i];
+        uint8_t payload[UINT8_MAX];
+        for (uint8_t j = 0; j < len; j++)
+        {
+            payload[j] = (uint8_t)rand();
+        }
+
+        RingBuffer_T queued;
+        RingBuffer_Init(&queued, queued_buf, sizeof(queued_buf));
+        SPSCRingBuffer_Init(&reserved, reserved_buf);
+
+        /* Both paths produce the same bytes, also across buffer end */
+        for (size_t j = 0; j < 2 * TEST_TX_BUFFER_LEN / TEST_PACKET_LEN(len); j++)
+        {
+            uint8_t queued_frame[TEST_PACKET_LEN(UINT8_MAX)];
+            uint8_t reserved_frame[TEST_PACKET_LEN(UINT8_MAX)];
+
+            payload[0] = (uint8_t)j;
+            if (!Test_SendQueued(&queued, len, 0x12, payload) || !Test_SendReserved(&reserved, len, 0x12, payload))
+            {
+                fails++;
+                break;
+            }
+
+            uint16_t frame_len = TEST_PACKET_LEN(len);
+            for (size_t k = 0; k < frame_len; k++)
+            {
+                RingBuffer_DequeueByte(&queued, &queued_frame[k]);
+            }
+            if ((SPSCRingBuffer_DequeueBytes(&reserved, reserved_frame, frame_len) != frame_len) ||
+                (memcmp(queued_frame, reserved_frame, frame_len) != 0))
+            {
+                fprintf(stderr, "Serialized frames differ, payload length %u\n", len);
+                fails++;
+                break;
+            }
+        }
+
+        BytesCopied  = 0;
+        double start = Test_GetTime();
+        for (uint32_t j = 0; j < TEST_BENCHMARK_FRAMES; j++)
+        {
+            Test_SendQueued(&queued, len, 0x12, payload);
+            RingBuffer_IncrementRdIndex(&queued, TEST_PACKET_LEN(len));
+        }
+        double   queued_time   = Test_GetTime() - start;
+        uint64_t queued_copied = BytesCopied;
+
+        BytesCopied = 0;
+        start       = Test_GetTime();
+        for (uint32_t j = 0; j < TEST_BENCHMARK_FRAMES; j++)
+        {
+            Test_SendReserved(&reserved, len, 0x12, payload);
+            SPSCRingBuffer_Skip(&reserved, TEST_PACKET_LEN(len));
+        }
+        double   reserved_time   = Test_GetTime() - start;
+        uint64_t reserved_copied = BytesCopied;
+
+        printf("%7u  %16lu/%-18lu  %12.0f/%-12.0f\n",
+               len,
+               (unsigned long)(queued_copied / TEST_BENCHMARK_FRAMES),
+               (unsigned long)(reserved_copied / TEST_BENCHMARK_FRAMES),
+               TEST_BENCHMARK_FRAMES / queued_time,
+               TEST_BENCHMARK_FRAMES / reserved_time);
+
+        if (reserved_copied != (uint64_t)TEST_PACKET_LEN(len) * TEST_BENCHMARK_FRAMES)
+        {
+            fprintf(stderr, "Frame copied more than once, payload length %u\n", len);
+            fails++;
+        }
+    }
+
+    return fails;
+}
+
+static bool Test_SendQueued(RingBuffer_T *p_ring_buffer, uint8_t len, uint8_t cmd, uint8_t *p_payload)
+{
+    uint8_t msg[TEST_PACKET_LEN(len)];
+
+    msg[0] = 0xAA;
+    msg[1] = 0x55;
+    msg[2] = len;
+    msg[3] = cmd;
+    Test_Copy(msg + TEST_HEADER_LEN, p_payload, len);
+
+    uint16_t crc                   = Test_CalcFrameCRC(len, cmd, p_payload);
+    msg[TEST_HEADER_LEN + len]     = (uint8_t)crc;
+    msg[TEST_HEADER_LEN + len + 1] = (uint8_t)(crc >> 8);
+
+    BytesCopied += sizeof(msg);
+    return RingBuffer_QueueBytes(p_ring_buffer, msg, sizeof(msg));
+}
+
+static bool Test_SendReserved(SPSCRingBuffer_T<TEST_TX_BUFFER_LEN> *p_ring_buffer,
+                              uint8_t                               len,
+                              uint8_t                               cmd,
+                              uint8_t *                             p_payload)
+{
+    RingBuffer_Span_T span;
+
+    if (!SPSCRingBuffer_Reserve(p_ring_buffer, TEST_PACKET_LEN(len), &span))
+    {
+        return false;
+    }
+
+    uint8_t header[TEST_HEADER_LEN] = {0xAA, 0x55, len, cmd};
+    RingBuffer_SpanWrite(&span, 0, header, sizeof(header));
+    RingBuffer_SpanWrite(&span, TEST_HEADER_LEN, p_payload, len);
+
+    uint16_t crc                   = Test_CalcFrameCRC(len, cmd, p_payload);
+    uint8_t  crc_buf[TEST_CRC_LEN] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+    RingBuffer_SpanWrite(&span, TEST_HEADER_LEN + len, crc_buf, sizeof(crc_buf));
+
+    BytesCopied += TEST_PACKET_LEN(len);
+    SPSCRingBuffer_Commit(p_ring_buffer, TEST_PACKET_LEN(len));
+    return true;
+}
+
+static uint16_t Test_CalcFrameCRC(uint8_t len, uint8_t cmd, uint8_t *p_payload)
+{
+    uint16_t crc = CRC16_INIT_VAL;
+    crc          = CalcCRC16(&len, sizeof(len), crc);
+    crc          = CalcCRC16(&cmd, sizeof(cmd), crc);
+    crc          = CalcCRC16(p_payload, len, crc);
+    return crc;
+}
+
+static void Test_Copy(uint8_t *p_dst, const uint8_t *p_src, size_t len)
+{
+    memcpy(p_dst, p_src, len);
+    BytesCopied += len;
+}
+
+static double Test_GetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,1200 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test of SDM poller. SDM and MODBUS run against SDM_METERS_COUNT
+ *  meters connected over MODBUSSerialHost, in one of two modes.
+ *
+ *  Emulated meters: meters are emulated by Tools/sdm_simulator.py, connected
+ *  over pseudo terminal at real baud rate timing. After baud rate negotiation,
+ *  meters are polled for a few seconds and every response has to refresh the
+ *  values of its planned query:
+ *
+ *   - by default, values polled every 500 ms are merged into one request, so
+ *     each poll cycle takes one request plus energy request every tenth cycle,
+ *   - with --strict, the emulated meters reject reads of unused registers, so
+ *     after the first such exception every value is read with its own request.
+ *
+ *  Every meter has to be refreshed as often as the others and the bus has to
+ *  end up at MODBUS_INTERFACE_BAUDRATE_MAX, or at MODBUS_INTERFACE_BAUDRATE
+ *  with --baud-after-restart, when the new baud rate is not confirmed by the
+ *  meters and they are switched back. Per-meter refresh rates are reported.
+ *  Other arguments are passed on to the simulator.
+ *
+ *  Virtual time (--virtual): meters are answered by the test itself over
+ *  socketpair, while millis(), micros() and delay() run on virtual time
+ *  advanced by 1 ms per main loop, so every response time is exact. SDM keeps
+ *  static state, so each case runs in its own process:
+ *
+ *   - fair polling: every meter gets as many requests and refreshes as the
+ *     others, none of them timing out,
+ *   - foreign address: response from another address than the one of queried
+ *     meter is received, but refreshes nothing and the query times out,
+ *   - round trip time: timeout follows smoothed RTT plus four deviations of
+ *     a meter answering in constant time, down to the minimal margin,
+ *   - early response: response received before its registers could have
+ *     been transferred is taken as 1 ms RTT,
+ *   - timeouts in row: timeout of a meter gone silent doubles up to its
+ *     limit, and it is polled after delays doubling up to their limit,
+ *   - renegotiation: meters reset to MODBUS_INTERFACE_BAUDRATE right after
+ *     negotiation are looked for again SDM_LINK_RETRY_PERIOD after it, and
+ *     polled at MODBUS_INTERFACE_BAUDRATE_MAX again.
+ *
+ *  Usage: SDMHostTest <path to sdm_simulator.py> [--strict] [simulator arguments]
+ *         SDMHostTest --virtual
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "CRC.h"
+#include "Config.h"
+#include "MODBUS.h"
+#include "MODBUSSerialHost.h"
+#include "SDM.h"
+
+
+#define TEST_LINK_TIME_MS 10000    /**< Time allowed for negotiation and first refresh of all meters */
+#define TEST_POLL_TIME_MS 6000     /**< Time meters are polled for, covers at least one energy period */
+#define TEST_LOOP_SLEEP_US 200     /**< Main loop pause, leaves CPU to the simulator */
+#define TEST_REG_VOLTAGE 0x0000    /**< Value read first by merged query */
+#define TEST_REG_ENERGY 0x0156     /**< Value read by its own query, far from the others */
+#define TEST_MAX_VALUES 8          /**< Upper limit of polled values */
+
+#define TEST_STEP_US 1000                   /**< Virtual time of one main loop */
+#define TEST_FAIR_TIME_MS 10000             /**< Time meters are polled for in fair polling case */
+#define TEST_RTT_MS 20                      /**< Response delay of virtual meters */
+#define TEST_LONG_RTT_MS 100                /**< Response delay in round trip time case */
+#define TEST_SETTLE_TIME_MS 2000            /**< Time round trip time settles in before meter goes silent */
+#define TEST_SETTLED_TIMEOUT_MS 60          /**< TEST_RTT_MS plus SDM_QUERY_TIMEOUT_MIN_MARGIN */
+#define TEST_TIMEOUTS_IN_ROW 10             /**< Timeouts of silent meter, enough to reach backoff limit */
+#define TEST_BUS_SLACK_MS 100               /**< Time other meter may take the bus for before delayed query */
+#define TEST_LINK_RETRY_PERIOD_MS 60000     /**< SDM_LINK_RETRY_PERIOD, time between negotiations */
+#define TEST_QUERY_TIMEOUT_MAX_MS 400       /**< SDM_QUERY_TIMEOUT_MAX, query pending when meters are lost */
+#define TEST_FRAME_MAX_LEN 128              /**< Longer than any request or response */
+#define TEST_REQUEST_LEN 8                  /**< Read request, address to CRC */
+#define TEST_PRESET_HEADER_LEN 7            /**< Preset Multiple Registers request up to its data */
+#define TEST_READ_HOLDING_REGISTERS 0x03
+#define TEST_READ_INPUT_REGISTERS 0x04
+#define TEST_PRESET_MULTIPLE_REGISTERS 0x10
+#define TEST_REG_BAUD_RATE 0x001C
+#define TEST_VALUE 230.0f                   /**< Value of every input register pair */
+#define TEST_BITS_PER_BYTE 10
+
+typedef struct Test_Snapshot_Tag
+{
+    uint32_t frames;                                       /**< MODBUS frames received */
+    uint32_t resyncs;                                      /**< MODBUS receiver resyncs */
+    uint32_t timeouts;                                     /**< Queries not answered in time */
+    uint32_t refreshes[SDM_METERS_COUNT][TEST_MAX_VALUES]; /**< Refreshes of each value of each meter */
+} Test_Snapshot_T;
+
+typedef struct Test_Meter_Tag
+{
+    bool     is_present;   /**< Meter answers requests sent at its baud rate */
+    uint32_t baud;         /**< Baud rate meter listens at */
+    uint32_t rtt_ms;       /**< Response delay, registers beyond the first float take their transfer time more */
+    bool     is_early;     /**< Response is sent without transfer time of registers beyond the first float */
+    uint32_t requests;     /**< Requests addressed to meter, answered or not */
+    uint32_t request_time; /**< millis() last request was received at */
+    uint32_t probes;       /**< Reads of baud rate register, sent by negotiation only */
+    uint32_t responses;    /**< Responses sent */
+} Test_Meter_T;
+
+typedef struct Test_MeterStats_Tag
+{
+    uint16_t round_trip_time; /**< Expected SDM_MeterStats_T round_trip_time */
+    uint16_t deviation;       /**< Expected SDM_MeterStats_T round_trip_time_deviation */
+    uint16_t timeout;         /**< Expected SDM_MeterStats_T timeout */
+} Test_MeterStats_T;
+
+typedef struct Test_Case_Tag
+{
+    const char *p_name;
+    bool (*p_run)(void);
+} Test_Case_T;
+
+
+static pid_t SimulatorPid       = -1;
+static bool  IsStrict           = false;
+static bool  IsBaudAfterRestart = false;
+
+static bool         IsVirtual        = false;
+static uint64_t     VirtualTimeUs    = 0;
+static int          BusFd            = -1;
+static Test_Meter_T Meters[SDM_METERS_COUNT];
+static uint8_t      Request[TEST_FRAME_MAX_LEN];
+static size_t       RequestLen       = 0;
+static uint8_t      Response[TEST_FRAME_MAX_LEN];
+static size_t       ResponseLen      = 0;
+static uint32_t     ResponseTime     = 0; /**< millis() pending response is sent at */
+static uint8_t      ResponseMeter    = 0; /**< Index of meter pending response is sent by */
+static uint32_t     ForeignResponses = 0; /**< Number of next responses sent from the next address */
+
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in microseconds
+ */
+static uint64_t Test_GetTimeUs(void);
+
+/*
+ *  Start simulator on pseudo terminal opened for MODBUS interface
+ *
+ *  @param p_simulator  Path to sdm_simulator.py
+ *  @param pp_args      Additional simulator arguments, NULL terminated
+ *  @return             True if simulator was started
+ */
+static bool Test_StartSimulator(const char *p_simulator, char *pp_args[]);
+
+/*
+ *  Run SDM main loop
+ *
+ *  @param time_ms      Time to run for
+ *  @param until_polled If true, return as soon as every meter refreshed all its values
+ *  @return             True if every meter refreshed all its values, or until_polled is false
+ */
+static bool Test_Run(uint32_t time_ms, bool until_polled);
+
+/*
+ *  Take current MODBUS and SDM counters
+ *
+ *  @param p_snapshot   Pointer to write counters
+ */
+static void Test_TakeSnapshot(Test_Snapshot_T *p_snapshot);
+
+/*
+ *  Check that responses received between two snapshots refreshed values as planned
+ *
+ *  @param p_before     Counters at start of polling
+ *  @param p_after      Counters at end of polling
+ *  @return             True if passed
+ */
+static bool Test_CheckPolling(const Test_Snapshot_T *p_before, const Test_Snapshot_T *p_after);
+
+/*
+ *  Run one main loop. In virtual mode virtual meters are served before and
+ *  after it, so response due now is read by this loop and request sent by it
+ *  is taken at once, and virtual time is advanced by TEST_STEP_US.
+ */
+static void Test_Step(void);
+
+/*
+ *  Send pending response if due, then read request and prepare response of addressed virtual meter
+ */
+static void Test_ServeBus(void);
+
+/*
+ *  Prepare response of virtual meter to complete request
+ *
+ *  @param len          Request len
+ */
+static void Test_AnswerRequest(size_t len);
+
+/*
+ *  Get baud rate register value of baud rate
+ *
+ *  @param baud         Baud rate
+ *  @return             SDM_BAUD_* code
+ */
+static uint8_t Test_GetBaudCode(uint32_t baud);
+
+/*
+ *  Run main loop until virtual meter sends given number of responses, each one is processed by SDM on return
+ *
+ *  @param meter        Meter index
+ *  @param count        Number of responses
+ *  @return             True if all responses were sent within TEST_LINK_TIME_MS
+ */
+static bool Test_RunResponses(uint8_t meter, uint32_t count);
+
+/*
+ *  Run main loop until SDM switches bus to given baud rate
+ *
+ *  @param baud         Baud rate
+ *  @return             True if switched within TEST_LINK_TIME_MS
+ */
+static bool Test_RunUntilBaudRate(uint32_t baud);
+
+/*
+ *  Compare round trip time statistics of meter with expected ones
+ *
+ *  @param meter        Meter index
+ *  @param p_expected   Expected statistics
+ *  @param p_step       Description printed on mismatch
+ *  @return             True if equal
+ */
+static bool Test_CheckMeterStats(uint8_t meter, const Test_MeterStats_T *p_expected, const char *p_step);
+
+/*
+ *  Check if every meter refreshed all its values
+ *
+ *  @return             True if all values were refreshed
+ */
+static bool Test_IsPolled(void);
+
+/*
+ *  Get refreshes of all values of meter
+ *
+ *  @param meter        Meter index
+ *  @return             Sum of refreshes
+ */
+static uint32_t Test_GetRefreshes(uint8_t meter);
+
+/*
+ *  Run virtual time case in its own process, with virtual meters present at MODBUS_INTERFACE_BAUDRATE
+ *
+ *  @param p_case       Case to run
+ *  @return             True if passed
+ */
+static bool Test_RunVirtualCase(const Test_Case_T *p_case);
+
+/*
+ *  Virtual time cases, each one sets up SDM by itself
+ *
+ *  @return             True if passed
+ */
+static bool Test_FairPolling(void);
+static bool Test_ForeignAddress(void);
+static bool Test_RoundTripTime(void);
+static bool Test_EarlyResponse(void);
+static bool Test_TimeoutsInRow(void);
+static bool Test_Renegotiation(void);
+
+
+static const Test_Case_T VirtualCases[] = {
+    {"fair polling", Test_FairPolling},
+    {"foreign address", Test_ForeignAddress},
+    {"round trip time", Test_RoundTripTime},
+    {"early response", Test_EarlyResponse},
+    {"timeouts in row", Test_TimeoutsInRow},
+    {"renegotiation", Test_Renegotiation},
+};
+
+/*
+ *  Samples of constant TEST_LONG_RTT_MS: the first one sets deviation to half of it, every next one takes a
+ *  quarter off, until four deviations fall below SDM_QUERY_TIMEOUT_MIN_MARGIN (40 ms)
+ */
+static const Test_MeterStats_T ConstantRttStats[] = {
+    {100, 50, 300},
+    {100, 37, 250},
+    {100, 28, 213},
+    {100, 21, 185},
+    {100, 16, 164},
+    {100, 12, 148},
+    {100, 9, 140},
+    {100, 6, 140},
+};
+
+/*
+ *  Baud rate read back in TEST_RTT_MS, then merged query answered before its extra registers could have been
+ *  transferred: the sample is 1 ms, which pulls smoothed RTT down by 1/8 of the difference
+ */
+static const Test_MeterStats_T EarlyResponseStats[] = {
+    {20, 10, 60},
+    {17, 12, 66},
+};
+
+/*
+ *  Timeout of meter settled at TEST_RTT_MS is doubled after every timeout up to SDM_QUERY_TIMEOUT_MAX (400 ms),
+ *  polling is delayed from the second timeout on by SDM_BACKOFF_INITIAL (250 ms) doubled up to SDM_BACKOFF_MAX_STEPS
+ *  (6) times. Delay shorter than poll period is extended by the query release.
+ */
+static const uint16_t SilentTimeouts[TEST_TIMEOUTS_IN_ROW] = {120, 240, 400, 400, 400, 400, 400, 400, 400, 400};
+static const uint32_t SilentDelays[TEST_TIMEOUTS_IN_ROW]   = {0, 250, 500, 1000, 2000, 4000, 8000, 16000, 16000, 16000};
+static const uint8_t  SilentBackoffs[TEST_TIMEOUTS_IN_ROW] = {1, 2, 3, 4, 5, 6, 7, 7, 7, 7};
+
+static const struct
+{
+    uint32_t baud;
+    uint8_t  code;
+} BaudRates[] = {
+    {2400, SDM_BAUD_2400},
+    {4800, SDM_BAUD_4800},
+    {9600, SDM_BAUD_9600},
+};
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <sdm_simulator.py> [--strict] [simulator arguments]\n", argv[0]);
+        fprintf(stderr, "       %s --virtual\n", argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "--virtual") == 0)
+    {
+        bool is_passed = true;
+        for (size_t i = 0; i < sizeof(VirtualCases) / sizeof(VirtualCases[0]); i++)
+        {
+            is_passed = Test_RunVirtualCase(&VirtualCases[i]) && is_passed;
+        }
+        return is_passed ? 0 : 1;
+    }
+
+    for (int i = 2; i < argc; i++)
+    {
+        IsStrict           = IsStrict || (strcmp(argv[i], "--strict") == 0);
+        IsBaudAfterRestart = IsBaudAfterRestart || (strcmp(argv[i], "--baud-after-restart") == 0);
+    }
+
+    if (!Test_StartSimulator(argv[1], argv + 2))
+    {
+        fprintf(stderr, "Simulator not started\n");
+        return 1;
+    }
+
+    SetupSDM();
+
+    Test_Snapshot_T before;
+    Test_Snapshot_T after;
+
+    bool is_linked = Test_Run(TEST_LINK_TIME_MS, true);
+    Test_TakeSnapshot(&before);
+    Test_Run(TEST_POLL_TIME_MS, false);
+    Test_TakeSnapshot(&after);
+
+    kill(SimulatorPid, SIGTERM);
+    waitpid(SimulatorPid, NULL, 0);
+
+    if (!is_linked)
+    {
+        fprintf(stderr, "Meters not polled within %d ms\n", TEST_LINK_TIME_MS);
+        return 1;
+    }
+
+    bool     is_passed = Test_CheckPolling(&before, &after);
+    uint32_t expected  = IsBaudAfterRestart ? MODBUS_INTERFACE_BAUDRATE : MODBUS_INTERFACE_BAUDRATE_MAX;
+
+    if ((SDM_GetStats()->baudrate != expected) || (MODBUSSerialHost_GetBaudRate() != expected))
+    {
+        fprintf(stderr, "Bus at %u baud, expected %u\n", MODBUSSerialHost_GetBaudRate(), expected);
+        is_passed = false;
+    }
+
+    return is_passed ? 0 : 1;
+}
+
+static uint64_t Test_GetTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static bool Test_StartSimulator(const char *p_simulator, char *pp_args[])
+{
+    char pty_name[64];
+    if (!MODBUSSerialHost_OpenPty(pty_name, sizeof(pty_name)))
+    {
+        return false;
+    }
+
+    char meters[8];
+    snprintf(meters, sizeof(meters), "%d", SDM_METERS_COUNT);
+
+    fflush(stdout);
+    SimulatorPid = fork();
+    if (SimulatorPid == 0)
+    {
+        const char *p_argv[16] = {p_simulator, pty_name, "--meters", meters, "--seconds", "0", "--report", "5"};
+        size_t      argc       = 8;
+        while ((*pp_args != NULL) && (argc < sizeof(p_argv) / sizeof(p_argv[0]) - 1))
+        {
+            p_argv[argc++] = *pp_args++;
+        }
+        execv(p_simulator, (char *const *)p_argv);
+        _exit(1);
+    }
+
+    return SimulatorPid > 0;
+}
+
+static bool Test_Run(uint32_t time_ms, bool until_polled)
+{
+    uint32_t start = millis();
+
+    while (millis() - start < time_ms)
+    {
+        Test_Step();
+
+        if (until_polled && Test_IsPolled())
+        {
+            return true;
+        }
+    }
+
+    return !until_polled;
+}
+
+static void Test_TakeSnapshot(Test_Snapshot_T *p_snapshot)
+{
+    memset(p_snapshot, 0, sizeof(*p_snapshot));
+
+    p_snapshot->frames   = MODBUS_GetStats()->frames;
+    p_snapshot->resyncs  = MODBUS_GetStats()->resyncs;
+    p_snapshot->timeouts = SDM_GetStats()->timeouts;
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        SDM_ValueStats_T value_stats;
+        for (size_t i = 0; (i < TEST_MAX_VALUES) && SDM_GetValueStats(meter, i, &value_stats); i++)
+        {
+            p_snapshot->refreshes[meter][i] = value_stats.refreshes;
+        }
+    }
+}
+
+static bool Test_CheckPolling(const Test_Snapshot_T *p_before, const Test_Snapshot_T *p_after)
+{
+    bool     is_passed  = true;
+    uint32_t frames     = p_after->frames - p_before->frames;
+    uint32_t timeouts   = p_after->timeouts - p_before->timeouts;
+    uint32_t expected   = 0;
+    uint32_t cycles     = 0;          /**< Refreshes of reported values, summed over meters */
+    uint32_t min_cycles = UINT32_MAX; /**< Refreshes of reported values of meter polled least */
+    uint32_t max_cycles = 0;          /**< Refreshes of reported values of meter polled most */
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        uint32_t reported = 0;
+        uint32_t energy   = 0;
+
+        SDM_ValueStats_T value_stats;
+        for (size_t i = 0; (i < TEST_MAX_VALUES) && SDM_GetValueStats(meter, i, &value_stats); i++)
+        {
+            uint32_t refreshes = p_after->refreshes[meter][i] - p_before->refreshes[meter][i];
+
+            /* Without gaps every value is read by its own request, otherwise the merged query is counted once */
+            if (IsStrict || (value_stats.address == TEST_REG_VOLTAGE) || (value_stats.address == TEST_REG_ENERGY))
+            {
+                expected += refreshes;
+            }
+
+            if (value_stats.address == TEST_REG_VOLTAGE)
+            {
+                reported = refreshes;
+            }
+            else if (value_stats.address == TEST_REG_ENERGY)
+            {
+                energy = refreshes;
+            }
+            else if (refreshes != reported)
+            {
+                fprintf(stderr, "Meter %d: value %04X refreshed %u times, voltage %u\n",
+                        meter, value_stats.address, refreshes, reported);
+                is_passed = false;
+            }
+        }
+
+        printf("Meter %d at %u baud: %.2f refreshes/s, energy %.2f refreshes/s\n",
+               meter,
+               SDM_GetStats()->baudrate,
+               reported * 1000.0 / TEST_POLL_TIME_MS,
+               energy * 1000.0 / TEST_POLL_TIME_MS);
+
+        if ((reported < TEST_POLL_TIME_MS / 1000) || (energy == 0))
+        {
+            fprintf(stderr, "Meter %d: %u voltage and %u energy refreshes in %d ms\n",
+                    meter, reported, energy, TEST_POLL_TIME_MS);
+            is_passed = false;
+        }
+        cycles += reported;
+        min_cycles = (reported < min_cycles) ? reported : min_cycles;
+        max_cycles = (reported > max_cycles) ? reported : max_cycles;
+    }
+
+    /* Snapshot may fall between requests of two meters, query timed out is refreshed in the next cycle */
+    if (max_cycles - min_cycles > 1 + timeouts)
+    {
+        fprintf(stderr, "Meters refreshed from %u to %u times\n", min_cycles, max_cycles);
+        is_passed = false;
+    }
+
+    printf("%u responses, %.2f requests per poll cycle, %u timeouts\n", frames, (double)frames / cycles, timeouts);
+
+    /* Late response to timed out query is received without refreshing anything */
+    if ((frames < expected) || (frames - expected > timeouts))
+    {
+        fprintf(stderr, "%u responses received, %u expected from refreshes\n", frames, expected);
+        is_passed = false;
+    }
+
+    if (p_after->resyncs != p_before->resyncs)
+    {
+        fprintf(stderr, "%u MODBUS resyncs\n", p_after->resyncs - p_before->resyncs);
+        is_passed = false;
+    }
+
+    return is_passed;
+}
+
+static void Test_Step(void)
+{
+    if (!IsVirtual)
+    {
+        LoopSDM();
+        usleep(TEST_LOOP_SLEEP_US);
+        return;
+    }
+
+    Test_ServeBus();
+    LoopSDM();
+    Test_ServeBus();
+    VirtualTimeUs += TEST_STEP_US;
+}
+
+static void Test_ServeBus(void)
+{
+    if ((ResponseLen > 0) && ((int32_t)(millis() - ResponseTime) >= 0))
+    {
+        if (write(BusFd, Response, ResponseLen) != (ssize_t)ResponseLen)
+        {
+            fprintf(stderr, "Response not sent\n");
+        }
+        ResponseLen = 0;
+        Meters[ResponseMeter].responses++;
+    }
+
+    ssize_t len = read(BusFd, Request + RequestLen, sizeof(Request) - RequestLen);
+    if (len > 0)
+    {
+        RequestLen += len;
+    }
+
+    size_t request_len = TEST_REQUEST_LEN;
+    if ((RequestLen >= TEST_PRESET_HEADER_LEN) && (Request[1] == TEST_PRESET_MULTIPLE_REGISTERS))
+    {
+        request_len = TEST_PRESET_HEADER_LEN + Request[TEST_PRESET_HEADER_LEN - 1] + sizeof(uint16_t);
+    }
+
+    if (RequestLen >= request_len)
+    {
+        Test_AnswerRequest(request_len);
+        RequestLen = 0;
+    }
+}
+
+static void Test_AnswerRequest(size_t len)
+{
+    uint8_t  address  = Request[0];
+    uint8_t  function = Request[1];
+    uint16_t start    = (Request[2] << 8) | Request[3];
+    uint16_t count    = (Request[4] << 8) | Request[5];
+
+    if ((address < 1) || (address > SDM_METERS_COUNT) || (CalcCRC16_Modbus(Request, len, CRC16_INIT_VAL) != 0))
+    {
+        fprintf(stderr, "Invalid request to %d\n", address);
+        return;
+    }
+
+    Test_Meter_T *p_meter = &Meters[address - 1];
+    p_meter->requests++;
+    p_meter->request_time = millis();
+
+    if ((function == TEST_READ_HOLDING_REGISTERS) && (start == TEST_REG_BAUD_RATE))
+    {
+        p_meter->probes++;
+    }
+
+    if (!p_meter->is_present || (p_meter->baud != MODBUSSerialHost_GetBaudRate()))
+    {
+        return;
+    }
+
+    uint32_t delay_ms = p_meter->rtt_ms;
+    size_t   index    = 0;
+
+    Response[index++] = address;
+    Response[index++] = function;
+
+    if (function == TEST_PRESET_MULTIPLE_REGISTERS)
+    {
+        uint32_t bits;
+        float    value;
+
+        memcpy(Response + index, Request + 2, 2 * sizeof(uint16_t));
+        index += 2 * sizeof(uint16_t);
+
+        bits = ((uint32_t)Request[7] << 24) | ((uint32_t)Request[8] << 16) | (Request[9] << 8) | Request[10];
+        memcpy(&value, &bits, sizeof(value));
+
+        /* Meter switches to new baud rate after acknowledging it */
+        for (size_t i = 0; (start == TEST_REG_BAUD_RATE) && (i < sizeof(BaudRates) / sizeof(BaudRates[0])); i++)
+        {
+            if (BaudRates[i].code == (uint8_t)value)
+            {
+                p_meter->baud = BaudRates[i].baud;
+            }
+        }
+    }
+    else
+    {
+        uint32_t bits;
+        float    value = TEST_VALUE;
+
+        if ((function == TEST_READ_HOLDING_REGISTERS) && (start == TEST_REG_BAUD_RATE))
+        {
+            value = Test_GetBaudCode(p_meter->baud);
+        }
+        memcpy(&bits, &value, sizeof(bits));
+
+        Response[index++] = count * sizeof(uint16_t);
+        for (uint16_t i = 0; i < count; i += sizeof(float) / sizeof(uint16_t))
+        {
+            Response[index++] = bits >> 24;
+            Response[index++] = bits >> 16;
+            Response[index++] = bits >> 8;
+            Response[index++] = bits;
+        }
+
+        /* Registers beyond the first float take their transfer time, as SDM expects */
+        if (!p_meter->is_early && (count > sizeof(float) / sizeof(uint16_t)))
+        {
+            uint32_t bits_sent = (count - sizeof(float) / sizeof(uint16_t)) * sizeof(uint16_t) * TEST_BITS_PER_BYTE;
+            delay_ms += (bits_sent * 1000 + p_meter->baud - 1) / p_meter->baud;
+        }
+    }
+
+    if (ForeignResponses > 0)
+    {
+        ForeignResponses--;
+        Response[0] = address + 1;
+    }
+
+    uint16_t crc      = CalcCRC16_Modbus(Response, index, CRC16_INIT_VAL);
+    Response[index++] = highByte(crc);
+    Response[index++] = lowByte(crc);
+
+    ResponseLen   = index;
+    ResponseTime  = millis() + delay_ms;
+    ResponseMeter = address - 1;
+}
+
+static uint8_t Test_GetBaudCode(uint32_t baud)
+{
+    for (size_t i = 0; i < sizeof(BaudRates) / sizeof(BaudRates[0]); i++)
+    {
+        if (BaudRates[i].baud == baud)
+        {
+            return BaudRates[i].code;
+        }
+    }
+
+    return UINT8_MAX;
+}
+
+static bool Test_RunResponses(uint8_t meter, uint32_t count)
+{
+    uint32_t start     = millis();
+    uint32_t responses = Meters[meter].responses;
+
+    while ((Meters[meter].responses - responses < count) && (millis() - start < TEST_LINK_TIME_MS))
+    {
+        Test_Step();
+    }
+
+    return Meters[meter].responses - responses >= count;
+}
+
+static bool Test_RunUntilBaudRate(uint32_t baud)
+{
+    uint32_t start = millis();
+
+    while ((SDM_GetStats()->baudrate != baud) && (millis() - start < TEST_LINK_TIME_MS))
+    {
+        Test_Step();
+    }
+
+    return SDM_GetStats()->baudrate == baud;
+}
+
+static bool Test_CheckMeterStats(uint8_t meter, const Test_MeterStats_T *p_expected, const char *p_step)
+{
+    SDM_MeterStats_T stats;
+    SDM_GetMeterStats(meter, &stats);
+
+    if ((stats.round_trip_time != p_expected->round_trip_time) ||
+        (stats.round_trip_time_deviation != p_expected->deviation) || (stats.timeout != p_expected->timeout))
+    {
+        fprintf(stderr, "%s: RTT %u, deviation %u, timeout %u instead of %u, %u, %u\n",
+                p_step,
+                stats.round_trip_time,
+                stats.round_trip_time_deviation,
+                stats.timeout,
+                p_expected->round_trip_time,
+                p_expected->deviation,
+                p_expected->timeout);
+        return false;
+    }
+
+    return true;
+}
+
+static bool Test_IsPolled(void)
+{
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        SDM_ValueStats_T value_stats;
+        for (size_t i = 0; SDM_GetValueStats(meter, i, &value_stats); i++)
+        {
+            if (value_stats.refreshes == 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint32_t Test_GetRefreshes(uint8_t meter)
+{
+    uint32_t         refreshes = 0;
+    SDM_ValueStats_T value_stats;
+
+    for (size_t i = 0; SDM_GetValueStats(meter, i, &value_stats); i++)
+    {
+        refreshes += value_stats.refreshes;
+    }
+
+    return refreshes;
+}
+
+static bool Test_RunVirtualCase(const Test_Case_T *p_case)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+        {
+            exit(1);
+        }
+
+        MODBUSSerialHost_SetFd(fds[0]);
+        MODBUSSerialHost_SetThrottling(false);
+        BusFd     = fds[1];
+        IsVirtual = true;
+
+        for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+        {
+            Meters[meter].is_present = true;
+            Meters[meter].baud       = MODBUS_INTERFACE_BAUDRATE;
+            Meters[meter].rtt_ms     = TEST_RTT_MS;
+        }
+
+        exit(p_case->p_run() ? 0 : 1);
+    }
+
+    int  status    = 0;
+    bool is_passed = (pid > 0) && (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) &&
+                     (WEXITSTATUS(status) == 0);
+
+    if (is_passed)
+    {
+        printf("%s passed\n", p_case->p_name);
+    }
+    else
+    {
+        fprintf(stderr, "%s failed\n", p_case->p_name);
+    }
+
+    return is_passed;
+}
+
+static bool Test_FairPolling(void)
+{
+    SetupSDM();
+    if (!Test_Run(TEST_LINK_TIME_MS, true))
+    {
+        fprintf(stderr, "Meters not polled within %d ms\n", TEST_LINK_TIME_MS);
+        return false;
+    }
+
+    Test_Snapshot_T before;
+    Test_Snapshot_T after;
+    uint32_t        requests[SDM_METERS_COUNT];
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        requests[meter] = Meters[meter].requests;
+    }
+
+    Test_TakeSnapshot(&before);
+    Test_Run(TEST_FAIR_TIME_MS, false);
+    Test_TakeSnapshot(&after);
+
+    bool     is_passed     = true;
+    uint32_t min_requests  = UINT32_MAX;
+    uint32_t max_requests  = 0;
+    uint32_t min_refreshes = UINT32_MAX;
+    uint32_t max_refreshes = 0;
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        uint32_t         meter_requests = Meters[meter].requests - requests[meter];
+        uint32_t         refreshes      = 0;
+        uint32_t         period         = 0;
+        SDM_ValueStats_T value_stats;
+
+        for (size_t i = 0; (i < TEST_MAX_VALUES) && SDM_GetValueStats(meter, i, &value_stats); i++)
+        {
+            if (value_stats.address == TEST_REG_VOLTAGE)
+            {
+                refreshes = after.refreshes[meter][i] - before.refreshes[meter][i];
+                period    = value_stats.period;
+            }
+        }
+
+        printf("Meter %d: %u requests, %u voltage refreshes\n", meter, meter_requests, refreshes);
+
+        if (refreshes + 1 < TEST_FAIR_TIME_MS / period)
+        {
+            fprintf(stderr, "Meter %d: %u voltage refreshes in %d ms\n", meter, refreshes, TEST_FAIR_TIME_MS);
+            is_passed = false;
+        }
+
+        min_requests  = (meter_requests < min_requests) ? meter_requests : min_requests;
+        max_requests  = (meter_requests > max_requests) ? meter_requests : max_requests;
+        min_refreshes = (refreshes < min_refreshes) ? refreshes : min_refreshes;
+        max_refreshes = (refreshes > max_refreshes) ? refreshes : max_refreshes;
+    }
+
+    /* Snapshots fall between requests of two meters, so the meters may differ by one */
+    if ((max_requests - min_requests > 1) || (max_refreshes - min_refreshes > 1))
+    {
+        fprintf(stderr, "Meters got from %u to %u requests, refreshed from %u to %u times\n",
+                min_requests, max_requests, min_refreshes, max_refreshes);
+        is_passed = false;
+    }
+
+    if (after.timeouts != before.timeouts)
+    {
+        fprintf(stderr, "%u timeouts\n", after.timeouts - before.timeouts);
+        is_passed = false;
+    }
+
+    return is_passed;
+}
+
+static bool Test_ForeignAddress(void)
+{
+    SetupSDM();
+    if (!Test_Run(TEST_LINK_TIME_MS, true))
+    {
+        fprintf(stderr, "Meters not polled within %d ms\n", TEST_LINK_TIME_MS);
+        return false;
+    }
+
+    bool     is_passed = true;
+    uint32_t start     = millis();
+    uint32_t frames    = MODBUS_GetStats()->frames;
+    uint32_t timeouts  = SDM_GetStats()->timeouts;
+    uint32_t refreshes[SDM_METERS_COUNT];
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        refreshes[meter] = Test_GetRefreshes(meter);
+    }
+
+    /* Next response is sent from the address of the next meter, or an unused one for the last meter */
+    ForeignResponses = 1;
+    while (((ForeignResponses > 0) || (ResponseLen > 0)) && (millis() - start < TEST_LINK_TIME_MS))
+    {
+        Test_Step();
+    }
+
+    if (MODBUS_GetStats()->frames != frames + 1)
+    {
+        fprintf(stderr, "%u frames received instead of one\n", MODBUS_GetStats()->frames - frames);
+        is_passed = false;
+    }
+
+    while ((SDM_GetStats()->timeouts == timeouts) && (millis() - start < TEST_LINK_TIME_MS))
+    {
+        Test_Step();
+    }
+
+    if (SDM_GetStats()->timeouts != timeouts + 1)
+    {
+        fprintf(stderr, "Query answered from foreign address did not time out\n");
+        is_passed = false;
+    }
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        if (Test_GetRefreshes(meter) != refreshes[meter])
+        {
+            fprintf(stderr, "Meter %d refreshed by response from foreign address\n", meter);
+            is_passed = false;
+        }
+    }
+
+    return is_passed;
+}
+
+static bool Test_RoundTripTime(void)
+{
+    Meters[0].rtt_ms = TEST_LONG_RTT_MS;
+    SetupSDM();
+
+    /* Round trip time is measured anew at every baud rate, baud rate read back is the first sample at the last one */
+    if (!Test_RunUntilBaudRate(MODBUS_INTERFACE_BAUDRATE_MAX))
+    {
+        fprintf(stderr, "Bus not switched to %d baud\n", MODBUS_INTERFACE_BAUDRATE_MAX);
+        return false;
+    }
+
+    const Test_MeterStats_T initial   = {0, 0, 200};
+    bool                    is_passed = Test_CheckMeterStats(0, &initial, "Before first sample");
+
+    for (size_t i = 0; i < sizeof(ConstantRttStats) / sizeof(ConstantRttStats[0]); i++)
+    {
+        char step[32];
+        snprintf(step, sizeof(step), "Sample %zu", i + 1);
+
+        if (!Test_RunResponses(0, 1))
+        {
+            fprintf(stderr, "%s not received\n", step);
+            return false;
+        }
+        is_passed = Test_CheckMeterStats(0, &ConstantRttStats[i], step) && is_passed;
+    }
+
+    return is_passed;
+}
+
+static bool Test_EarlyResponse(void)
+{
+    Meters[0].is_early = true;
+    SetupSDM();
+
+    if (!Test_RunUntilBaudRate(MODBUS_INTERFACE_BAUDRATE_MAX))
+    {
+        fprintf(stderr, "Bus not switched to %d baud\n", MODBUS_INTERFACE_BAUDRATE_MAX);
+        return false;
+    }
+
+    bool is_passed = true;
+
+    for (size_t i = 0; i < sizeof(EarlyResponseStats) / sizeof(EarlyResponseStats[0]); i++)
+    {
+        char step[32];
+        snprintf(step, sizeof(step), "Sample %zu", i + 1);
+
+        if (!Test_RunResponses(0, 1))
+        {
+            fprintf(stderr, "%s not received\n", step);
+            return false;
+        }
+        is_passed = Test_CheckMeterStats(0, &EarlyResponseStats[i], step) && is_passed;
+    }
+
+    return is_passed;
+}
+
+static bool Test_TimeoutsInRow(void)
+{
+    SetupSDM();
+    if (!Test_Run(TEST_LINK_TIME_MS, true))
+    {
+        fprintf(stderr, "Meters not polled within %d ms\n", TEST_LINK_TIME_MS);
+        return false;
+    }
+    Test_Run(TEST_SETTLE_TIME_MS, false);
+
+    SDM_MeterStats_T stats;
+    SDM_GetMeterStats(0, &stats);
+    if ((stats.round_trip_time != TEST_RTT_MS) || (stats.timeout != TEST_SETTLED_TIMEOUT_MS))
+    {
+        fprintf(stderr, "Settled at RTT %u, timeout %u\n", stats.round_trip_time, stats.timeout);
+        return false;
+    }
+
+    bool             is_passed    = true;
+    uint32_t         timeout_time = 0;
+    SDM_ValueStats_T value_stats;
+
+    SDM_GetValueStats(0, 0, &value_stats);
+
+    /* Other meters keep answering, so only meter 0 times out, but its delayed query may wait for theirs */
+    Meters[0].is_present = false;
+
+    for (size_t i = 0; i < TEST_TIMEOUTS_IN_ROW; i++)
+    {
+        uint32_t start    = millis();
+        uint32_t timeouts = SDM_GetStats()->timeouts;
+        uint32_t now      = start;
+
+        while ((SDM_GetStats()->timeouts == timeouts) && (now - start < 2 * SilentDelays[TEST_TIMEOUTS_IN_ROW - 1]))
+        {
+            now = millis();
+            Test_Step();
+        }
+
+        if (SDM_GetStats()->timeouts != timeouts + 1)
+        {
+            fprintf(stderr, "Timeout %zu not detected\n", i + 1);
+            return false;
+        }
+
+        /* Request which timed out now was sent after the delay set by the previous timeout */
+        if (i >= 2)
+        {
+            uint32_t delay    = Meters[0].request_time - timeout_time;
+            uint32_t expected = SilentDelays[i - 1];
+            uint32_t slack    = TEST_BUS_SLACK_MS * (SDM_METERS_COUNT - 1);
+
+            if ((delay < expected) || ((expected >= value_stats.period) && (delay > expected + slack)))
+            {
+                fprintf(stderr, "Timeout %zu: polled %u ms after previous one, expected %u ms\n", i, delay, expected);
+                is_passed = false;
+            }
+        }
+        timeout_time = now;
+
+        SDM_GetMeterStats(0, &stats);
+        if ((stats.timeout != SilentTimeouts[i]) || (stats.backoff != SilentBackoffs[i]))
+        {
+            fprintf(stderr, "Timeout %zu: timeout %u, backoff %u instead of %u, %u\n",
+                    i + 1, stats.timeout, stats.backoff, SilentTimeouts[i], SilentBackoffs[i]);
+            is_passed = false;
+        }
+    }
+
+    return is_passed;
+}
+
+static bool Test_Renegotiation(void)
+{
+    SetupSDM();
+    if (!Test_RunUntilBaudRate(MODBUS_INTERFACE_BAUDRATE_MAX))
+    {
+        fprintf(stderr, "Bus not switched to %d baud\n", MODBUS_INTERFACE_BAUDRATE_MAX);
+        return false;
+    }
+
+    /* Negotiation ends with baud rate read back from the last meter, before any polling */
+    if (!Test_RunResponses(SDM_METERS_COUNT - 1, 1))
+    {
+        fprintf(stderr, "Baud rate not read back\n");
+        return false;
+    }
+
+    bool     is_passed = true;
+    uint32_t link_time = millis() - TEST_STEP_US / 1000;
+    uint32_t probes    = 0;
+    uint32_t refreshes[SDM_METERS_COUNT];
+
+    /* Meters replaced or reset, they are all lost long before negotiation may start again */
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        Meters[meter].baud = MODBUS_INTERFACE_BAUDRATE;
+        probes += Meters[meter].probes;
+        refreshes[meter] = Test_GetRefreshes(meter);
+    }
+
+    uint32_t now        = millis();
+    uint32_t probe_time = 0;
+    bool     is_probed  = false;
+
+    while (!is_probed && (now - link_time < TEST_LINK_RETRY_PERIOD_MS + TEST_LINK_TIME_MS))
+    {
+        now = millis();
+        Test_Step();
+
+        uint32_t count = 0;
+        for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+        {
+            count += Meters[meter].probes;
+        }
+        is_probed  = (count != probes);
+        probe_time = now;
+    }
+
+    /* Query sent to a lost meter just before may still be pending */
+    uint32_t elapsed = probe_time - link_time;
+    if (!is_probed || (elapsed < TEST_LINK_RETRY_PERIOD_MS) ||
+        (elapsed > TEST_LINK_RETRY_PERIOD_MS + TEST_QUERY_TIMEOUT_MAX_MS))
+    {
+        fprintf(stderr, "Meters looked for %u ms after negotiation, expected %d ms\n",
+                elapsed, TEST_LINK_RETRY_PERIOD_MS);
+        is_passed = false;
+    }
+
+    Test_Run(TEST_LINK_TIME_MS, false);
+
+    if (SDM_GetStats()->baudrate != MODBUS_INTERFACE_BAUDRATE_MAX)
+    {
+        fprintf(stderr, "Bus at %u baud after renegotiation\n", SDM_GetStats()->baudrate);
+        is_passed = false;
+    }
+
+    for (uint8_t meter = 0; meter < SDM_METERS_COUNT; meter++)
+    {
+        if ((Meters[meter].baud != MODBUS_INTERFACE_BAUDRATE_MAX) || (SDM_GetState(meter) == NULL) ||
+            (Test_GetRefreshes(meter) == refreshes[meter]))
+        {
+            fprintf(stderr, "Meter %d not polled after renegotiation\n", meter);
+            is_passed = false;
+        }
+    }
+
+    return is_passed;
+}
+
+
+/*
+ *  Arduino functions used by linked modules
+ */
+
+uint32_t millis(void)
+{
+    return (uint32_t)((IsVirtual ? VirtualTimeUs : Test_GetTimeUs()) / 1000);
+}
+
+uint32_t micros(void)
+{
+    return (uint32_t)(IsVirtual ? VirtualTimeUs : Test_GetTimeUs());
+}
+
+void delay(uint32_t ms)
+{
+    if (IsVirtual)
+    {
+        VirtualTimeUs += ms * 1000;
+        return;
+    }
+
+    usleep(ms * 1000);
+}
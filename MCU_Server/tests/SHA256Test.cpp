@@ -0,0 +1,482 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test of SHA256 against NIST example vectors, calculated at once with
+ *  CalcSHA256, incrementally page by page as DFU does, and incrementally with
+ *  random split points. Random messages at random alignments are checked
+ *  against the previous implementation with 64-word message schedule, kept
+ *  here as reference, and throughput of both is reported. Then the longest
+ *  stall of blocking calculation over a whole image after the last page is
+ *  compared with the longest stall of incremental one. Built once per
+ *  SHA256_UNROLL setting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CRC.h"
+
+
+#define TEST_MAX_MESSAGE_LEN 1000000u /**< Longest test vector message */
+#define TEST_PAGE_SIZE 1024u          /**< DFU page size messages are fed in */
+#define TEST_IMAGE_SIZE (64 * 1024u)  /**< Image size in timing comparison */
+#define TEST_TIMING_ROUNDS 20u        /**< Timing repetitions, shortest time is taken */
+#define TEST_SPLIT_RUNS 20u           /**< Random split runs per vector */
+#define TEST_RANDOM_CASES 500u        /**< Random messages checked against reference */
+#define TEST_MAX_RANDOM_LEN 3000u     /**< Longest random message */
+#define TEST_BENCHMARK_ROUNDS 20u     /**< Passes over image per throughput measurement */
+
+#define TEST_RIGHT_ROTATION(value, count) (((value) >> (count)) | ((value) << (32 - (count))))
+
+
+typedef struct Test_Vector_Tag
+{
+    const char *p_pattern; /**< Message is pattern repeated */
+    size_t      repeat;
+    uint8_t     sha256[SHA256_SIZE];
+} Test_Vector_T;
+
+
+static const Test_Vector_T Vectors[] = {
+    {"",
+     1,
+     {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+      0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55}},
+    {"abc",
+     1,
+     {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+      0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad}},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     1,
+     {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+      0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}},
+    {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+     1,
+     {0xcf, 0x5b, 0x16, 0xa7, 0x78, 0xaf, 0x83, 0x80, 0x03, 0x6c, 0xe5, 0x9e, 0x7b, 0x04, 0x92, 0x37,
+      0x0b, 0x24, 0x9b, 0x11, 0xe8, 0xf0, 0x7a, 0x51, 0xaf, 0xac, 0x45, 0x03, 0x7a, 0xfe, 0xe9, 0xd1}},
+    {"a",
+     1000000,
+     {0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92, 0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+      0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e, 0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0}},
+};
+
+static const uint32_t RefK[] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t RefH[] =
+    {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static uint8_t Message[TEST_MAX_MESSAGE_LEN];
+
+
+/*
+ *  Build test vector message
+ *
+ *  @param p_vector     Pointer to test vector
+ *  @return             Message length
+ */
+static size_t Test_BuildMessage(const Test_Vector_T *p_vector);
+
+/*
+ *  Previous SHA256 chunk compression with 64-word message schedule, reference
+ *
+ *  @param hash     Hash state
+ *  @param chunk    Chunk to process
+ */
+static void Test_RefCompress(uint32_t hash[8], const uint8_t chunk[SHA256_CHUNK_SIZE]);
+
+/*
+ *  Calculate SHA256 with reference compression
+ *
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ *  @param * sha256     [out] calculated SHA256
+ */
+static void Test_RefSHA256(const uint8_t *data, size_t len, uint8_t *sha256);
+
+/*
+ *  Calculate SHA256 incrementally, with random split points
+ *
+ *  @param * data       Pointer to data
+ *  @param len          Data len
+ *  @param max_split    Longest piece passed to SHA256_Update
+ *  @param * sha256     [out] calculated SHA256
+ */
+static void Test_SplitSHA256(const uint8_t *data, size_t len, size_t max_split, uint8_t *sha256);
+
+/*
+ *  Check CalcSHA256 and incremental SHA256 against test vectors
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_Vectors(void);
+
+/*
+ *  Check SHA256 of random messages at random alignments against reference
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_Random(void);
+
+/*
+ *  Report throughput of CalcSHA256 and reference
+ */
+static void Test_Benchmark(void);
+
+/*
+ *  Compare longest main loop stall of blocking and incremental image hashing
+ */
+static void Test_Timing(void);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in seconds
+ */
+static double Test_GetTime(void);
+
+
+int main(void)
+{
+    unsigned fails = Test_Vectors();
+    fails += Test_Random();
+    Test_Benchmark();
+    Test_Timing();
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static size_t Test_BuildMessage(const Test_Vector_T *p_vector)
+{
+    size_t pattern_len = strlen(p_vector->p_pattern);
+    for (size_t i = 0; i < p_vector->repeat; i++)
+    {
+        memcpy(Message + i * pattern_len, p_vector->p_pattern, pattern_len);
+    }
+
+    return pattern_len * p_vector->repeat;
+}
+
+static unsigned Test_Vectors(void)
+{
+    unsigned fails = 0;
+
+    for (size_t i = 0; i < sizeof(Vectors) / sizeof(Vectors[0]); i++)
+    {
+        size_t  len = Test_BuildMessage(&Vectors[i]);
+        uint8_t sha256[SHA256_SIZE];
+
+        CalcSHA256(Message, len, sha256);
+        if (memcmp(sha256, Vectors[i].sha256, SHA256_SIZE) != 0)
+        {
+            fprintf(stderr, "CalcSHA256 mismatch, vector %zu\n", i);
+            fails++;
+        }
+
+        SHA256_Context_T ctx;
+        SHA256_Init(&ctx);
+        for (size_t offset = 0; offset < len; offset += TEST_PAGE_SIZE)
+        {
+            SHA256_Update(&ctx, Message + offset, (len - offset < TEST_PAGE_SIZE) ? len - offset : TEST_PAGE_SIZE);
+        }
+        SHA256_Final(&ctx, sha256);
+        if (memcmp(sha256, Vectors[i].sha256, SHA256_SIZE) != 0)
+        {
+            fprintf(stderr, "Incremental SHA256 mismatch, vector %zu\n", i);
+            fails++;
+        }
+
+        for (uint32_t run = 0; run < TEST_SPLIT_RUNS; run++)
+        {
+            /* Short pieces cross chunk boundaries at every position, long ones take the full chunk path */
+            size_t max_split = (run % 2) ? SHA256_CHUNK_SIZE : 4 * TEST_PAGE_SIZE;
+            Test_SplitSHA256(Message, len, max_split, sha256);
+            if (memcmp(sha256, Vectors[i].sha256, SHA256_SIZE) != 0)
+            {
+                fprintf(stderr, "Split SHA256 mismatch, vector %zu, run %u\n", i, run);
+                fails++;
+            }
+        }
+    }
+
+    printf("SHA256_UNROLL=%d: %zu NIST vectors, %u failed\n",
+           SHA256_UNROLL,
+           sizeof(Vectors) / sizeof(Vectors[0]),
+           fails);
+    return fails;
+}
+
+static unsigned Test_Random(void)
+{
+    unsigned fails = 0;
+
+    for (uint32_t i = 0; i < TEST_RANDOM_CASES; i++)
+    {
+        /* Message is placed at every alignment, unaligned chunks take the byte by byte path */
+        size_t   len    = rand() % TEST_MAX_RANDOM_LEN;
+        uint8_t *p_data = Message + (i % sizeof(uint32_t));
+        for (size_t j = 0; j < len; j++)
+        {
+            p_data[j] = (uint8_t)rand();
+        }
+
+        uint8_t expected[SHA256_SIZE];
+        uint8_t sha256[SHA256_SIZE];
+        Test_RefSHA256(p_data, len, expected);
+
+        CalcSHA256(p_data, len, sha256);
+        if (memcmp(sha256, expected, SHA256_SIZE) != 0)
+        {
+            fprintf(stderr, "CalcSHA256 differs from reference, len %zu\n", len);
+            fails++;
+        }
+
+        Test_SplitSHA256(p_data, len, 2 * SHA256_CHUNK_SIZE, sha256);
+        if (memcmp(sha256, expected, SHA256_SIZE) != 0)
+        {
+            fprintf(stderr, "Split SHA256 differs from reference, len %zu\n", len);
+            fails++;
+        }
+    }
+
+    printf("SHA256 random messages: %u cases, %u failed\n", TEST_RANDOM_CASES, fails);
+    return fails;
+}
+
+static void Test_Benchmark(void)
+{
+    uint8_t sha256[SHA256_SIZE];
+    double  bytes = (double)TEST_BENCHMARK_ROUNDS * TEST_IMAGE_SIZE;
+
+    double start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        Test_RefSHA256(Message, TEST_IMAGE_SIZE, sha256);
+    }
+    double ref_time = Test_GetTime() - start;
+
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_ROUNDS; i++)
+    {
+        CalcSHA256(Message, TEST_IMAGE_SIZE, sha256);
+    }
+    double time = Test_GetTime() - start;
+
+    printf("SHA256 64-word schedule %.1f MB/s, rolling schedule %.1f MB/s\n",
+           bytes / ref_time / 1e6,
+           bytes / time / 1e6);
+}
+
+static void Test_RefCompress(uint32_t hash[8], const uint8_t chunk[SHA256_CHUNK_SIZE])
+{
+    uint32_t ah[8];
+    uint32_t w[64];
+    size_t   i;
+
+    for (i = 0; i < 16; i++)
+    {
+        const uint8_t *p = chunk + 4 * i;
+        w[i]             = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+    }
+
+    for (i = 16; i < 64; i++)
+    {
+        const uint32_t s0 =
+            TEST_RIGHT_ROTATION(w[i - 15], 7) ^ TEST_RIGHT_ROTATION(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 =
+            TEST_RIGHT_ROTATION(w[i - 2], 17) ^ TEST_RIGHT_ROTATION(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        ah[i] = hash[i];
+    }
+
+    for (i = 0; i < 64; i++)
+    {
+        const uint32_t s1 =
+            TEST_RIGHT_ROTATION(ah[4], 6) ^ TEST_RIGHT_ROTATION(ah[4], 11) ^ TEST_RIGHT_ROTATION(ah[4], 25);
+        const uint32_t ch    = (ah[4] & ah[5]) ^ (~ah[4] & ah[6]);
+        const uint32_t temp1 = ah[7] + s1 + ch + RefK[i] + w[i];
+        const uint32_t s0 =
+            TEST_RIGHT_ROTATION(ah[0], 2) ^ TEST_RIGHT_ROTATION(ah[0], 13) ^ TEST_RIGHT_ROTATION(ah[0], 22);
+        const uint32_t maj   = (ah[0] & ah[1]) ^ (ah[0] & ah[2]) ^ (ah[1] & ah[2]);
+        const uint32_t temp2 = s0 + maj;
+
+        ah[7] = ah[6];
+        ah[6] = ah[5];
+        ah[5] = ah[4];
+        ah[4] = ah[3] + temp1;
+        ah[3] = ah[2];
+        ah[2] = ah[1];
+        ah[1] = ah[0];
+        ah[0] = temp1 + temp2;
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        hash[i] += ah[i];
+    }
+}
+
+static void Test_RefSHA256(const uint8_t *data, size_t len, uint8_t *sha256)
+{
+    uint32_t hash[8];
+    uint8_t  chunk[SHA256_CHUNK_SIZE];
+    size_t   offset = 0;
+
+    memcpy(hash, RefH, sizeof(hash));
+
+    for (; offset + SHA256_CHUNK_SIZE <= len; offset += SHA256_CHUNK_SIZE)
+    {
+        Test_RefCompress(hash, data + offset);
+    }
+
+    /* Padding: single one bit, zeros, message length in bits as big endian 64-bit value */
+    size_t rest = len - offset;
+    memset(chunk, 0x00, sizeof(chunk));
+    memcpy(chunk, data + offset, rest);
+    chunk[rest] = 0x80;
+    if (rest >= SHA256_CHUNK_SIZE - 8)
+    {
+        Test_RefCompress(hash, chunk);
+        memset(chunk, 0x00, sizeof(chunk));
+    }
+
+    uint64_t bits = (uint64_t)len << 3;
+    for (size_t i = 0; i < 8; i++)
+    {
+        chunk[SHA256_CHUNK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    Test_RefCompress(hash, chunk);
+
+    for (size_t i = 0; i < 8; i++)
+    {
+        sha256[4 * i + 0] = (uint8_t)(hash[i] >> 24);
+        sha256[4 * i + 1] = (uint8_t)(hash[i] >> 16);
+        sha256[4 * i + 2] = (uint8_t)(hash[i] >> 8);
+        sha256[4 * i + 3] = (uint8_t)hash[i];
+    }
+}
+
+static void Test_SplitSHA256(const uint8_t *data, size_t len, size_t max_split, uint8_t *sha256)
+{
+    SHA256_Context_T ctx;
+    size_t           offset = 0;
+
+    SHA256_Init(&ctx);
+    while (offset < len)
+    {
+        /* Empty pieces are passed too */
+        size_t split_len = rand() % (max_split + 1);
+        if (split_len > len - offset)
+        {
+            split_len = len - offset;
+        }
+
+        SHA256_Update(&ctx, data + offset, split_len);
+        offset += split_len;
+    }
+    SHA256_Final(&ctx, sha256);
+}
+
+static void Test_Timing(void)
+{
+    uint8_t sha256[SHA256_SIZE];
+    double  blocking_stall = 1e9;
+    double  page_stall     = 1e9;
+    double  final_stall    = 1e9;
+
+    for (size_t i = 0; i < TEST_IMAGE_SIZE; i++)
+    {
+        Message[i] = (uint8_t)rand();
+    }
+
+    for (uint32_t round = 0; round < TEST_TIMING_ROUNDS; round++)
+    {
+        /* Blocking: whole image hashed after the last page */
+        double start = Test_GetTime();
+        CalcSHA256(Message, TEST_IMAGE_SIZE, sha256);
+        double time = Test_GetTime() - start;
+        if (time < blocking_stall)
+        {
+            blocking_stall = time;
+        }
+
+        /* Incremental: each page hashed when stored, only finalization left after the last one */
+        SHA256_Context_T ctx;
+        double           round_page_stall = 0;
+        SHA256_Init(&ctx);
+        for (size_t offset = 0; offset < TEST_IMAGE_SIZE; offset += TEST_PAGE_SIZE)
+        {
+            start = Test_GetTime();
+            SHA256_Update(&ctx, Message + offset, TEST_PAGE_SIZE);
+            time = Test_GetTime() - start;
+            if (time > round_page_stall)
+            {
+                round_page_stall = time;
+            }
+        }
+        if (round_page_stall < page_stall)
+        {
+            page_stall = round_page_stall;
+        }
+
+        start = Test_GetTime();
+        SHA256_Final(&ctx, sha256);
+        time = Test_GetTime() - start;
+        if (time < final_stall)
+        {
+            final_stall = time;
+        }
+    }
+
+    printf("SHA256 of %u byte image: blocking stall %.1f us, incremental stall %.1f us per page, %.1f us final\n",
+           TEST_IMAGE_SIZE,
+           blocking_stall * 1e6,
+           page_stall * 1e6,
+           final_stall * 1e6);
+}
+
+static double Test_GetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,271 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host stress test of SPSCRingBuffer_T. Producer thread queues a counting
+ *  byte sequence in chunks of varying length, alternating QueueBytes with
+ *  Reserve/SpanWrite/Commit, while consumer thread alternates DequeueBytes
+ *  with Peek/Skip and checks every byte. Throughput is then compared with
+ *  RingBuffer_T, which dequeues byte by byte.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "RingBuffer.h"
+#include "SPSCRingBuffer.h"
+
+
+#define TEST_BUFFER_LEN 512u        /**< Ring buffer size, power of two */
+#define TEST_STRESS_BYTES 10000000u /**< Bytes passed between threads in stress test */
+#define TEST_MAX_CHUNK_LEN 97u      /**< Longest chunk queued or dequeued at once, not a divisor of buffer size */
+#define TEST_BENCHMARK_CHUNK_LEN 48u
+#define TEST_BENCHMARK_CHUNKS 2000000u
+
+
+static uint8_t                           Buffer[TEST_BUFFER_LEN];
+static SPSCRingBuffer_T<TEST_BUFFER_LEN> RingBuffer;
+
+static uint32_t ConsumerErrors = 0;
+
+
+/*
+ *  Queue counting byte sequence
+ *
+ *  @param p_arg    Unused
+ *  @return         NULL
+ */
+static void *Test_Producer(void *p_arg);
+
+/*
+ *  Dequeue counting byte sequence and check it
+ *
+ *  @param p_arg    Unused
+ *  @return         NULL
+ */
+static void *Test_Consumer(void *p_arg);
+
+/*
+ *  Pass bytes between producer and consumer thread
+ *
+ *  @return     Number of failed checks
+ */
+static unsigned Test_Stress(void);
+
+/*
+ *  Compare single thread queue and dequeue throughput of RingBuffer_T and SPSCRingBuffer_T
+ */
+static void Test_Benchmark(void);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in seconds
+ */
+static double Test_GetTime(void);
+
+
+int main(void)
+{
+    unsigned fails = Test_Stress();
+    Test_Benchmark();
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void *Test_Producer(void *p_arg)
+{
+    uint32_t sent = 0;
+    uint8_t  chunk[TEST_MAX_CHUNK_LEN];
+    bool     is_reserved = false;
+
+    while (sent < TEST_STRESS_BYTES)
+    {
+        uint16_t len = 1 + (sent % TEST_MAX_CHUNK_LEN);
+        if (len > TEST_STRESS_BYTES - sent)
+        {
+            len = TEST_STRESS_BYTES - sent;
+        }
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            chunk[i] = (uint8_t)(sent + i);
+        }
+
+        if (is_reserved)
+        {
+            RingBuffer_Span_T span;
+            if (!SPSCRingBuffer_Reserve(&RingBuffer, len, &span))
+            {
+                sched_yield();
+                continue;
+            }
+
+            /* Tail first, consumer must not see it before commit */
+            uint16_t half = len / 2;
+            RingBuffer_SpanWrite(&span, half, chunk + half, len - half);
+            RingBuffer_SpanWrite(&span, 0, chunk, half);
+            SPSCRingBuffer_Commit(&RingBuffer, len);
+        }
+        else if (!SPSCRingBuffer_QueueBytes(&RingBuffer, chunk, len))
+        {
+            sched_yield();
+            continue;
+        }
+
+        sent += len;
+        is_reserved = !is_reserved;
+    }
+
+    return NULL;
+}
+
+static void *Test_Consumer(void *p_arg)
+{
+    uint32_t received = 0;
+    uint8_t  chunk[TEST_MAX_CHUNK_LEN];
+    bool     is_peeked = false;
+
+    while (received < TEST_STRESS_BYTES)
+    {
+        const uint8_t *p_data;
+        uint16_t       len;
+
+        if (is_peeked)
+        {
+            p_data = SPSCRingBuffer_Peek(&RingBuffer, &len);
+            if (len > TEST_MAX_CHUNK_LEN - (received % TEST_MAX_CHUNK_LEN))
+            {
+                len = TEST_MAX_CHUNK_LEN - (received % TEST_MAX_CHUNK_LEN);
+            }
+        }
+        else
+        {
+            p_data = chunk;
+            len    = SPSCRingBuffer_DequeueBytes(&RingBuffer, chunk, 1 + (received % TEST_MAX_CHUNK_LEN));
+        }
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            if (p_data[i] != (uint8_t)(received + i))
+            {
+                ConsumerErrors++;
+            }
+        }
+
+        if (is_peeked)
+        {
+            SPSCRingBuffer_Skip(&RingBuffer, len);
+        }
+        if (len == 0)
+        {
+            /* Let the producer run when threads share a core */
+            sched_yield();
+            continue;
+        }
+
+        received += len;
+        is_peeked = !is_peeked;
+    }
+
+    return NULL;
+}
+
+static unsigned Test_Stress(void)
+{
+    pthread_t producer;
+    pthread_t consumer;
+
+    SPSCRingBuffer_Init(&RingBuffer, Buffer);
+
+    double start = Test_GetTime();
+    if ((pthread_create(&producer, NULL, Test_Producer, NULL) != 0) ||
+        (pthread_create(&consumer, NULL, Test_Consumer, NULL) != 0))
+    {
+        fprintf(stderr, "Threads not started\n");
+        return 1;
+    }
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double time = Test_GetTime() - start;
+
+    unsigned fails = ConsumerErrors;
+    if (!SPSCRingBuffer_IsEmpty(&RingBuffer))
+    {
+        fails++;
+    }
+
+    printf("Producer/consumer threads: %u bytes, %u wrong, %.1f MB/s\n",
+           TEST_STRESS_BYTES,
+           ConsumerErrors,
+           TEST_STRESS_BYTES / time / 1e6);
+    return fails;
+}
+
+static void Test_Benchmark(void)
+{
+    static uint8_t old_buffer[TEST_BUFFER_LEN];
+    RingBuffer_T   old_ring_buffer;
+    uint8_t        chunk[TEST_BENCHMARK_CHUNK_LEN] = {0};
+
+    RingBuffer_Init(&old_ring_buffer, old_buffer, sizeof(old_buffer));
+    double start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_CHUNKS; i++)
+    {
+        RingBuffer_QueueBytes(&old_ring_buffer, chunk, sizeof(chunk));
+        for (size_t j = 0; j < sizeof(chunk); j++)
+        {
+            RingBuffer_DequeueByte(&old_ring_buffer, &chunk[j]);
+        }
+    }
+    double old_time = Test_GetTime() - start;
+
+    SPSCRingBuffer_Init(&RingBuffer, Buffer);
+    start = Test_GetTime();
+    for (uint32_t i = 0; i < TEST_BENCHMARK_CHUNKS; i++)
+    {
+        SPSCRingBuffer_QueueBytes(&RingBuffer, chunk, sizeof(chunk));
+        SPSCRingBuffer_DequeueBytes(&RingBuffer, chunk, sizeof(chunk));
+    }
+    double spsc_time = Test_GetTime() - start;
+
+    double bytes = (double)TEST_BENCHMARK_CHUNKS * TEST_BENCHMARK_CHUNK_LEN;
+    printf("Queue and dequeue of %u byte chunks: RingBuffer_T %.1f MB/s, SPSCRingBuffer_T %.1f MB/s\n",
+           TEST_BENCHMARK_CHUNK_LEN,
+           bytes / old_time / 1e6,
+           bytes / spsc_time / 1e6);
+}
+
+static double Test_GetTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
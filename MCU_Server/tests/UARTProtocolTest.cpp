@@ -0,0 +1,583 @@
+/*
+Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ *  Host test and benchmark of UART frame reception. A stream of DFU Write
+ *  Data frames, mixed with garbage and frames with corrupted payload, is fed
+ *  into the RX buffer of a fake UART driver. UART_ProcessIncomingCommand must
+ *  dispatch every valid frame once, in order and intact. Frames/s and
+ *  frame-to-handler latency are reported for it and for the previous parser,
+ *  which consumed one byte per main loop pass, with and without simulated
+ *  work done by the rest of the main loop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CRC.h"
+#include "MeshTime.h"
+#include "SPSCRingBuffer.h"
+#include "UARTDriver.h"
+#include "UARTProtocol.h"
+
+
+#define TEST_RX_BUFFER_LEN 512u         /**< Same as UART driver RX buffer on target */
+#define TEST_TX_BUFFER_LEN 512u
+#define TEST_FRAMES 300u                /**< Valid frames in test stream */
+#define TEST_STREAM_LEN (TEST_FRAMES * 2 * (MAX_PAYLOAD_SIZE + 16))
+#define TEST_BENCHMARK_ROUNDS 20u       /**< Passes over test stream when rest of main loop takes no time */
+#define TEST_LOOP_WORK_US 20u           /**< Simulated time of main loop pass outside of UART (LCD, SDM, sensors) */
+#define TEST_LATENCY_FRAMES 50u         /**< Frames sent one at a time to measure latency */
+#define TEST_CMD_DFU_WRITE_DATA 0x86u   /**< Command dispatched to ProcessDfuWriteDataEvent */
+#define TEST_PREAMBLE_BYTE_1 0xAAu
+#define TEST_PREAMBLE_BYTE_2 0x55u
+#define TEST_HEADER_LEN 4u
+#define TEST_CRC_LEN 2u
+
+typedef enum
+{
+    TEST_PARSER_BURST,        /**< UART_ProcessIncomingCommand */
+    TEST_PARSER_BYTE_BY_BYTE, /**< Previous parser, one byte per main loop pass */
+} Test_Parser_T;
+
+typedef struct Test_RxFrame_Tag
+{
+    uint8_t len;
+    uint8_t cmd;
+    uint8_t p_payload[MAX_PAYLOAD_SIZE];
+} Test_RxFrame_T;
+
+
+static SPSCRingBuffer_T<TEST_RX_BUFFER_LEN> RxBuffer;
+static SPSCRingBuffer_T<TEST_TX_BUFFER_LEN> TxBuffer;
+
+static uint8_t RxBuf[TEST_RX_BUFFER_LEN];
+static uint8_t TxBuf[TEST_TX_BUFFER_LEN];
+
+static UARTDriver_Stats_T Stats;
+
+static uint8_t Stream[TEST_STREAM_LEN];
+static size_t  StreamLen = 0;
+static size_t  FrameOffsets[TEST_FRAMES]; /**< Offsets of valid frames in stream */
+
+static uint32_t HandledFrames = 0; /**< Valid frames dispatched since last Test_ResetReceiver */
+static uint32_t FrameErrors   = 0; /**< Frames dispatched out of order or with wrong payload */
+static uint64_t HandledUs     = 0; /**< Time when last frame was dispatched */
+
+
+/*
+ *  Append frame to test stream
+ *
+ *  @param seq          Frame sequence number, determines payload
+ *  @param len          Payload length, at least 2
+ *  @param is_corrupted If true, one payload byte is changed after CRC is calculated
+ */
+static void Test_AppendFrame(uint16_t seq, uint8_t len, bool is_corrupted);
+
+/*
+ *  Build test stream of valid frames, garbage and corrupted frames
+ */
+static void Test_BuildStream(void);
+
+/*
+ *  Clear receive buffer and dispatched frame counters
+ */
+static void Test_ResetReceiver(void);
+
+/*
+ *  Single main loop pass of UART reception
+ *
+ *  @param parser       Parser to use
+ */
+static void Test_LoopPass(Test_Parser_T parser);
+
+/*
+ *  Previous frame parser, reference for the burst one in UARTProtocol.cpp.
+ *  Consumes at most one received byte per call.
+ *
+ *  @param rx_frame     Pointer to frame to be filled with received data
+ *  @return             True if frame's CRC is valid, false otherwise
+ */
+static bool Test_ExtractFrameByteByByte(Test_RxFrame_T *rx_frame);
+
+/*
+ *  Feed whole test stream through the parser, topping up RX buffer before every main loop pass
+ *
+ *  @param parser       Parser to use
+ *  @param loop_work_us Simulated time of the rest of main loop pass
+ *  @param rounds       Number of passes over test stream
+ *  @return             Number of failed checks
+ */
+static unsigned Test_Throughput(Test_Parser_T parser, uint32_t loop_work_us, uint32_t rounds);
+
+/*
+ *  Send frames one at a time into idle receiver and measure time until each one is dispatched
+ *
+ *  @param parser       Parser to use
+ *  @param loop_work_us Simulated time of the rest of main loop pass
+ *  @return             Number of failed checks
+ */
+static unsigned Test_Latency(Test_Parser_T parser, uint32_t loop_work_us);
+
+/*
+ *  Busy wait, stands for the rest of main loop pass
+ *
+ *  @param us   Time to wait in microseconds
+ */
+static void Test_Spin(uint32_t us);
+
+/*
+ *  Get monotonic time
+ *
+ *  @return     Time in microseconds
+ */
+static uint64_t Test_GetTimeUs(void);
+
+
+int main(void)
+{
+    const Test_Parser_T parsers[] = {TEST_PARSER_BYTE_BY_BYTE, TEST_PARSER_BURST};
+    unsigned            fails     = 0;
+
+    srand(1);
+    Test_BuildStream();
+    UART_Init();
+
+    for (size_t i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++)
+    {
+        fails += Test_Throughput(parsers[i], 0, TEST_BENCHMARK_ROUNDS);
+        fails += Test_Throughput(parsers[i], TEST_LOOP_WORK_US, 1);
+        fails += Test_Latency(parsers[i], 0);
+        fails += Test_Latency(parsers[i], TEST_LOOP_WORK_US);
+    }
+
+    if (fails != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", fails);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void Test_AppendFrame(uint16_t seq, uint8_t len, bool is_corrupted)
+{
+    uint8_t *p_frame = Stream + StreamLen;
+    uint8_t  cmd     = TEST_CMD_DFU_WRITE_DATA;
+
+    p_frame[0] = TEST_PREAMBLE_BYTE_1;
+    p_frame[1] = TEST_PREAMBLE_BYTE_2;
+    p_frame[2] = len;
+    p_frame[3] = cmd;
+
+    uint8_t *p_payload = p_frame + TEST_HEADER_LEN;
+    p_payload[0]       = (uint8_t)seq;
+    p_payload[1]       = (uint8_t)(seq >> 8);
+    for (uint8_t i = 2; i < len; i++)
+    {
+        p_payload[i] = (uint8_t)(seq + i);
+    }
+
+    uint16_t crc = CalcCRC16(&len, sizeof(len), CRC16_INIT_VAL);
+    crc          = CalcCRC16(&cmd, sizeof(cmd), crc);
+    crc          = CalcCRC16(p_payload, len, crc);
+
+    p_payload[len]     = (uint8_t)crc;
+    p_payload[len + 1] = (uint8_t)(crc >> 8);
+
+    if (is_corrupted)
+    {
+        p_payload[rand() % len] ^= 0x01;
+    }
+
+    StreamLen += TEST_HEADER_LEN + len + TEST_CRC_LEN;
+}
+
+static void Test_BuildStream(void)
+{
+    for (uint16_t seq = 0; seq < TEST_FRAMES; seq++)
+    {
+        /* Garbage contains preamble first byte, but never a complete preamble or a trailing first byte */
+        size_t garbage_len = (seq % 5 == 0) ? rand() % 8 : 0;
+        for (size_t i = 0; i < garbage_len; i++)
+        {
+            uint8_t byte = (uint8_t)rand();
+            if ((byte == TEST_PREAMBLE_BYTE_2) || ((i + 1 == garbage_len) && (byte == TEST_PREAMBLE_BYTE_1)))
+            {
+                byte = 0;
+            }
+            Stream[StreamLen++] = byte;
+        }
+
+        uint8_t len = (seq % 4 == 0) ? 2 + rand() % (MAX_PAYLOAD_SIZE - 1) : MAX_PAYLOAD_SIZE;
+
+        if (seq % 7 == 3)
+        {
+            Test_AppendFrame(seq, len, true);
+        }
+
+        FrameOffsets[seq] = StreamLen;
+        Test_AppendFrame(seq, len, false);
+    }
+}
+
+static void Test_ResetReceiver(void)
+{
+    SPSCRingBuffer_Init(&RxBuffer, RxBuf);
+    HandledFrames = 0;
+    FrameErrors   = 0;
+}
+
+static void Test_LoopPass(Test_Parser_T parser)
+{
+    static Test_RxFrame_T rx_frame;
+
+    if (parser == TEST_PARSER_BURST)
+    {
+        UART_ProcessIncomingCommand();
+        return;
+    }
+
+    UARTDriver_RxDMAPoll();
+    if (Test_ExtractFrameByteByByte(&rx_frame) && (rx_frame.cmd == TEST_CMD_DFU_WRITE_DATA))
+    {
+        ProcessDfuWriteDataEvent(rx_frame.p_payload, rx_frame.len);
+    }
+}
+
+static bool Test_ExtractFrameByteByByte(Test_RxFrame_T *rx_frame)
+{
+    static uint16_t crc   = 0;
+    static size_t   count = 0;
+    uint8_t         received_byte;
+
+    if (!UARTDriver_ReadByte(&received_byte))
+    {
+        return false;
+    }
+
+    if (count == 0)
+    {
+        count = (received_byte == TEST_PREAMBLE_BYTE_1) ? 1 : 0;
+    }
+    else if (count == 1)
+    {
+        count = (received_byte == TEST_PREAMBLE_BYTE_2) ? 2 : 0;
+    }
+    else if (count == 2)
+    {
+        rx_frame->len = received_byte;
+        count         = (received_byte <= MAX_PAYLOAD_SIZE) ? 3 : 0;
+    }
+    else if (count == 3)
+    {
+        rx_frame->cmd = received_byte;
+        count++;
+    }
+    else if (count < TEST_HEADER_LEN + rx_frame->len)
+    {
+        rx_frame->p_payload[count - TEST_HEADER_LEN] = received_byte;
+        count++;
+    }
+    else if (count == TEST_HEADER_LEN + rx_frame->len)
+    {
+        crc = received_byte;
+        count++;
+    }
+    else
+    {
+        crc += ((uint16_t)received_byte) << 8;
+        count = 0;
+
+        uint16_t calc_crc = CalcCRC16(&rx_frame->len, sizeof(rx_frame->len), CRC16_INIT_VAL);
+        calc_crc          = CalcCRC16(&rx_frame->cmd, sizeof(rx_frame->cmd), calc_crc);
+        calc_crc          = CalcCRC16(rx_frame->p_payload, rx_frame->len, calc_crc);
+        return (crc == calc_crc);
+    }
+
+    return false;
+}
+
+static unsigned Test_Throughput(Test_Parser_T parser, uint32_t loop_work_us, uint32_t rounds)
+{
+    uint32_t passes  = 0;
+    uint32_t handled = 0;
+    unsigned fails   = 0;
+
+    Test_ResetReceiver();
+
+    uint64_t start = Test_GetTimeUs();
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        size_t offset = 0;
+        HandledFrames = 0;
+
+        while (HandledFrames < TEST_FRAMES)
+        {
+            uint32_t len = SPSCRingBuffer_FreeLen(&RxBuffer);
+            if (len > StreamLen - offset)
+            {
+                len = StreamLen - offset;
+            }
+            SPSCRingBuffer_QueueBytes(&RxBuffer, Stream + offset, (uint16_t)len);
+            offset += len;
+
+            Test_LoopPass(parser);
+            Test_Spin(loop_work_us);
+            passes++;
+
+            if ((offset == StreamLen) && SPSCRingBuffer_IsEmpty(&RxBuffer))
+            {
+                break;
+            }
+        }
+
+        handled += HandledFrames;
+        if ((HandledFrames != TEST_FRAMES) || (FrameErrors != 0))
+        {
+            fprintf(stderr, "%u of %u frames dispatched, %u wrong\n", HandledFrames, TEST_FRAMES, FrameErrors);
+            fails++;
+        }
+    }
+    double time = (Test_GetTimeUs() - start) / 1e6;
+
+    printf("%-12s main loop work %2u us: %9.0f frames/s, %6.1f main loop passes per frame\n",
+           (parser == TEST_PARSER_BURST) ? "Burst" : "Byte by byte",
+           loop_work_us,
+           handled / time,
+           (double)passes / handled);
+    return fails;
+}
+
+static unsigned Test_Latency(Test_Parser_T parser, uint32_t loop_work_us)
+{
+    uint64_t total_us     = 0;
+    uint32_t total_passes = 0;
+    unsigned fails        = 0;
+
+    Test_ResetReceiver();
+
+    for (uint32_t i = 0; i < TEST_LATENCY_FRAMES; i++)
+    {
+        /* Frame arrives while main loop is busy elsewhere, it is dispatched after some passes */
+        size_t offset = FrameOffsets[i];
+        size_t len    = TEST_HEADER_LEN + Stream[offset + 2] + TEST_CRC_LEN;
+        SPSCRingBuffer_QueueBytes(&RxBuffer, Stream + offset, (uint16_t)len);
+
+        uint32_t handled = HandledFrames;
+        uint64_t start   = Test_GetTimeUs();
+        uint32_t passes  = 0;
+        while ((HandledFrames == handled) && (passes <= len))
+        {
+            Test_LoopPass(parser);
+            Test_Spin(loop_work_us);
+            passes++;
+        }
+
+        if ((HandledFrames != handled + 1) || (FrameErrors != 0))
+        {
+            fprintf(stderr, "Frame %u not dispatched\n", i);
+            fails++;
+            break;
+        }
+        total_us += HandledUs - start;
+        total_passes += passes;
+    }
+
+    printf("%-12s main loop work %2u us: %9.1f us latency, %6.1f main loop passes per frame\n",
+           (parser == TEST_PARSER_BURST) ? "Burst" : "Byte by byte",
+           loop_work_us,
+           (double)total_us / TEST_LATENCY_FRAMES,
+           (double)total_passes / TEST_LATENCY_FRAMES);
+    return fails;
+}
+
+static void Test_Spin(uint32_t us)
+{
+    uint64_t end = Test_GetTimeUs() + us;
+    while (Test_GetTimeUs() < end)
+    {
+    }
+}
+
+static uint64_t Test_GetTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+
+/*
+ *  UART driver with RX buffer filled by test, sent bytes are discarded
+ */
+
+void UARTDriver_Init(void)
+{
+    SPSCRingBuffer_Init(&RxBuffer, RxBuf);
+    SPSCRingBuffer_Init(&TxBuffer, TxBuf);
+}
+
+bool UARTDriver_WriteBytes(uint8_t *table, uint16_t len)
+{
+    return true;
+}
+
+bool UARTDriver_ReserveTx(uint16_t len, RingBuffer_Span_T *p_span)
+{
+    return SPSCRingBuffer_Reserve(&TxBuffer, len, p_span);
+}
+
+void UARTDriver_CommitTx(uint16_t len)
+{
+    SPSCRingBuffer_Commit(&TxBuffer, len);
+    SPSCRingBuffer_Skip(&TxBuffer, len);
+}
+
+bool UARTDriver_ReadByte(uint8_t *read_byte)
+{
+    return SPSCRingBuffer_DequeueByte(&RxBuffer, read_byte);
+}
+
+uint8_t *UARTDriver_GetRxBuffer(uint16_t *len)
+{
+    return SPSCRingBuffer_Peek(&RxBuffer, len);
+}
+
+void UARTDriver_ReleaseRxBytes(uint16_t len)
+{
+    SPSCRingBuffer_Skip(&RxBuffer, len);
+}
+
+bool UARTDriver_RxDMAPoll(void)
+{
+    return true;
+}
+
+const UARTDriver_Stats_T *UARTDriver_GetStats(void)
+{
+    return &Stats;
+}
+
+
+/*
+ *  Application functions used by linked modules
+ */
+
+void ProcessDfuWriteDataEvent(uint8_t *p_payload, uint8_t len)
+{
+    HandledUs = Test_GetTimeUs();
+
+    /* Frames of every pass over test stream are dispatched in order, starting from the first one */
+    uint16_t seq = p_payload[0] | ((uint16_t)p_payload[1] << 8);
+    if ((seq != HandledFrames) || (len != Stream[FrameOffsets[seq] + 2]) ||
+        (memcmp(p_payload, Stream + FrameOffsets[seq] + TEST_HEADER_LEN, len) != 0))
+    {
+        FrameErrors++;
+    }
+    HandledFrames++;
+}
+
+void ProcessEnterInitDevice(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterDevice(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterInitNode(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessEnterNode(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessMeshCommand(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessMeshMessageRequest1(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessAttention(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessError(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessModemFirmwareVersion(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessStartTest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuInitRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuStatusRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuPageCreateRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuPageStoreRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuStateCheckResponse(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessDfuCancelResponse(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void ProcessFirmwareVersionSetResponse(void)
+{
+}
+
+void ProcessFactoryResetEvent(void)
+{
+}
+
+void MeshTime_ProcessTimeSourceSetRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void MeshTime_ProcessTimeSourceGetRequest(uint8_t *p_payload, uint8_t len)
+{
+}
+
+void MeshTime_ProcessTimeGetResponse(uint8_t *p_payload, uint8_t len)
+{
+}
@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Packer of compressed DFU images for MCU_DFU.cpp.
+
+Container layout:
+
+    magic "DFUZ", format u8, 3 reserved bytes, image size u32 LE, payload
+
+where payload is LZSS stream (format 1) or delta patch (format 2).
+
+LZSS stream is a sequence of groups, each starting with a flag byte followed
+by up to 8 items, one per flag bit starting from the LSB. Set bit is a literal
+byte, clear bit is a 2-byte back reference: 12-bit distance - 1 (low byte
+first) and 4-bit length - 3 in the high nibble of the second byte.
+
+Delta patch rebuilds the image from the firmware currently running on the
+device (--base, plain image of that firmware). It is a sequence of operations:
+
+    0x00 len u16 LE, len bytes      insert data
+    0x01 len u16 LE, offset u32 LE  copy len bytes from offset of base image
+
+With --base all formats are tried and the smallest one is written. Patch is
+only valid for devices running exactly the base image, SHA256 check rejects
+it on others.
+
+Image is padded with 0xFF to a multiple of 4 bytes. SHA256 used in DFU Init
+has to be calculated over the padded, decompressed image, it is printed by
+this tool. If compression does not make the image smaller, the plain image is
+written instead, unless --force is given.
+
+Example:
+    dfu_pack.py MCU_Server.ino.hex.bin MCU_Server.dfuz
+    dfu_pack.py MCU_Server.ino.hex.bin MCU_Server.dfuz --base MCU_Server_running.bin
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+IMAGE_MAGIC = b"DFUZ"
+IMAGE_FORMAT_LZSS = 0x01
+IMAGE_FORMAT_DELTA = 0x02
+IMAGE_HEADER = struct.Struct("<4sB3xI")
+
+WINDOW_SIZE = 4096
+MIN_MATCH = 3
+MAX_MATCH = 18
+MAX_CHAIN = 256
+
+DELTA_OP_INSERT = 0x00
+DELTA_OP_COPY = 0x01
+DELTA_MAX_LEN = 0xFFFF
+DELTA_MIN_COPY = 12
+DELTA_BLOCK = 8
+DELTA_MAX_CANDIDATES = 32
+
+
+def pad_image(image):
+    if len(image) % 4:
+        image += b"\xFF" * (4 - len(image) % 4)
+    return image
+
+
+def lzss_compress(data):
+    out = bytearray()
+    heads = {}
+    prev = [-1] * len(data)
+    pos = 0
+    flags_pos = -1
+    flag_bit = 8
+
+    def insert(i):
+        if i + MIN_MATCH <= len(data):
+            key = data[i : i + MIN_MATCH]
+            prev[i] = heads.get(key, -1)
+            heads[key] = i
+
+    while pos < len(data):
+        if flag_bit == 8:
+            flags_pos = len(out)
+            out.append(0)
+            flag_bit = 0
+
+        best_len = 0
+        best_dist = 0
+        if pos + MIN_MATCH <= len(data):
+            candidate = heads.get(data[pos : pos + MIN_MATCH], -1)
+            limit = min(MAX_MATCH, len(data) - pos)
+            chain = MAX_CHAIN
+            while candidate >= 0 and pos - candidate <= WINDOW_SIZE and chain:
+                length = 0
+                while length < limit and data[candidate + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_dist = pos - candidate
+                    if length == limit:
+                        break
+                candidate = prev[candidate]
+                chain -= 1
+
+        if best_len >= MIN_MATCH:
+            ref = best_dist - 1
+            out += bytes([ref & 0xFF, (ref >> 8) | ((best_len - MIN_MATCH) << 4)])
+            for i in range(pos, pos + best_len):
+                insert(i)
+            pos += best_len
+        else:
+            out[flags_pos] |= 1 << flag_bit
+            out.append(data[pos])
+            insert(pos)
+            pos += 1
+        flag_bit += 1
+
+    return bytes(out)
+
+
+def lzss_decompress(stream, size):
+    out = bytearray()
+    index = 0
+    while len(out) < size:
+        flags = stream[index]
+        index += 1
+        for bit in range(8):
+            if len(out) >= size:
+                break
+            if flags & (1 << bit):
+                out.append(stream[index])
+                index += 1
+            else:
+                ref = stream[index] | (stream[index + 1] << 8)
+                index += 2
+                distance = (ref & 0x0FFF) + 1
+                if distance > len(out):
+                    raise ValueError("back reference beyond image start at %d" % len(out))
+                for _ in range((ref >> 12) + MIN_MATCH):
+                    out.append(out[-distance])
+    return bytes(out)
+
+
+def match_length(a, a_pos, b, b_pos, limit):
+    length = 0
+    while length < limit and a[a_pos + length] == b[b_pos + length]:
+        length += 1
+    return length
+
+
+def delta_encode(base, image):
+    index = {}
+    for i in range(len(base) - DELTA_BLOCK + 1):
+        index.setdefault(base[i : i + DELTA_BLOCK], []).append(i)
+
+    out = bytearray()
+    inserted = bytearray()
+
+    def flush_insert():
+        for i in range(0, len(inserted), DELTA_MAX_LEN):
+            data = inserted[i : i + DELTA_MAX_LEN]
+            out.extend(struct.pack("<BH", DELTA_OP_INSERT, len(data)) + data)
+        inserted.clear()
+
+    pos = 0
+    expected = None
+    while pos < len(image):
+        limit = min(DELTA_MAX_LEN, len(image) - pos)
+        # Continuing previous copy catches data following small changes, like patched addresses
+        candidates = index.get(image[pos : pos + DELTA_BLOCK], [])[:DELTA_MAX_CANDIDATES]
+        if expected is not None and expected < len(base):
+            candidates = [expected] + candidates
+
+        best_len = 0
+        best_src = 0
+        for src in candidates:
+            length = match_length(base, src, image, pos, min(limit, len(base) - src))
+            if length > best_len:
+                best_len = length
+                best_src = src
+
+        if best_len >= DELTA_MIN_COPY:
+            flush_insert()
+            out.extend(struct.pack("<BHI", DELTA_OP_COPY, best_len, best_src))
+            pos += best_len
+            expected = best_src + best_len
+        else:
+            inserted.append(image[pos])
+            pos += 1
+            if expected is not None:
+                expected += 1
+
+    flush_insert()
+    return bytes(out)
+
+
+def delta_decode(base, patch, size):
+    out = bytearray()
+    index = 0
+    while index < len(patch):
+        op, length = struct.unpack_from("<BH", patch, index)
+        index += 3
+        if op == DELTA_OP_INSERT:
+            out += patch[index : index + length]
+            index += length
+        elif op == DELTA_OP_COPY:
+            (offset,) = struct.unpack_from("<I", patch, index)
+            index += 4
+            if offset + length > len(base):
+                raise ValueError("copy beyond base image at %d" % len(out))
+            out += base[offset : offset + length]
+        else:
+            raise ValueError("invalid delta operation %d at %d" % (op, index - 3))
+    if len(out) != size:
+        raise ValueError("patch produces %d bytes instead of %d" % (len(out), size))
+    return bytes(out)
+
+
+def pack(image, base=None):
+    image = pad_image(image)
+    if base is not None:
+        return IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_FORMAT_DELTA, len(image)) + delta_encode(base, image)
+    return IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_FORMAT_LZSS, len(image)) + lzss_compress(image)
+
+
+def unpack(container, base=None):
+    """Return image stored on the device for given DFU file, plain images are returned padded."""
+    if len(container) < IMAGE_HEADER.size or container[:4] != IMAGE_MAGIC:
+        return pad_image(container)
+    _, image_format, size = IMAGE_HEADER.unpack_from(container)
+    payload = container[IMAGE_HEADER.size :]
+    if image_format == IMAGE_FORMAT_LZSS:
+        return lzss_decompress(payload, size)
+    if image_format == IMAGE_FORMAT_DELTA:
+        if base is None:
+            raise ValueError("delta image requires base image")
+        return delta_decode(base, payload, size)
+    raise ValueError("unsupported image format %d" % image_format)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="plain firmware image (.bin)")
+    parser.add_argument("output", help="DFU image to write")
+    parser.add_argument("--base", help="plain image of firmware running on the device, enables delta format")
+    parser.add_argument("--force", action="store_true", help="write packed image even if it is not smaller")
+    args = parser.parse_args()
+
+    image = pad_image(open(args.input, "rb").read())
+    base = open(args.base, "rb").read() if args.base else None
+
+    candidates = [("LZSS", pack(image))]
+    if base is not None:
+        candidates.append(("delta", pack(image, base)))
+
+    print("Image:  %d bytes" % len(image))
+    for name, packed in candidates:
+        if unpack(packed, base) != image:
+            sys.exit("internal error: %s image does not unpack to the input" % name)
+        print("%-7s %d bytes (%.1f%%)" % (name + ":", len(packed), 100.0 * len(packed) / len(image)))
+
+    name, packed = min(candidates, key=lambda c: len(c[1]))
+    if len(packed) >= len(image) and not args.force:
+        name, packed = "plain", image
+        print("Packing does not reduce size, writing plain image")
+
+    open(args.output, "wb").write(packed)
+    print("Output: %s, %d bytes" % (name, len(packed)))
+    print("SHA256: %s" % hashlib.sha256(image).hexdigest())
+
+
+if __name__ == "__main__":
+    main()
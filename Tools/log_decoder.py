@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+"""
+Decoder of deferred binary logs (LOG_DEFERRED_ENABLE in Log.h).
+
+Records sent over DEBUG_INTERFACE carry format string address instead of the
+string itself, so the firmware ELF file matching the running image is needed:
+
+    0xA5 <len> <format address u32 LE> <tagged arguments...>
+
+Example:
+    log_decoder.py MCU_Server.ino.elf /dev/ttyACM0
+    log_decoder.py MCU_Server.ino.elf captured_log.bin
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import termios
+
+LOG_RECORD_SYNC = 0xA5
+
+LOG_ARG_TAG_INT = ord("i")
+LOG_ARG_TAG_INT64 = ord("q")
+LOG_ARG_TAG_DOUBLE = ord("f")
+LOG_ARG_TAG_STRING = ord("s")
+LOG_ARG_TAG_BUFFER = ord("b")
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+CONVERSION = re.compile(r"%([-+ #0]*[0-9*]*(?:\.[0-9*]+)?)(hh|h|ll|l|z|j|t)?([diouxXcspfFeEgG%])")
+
+
+class Elf:
+    """Minimal ELF reader, maps addresses of allocated sections to file contents."""
+
+    def __init__(self, path):
+        self.data = open(path, "rb").read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is_64 = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+        if is_64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3A)
+            section = endian + "IIQQQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2E)
+            section = endian + "IIIIII"
+
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from(section, self.data, shoff + i * shentsize)
+            if (flags & SHF_ALLOC) and sh_type != SHT_NOBITS and addr:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for start, offset, size in self.sections:
+            if start <= addr < start + size:
+                begin = offset + addr - start
+                end = self.data.index(b"\0", begin, offset + size)
+                return self.data[begin:end].decode("utf-8", "replace")
+        return None
+
+
+def parse_args(payload):
+    args = []
+    buffers = []
+    index = 0
+    while index < len(payload):
+        tag = payload[index]
+        index += 1
+        if tag == LOG_ARG_TAG_INT:
+            args.append(struct.unpack_from("<I", payload, index)[0])
+            index += 4
+        elif tag == LOG_ARG_TAG_INT64:
+            args.append(struct.unpack_from("<Q", payload, index)[0])
+            index += 8
+        elif tag == LOG_ARG_TAG_DOUBLE:
+            args.append(struct.unpack_from("<d", payload, index)[0])
+            index += 8
+        elif tag == LOG_ARG_TAG_STRING:
+            end = payload.index(b"\0", index)
+            args.append(payload[index:end].decode("utf-8", "replace"))
+            index = end + 1
+        elif tag == LOG_ARG_TAG_BUFFER:
+            length = payload[index]
+            buffers.append(payload[index + 1 : index + 1 + length])
+            index += 1 + length
+        else:
+            raise ValueError("unknown argument tag 0x%02X" % tag)
+    return args, buffers
+
+
+def to_signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def format_message(fmt, args):
+    """printf-like formatting of raw arguments, driven by the format string."""
+    args = list(args)
+
+    def convert(match):
+        flags, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if not args:
+            return match.group(0)
+        value = args.pop(0)
+        if conversion in "di" and isinstance(value, int):
+            value = to_signed(value, 64 if length == "ll" else 32)
+        elif conversion == "p":
+            return "0x%08x" % value
+        elif conversion == "c":
+            value = chr(value & 0xFF)
+        elif conversion in "fFeEgG" and isinstance(value, int):
+            value = float(value)
+        elif conversion in "uoxX" and not isinstance(value, int):
+            value = int(value)
+        try:
+            return ("%" + flags + conversion.replace("u", "d")) % value
+        except (TypeError, ValueError):
+            return str(value)
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode(elf, stream, out):
+    buf = bytearray()
+    while True:
+        data = stream()
+        if not data:
+            return
+        buf += data
+        while True:
+            start = buf.find(bytes([LOG_RECORD_SYNC]))
+            if start < 0:
+                buf.clear()
+                break
+            del buf[:start]
+            if len(buf) < 2 or len(buf) < 2 + buf[1]:
+                break
+            length = buf[1]
+            record = bytes(buf[2 : 2 + length])
+            if length < 4:
+                del buf[:1]
+                continue
+            (addr,) = struct.unpack_from("<I", record)
+            try:
+                args, buffers = parse_args(record[4:])
+            except (ValueError, struct.error):
+                del buf[:1]
+                continue
+            if addr == 0:
+                out.write("<%d log records dropped>\n" % (args[0] if args else 0))
+            else:
+                fmt = elf.string(addr)
+                if fmt is None:
+                    # Not a record start, resynchronize on next sync byte
+                    del buf[:1]
+                    continue
+                out.write(format_message(fmt, args) + "\n")
+                for data in buffers:
+                    out.write("".join("%02X " % b for b in data) + "\n")
+            out.flush()
+            del buf[: 2 + length]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF file")
+    parser.add_argument("input", nargs="?", default="-", help="serial device or captured log file, - for stdin")
+    parser.add_argument("--baud", type=int, default=115200, help="serial device baudrate")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    if args.input == "-":
+        fd = sys.stdin.fileno()
+    else:
+        fd = os.open(args.input, os.O_RDONLY | os.O_NOCTTY)
+        if os.isatty(fd):
+            attrs = termios.tcgetattr(fd)
+            attrs[0] = attrs[1] = attrs[3] = 0
+            attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+            attrs[4] = attrs[5] = getattr(termios, "B%d" % args.baud)
+            termios.tcsetattr(fd, termios.TCSANOW, attrs)
+
+    try:
+        decode(elf, lambda: os.read(fd, 4096), sys.stdout)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,514 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+UART modem simulator for load and soak testing of MCU_Server / MCU_Client.
+
+Speaks the frame format of UARTProtocol.cpp:
+
+    0xAA 0x55 <len> <cmd> <payload...> <CRC16 LE>
+
+where CRC16 (poly 0x8005, init 0xFFFF, MSB first) covers len, cmd and payload.
+
+Connects to a serial device (MCU board, or pty slave opened by host build
+with UARTDriverHost_OpenPty), runs the InitDevice -> CreateInstances ->
+InitNode -> StartNode handshake and then the selected scenarios. At the end
+per-command round-trip latency and loss are reported.
+
+Example:
+    modem_simulator.py /dev/ttyUSB0 --pings 200 --mesh-flood 500 --mesh-rate 50 \\
+                       --sensor-storm 500 --dfu firmware.bin
+"""
+
+import argparse
+import hashlib
+import os
+import random
+import select
+import struct
+import sys
+import termios
+import time
+import zlib
+
+import dfu_pack
+
+# UART Command Codes, see UARTProtocol.cpp
+CMD_PING_REQUEST = 0x01
+CMD_PONG_RESPONSE = 0x02
+CMD_INIT_DEVICE_EVENT = 0x03
+CMD_CREATE_INSTANCES_REQUEST = 0x04
+CMD_CREATE_INSTANCES_RESPONSE = 0x05
+CMD_INIT_NODE_EVENT = 0x06
+CMD_MESH_MESSAGE_REQUEST = 0x07
+CMD_START_NODE_REQUEST = 0x09
+CMD_START_NODE_RESPONSE = 0x0B
+CMD_MODEM_FIRMWARE_VERSION_REQUEST = 0x13
+CMD_MODEM_FIRMWARE_VERSION_RESPONSE = 0x14
+CMD_SENSOR_UPDATE_REQUEST = 0x15
+CMD_FIRMWARE_VERSION_SET_REQ = 0x24
+CMD_FIRMWARE_VERSION_SET_RESP = 0x25
+CMD_DFU_INIT_REQ = 0x80
+CMD_DFU_INIT_RESP = 0x81
+CMD_DFU_STATUS_REQ = 0x82
+CMD_DFU_STATUS_RESP = 0x83
+CMD_DFU_PAGE_CREATE_REQ = 0x84
+CMD_DFU_PAGE_CREATE_RESP = 0x85
+CMD_DFU_WRITE_DATA_EVENT = 0x86
+CMD_DFU_PAGE_STORE_REQ = 0x87
+CMD_DFU_PAGE_STORE_RESP = 0x88
+
+CMD_NAMES = {
+    CMD_PING_REQUEST: "Ping",
+    CMD_PONG_RESPONSE: "Pong",
+    CMD_INIT_DEVICE_EVENT: "InitDeviceEvent",
+    CMD_CREATE_INSTANCES_REQUEST: "CreateInstancesRequest",
+    CMD_INIT_NODE_EVENT: "InitNodeEvent",
+    CMD_START_NODE_REQUEST: "StartNodeRequest",
+    CMD_DFU_INIT_REQ: "DfuInit",
+    CMD_DFU_STATUS_REQ: "DfuStatus",
+    CMD_DFU_PAGE_CREATE_REQ: "DfuPageCreate",
+    CMD_DFU_PAGE_STORE_REQ: "DfuPageStore",
+}
+
+PREAMBLE = b"\xAA\x55"
+MAX_PAYLOAD_SIZE = 127
+
+DFU_SUCCESS = 0x01
+DFU_FIRMWARE_SUCCESSFULLY_UPDATED = 0xFF
+
+# Mesh model IDs, see Mesh.h
+MODEL_ID_HEALTH_SERVER = 0x0002
+MODEL_ID_SENSOR_SERVER = 0x1100
+MODEL_ID_SENSOR_CLIENT = 0x1102
+MODEL_ID_TIME_SERVER = 0x1200
+MODEL_ID_LIGHT_CTL_SERVER = 0x1303
+MODEL_ID_LIGHT_LC_SERVER = 0x130F
+MODEL_ID_LIGHT_LC_CLIENT = 0x1311
+MODEL_ID_GENERIC_ONOFF_CLIENT = 0x1001
+MODEL_ID_GENERIC_LEVEL_CLIENT = 0x1003
+MODEL_ID_LIGHT_L_CLIENT = 0x1302
+MODEL_ID_LIGHT_CTL_CLIENT = 0x1305
+MODEL_ID_LIGHT_EL_SERVER = 0xE400
+
+SUPPORTED_MODELS = [
+    MODEL_ID_HEALTH_SERVER,
+    MODEL_ID_SENSOR_SERVER,
+    MODEL_ID_SENSOR_CLIENT,
+    MODEL_ID_TIME_SERVER,
+    MODEL_ID_LIGHT_CTL_SERVER,
+    MODEL_ID_LIGHT_LC_SERVER,
+    MODEL_ID_LIGHT_LC_CLIENT,
+    MODEL_ID_GENERIC_ONOFF_CLIENT,
+    MODEL_ID_GENERIC_LEVEL_CLIENT,
+    MODEL_ID_LIGHT_L_CLIENT,
+    MODEL_ID_LIGHT_CTL_CLIENT,
+    MODEL_ID_LIGHT_EL_SERVER,
+]
+
+MESH_MESSAGE_LIGHT_L_STATUS = 0x824E
+MESH_MESSAGE_SENSOR_STATUS = 0x0052
+MESH_PROP_ID_PRESENCE_DETECTED = 0x004D
+MESH_PROP_ID_PRESENT_AMBIENT_LIGHT_LEVEL = 0x004E
+
+BAUD_RATES = {
+    9600: termios.B9600,
+    19200: termios.B19200,
+    38400: termios.B38400,
+    57600: termios.B57600,
+    115200: termios.B115200,
+}
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x8005) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def encode_frame(cmd, payload=b""):
+    if len(payload) > MAX_PAYLOAD_SIZE:
+        raise ValueError("payload too long: %d" % len(payload))
+    body = bytes([len(payload), cmd]) + bytes(payload)
+    return PREAMBLE + body + struct.pack("<H", crc16(body))
+
+
+class FrameDecoder:
+    """Byte-wise frame parser, mirrors ExtractFrameFromBuffer in UARTProtocol.cpp."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(PREAMBLE)
+            if start < 0:
+                # Keep trailing 0xAA, it may be start of preamble
+                del self.buf[: max(0, len(self.buf) - 1)]
+                return frames
+            del self.buf[:start]
+            if len(self.buf) < 4:
+                return frames
+            length = self.buf[2]
+            if length > MAX_PAYLOAD_SIZE:
+                del self.buf[:1]
+                continue
+            if len(self.buf) < 6 + length:
+                return frames
+            body = bytes(self.buf[2 : 4 + length])
+            (crc,) = struct.unpack_from("<H", self.buf, 4 + length)
+            if crc == crc16(body):
+                frames.append((body[1], body[2:]))
+                del self.buf[: 6 + length]
+            else:
+                self.crc_errors += 1
+                del self.buf[:1]
+
+
+class Stats:
+    """Per-command request/response bookkeeping."""
+
+    def __init__(self):
+        self.sent = {}
+        self.rtts = {}
+
+    def on_sent(self, name):
+        self.sent[name] = self.sent.get(name, 0) + 1
+
+    def on_response(self, name, rtt):
+        self.rtts.setdefault(name, []).append(rtt)
+
+    def report(self, out=sys.stdout):
+        out.write("%-24s %8s %8s %7s %9s %9s %9s %9s\n" % ("command", "sent", "answered", "loss", "min ms", "avg ms", "p95 ms", "max ms"))
+        for name in sorted(self.sent):
+            rtts = sorted(self.rtts.get(name, []))
+            sent = self.sent[name]
+            loss = 100.0 * (sent - len(rtts)) / sent if sent else 0.0
+            if rtts:
+                p95 = rtts[min(len(rtts) - 1, int(len(rtts) * 0.95))]
+                out.write(
+                    "%-24s %8d %8d %6.1f%% %9.2f %9.2f %9.2f %9.2f\n"
+                    % (name, sent, len(rtts), loss, rtts[0] * 1e3, sum(rtts) / len(rtts) * 1e3, p95 * 1e3, rtts[-1] * 1e3)
+                )
+            else:
+                out.write("%-24s %8d %8d %6.1f%%\n" % (name, sent, 0, loss))
+
+
+class Modem:
+    def __init__(self, port, baud, verbose=False):
+        self.fd = os.open(port, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        if os.isatty(self.fd):
+            attrs = termios.tcgetattr(self.fd)
+            attrs[0] = 0  # iflag
+            attrs[1] = 0  # oflag
+            attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL  # cflag
+            attrs[3] = 0  # lflag
+            attrs[4] = attrs[5] = BAUD_RATES[baud]
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        self.decoder = FrameDecoder()
+        self.stats = Stats()
+        self.verbose = verbose
+        self.received = {}
+
+    def send(self, cmd, payload=b""):
+        frame = encode_frame(cmd, payload)
+        view = memoryview(frame)
+        while view:
+            select.select([], [self.fd], [], 1.0)
+            try:
+                written = os.write(self.fd, view)
+            except BlockingIOError:
+                continue
+            view = view[written:]
+        if self.verbose:
+            print("-> %02X %s" % (cmd, bytes(payload).hex()))
+
+    def poll(self, timeout):
+        """Read available bytes, return list of decoded (cmd, payload) frames."""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return []
+        try:
+            data = os.read(self.fd, 4096)
+        except BlockingIOError:
+            return []
+        frames = self.decoder.feed(data)
+        for cmd, payload in frames:
+            self.received[cmd] = self.received.get(cmd, 0) + 1
+            if self.verbose:
+                print("<- %02X %s" % (cmd, payload.hex()))
+            self.on_unsolicited(cmd, payload)
+        return frames
+
+    def on_unsolicited(self, cmd, payload):
+        # MCU pings modem periodically, answer like a real modem would
+        if cmd == CMD_PING_REQUEST:
+            self.send(CMD_PONG_RESPONSE, payload)
+        elif cmd == CMD_FIRMWARE_VERSION_SET_REQ:
+            self.send(CMD_FIRMWARE_VERSION_SET_RESP)
+        elif cmd == CMD_MODEM_FIRMWARE_VERSION_REQUEST:
+            self.send(CMD_MODEM_FIRMWARE_VERSION_RESPONSE, b"simulator")
+
+    def wait_for(self, cmd, timeout, match=None):
+        """Wait for frame with given command, return (payload, rtt) or (None, None)."""
+        start = time.monotonic()
+        while True:
+            left = timeout - (time.monotonic() - start)
+            if left <= 0:
+                return None, None
+            for rx_cmd, payload in self.poll(left):
+                if rx_cmd == cmd and (match is None or match(payload)):
+                    return payload, time.monotonic() - start
+
+    def request(self, cmd, payload, resp_cmd, timeout, name=None, match=None):
+        name = name or CMD_NAMES.get(cmd, "0x%02X" % cmd)
+        self.stats.on_sent(name)
+        self.send(cmd, payload)
+        resp, rtt = self.wait_for(resp_cmd, timeout, match)
+        if resp is not None:
+            self.stats.on_response(name, rtt)
+        return resp
+
+
+def models_payload(models):
+    return b"".join(struct.pack("<H", m) for m in models)
+
+
+def parse_registrations(payload):
+    """Extract model IDs from Create Instances Request, see registrations in MCU_Server.ino and MCU_Client.ino."""
+    models = []
+    index = 0
+    while index + 2 <= len(payload):
+        (model,) = struct.unpack_from("<H", payload, index)
+        index += 2
+        models.append(model)
+        if model == MODEL_ID_SENSOR_SERVER:
+            # Number of sensors, then per sensor: property ID, tolerances, sampling function, period, interval
+            index += 1 + payload[index] * 9
+        elif model == MODEL_ID_HEALTH_SERVER:
+            # Number of company IDs, then company IDs
+            index += 1 + payload[index] * 2
+        elif model == MODEL_ID_TIME_SERVER:
+            index += 3
+        elif model in (MODEL_ID_LIGHT_CTL_SERVER, MODEL_ID_LIGHT_EL_SERVER):
+            index += 4
+        # Light LC Server and client models carry no registration parameters
+    return models
+
+
+def run_handshake(modem, args):
+    print("Handshake")
+    resp = modem.request(
+        CMD_INIT_DEVICE_EVENT, models_payload(SUPPORTED_MODELS), CMD_CREATE_INSTANCES_REQUEST, args.timeout
+    )
+    if resp is None:
+        print("  no Create Instances Request")
+        return False
+    models = parse_registrations(resp)
+    print("  instances: " + " ".join("%04X" % m for m in models))
+    modem.send(CMD_CREATE_INSTANCES_RESPONSE)
+
+    resp = modem.request(CMD_INIT_NODE_EVENT, models_payload(models), CMD_START_NODE_REQUEST, args.timeout)
+    if resp is None:
+        print("  no Start Node Request")
+        return False
+    modem.send(CMD_START_NODE_RESPONSE)
+    return True
+
+
+def run_pings(modem, args):
+    print("Pings: %d" % args.pings)
+    for seq in range(args.pings):
+        tag = struct.pack("<I", seq)
+        modem.request(CMD_PING_REQUEST, tag, CMD_PONG_RESPONSE, args.timeout, match=lambda p, t=tag: p == t)
+
+
+def paced(count, rate):
+    """Yield indices at given rate per second, 0 means as fast as possible."""
+    start = time.monotonic()
+    for i in range(count):
+        if rate:
+            delay = start + i / rate - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        yield i
+
+
+def run_flood(modem, args, name, count, make_payload):
+    print("%s: %d at %s/s" % (name, count, args.mesh_rate or "max"))
+    start = time.monotonic()
+    for i in paced(count, args.mesh_rate):
+        modem.send(CMD_MESH_MESSAGE_REQUEST, make_payload(i))
+        modem.poll(0)
+        if args.probe_every and (i % args.probe_every) == 0:
+            tag = struct.pack("<I", 0x80000000 | i)
+            modem.request(
+                CMD_PING_REQUEST, tag, CMD_PONG_RESPONSE, args.timeout, name="Ping during " + name, match=lambda p, t=tag: p == t
+            )
+    elapsed = time.monotonic() - start
+    print("  %.0f frames/s" % (count / elapsed if elapsed else 0))
+
+
+def light_l_status(i):
+    value = random.randint(0, 0xFFFF)
+    return struct.pack("<BBHHHB", 1, 0, MESH_MESSAGE_LIGHT_L_STATUS, value, value, 0)
+
+
+def sensor_status(i):
+    src_addr = 0x0100 + (i % 16)
+    if i % 2:
+        prop = MESH_PROP_ID_PRESENCE_DETECTED
+        value = bytes([i & 1])
+    else:
+        prop = MESH_PROP_ID_PRESENT_AMBIENT_LIGHT_LEVEL
+        value = struct.pack("<I", random.randint(0, 100000))[:3]
+    # Long format Marshalled Property ID (length field is 0-based), followed by source address
+    marshalled = bytes([((len(value) - 1) << 1) | 1]) + struct.pack("<H", prop) + value
+    return struct.pack("<BBH", 1, 0, MESH_MESSAGE_SENSOR_STATUS) + marshalled + struct.pack("<H", src_addr)
+
+
+def run_dfu(modem, args):
+    image = open(args.dfu, "rb").read()
+    base = open(args.dfu_base, "rb").read() if args.dfu_base else None
+    stored = dfu_pack.unpack(image, base)
+    if image[:4] != dfu_pack.IMAGE_MAGIC:
+        image = stored
+    print("DFU: %d bytes (%d stored), page %d" % (len(image), len(stored), args.page_size))
+
+    digest = hashlib.sha256(stored).digest()
+    app_data = args.app_data.encode()
+    init = struct.pack("<I", len(image)) + digest[::-1] + bytes([len(app_data)]) + app_data
+    resp = modem.request(CMD_DFU_INIT_REQ, init, CMD_DFU_INIT_RESP, args.dfu_timeout)
+    if resp is None or resp[0] != DFU_SUCCESS:
+        print("  init failed: %s" % (resp.hex() if resp else "timeout"))
+        return False
+
+    start = time.monotonic()
+    offset = 0
+    while offset < len(image):
+        resp = modem.request(CMD_DFU_STATUS_REQ, b"", CMD_DFU_STATUS_RESP, args.dfu_timeout)
+        if resp is None:
+            return False
+        _, max_page, mcu_offset, mcu_crc = struct.unpack_from("<BIII", resp)
+        if offset == 0:
+            # Page buffer count follows CRC, older firmware has a single buffer and does not send it
+            buffers = resp[13] if len(resp) > 13 else 1
+            print("  max page %d, %d page buffers" % (max_page, buffers))
+        if offset == 0 and 0 < mcu_offset <= len(image) and mcu_crc == zlib.crc32(image[:mcu_offset]):
+            print("  resuming at %d" % mcu_offset)
+            offset = mcu_offset
+        if mcu_offset != offset or mcu_crc != zlib.crc32(image[:offset]):
+            print("  status mismatch: offset %d/%d crc %08X/%08X" % (mcu_offset, offset, mcu_crc, zlib.crc32(image[:offset])))
+            return False
+        if offset == len(image):
+            # Whole image was committed before the device reset, empty store only verifies it
+            resp = modem.request(CMD_DFU_PAGE_STORE_REQ, b"", CMD_DFU_PAGE_STORE_RESP, args.dfu_timeout)
+            if resp is None:
+                return False
+            break
+
+        page = image[offset : offset + min(args.page_size, max_page)]
+        resp = modem.request(CMD_DFU_PAGE_CREATE_REQ, struct.pack("<I", len(page)), CMD_DFU_PAGE_CREATE_RESP, args.dfu_timeout)
+        if resp is None or resp[0] != DFU_SUCCESS:
+            return False
+
+        chunk = args.chunk_size
+        for i in paced((len(page) + chunk - 1) // chunk, args.dfu_rate):
+            data = page[i * chunk : (i + 1) * chunk]
+            modem.send(CMD_DFU_WRITE_DATA_EVENT, bytes([len(data)]) + data)
+            modem.poll(0)
+
+        resp = modem.request(CMD_DFU_PAGE_STORE_REQ, b"", CMD_DFU_PAGE_STORE_RESP, args.dfu_timeout)
+        if resp is None or resp[0] not in (DFU_SUCCESS, DFU_FIRMWARE_SUCCESSFULLY_UPDATED):
+            print("  page store failed at %d: %s" % (offset, resp.hex() if resp else "timeout"))
+            return False
+        offset += len(page)
+        if resp[0] == DFU_FIRMWARE_SUCCESSFULLY_UPDATED:
+            break
+
+    elapsed = time.monotonic() - start
+    print("  transferred in %.1f s, %.0f B/s" % (elapsed, len(image) / elapsed if elapsed else 0))
+    return resp[0] == DFU_FIRMWARE_SUCCESSFULLY_UPDATED
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="serial device or pty slave path")
+    parser.add_argument("--baud", type=int, default=57600, choices=sorted(BAUD_RATES))
+    parser.add_argument("--timeout", type=float, default=1.0, help="response timeout in seconds")
+    parser.add_argument("--no-handshake", action="store_true", help="skip InitDevice/InitNode handshake")
+    parser.add_argument("--pings", type=int, default=0, help="number of tagged ping requests")
+    parser.add_argument("--mesh-flood", type=int, default=0, help="number of Light L Status mesh messages")
+    parser.add_argument("--sensor-storm", type=int, default=0, help="number of Sensor Status mesh messages")
+    parser.add_argument("--mesh-rate", type=float, default=0, help="mesh messages per second, 0 = max")
+    parser.add_argument("--probe-every", type=int, default=10, help="interleave ping every N mesh messages, 0 = off")
+    parser.add_argument("--dfu", help="firmware image to transfer, plain or packed with dfu_pack.py")
+    parser.add_argument("--dfu-base", help="image running on the device, needed for delta images")
+    parser.add_argument("--app-data", default="ignore", help="DFU application data")
+    parser.add_argument("--page-size", type=int, default=1024)
+    parser.add_argument("--chunk-size", type=int, default=64, help="bytes per DFU Write Data event")
+    parser.add_argument("--dfu-rate", type=float, default=0, help="DFU Write Data events per second, 0 = max")
+    parser.add_argument("--dfu-timeout", type=float, default=5.0)
+    parser.add_argument("--repeat", type=int, default=1, help="repeat scenarios, for soak testing")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    modem = Modem(args.port, args.baud, args.verbose)
+    ok = True
+
+    if not args.no_handshake:
+        ok = run_handshake(modem, args)
+
+    for _ in range(args.repeat):
+        if not ok:
+            break
+        if args.pings:
+            run_pings(modem, args)
+        if args.mesh_flood:
+            run_flood(modem, args, "Mesh flood", args.mesh_flood, light_l_status)
+        if args.sensor_storm:
+            run_flood(modem, args, "Sensor storm", args.sensor_storm, sensor_status)
+        if args.dfu:
+            ok = run_dfu(modem, args)
+
+    # Collect frames still in flight
+    end = time.monotonic() + args.timeout
+    while time.monotonic() < end:
+        modem.poll(max(0, end - time.monotonic()))
+
+    print()
+    modem.stats.report()
+    print()
+    print("Received frames: " + ", ".join("%02X x%d" % kv for kv in sorted(modem.received.items())))
+    print("CRC errors: %d" % modem.decoder.crc_errors)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2021 Silvair Sp. z o.o. All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+SDM120 MODBUS bus emulator for MCU_Server energy monitoring.
+
+Answers Read Input Registers and Read/Write Holding Registers requests of the
+board on a serial port (RS-485 adapter) or pty, as several SDM120 meters with
+consecutive addresses would. Meters start at the given baud rate and
+follow writes of their baud rate register, so the negotiation of the board can
+be exercised. Per-meter request and refresh rates are reported periodically.
+
+On a serial port, the port follows the meters to their new baud rate. On a pty
+opened by host build of MODBUSSerialHost, line speed is set by the board and
+meters answer only requests sent at the baud rate they listen at.
+
+Example:
+    sdm_simulator.py /dev/ttyUSB1 --meters 2 --latency 20
+    sdm_simulator.py /dev/ttyUSB1 --baud-after-restart
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+
+SDM_DEFAULT_ADDRESS = 1
+SDM_FLOAT_REGISTERS = 2
+SDM_BITS_PER_BYTE = 10
+SDM_INPUT_REG_VOLTAGE = 0x0000  # First register read by the board, counted as refresh
+SDM_HOLDING_REG_BAUD_RATE = 0x001C
+
+# Input registers implemented by SDM120, other addresses read as 0 within a query
+SDM120_INPUT_REGISTERS = [
+    0x0000, 0x0006, 0x000C, 0x0012, 0x0018, 0x001E, 0x0046, 0x0048, 0x004A, 0x004C, 0x004E,
+    0x0054, 0x0056, 0x0058, 0x005A, 0x005C, 0x005E, 0x0102, 0x0108, 0x0156, 0x0158,
+]
+
+MODBUS_READ_HOLDING_REGISTERS = 0x03
+MODBUS_READ_INPUT_REGISTERS = 0x04
+MODBUS_PRESET_SINGLE_REGISTER = 0x06
+MODBUS_PRESET_MULTIPLE_REGISTERS = 0x10
+MODBUS_ERROR_ILLEGAL_FUNCTION = 0x01
+MODBUS_ERROR_ILLEGAL_DATA_ADDRESS = 0x02
+
+# Values of SDM_HOLDING_REG_BAUD_RATE
+SDM_BAUD_CODES = {1200: 5, 2400: 0, 4800: 1, 9600: 2}
+
+BAUD_RATES = {
+    1200: termios.B1200,
+    2400: termios.B2400,
+    4800: termios.B4800,
+    9600: termios.B9600,
+    19200: termios.B19200,
+    38400: termios.B38400,
+}
+
+
+def crc16(data, crc=0xFFFF):
+    """MODBUS CRC16, poly 0xA001 reflected, init 0xFFFF, sent LSB first"""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def add_crc(frame):
+    return frame + struct.pack("<H", crc16(frame))
+
+
+def byte_time_ms(baud):
+    return SDM_BITS_PER_BYTE * 1000.0 / baud
+
+
+def frame_silence_ms(baud):
+    return 1.75 if baud > 19200 else 3.5 * 11 * 1000.0 / baud
+
+
+class Emulator:
+    def __init__(self, args):
+        self.args = args
+        self.fd = os.open(args.port, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        self.is_pty = os.path.realpath(args.port).startswith("/dev/pts/")
+        self.addresses = range(SDM_DEFAULT_ADDRESS, SDM_DEFAULT_ADDRESS + args.meters)
+        self.set_baud(args.baud)
+        # Baud rate each meter listens at, written baud rate register is kept in holding
+        self.meter_baud = {address: self.baud for address in self.addresses}
+        self.holding = {(address, SDM_HOLDING_REG_BAUD_RATE): float(SDM_BAUD_CODES[self.baud])
+                        for address in self.addresses}
+        self.requests = {address: 0 for address in self.addresses}
+        self.refreshes = {address: 0 for address in self.addresses}
+        self.crc_errors = 0
+        self.baud_written = None
+
+    def set_baud(self, baud):
+        """Serial port follows the meters, line speed of a pty is left to the board"""
+        self.baud = baud
+        if self.is_pty:
+            return
+        attrs = termios.tcgetattr(self.fd)
+        attrs[0] = 0  # iflag
+        attrs[1] = 0  # oflag
+        attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL  # cflag
+        attrs[3] = 0  # lflag
+        attrs[4] = attrs[5] = BAUD_RATES[baud]
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, attrs)
+
+    def line_baud(self):
+        """Baud rate frames are exchanged at"""
+        if not self.is_pty:
+            return self.baud
+        speed = termios.tcgetattr(self.fd)[5]
+        return next((baud for baud, value in BAUD_RATES.items() if value == speed), self.baud)
+
+    def write_baud(self, address, value):
+        """Meter switches after acknowledging, port follows once no meter listens at its baud rate"""
+        baud = {code: baud for baud, code in SDM_BAUD_CODES.items()}.get(int(value))
+        if baud is None or self.args.baud_after_restart:
+            return
+        self.meter_baud[address] = baud
+        if all(meter_baud != self.baud for meter_baud in self.meter_baud.values()):
+            print("Meters switched to %d baud" % baud)
+            self.set_baud(baud)
+
+    def value(self, address, register):
+        # Distinct, slowly changing values, meter N reads N * 1000 more than meter 1
+        return (address - SDM_DEFAULT_ADDRESS) * 1000 + register + 0.5 + (time.monotonic() % 10) / 100
+
+    def respond(self, frame):
+        if len(frame) < 4 or crc16(frame) != 0:
+            self.crc_errors += 1
+            return None
+        address, function = frame[0], frame[1]
+        # Request sent at other baud rate is garbage to the meter
+        if address not in self.addresses or self.meter_baud[address] != self.line_baud():
+            return None
+        self.requests[address] += 1
+
+        if function in (MODBUS_READ_INPUT_REGISTERS, MODBUS_READ_HOLDING_REGISTERS) and len(frame) == 8:
+            start, count = struct.unpack(">HH", frame[2:6])
+            data = b""
+            for register in range(start, start + count, SDM_FLOAT_REGISTERS):
+                if function == MODBUS_READ_HOLDING_REGISTERS:
+                    value = self.holding.get((address, register), 0.0)
+                elif register in SDM120_INPUT_REGISTERS:
+                    value = self.value(address, register)
+                elif self.args.strict:
+                    return add_crc(bytes([address, function | 0x80, MODBUS_ERROR_ILLEGAL_DATA_ADDRESS]))
+                else:
+                    value = 0.0
+                data += struct.pack(">f", value)
+            if function == MODBUS_READ_INPUT_REGISTERS and start == SDM_INPUT_REG_VOLTAGE:
+                self.refreshes[address] += 1
+            return add_crc(bytes([address, function, len(data)]) + data[:count * 2])
+
+        if function == MODBUS_PRESET_SINGLE_REGISTER and len(frame) == 8:
+            return add_crc(frame[:6])
+
+        if function == MODBUS_PRESET_MULTIPLE_REGISTERS and len(frame) >= 13:
+            start, count = struct.unpack(">HH", frame[2:6])
+            if count == SDM_FLOAT_REGISTERS:
+                self.holding[(address, start)] = struct.unpack(">f", frame[7:11])[0]
+                if start == SDM_HOLDING_REG_BAUD_RATE:
+                    self.baud_written = address
+            return add_crc(frame[:6])
+
+        return add_crc(bytes([address, function | 0x80, MODBUS_ERROR_ILLEGAL_FUNCTION]))
+
+    def report(self, elapsed):
+        print("%.0f s: " % elapsed + ", ".join("meter %d %.2f req/s %.2f refresh/s" % (
+            address, self.requests[address] / elapsed, self.refreshes[address] / elapsed)
+            for address in self.addresses) + ", CRC errors %d" % self.crc_errors)
+        sys.stdout.flush()
+
+    def run(self):
+        frame = b""
+        start = time.monotonic()
+        next_report = start + self.args.report
+        end = start + self.args.seconds if self.args.seconds else None
+
+        while end is None or time.monotonic() < end:
+            silence = frame_silence_ms(self.line_baud()) / 1000
+            readable, _, _ = select.select([self.fd], [], [], silence if frame else 0.1)
+            if readable:
+                frame += os.read(self.fd, 256)
+                continue
+
+            if frame:
+                response = self.respond(frame)
+                frame = b""
+                if response is not None:
+                    time.sleep(self.args.latency / 1000)
+                    os.write(self.fd, response)
+                    # Half duplex bus stays busy until the response is out
+                    time.sleep(len(response) * byte_time_ms(self.line_baud()) / 1000)
+                if self.baud_written is not None:
+                    self.write_baud(self.baud_written, self.holding[(self.baud_written, SDM_HOLDING_REG_BAUD_RATE)])
+                    self.baud_written = None
+
+            if time.monotonic() >= next_report:
+                next_report += self.args.report
+                self.report(time.monotonic() - start)
+
+        self.report(time.monotonic() - start)
+        return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="serial device or pty slave path")
+    parser.add_argument("--meters", type=int, default=1, help="number of meters, addressed from 1")
+    parser.add_argument("--baud", type=int, default=2400, help="baud rate meters start at")
+    parser.add_argument("--baud-after-restart", action="store_true",
+                        help="acknowledge baud rate writes but keep the baud rate, as meters applying it "
+                             "only after restart do")
+    parser.add_argument("--latency", type=float, default=20, help="meter turnaround in milliseconds")
+    parser.add_argument("--seconds", type=float, default=60, help="duration, 0 = run until interrupted")
+    parser.add_argument("--report", type=float, default=10, help="report interval in seconds")
+    parser.add_argument("--strict", action="store_true",
+                        help="reject reads of registers SDM120 does not implement, as some firmware does")
+    args = parser.parse_args()
+    if args.baud not in SDM_BAUD_CODES:
+        parser.error("supported baud rates: %s" % ", ".join(str(baud) for baud in sorted(SDM_BAUD_CODES)))
+
+    return Emulator(args).run()
+
+
+if __name__ == "__main__":
+    sys.exit(main())